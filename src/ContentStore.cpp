@@ -0,0 +1,334 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <vector>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+#include "ContentStore.h"
+#include "Logging.h"
+
+#define CONTENTSTORE_HASHBUFFER     (64 * 1024)
+#define CONTENTSTORE_NAMELENGTH     64          //hex SHA-256
+
+std::string ContentStore::s_dir;
+uint64_t ContentStore::s_maxBytes = 0;
+uint64_t ContentStore::s_bytes = 0;
+unsigned int ContentStore::s_files = 0;
+uint64_t ContentStore::s_storeBytes = 0;
+unsigned int ContentStore::s_storeFiles = 0;
+ContentStore::StoredFn ContentStore::s_stored = NULL;
+GThreadPool * ContentStore::s_worker = NULL;
+
+namespace {
+
+struct StoredFile {
+    int64_t ctimeNs;
+    std::string path;
+    off_t size;
+    bool operator<(const StoredFile& other) const { return ctimeNs < other.ctimeNs; }
+};
+
+int64_t mtimeOf(const struct stat& st)
+{
+    return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+// the store's files, oldest first; whatever else is in the directory (an interrupted store's .tmp) is removed
+void listStore(const std::string& dir, std::vector<StoredFile>& files)
+{
+    GDir * gdir = g_dir_open(dir.c_str(),0,NULL);
+    if (gdir == NULL)
+        return;
+
+    const gchar * name;
+    while ((name = g_dir_read_name(gdir)) != NULL) {
+        std::string path = dir + name;
+        struct stat st;
+        if (lstat(path.c_str(),&st) != 0)
+            continue;
+        if ((strlen(name) != CONTENTSTORE_NAMELENGTH) || !S_ISREG(st.st_mode)) {
+            if (S_ISREG(st.st_mode))
+                unlink(path.c_str());
+            continue;
+        }
+        StoredFile file;
+        file.ctimeNs = (int64_t)st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+        file.path = path;
+        file.size = st.st_size;
+        files.push_back(file);
+    }
+    g_dir_close(gdir);
+    std::sort(files.begin(),files.end());
+}
+
+// "" if the file can't be read
+std::string sha256Of(const std::string& path)
+{
+    int fd = open(path.c_str(),O_RDONLY);
+    if (fd < 0)
+        return "";
+
+    GChecksum * checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    std::vector<guchar> buffer(CONTENTSTORE_HASHBUFFER);
+    ssize_t got;
+    while ((got = read(fd,&buffer[0],buffer.size())) != 0) {
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        g_checksum_update(checksum,&buffer[0],got);
+    }
+    close(fd);
+
+    std::string sha256 = (got == 0) ? g_checksum_get_string(checksum) : "";
+    g_checksum_free(checksum);
+    return sha256;
+}
+
+}
+
+bool ContentStore::setup(const std::string& dir, uint64_t maxBytes, StoredFn stored)
+{
+    if (dir.empty())
+        return false;
+    if (g_mkdir_with_parents(dir.c_str(),0755) == -1) {
+        LOG_DEBUG ("%s: can't create %s [%d]; no content store",__FUNCTION__,dir.c_str(),errno);
+        return false;
+    }
+
+    s_dir = dir;
+    if (s_dir.at(s_dir.size() - 1) != '/')
+        s_dir += "/";
+    s_maxBytes = maxBytes;
+    s_stored = stored;
+
+    //before the worker is there: nothing else is touching the store yet
+    trim();
+    s_bytes = s_storeBytes;
+    s_files = s_storeFiles;
+    if (s_worker == NULL)
+        s_worker = g_thread_pool_new(&ContentStore::work,NULL,1,FALSE,NULL);
+    LOG_DEBUG ("%s: %u files, %llu bytes in %s",__FUNCTION__,s_files,(unsigned long long)s_bytes,s_dir.c_str());
+    return true;
+}
+
+std::string ContentStore::lookup(const std::string& sha256, const std::string& onFsOf)
+{
+    if (!enabled() || (sha256.size() != CONTENTSTORE_NAMELENGTH))
+        return "";
+
+    std::string path = s_dir + sha256;
+    struct stat fileStat, dirStat;
+    if ((stat(path.c_str(),&fileStat) != 0) || (stat(onFsOf.c_str(),&dirStat) != 0)
+            || (fileStat.st_dev != dirStat.st_dev))
+        return "";
+    return path;
+}
+
+void ContentStore::add(const std::string& path, const std::string& url, const std::string& etag,
+                       const std::string& lastModified, const std::string& sha256)
+{
+    if (!enabled())
+        return;
+
+    struct stat st;
+    if ((stat(path.c_str(),&st) != 0) || !S_ISREG(st.st_mode) || (st.st_size == 0))
+        return;
+
+    Job * job = new Job();
+    job->path = path;
+    job->url = url;
+    job->etag = etag;
+    job->lastModified = lastModified;
+    job->dev = st.st_dev;
+    job->ino = st.st_ino;
+    job->size = st.st_size;
+    job->mtimeNs = mtimeOf(st);
+    job->sha256 = sha256;
+    g_thread_pool_push(s_worker,job,NULL);
+}
+
+void ContentStore::place(const std::string& from, const std::string& to, PlacedFn placed, void * data)
+{
+    Job * job = new Job();
+    job->path = from;
+    job->placeTo = to;
+    job->placed = placed;
+    job->placedData = data;
+    g_thread_pool_push(s_worker,job,NULL);
+}
+
+bool ContentStore::reflink(const std::string& from, const std::string& to)
+{
+    return copy(from,to,false);
+}
+
+/*
+ * to (which mustn't exist) gets from's content: as a reflink, or else (if bytes) copied in the kernel. Never a
+ * hardlink, the download and the store's copy would be one file, changed together by whatever writes to it.
+ *
+ */
+bool ContentStore::copy(const std::string& from, const std::string& to, bool bytes)
+{
+    int src = open(from.c_str(),O_RDONLY);
+    if (src < 0)
+        return false;
+    struct stat st;
+    int dst = -1;
+    if (fstat(src,&st) == 0)
+        dst = open(to.c_str(),O_WRONLY | O_CREAT | O_EXCL,st.st_mode & 0777);
+    if (dst < 0) {
+        close(src);
+        return false;
+    }
+
+    bool copied = false;
+#ifdef FICLONE
+    copied = (ioctl(dst,FICLONE,src) == 0);
+#endif
+    if (!copied && bytes) {
+        off_t offset = 0;
+        while (offset < st.st_size) {
+            ssize_t sent = sendfile(dst,src,&offset,st.st_size - offset);
+            if ((sent < 0) && (errno == EINTR))
+                continue;
+            if (sent <= 0)
+                break;
+        }
+        copied = (offset == st.st_size);
+    }
+    close(src);
+    if (close(dst) != 0)
+        copied = false;
+    if (!copied)
+        unlink(to.c_str());
+    return copied;
+}
+
+//on the worker thread
+void ContentStore::work(gpointer data, gpointer userData)
+{
+    Job * job = (Job *)data;
+    if (job->placed != NULL) {
+        int error = 0;
+        errno = 0;
+        if (!copy(job->path,job->placeTo,true))
+            error = errno ? errno : EIO;
+        job->placed(job->placedData,error);
+        delete job;
+        return;
+    }
+
+    if (job->sha256.empty())
+        job->sha256 = sha256Of(job->path);
+    if (!job->sha256.empty())
+        store(job);
+    job->storeBytes = s_storeBytes;
+    job->storeFiles = s_storeFiles;
+    g_idle_add(&ContentStore::cbStored,job);
+}
+
+gboolean ContentStore::cbStored(gpointer data)
+{
+    Job * job = (Job *)data;
+    s_bytes = job->storeBytes;
+    s_files = job->storeFiles;
+    if (job->stored && (s_stored != NULL))
+        s_stored(job->url,job->etag,job->lastModified,job->sha256,job->deduplicated);
+    delete job;
+    return FALSE;
+}
+
+void ContentStore::store(Job * job)
+{
+    //moved, replaced or written to since it was hashed: the hash may not be its content anymore
+    struct stat st;
+    if ((stat(job->path.c_str(),&st) != 0) || (st.st_dev != job->dev) || (st.st_ino != job->ino)
+            || (st.st_size != job->size) || (mtimeOf(st) != job->mtimeNs))
+        return;
+
+    std::string stored = s_dir + job->sha256;
+    struct stat storedStat;
+    bool added = false;
+    if (stat(stored.c_str(),&storedStat) == 0) {
+        if (storedStat.st_size != st.st_size) {
+            LOG_DEBUG ("%s: %s isn't the size of %s; left alone",__FUNCTION__,stored.c_str(),job->path.c_str());
+            return;
+        }
+        //the download becomes a reflink of what is in the store, its own blocks go. Without reflinks it stays
+        //as it is; the store still has the url's content for a 304
+        //it keeps the download's mtime, by which its validators tell it hasn't changed (see DownloadManager::download())
+        std::string linked = job->path + ".store";
+        if (reflink(stored,linked)) {
+            struct timespec times[2];
+            times[0].tv_sec = 0;
+            times[0].tv_nsec = UTIME_OMIT;
+            times[1].tv_sec = job->mtimeNs / 1000000000LL;
+            times[1].tv_nsec = job->mtimeNs % 1000000000LL;
+            (void) utimensat(AT_FDCWD,linked.c_str(),times,0);
+            if (rename(linked.c_str(),job->path.c_str()) == 0)
+                job->deduplicated = st.st_size;
+            else
+                unlink(linked.c_str());
+        }
+    }
+    else {
+        std::string adding = stored + ".tmp";
+        unlink(adding.c_str());
+        if (!copy(job->path,adding,true))
+            return;
+        if (rename(adding.c_str(),stored.c_str()) != 0) {
+            unlink(adding.c_str());
+            return;
+        }
+        added = true;
+        s_storeBytes += st.st_size;
+        s_storeFiles++;
+    }
+
+    job->stored = true;
+    if (added && (s_maxBytes > 0) && (s_storeBytes > s_maxBytes))
+        trim();
+}
+
+// recounts the store (the worker's counts) and drops the oldest files while it is over ContentStoreMaxMB
+void ContentStore::trim()
+{
+    std::vector<StoredFile> files;
+    listStore(s_dir,files);
+
+    s_storeBytes = 0;
+    for (size_t i = 0; i < files.size(); ++i)
+        s_storeBytes += files[i].size;
+    s_storeFiles = files.size();
+
+    for (size_t i = 0; (i < files.size()) && (s_maxBytes > 0) && (s_storeBytes > s_maxBytes); ++i) {
+        if (unlink(files[i].path.c_str()) != 0)
+            continue;
+        s_storeBytes -= files[i].size;
+        s_storeFiles--;
+    }
+}
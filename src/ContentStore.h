@@ -0,0 +1,115 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef CONTENTSTORE_H_
+#define CONTENTSTORE_H_
+
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include <glib.h>
+
+/*
+ * Content-addressed store of completed downloads (ContentStoreDir): one file per content, named by its SHA-256.
+ *
+ * A completed download (of those asking for it, "contentStore") is hashed on a worker thread and goes into the
+ * store as a reflink, or a copy where the filesystem has no reflinks. If the store already has its content, the
+ * download is replaced by a reflink to that, so the bytes are on disk once however many times they were
+ * downloaded. Nothing is ever hardlinked: a download changed in place (appended to, resumed into) mustn't change
+ * the stored content. The store has to be on the filesystem the downloads are on. Past ContentStoreMaxMB, the
+ * files that went in first are dropped from it (downloads reflinked to them keep their content).
+ *
+ * Called on the main thread. Hashing, copying, linking and trimming the store are done on one worker thread, one
+ * job after the other, so that a copy of a big download (where there are no reflinks) holds up nothing else; what
+ * comes of them is handed back to the main thread (StoredFn, bytes(), files()), or to the PlacedFn's thread.
+ *
+ */
+class ContentStore {
+
+public:
+
+    // the content is in the store; deduplicated: it was there already and the file is now a reflink to it, taking up
+    // that many bytes less (0: it went in, or there are no reflinks)
+    typedef void (*StoredFn)(const std::string& url, const std::string& etag, const std::string& lastModified,
+                             const std::string& sha256, uint64_t deduplicated);
+
+    // creates the directory and counts what is in it; an empty dir leaves the store off
+    static bool setup(const std::string& dir, uint64_t maxBytes, StoredFn stored);
+    static bool enabled() { return !s_dir.empty(); }
+
+    // the store's file for a content, if it has it, and on the filesystem of the directory given
+    static std::string lookup(const std::string& sha256, const std::string& onFsOf);
+
+    // hashes a completed download in the background and then stores or links it; url/validators are handed back.
+    // One whose SHA-256 was taken as it came in (StreamHash) isn't hashed again
+    static void add(const std::string& path, const std::string& url, const std::string& etag,
+                    const std::string& lastModified, const std::string& sha256 = "");
+
+    // a place() is done: 0, or the errno it failed with. Called on the worker thread
+    typedef void (*PlacedFn)(void * data, int error);
+
+    // makes to (which mustn't exist) a reflink or copy of from, in the background
+    static void place(const std::string& from, const std::string& to, PlacedFn placed, void * data);
+
+    static const std::string& dir() { return s_dir; }
+    static uint64_t bytes() { return s_bytes; }
+    static unsigned int files() { return s_files; }
+
+private:
+
+    struct Job {
+        Job() : dev(0), ino(0), size(0), mtimeNs(0), deduplicated(0), stored(false), storeBytes(0), storeFiles(0),
+                placed(NULL), placedData(NULL) {}
+        std::string path;
+        std::string url;
+        std::string etag;
+        std::string lastModified;
+        dev_t dev;
+        ino_t ino;
+        off_t size;
+        int64_t mtimeNs;
+        std::string sha256;
+        // what came of it, for cbStored
+        uint64_t deduplicated;
+        bool stored;
+        uint64_t storeBytes;
+        unsigned int storeFiles;
+        // a place(): path is copied to placeTo
+        std::string placeTo;
+        PlacedFn placed;
+        void * placedData;
+    };
+
+    static void work(gpointer data, gpointer userData);
+    static gboolean cbStored(gpointer data);
+    static void store(Job * job);
+    static bool reflink(const std::string& from, const std::string& to);
+    static bool copy(const std::string& from, const std::string& to, bool bytes);
+    static void trim();
+
+    static std::string s_dir;
+    static uint64_t s_maxBytes;
+    // main thread's view of the store...
+    static uint64_t s_bytes;
+    static unsigned int s_files;
+    // ...and the worker's, which it is kept up to date with
+    static uint64_t s_storeBytes;
+    static unsigned int s_storeFiles;
+    static StoredFn s_stored;
+    static GThreadPool * s_worker;
+};
+
+#endif /* CONTENTSTORE_H_ */
@@ -0,0 +1,657 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "DiskWriter.h"
+#include "Logging.h"
+
+#define DISKWRITER_RING_ENTRIES     256
+#define DISKWRITER_LATENCY_BUCKETS  32      //bucket n holds latencies < 2^n us
+
+DiskWriter::Backend DiskWriter::s_backend = DiskWriter::BACKEND_NONE;
+GThreadPool * DiskWriter::s_pool = NULL;
+uint64_t DiskWriter::s_budget = 0;
+DiskWriter::DrainedCallback DiskWriter::s_drainedCb = NULL;
+
+static volatile gint s_writeLatency[DISKWRITER_LATENCY_BUCKETS];
+
+#ifdef HAVE_LIBURING
+/*
+ * One submission (or, for FINISH, a linked chain of them) on the ring. The rename of a FINISH chain is tagged
+ * by setting the low bit of its user_data; user_data 0 tells the completion thread to stop, once shutdown() has
+ * seen every other completion handled.
+ *
+ */
+struct RingOp {
+    enum Kind { WRITE , SYNC , FINISH };
+
+    RingOp(Kind k, DiskWriter * w)
+        : kind(k) , writer(w) , submittedUs(g_get_monotonic_time()) , pending(0) , renameError(0)
+        , cb(NULL) , data(NULL) {}
+
+    Kind kind;
+    DiskWriter * writer;
+    gint64 submittedUs;
+    int pending;                //FINISH: completions still to come
+    int renameError;
+    std::string from;           //FINISH: renameat() needs these to outlive the submission
+    std::string to;
+    DiskWriter::FinishedCallback cb;
+    void * data;
+};
+
+static struct io_uring s_ring;
+static GMutex s_ringLock;       //submission side; the completion side is only touched by s_reaper
+static GCond s_ringSpace;       //s_inFlight went down
+static GThread * s_reaper = NULL;
+static unsigned int s_inFlight = 0;     //submissions whose completion s_reaper hasn't handled yet
+static bool s_ringFinish = false;   //kernel can fsync/close/rename on the ring too
+
+static bool ringInit()
+{
+    int rc = io_uring_queue_init(DISKWRITER_RING_ENTRIES, &s_ring, 0);
+    if (rc < 0) {
+        LOG_DEBUG ("%s: io_uring_queue_init failed (%d)",__FUNCTION__,-rc);
+        return false;
+    }
+
+    //the probe itself needs 5.6, which is also where IORING_OP_WRITE comes in
+    struct io_uring_probe * probe = io_uring_get_probe_ring(&s_ring);
+    bool writes = (probe != NULL) && io_uring_opcode_supported(probe, IORING_OP_WRITE)
+                                  && io_uring_opcode_supported(probe, IORING_OP_SYNC_FILE_RANGE);
+    s_ringFinish = (probe != NULL) && io_uring_opcode_supported(probe, IORING_OP_FSYNC)
+                                   && io_uring_opcode_supported(probe, IORING_OP_CLOSE)
+                                   && io_uring_opcode_supported(probe, IORING_OP_RENAMEAT);
+    if (probe)
+        io_uring_free_probe(probe);
+    if (!writes) {
+        LOG_DEBUG ("%s: kernel io_uring can't write",__FUNCTION__);
+        io_uring_queue_exit(&s_ring);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * With s_ringLock held: the first of chain free sqes, counted in s_inFlight. Keeping s_inFlight below the ring
+ * size means neither the submission nor the completion queue can fill up, so io_uring_submit() never sees EBUSY.
+ * Other threads wait for room with s_ringLock released; s_reaper doesn't wait, since it only ever submits the
+ * one follow-up of the completion it is handling, whose slot it gives back afterwards.
+ *
+ */
+static struct io_uring_sqe * ringSqe(unsigned int chain)
+{
+    if (g_thread_self() != s_reaper) {
+        while (s_inFlight + chain > DISKWRITER_RING_ENTRIES - 1)
+            g_cond_wait(&s_ringSpace, &s_ringLock);
+    }
+    s_inFlight += chain;
+    return io_uring_get_sqe(&s_ring);
+}
+#endif
+
+//static
+void DiskWriter::setup(int threads, uint64_t budgetBytes, DrainedCallback cb, bool useRing)
+{
+    shutdown();
+    s_budget = budgetBytes;
+    s_drainedCb = cb;
+
+#ifdef HAVE_LIBURING
+    if (useRing) {
+        if (ringInit()) {
+            s_reaper = g_thread_new("diskwriter", &DiskWriter::reap, NULL);
+            s_backend = BACKEND_IO_URING;
+            return;
+        }
+        LOG_DEBUG ("%s: no io_uring; using the thread pool",__FUNCTION__);
+    }
+#else
+    if (useRing)
+        LOG_DEBUG ("%s: built without liburing; using the thread pool",__FUNCTION__);
+#endif
+
+    if (threads <= 0)
+        return;
+
+    GError * error = NULL;
+    s_pool = g_thread_pool_new(&DiskWriter::work, NULL, threads, FALSE, &error);
+    if (s_pool == NULL) {
+        LOG_DEBUG ("%s: g_thread_pool_new failed (%s); writing synchronously",__FUNCTION__, error ? error->message : "");
+        if (error)
+            g_error_free(error);
+        return;
+    }
+    s_backend = BACKEND_THREADS;
+}
+
+//static
+void DiskWriter::shutdown()
+{
+    //every DiskWriter drains in its destructor, so there is nothing left to wait for here
+#ifdef HAVE_LIBURING
+    if (s_backend == BACKEND_IO_URING) {
+        //completions may come in any order, so wait for the last FINISH chain before telling s_reaper to stop
+        g_mutex_lock(&s_ringLock);
+        while (s_inFlight > 0)
+            g_cond_wait(&s_ringSpace, &s_ringLock);
+        struct io_uring_sqe * sqe = io_uring_get_sqe(&s_ring);
+        io_uring_prep_nop(sqe);
+        io_uring_sqe_set_data(sqe, NULL);
+        io_uring_submit(&s_ring);
+        g_mutex_unlock(&s_ringLock);
+        g_thread_join(s_reaper);
+        s_reaper = NULL;
+        io_uring_queue_exit(&s_ring);
+    }
+#endif
+    if (s_pool != NULL)
+        g_thread_pool_free(s_pool, FALSE, TRUE);
+    s_pool = NULL;
+    s_backend = BACKEND_NONE;
+}
+
+//static
+const char * DiskWriter::backendName()
+{
+    switch (s_backend) {
+    case BACKEND_THREADS:
+        return "threads";
+    case BACKEND_IO_URING:
+        return "io_uring";
+    default:
+        return "none";
+    }
+}
+
+//static
+int DiskWriter::threads()
+{
+    return s_pool ? g_thread_pool_get_max_threads(s_pool) : 0;
+}
+
+//static
+bool DiskWriter::finishFile(int fd, bool datasync, const std::string& from, const std::string& to,
+                            FinishedCallback cb, void * data)
+{
+#ifdef HAVE_LIBURING
+    if ((s_backend != BACKEND_IO_URING) || !s_ringFinish)
+        return false;
+
+    RingOp * op = new RingOp(RingOp::FINISH, NULL);
+    op->from = from;
+    op->to = to;
+    op->cb = cb;
+    op->data = data;
+    op->pending = 1 + (datasync ? 1 : 0) + (from.empty() ? 0 : 1);
+
+    //hard links: a failed fsync must not keep the fd open, nor stop the rename (the sync one didn't either)
+    g_mutex_lock(&s_ringLock);
+    struct io_uring_sqe * sqe = ringSqe(op->pending);
+    if (datasync) {
+        io_uring_prep_fsync(sqe, fd, IORING_FSYNC_DATASYNC);
+        io_uring_sqe_set_data(sqe, op);
+        sqe->flags |= IOSQE_IO_HARDLINK;
+        sqe = io_uring_get_sqe(&s_ring);
+    }
+    io_uring_prep_close(sqe, fd);
+    io_uring_sqe_set_data(sqe, op);
+    if (!from.empty()) {
+        sqe->flags |= IOSQE_IO_HARDLINK;
+        sqe = io_uring_get_sqe(&s_ring);
+        io_uring_prep_renameat(sqe, AT_FDCWD, op->from.c_str(), AT_FDCWD, op->to.c_str(), 0);
+        io_uring_sqe_set_data(sqe, (void *)((uintptr_t)op | 1));
+    }
+    io_uring_submit(&s_ring);
+    g_mutex_unlock(&s_ringLock);
+    return true;
+#else
+    return false;
+#endif
+}
+
+//static
+void DiskWriter::recordLatency(gint64 us)
+{
+    int bucket = 0;
+    while ((bucket < DISKWRITER_LATENCY_BUCKETS - 1) && ((us >> bucket) > 0))
+        bucket++;
+    g_atomic_int_inc(&s_writeLatency[bucket]);
+}
+
+//static
+uint64_t DiskWriter::writeCount()
+{
+    uint64_t count = 0;
+    for (int bucket = 0; bucket < DISKWRITER_LATENCY_BUCKETS; bucket++)
+        count += (guint)g_atomic_int_get(&s_writeLatency[bucket]);
+    return count;
+}
+
+//static
+uint64_t DiskWriter::writeLatencyPercentileUs(unsigned int percent)
+{
+    uint64_t total = writeCount();
+    if (total == 0)
+        return 0;
+
+    uint64_t wanted = (total * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < DISKWRITER_LATENCY_BUCKETS; bucket++) {
+        seen += (guint)g_atomic_int_get(&s_writeLatency[bucket]);
+        if (seen >= wanted)
+            return (uint64_t)1 << bucket;
+    }
+    return (uint64_t)1 << (DISKWRITER_LATENCY_BUCKETS - 1);
+}
+
+DiskWriter::DiskWriter(unsigned long ticket, int fd, off64_t offset)
+    : m_ticket(ticket)
+    , m_fd(fd)
+    , m_offset(offset)
+    , m_syncedTo(offset)
+    , m_droppedTo(offset)
+    , m_written(0)
+    , m_inFlight(0)
+    , m_lostBytes(0)
+    , m_throttleCount(0)
+    , m_scheduled(false)
+    , m_syncRequested(false)
+    , m_dropCache(false)
+    , m_throttled(false)
+    , m_failed(false)
+{
+    g_mutex_init(&m_lock);
+    g_cond_init(&m_idle);
+}
+
+DiskWriter::~DiskWriter()
+{
+    drain();
+    g_cond_clear(&m_idle);
+    g_mutex_clear(&m_lock);
+}
+
+bool DiskWriter::queue(const unsigned char * data, size_t len)
+{
+    bool schedule = false;
+
+    g_mutex_lock(&m_lock);
+    uint64_t backlog = m_pending.size() + m_inFlight;
+    //always take something when nothing is outstanding, however big
+    if ((backlog > 0) && (backlog + len > s_budget)) {
+        if (!m_throttled)
+            m_throttleCount++;
+        m_throttled = true;
+        g_mutex_unlock(&m_lock);
+        return false;
+    }
+
+    if (m_failed) {
+        //nowhere to put it; drain() reports it
+        m_lostBytes += len;
+    }
+    else {
+        m_pending.append((const char *)data, len);
+        schedule = kickLocked();
+    }
+    g_mutex_unlock(&m_lock);
+
+    if (schedule)
+        g_thread_pool_push(s_pool, this, NULL);
+    return true;
+}
+
+void DiskWriter::requestSync(bool dropCache)
+{
+    bool schedule = false;
+
+    g_mutex_lock(&m_lock);
+    m_syncRequested = true;
+    m_dropCache = m_dropCache || dropCache;
+    schedule = kickLocked();
+    g_mutex_unlock(&m_lock);
+
+    if (schedule)
+        g_thread_pool_push(s_pool, this, NULL);
+}
+
+uint64_t DiskWriter::drain()
+{
+    g_mutex_lock(&m_lock);
+    while (m_scheduled)
+        g_cond_wait(&m_idle, &m_lock);
+    uint64_t lost = m_lostBytes;
+    g_mutex_unlock(&m_lock);
+    return lost;
+}
+
+bool DiskWriter::failed()
+{
+    g_mutex_lock(&m_lock);
+    bool rc = m_failed;
+    g_mutex_unlock(&m_lock);
+    return rc;
+}
+
+uint64_t DiskWriter::backlog()
+{
+    g_mutex_lock(&m_lock);
+    uint64_t rc = m_pending.size() + m_inFlight;
+    g_mutex_unlock(&m_lock);
+    return rc;
+}
+
+bool DiskWriter::throttled()
+{
+    g_mutex_lock(&m_lock);
+    bool rc = m_throttled;
+    g_mutex_unlock(&m_lock);
+    return rc;
+}
+
+uint64_t DiskWriter::throttleCount()
+{
+    g_mutex_lock(&m_lock);
+    uint64_t rc = m_throttleCount;
+    g_mutex_unlock(&m_lock);
+    return rc;
+}
+
+//static
+void DiskWriter::writebackRange(int fd, off64_t& syncedTo, off64_t to, off64_t * droppedTo)
+{
+    if (to <= syncedTo)
+        return;
+
+    off64_t previous = syncedTo;
+    if (sync_file_range(fd, previous, to - previous, SYNC_FILE_RANGE_WRITE) != 0) {
+        LOG_DEBUG ("Function sync_file_range() failed (%d)", errno);
+    }
+    //everything before 'previous' was started by earlier calls and is normally done by now
+    if ((previous > 0) &&
+        (sync_file_range(fd, 0, previous, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) != 0)) {
+        LOG_DEBUG ("Function sync_file_range() failed (%d)", errno);
+    }
+    //clean now, so dropping them is cheap and they won't be read back by this download
+    if (droppedTo && (previous > *droppedTo)) {
+        int rc = posix_fadvise(fd, *droppedTo, previous - *droppedTo, POSIX_FADV_DONTNEED);
+        if (rc != 0) {
+            LOG_DEBUG ("Function posix_fadvise() failed (%d)", rc);
+        }
+        *droppedTo = previous;
+    }
+    syncedTo = to;
+}
+
+/*
+ * With m_lock held: gets an idle writer going. true: it has to be pushed to the pool, once m_lock is released
+ *
+ */
+bool DiskWriter::kickLocked()
+{
+    if (m_scheduled)
+        return false;
+    m_scheduled = true;
+#ifdef HAVE_LIBURING
+    if (s_backend == BACKEND_IO_URING) {
+        ringNext();
+        return false;
+    }
+#endif
+    return true;
+}
+
+//static
+void DiskWriter::work(gpointer data, gpointer userData)
+{
+    ((DiskWriter *)data)->writeOut();
+}
+
+/*
+ * Runs on a pool thread; m_scheduled guarantees only one of them works on a given DiskWriter at a time,
+ * so the writes land in the order they were queued.
+ *
+ */
+void DiskWriter::writeOut()
+{
+    std::string writing;
+
+    g_mutex_lock(&m_lock);
+    while (true) {
+        writing.swap(m_pending);
+        m_pending.clear();
+        bool sync = m_syncRequested;
+        bool drop = m_dropCache;
+        if (writing.empty() && !sync)
+            break;
+        m_inFlight = writing.size();
+        m_syncRequested = false;
+        g_mutex_unlock(&m_lock);
+
+        size_t done = 0;
+        int err = 0;
+        while (done < writing.size()) {
+            gint64 start = g_get_monotonic_time();
+            ssize_t rc = pwrite64(m_fd, writing.data() + done, writing.size() - done, m_offset + done);
+            if (rc < 0) {
+                if (errno == EINTR)
+                    continue;
+                err = errno;
+                break;
+            }
+            recordLatency(g_get_monotonic_time() - start);
+            done += rc;
+        }
+        if (sync && (err == 0)) {
+            writebackRange(m_fd, m_syncedTo, m_offset + done, drop ? &m_droppedTo : NULL);
+        }
+
+        bool resume = false;
+        g_mutex_lock(&m_lock);
+        m_offset += done;
+        m_inFlight = 0;
+        if (err != 0) {
+            LOG_DEBUG ("%s: pwrite failed for ticket %lu (%d); dropping the rest",__FUNCTION__,m_ticket,err);
+            m_failed = true;
+            m_lostBytes += (writing.size() - done) + m_pending.size();
+            m_pending.clear();
+        }
+        //let the transfer go again once half the budget is free (or it has to find out about the failure)
+        if (m_throttled && (m_failed || (m_pending.size() <= s_budget / 2))) {
+            m_throttled = false;
+            resume = true;
+        }
+        writing.clear();
+        if (resume && s_drainedCb) {
+            g_mutex_unlock(&m_lock);
+            s_drainedCb(m_ticket);
+            g_mutex_lock(&m_lock);
+        }
+    }
+    m_scheduled = false;
+    g_cond_broadcast(&m_idle);
+    g_mutex_unlock(&m_lock);
+}
+
+#ifdef HAVE_LIBURING
+/*
+ * With m_lock held and m_scheduled set: submits the next batch of the backlog, or the requested sync once
+ * everything is written. Like writeOut(), at most one submission per DiskWriter is in flight, so the writes
+ * land in the order they were queued.
+ *
+ */
+void DiskWriter::ringNext()
+{
+    m_writing.swap(m_pending);
+    m_pending.clear();
+    if (!m_writing.empty()) {
+        m_inFlight = m_writing.size();
+        m_written = 0;
+        ringSubmitWrite();
+        return;
+    }
+
+    if (m_syncRequested) {
+        m_syncRequested = false;
+        //one call does what writebackRange() does in two: wait for the writeback started last time, start the rest
+        RingOp * op = new RingOp(RingOp::SYNC, this);
+        g_mutex_lock(&s_ringLock);
+        struct io_uring_sqe * sqe = ringSqe(1);
+        io_uring_prep_sync_file_range(sqe, m_fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE);
+        io_uring_sqe_set_data(sqe, op);
+        io_uring_submit(&s_ring);
+        g_mutex_unlock(&s_ringLock);
+        return;
+    }
+
+    m_scheduled = false;
+    g_cond_broadcast(&m_idle);
+}
+
+//with m_lock held
+void DiskWriter::ringSubmitWrite()
+{
+    RingOp * op = new RingOp(RingOp::WRITE, this);
+    g_mutex_lock(&s_ringLock);
+    struct io_uring_sqe * sqe = ringSqe(1);
+    io_uring_prep_write(sqe, m_fd, m_writing.data() + m_written, m_writing.size() - m_written, m_offset + m_written);
+    io_uring_sqe_set_data(sqe, op);
+    io_uring_submit(&s_ring);
+    g_mutex_unlock(&s_ringLock);
+}
+
+//on s_reaper; the io_uring counterpart of one round of writeOut()
+void DiskWriter::ringWritten(int res, gint64 latencyUs)
+{
+    bool resume = false;
+
+    g_mutex_lock(&m_lock);
+    if ((res == -EINTR) || (res == -EAGAIN)) {
+        ringSubmitWrite();
+        g_mutex_unlock(&m_lock);
+        return;
+    }
+    if (res > 0) {
+        recordLatency(latencyUs);
+        m_written += res;
+        if (m_written < m_writing.size()) {
+            //short write: the rest goes in another one
+            ringSubmitWrite();
+            g_mutex_unlock(&m_lock);
+            return;
+        }
+    }
+
+    m_offset += m_written;
+    m_inFlight = 0;
+    if (m_written < m_writing.size()) {
+        LOG_DEBUG ("%s: write failed for ticket %lu (%d); dropping the rest",__FUNCTION__,m_ticket,(res < 0) ? -res : EIO);
+        m_failed = true;
+        m_lostBytes += (m_writing.size() - m_written) + m_pending.size();
+        m_pending.clear();
+    }
+    m_writing.clear();
+    if (m_throttled && (m_failed || (m_pending.size() <= s_budget / 2))) {
+        m_throttled = false;
+        resume = true;
+    }
+    if (resume && s_drainedCb) {
+        g_mutex_unlock(&m_lock);
+        s_drainedCb(m_ticket);
+        g_mutex_lock(&m_lock);
+    }
+    ringNext();
+    g_mutex_unlock(&m_lock);
+}
+
+//on s_reaper
+void DiskWriter::ringSynced()
+{
+    g_mutex_lock(&m_lock);
+    //the sync waited for the writeback started by the one before it, i.e. up to m_syncedTo
+    if (m_dropCache && (m_syncedTo > m_droppedTo)) {
+        int rc = posix_fadvise(m_fd, m_droppedTo, m_syncedTo - m_droppedTo, POSIX_FADV_DONTNEED);
+        if (rc != 0) {
+            LOG_DEBUG ("Function posix_fadvise() failed (%d)", rc);
+        }
+        m_droppedTo = m_syncedTo;
+    }
+    m_syncedTo = m_offset;
+    ringNext();
+    g_mutex_unlock(&m_lock);
+}
+
+//static
+gpointer DiskWriter::reap(gpointer data)
+{
+    while (true) {
+        struct io_uring_cqe * cqe = NULL;
+        int rc = io_uring_wait_cqe(&s_ring, &cqe);
+        if (rc == -EINTR)
+            continue;
+        if (rc < 0) {
+            LOG_DEBUG ("%s: io_uring_wait_cqe failed (%d)",__FUNCTION__,-rc);
+            break;
+        }
+        uintptr_t tag = (uintptr_t)io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(&s_ring, cqe);
+        if (tag == 0)
+            break;      //shutdown()
+
+        RingOp * op = (RingOp *)(tag & ~(uintptr_t)1);
+        switch (op->kind) {
+        case RingOp::WRITE:
+            op->writer->ringWritten(res, g_get_monotonic_time() - op->submittedUs);
+            delete op;
+            break;
+        case RingOp::SYNC:
+            if (res < 0) {
+                LOG_DEBUG ("%s: sync_file_range failed (%d)",__FUNCTION__,-res);
+            }
+            op->writer->ringSynced();
+            delete op;
+            break;
+        case RingOp::FINISH:
+            if (tag & 1)
+                op->renameError = (res < 0) ? -res : 0;
+            else if (res < 0) {
+                LOG_DEBUG ("%s: fsync/close failed (%d)",__FUNCTION__,-res);
+            }
+            if (--op->pending == 0) {
+                if (op->cb)
+                    op->cb(op->data, op->renameError);
+                delete op;
+            }
+            break;
+        }
+
+        g_mutex_lock(&s_ringLock);
+        s_inFlight--;
+        g_cond_broadcast(&s_ringSpace);
+        g_mutex_unlock(&s_ringLock);
+    }
+    return NULL;
+}
+#endif
@@ -0,0 +1,135 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef DISKWRITER_H_
+#define DISKWRITER_H_
+
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include <glib.h>
+
+/*
+ * Write-behind stage between the curl write callback and a download's file.
+ *
+ * queue() only appends to an in-memory backlog; a shared pool of writer threads pwrite()s it out, in order,
+ * at the file offset the writer was created with. When a backlog reaches the budget, queue() refuses the payload
+ * and the caller is expected to pause the transfer (CURL_WRITEFUNC_PAUSE). Once the writer thread has brought
+ * the backlog down to half the budget, the DrainedCallback tells the owner to unpause it.
+ *
+ * With the io_uring backend (HAVE_LIBURING, and a kernel that has it) the backlog is submitted to a shared ring
+ * instead, and a single completion thread takes the place of the pool. finishFile() can then also sync, close
+ * and rename a finished download's file without blocking the caller.
+ *
+ */
+class DiskWriter {
+
+public:
+
+    enum Backend { BACKEND_NONE, BACKEND_THREADS, BACKEND_IO_URING };
+
+    // called on a writer thread
+    typedef void (*DrainedCallback)(unsigned long ticket);
+    // called on the io_uring completion thread; renameError is 0 or the errno of the failed rename
+    typedef void (*FinishedCallback)(void * data, int renameError);
+
+    // useRing: io_uring instead of the thread pool, falling back to the pool if it can't be had.
+    // threads == 0 (and no ring) disables write-behind; enabled() is false then and no DiskWriter should be created
+    static void setup(int threads, uint64_t budgetBytes, DrainedCallback cb, bool useRing);
+    static void shutdown();
+    static bool enabled() { return (s_backend != BACKEND_NONE); }
+    static Backend backend() { return s_backend; }
+    static const char * backendName();
+    static int threads();
+    static uint64_t budget() { return s_budget; }
+
+    // io_uring only: fdatasync (if datasync) and close fd, then rename from -> to (if from isn't empty), and
+    // call cb once that is all done. false: the ring isn't there (or can't do it), nothing was done
+    static bool finishFile(int fd, bool datasync, const std::string& from, const std::string& to,
+                           FinishedCallback cb, void * data);
+
+    // every pwrite (or io_uring write) since setup(), and the upper bound of the log2 latency bucket that
+    // holds the given percentile of them
+    static uint64_t writeCount();
+    static uint64_t writeLatencyPercentileUs(unsigned int percent);
+
+    // sync_file_range() based writeback for the "interval" durability mode: starts writeback of [syncedTo,to) and
+    // waits for whatever the previous call started, so at most one interval of dirty data is outstanding.
+    // Metadata is not flushed; pause/completion still fdatasync().
+    // With droppedTo (streaming downloads), the pages that are known to be on disk now are also dropped from
+    // the page cache (POSIX_FADV_DONTNEED), from *droppedTo on.
+    static void writebackRange(int fd, off64_t& syncedTo, off64_t to, off64_t * droppedTo = NULL);
+
+    DiskWriter(unsigned long ticket, int fd, off64_t offset);
+    ~DiskWriter();      // drains
+
+    // false: over budget, nothing was taken
+    bool queue(const unsigned char * data, size_t len);
+    // have the writer thread start writeback (see writebackRange) once everything queued so far is written;
+    // dropCache: from now on, also drop what has been written back from the page cache
+    void requestSync(bool dropCache = false);
+    // blocks until the backlog is written out; returns the number of queued bytes that could not be written
+    uint64_t drain();
+
+    bool failed();
+    uint64_t backlog();         // queued but not yet written
+    bool throttled();           // last queue() was refused and the drained callback hasn't been made yet
+    uint64_t throttleCount();   // how often queue() was refused
+
+private:
+
+    static void work(gpointer data, gpointer userData);
+    static void recordLatency(gint64 us);
+    bool kickLocked();
+    void writeOut();
+
+    // io_uring backend, see DiskWriter.cpp
+    static gpointer reap(gpointer data);
+    void ringNext();
+    void ringSubmitWrite();
+    void ringWritten(int res, gint64 latencyUs);
+    void ringSynced();
+
+    unsigned long m_ticket;
+    int m_fd;
+    off64_t m_offset;           // where the next byte of m_pending goes
+    off64_t m_syncedTo;         // see writebackRange
+    off64_t m_droppedTo;        //  ""
+
+    GMutex m_lock;
+    GCond m_idle;
+    std::string m_pending;      // appended by queue(), swapped out by the writer thread
+    std::string m_writing;      // io_uring: swapped out, submitted from m_written on
+    size_t m_written;
+    uint64_t m_inFlight;        // swapped out, being written
+    uint64_t m_lostBytes;
+    uint64_t m_throttleCount;
+    bool m_scheduled;           // in the pool or being worked on
+    bool m_syncRequested;
+    bool m_dropCache;
+    bool m_throttled;
+    bool m_failed;
+
+    static Backend s_backend;
+    static GThreadPool * s_pool;
+    static uint64_t s_budget;
+    static DrainedCallback s_drainedCb;
+
+    DiskWriter(const DiskWriter&);
+    DiskWriter& operator=(const DiskWriter&);
+};
+
+#endif /*DISKWRITER_H_*/
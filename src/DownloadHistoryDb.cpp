@@ -559,6 +559,35 @@ bool DownloadHistoryDb::openDownloadHistoryDb(std::string& errmsg)
         return false;
     }
 
+    //one by url alone (before owners and file sizes were kept) is dropped: validators are only worth a 304
+    if (sqlite3_exec(m_dlDb, "SELECT owner, size, mtimeNs FROM Validators LIMIT 0;", NULL, NULL, NULL))
+        (void) sqlite3_exec(m_dlDb, "DROP TABLE IF EXISTS Validators;", NULL, NULL, NULL);
+    ret = sqlite3_exec(m_dlDb,
+            "CREATE TABLE IF NOT EXISTS Validators "
+            "(owner TEXT, "
+            " url TEXT, "
+            " etag TEXT, "
+            " lastModified TEXT, "
+            " target TEXT, "
+            " size INTEGER, "
+            " mtimeNs INTEGER, "
+            " PRIMARY KEY (owner, url));", NULL, NULL, NULL);
+    if (ret) {
+        //downloads just aren't revalidated then
+        LOG_DEBUG ("Failed to create Validators table");
+    }
+
+    ret = sqlite3_exec(m_dlDb,
+            "CREATE TABLE IF NOT EXISTS StoredContent "
+            "(url TEXT PRIMARY KEY, "
+            " etag TEXT, "
+            " lastModified TEXT, "
+            " sha256 TEXT);", NULL, NULL, NULL);
+    if (ret) {
+        //downloads still go into the content store, they just aren't found in it by url
+        LOG_DEBUG ("Failed to create StoredContent table");
+    }
+
     ret = sqlite3_exec(m_dlDb,
             "PRAGMA default_cache_size=1;", NULL, NULL, NULL);              //100 , 1Kb pages
     if (ret) {
@@ -712,6 +741,145 @@ CorruptDb:
     return true;
 }
 
+void DownloadHistoryDb::addValidators(const std::string& owner,const std::string& url,const std::string& etag,const std::string& lastModified,
+                                      const std::string& target,uint64_t size,int64_t mtimeNs)
+{
+    if (!m_dlDb)
+        return;
+
+    char* queryStr = sqlite3_mprintf("REPLACE INTO Validators VALUES (%Q, %Q, %Q, %Q, %Q, %lld, %lld)",
+                                     owner.c_str(),url.c_str(),etag.c_str(),lastModified.c_str(),target.c_str(),
+                                     (long long)size,(long long)mtimeNs);
+    if (!queryStr) {
+        LOG_DEBUG ("Function addValidators() failed: wrong return of sqlite3_mprintf()");
+        return;
+    }
+
+    if (sqlite3_exec(m_dlDb, queryStr, NULL, NULL, NULL)) {
+        LOG_DEBUG ("Failed to execute query: %s", queryStr);
+    }
+    sqlite3_free(queryStr);
+}
+
+bool DownloadHistoryDb::getValidators(const std::string& owner,const std::string& url,std::string& r_etag,std::string& r_lastModified,
+                                      std::string& r_target,uint64_t& r_size,int64_t& r_mtimeNs)
+{
+    sqlite3_stmt* statement = 0;
+    const char* tail = 0;
+    int ret = 0;
+    bool found = false;
+    char* queryStr = 0;
+
+    if (!m_dlDb)
+        return false;
+
+    queryStr = sqlite3_mprintf("SELECT etag, lastModified, target, size, mtimeNs FROM Validators WHERE owner = %Q AND url = %Q",
+                               owner.c_str(), url.c_str());
+    if (!queryStr)
+        goto Done;
+
+    ret = sqlite3_prepare(m_dlDb, queryStr, -1, &statement, &tail);
+    if (ret) {
+        LOG_DEBUG ("Failed to prepare sql statement: %s", queryStr);
+        goto Done;
+    }
+
+    ret = sqlite3_step(statement);
+    if (ret == SQLITE_ROW) {
+        const char* res = (const char*)sqlite3_column_text(statement,0);
+        r_etag = res ? res : "";
+        res = (const char*)sqlite3_column_text(statement,1);
+        r_lastModified = res ? res : "";
+        res = (const char*)sqlite3_column_text(statement,2);
+        r_target = res ? res : "";
+        r_size = sqlite3_column_int64(statement,3);
+        r_mtimeNs = sqlite3_column_int64(statement,4);
+        found = true;
+    }
+
+Done:
+
+    if (statement)
+        (void) sqlite3_finalize(statement);
+
+    if (queryStr)
+        sqlite3_free(queryStr);
+
+    return found;
+}
+
+void DownloadHistoryDb::addStoredContent(const std::string& url,const std::string& etag,const std::string& lastModified,const std::string& sha256)
+{
+    addUrlRecord("StoredContent",url,etag,lastModified,sha256);
+}
+
+bool DownloadHistoryDb::getStoredContent(const std::string& url,std::string& r_etag,std::string& r_lastModified,std::string& r_sha256)
+{
+    return getUrlRecord("StoredContent","sha256",url,r_etag,r_lastModified,r_sha256);
+}
+
+// StoredContent is (url, etag, lastModified, one more column); table and column are ours, not input
+void DownloadHistoryDb::addUrlRecord(const char* table,const std::string& url,const std::string& etag,const std::string& lastModified,const std::string& value)
+{
+    if (!m_dlDb)
+        return;
+
+    char* queryStr = sqlite3_mprintf("REPLACE INTO %s VALUES (%Q, %Q, %Q, %Q)",
+                                     table,url.c_str(),etag.c_str(),lastModified.c_str(),value.c_str());
+    if (!queryStr) {
+        LOG_DEBUG ("Function addUrlRecord() failed: wrong return of sqlite3_mprintf()");
+        return;
+    }
+
+    if (sqlite3_exec(m_dlDb, queryStr, NULL, NULL, NULL)) {
+        LOG_DEBUG ("Failed to execute query: %s", queryStr);
+    }
+    sqlite3_free(queryStr);
+}
+
+bool DownloadHistoryDb::getUrlRecord(const char* table,const char* column,const std::string& url,std::string& r_etag,std::string& r_lastModified,std::string& r_value)
+{
+    sqlite3_stmt* statement = 0;
+    const char* tail = 0;
+    int ret = 0;
+    bool found = false;
+    char* queryStr = 0;
+
+    if (!m_dlDb)
+        return false;
+
+    queryStr = sqlite3_mprintf("SELECT etag, lastModified, %s FROM %s WHERE url = %Q", column, table, url.c_str());
+    if (!queryStr)
+        goto Done;
+
+    ret = sqlite3_prepare(m_dlDb, queryStr, -1, &statement, &tail);
+    if (ret) {
+        LOG_DEBUG ("Failed to prepare sql statement: %s", queryStr);
+        goto Done;
+    }
+
+    ret = sqlite3_step(statement);
+    if (ret == SQLITE_ROW) {
+        const char* res = (const char*)sqlite3_column_text(statement,0);
+        r_etag = res ? res : "";
+        res = (const char*)sqlite3_column_text(statement,1);
+        r_lastModified = res ? res : "";
+        res = (const char*)sqlite3_column_text(statement,2);
+        r_value = res ? res : "";
+        found = true;
+    }
+
+Done:
+
+    if (statement)
+        (void) sqlite3_finalize(statement);
+
+    if (queryStr)
+        sqlite3_free(queryStr);
+
+    return found;
+}
+
 int DownloadHistoryDb::clear()
 {
     if (!m_dlDb)
@@ -18,6 +18,7 @@
 #define DOWNLOADHISTORYDB_H_
 
 #include <string>
+#include <stdint.h>
 #include <sqlite3.h>
 
 #define     DOWNLOADHISTORYDB_HISTORYSTATUS_OK                    0
@@ -84,6 +85,17 @@ public:
 
     void changeStateForAll(const std::string& oldState,const std::string& newState);
 
+    // HTTP validators (ETag, Last-Modified) of an owner's last complete download of a url, where its file went and
+    // the size and mtime (ns) that file had then
+    void addValidators(const std::string& owner,const std::string& url,const std::string& etag,const std::string& lastModified,
+                       const std::string& target,uint64_t size,int64_t mtimeNs);
+    bool getValidators(const std::string& owner,const std::string& url,std::string& r_etag,std::string& r_lastModified,
+                       std::string& r_target,uint64_t& r_size,int64_t& r_mtimeNs);
+
+    // url, with its validators, of content in the content store (ContentStoreDir), by SHA-256
+    void addStoredContent(const std::string& url,const std::string& etag,const std::string& lastModified,const std::string& sha256);
+    bool getStoredContent(const std::string& url,std::string& r_etag,std::string& r_lastModified,std::string& r_sha256);
+
     int clear();
     void clearByTicket(const unsigned long ticket);
     void clearByOwner(const std::string& caller);
@@ -101,6 +113,9 @@ private:
     bool checkTableConsistency();
     bool integrityCheckDb();
 
+    void addUrlRecord(const char* table,const std::string& url,const std::string& etag,const std::string& lastModified,const std::string& value);
+    bool getUrlRecord(const char* table,const char* column,const std::string& url,std::string& r_etag,std::string& r_lastModified,std::string& r_value);
+
 private:
 
     static DownloadHistoryDb* s_dlhist_instance;
@@ -22,6 +22,7 @@
 #include <vector>
 #include <iostream>
 #include <cstring>
+#include <strings.h>
 #include <stdio.h>
 #include <sstream>
 #include <stdlib.h>
@@ -30,6 +31,7 @@
 #include <sys/stat.h>
 #include <sys/statfs.h>
 #include <sys/statvfs.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
 #include <pbnjson.hpp>
@@ -38,6 +40,9 @@
 #include "Time.h"
 #include "JUtil.h"
 #include "Utils.h"
+#include "TrustedCerts.h"
+#include "ContentStore.h"
+#include "StreamHash.h"
 
 #define TIMEOUT_INTERVAL_SEC 10
 
@@ -48,6 +53,97 @@ unsigned long  DownloadManager::s_ticketGenerator   = 1;
 
 //#define CURL_COOKIE_SHARING
 static CURLSH* s_curlShareHandle = 0;
+// resumed downloads' hashes are taken over their temp files again here, off the main and transfer threads (rehashPrefix())
+static GThreadPool* s_rehasher = 0;
+// the share handle is used by every transfer shard's thread
+static GMutex s_curlShareLocks[CURL_LOCK_DATA_LAST];
+
+static void cbCurlShareLock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    g_mutex_lock(&s_curlShareLocks[data]);
+}
+
+static void cbCurlShareUnlock(CURL *handle, curl_lock_data data, void *userptr) {
+    g_mutex_unlock(&s_curlShareLocks[data]);
+}
+
+// the given percentile (nearest rank) of some latency samples, 0 if there are none
+static uint64_t percentileOf(std::vector<uint32_t> samples, unsigned int percent)
+{
+    if (samples.empty())
+        return 0;
+    size_t rank = (samples.size() * std::min(percent,100u) + 99) / 100;
+    std::vector<uint32_t>::iterator nth = samples.begin() + (rank ? rank - 1 : 0);
+    std::nth_element(samples.begin(),nth,samples.end());
+    return *nth;
+}
+
+// host:port of a url, which connections (and their TTFBs) go by
+static std::string hostKeyOf(const std::string& url)
+{
+    UrlRep parsedUrl = UrlRep::fromUrl(url);
+    return parsedUrl.host + ":" + parsedUrl.port;
+}
+
+// the FairShare settings, for m_queue
+static unsigned int ownerWeightOf(const std::string& owner)
+{
+    return DownloadSettings::instance().ownerWeight(owner);
+}
+
+static unsigned int ownerMaxSlotsOf(const std::string& owner)
+{
+    return DownloadSettings::instance().ownerMaxSlots(owner);
+}
+
+// the schemes a download may be fetched from, whether its target or a mirror (CURLOPT_PROTOCOLS)
+static bool isAllowedScheme(const std::string& url)
+{
+    UrlRep parsedUrl = UrlRep::fromUrl(url.c_str());
+    return (parsedUrl.scheme == "http") || (parsedUrl.scheme == "https") || (parsedUrl.scheme == "ftp");
+}
+
+// a file's mtime in ns, which validators keep to tell whether the file is still what the server sent
+static int64_t mtimeNsOf(const struct stat& st)
+{
+    return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+// the responses curl follows to their Location (CURLOPT_FOLLOWLOCATION)
+static bool isRedirectCode(long httpCode)
+{
+    return (httpCode == 301) || (httpCode == 302) || (httpCode == 303) || (httpCode == 307) || (httpCode == 308);
+}
+
+// maxRecvSpeed order, 0 (no limit of its own) last: it wraps round to the highest
+static bool lowerRecvSpeed(const DownloadTask* a, const DownloadTask* b)
+{
+    return (a->maxRecvSpeed - 1) < (b->maxRecvSpeed - 1);
+}
+
+// a name for a download in dir that neither a finished (name) nor an unfinished (prefix + name) file has yet:
+// name itself, else name_1.ext, name_2.ext...
+static std::string uniqueFileName(const std::string& dir, const std::string& prefix, const std::string& name)
+{
+    size_t extPos = name.rfind ('.');
+    std::string fileName, fileExt;
+    if (extPos == std::string::npos)  {
+        fileName = name;
+    }
+    else {
+        fileName = name.substr (0, extPos);
+        fileExt = name.substr (extPos);
+    }
+
+    std::string newFileName = name;
+    int addExt = 0;
+    while (g_file_test ((dir + newFileName).c_str(), G_FILE_TEST_EXISTS)
+            || g_file_test ((dir + prefix + newFileName).c_str(), G_FILE_TEST_EXISTS)) {
+        std::stringstream nextName;
+        nextName << fileName << "_" << ++addExt << fileExt;
+        newFileName = nextName.str();
+    }
+    return newFileName;
+}
 
 // curl callback functions
 // these functions redirect the callback to a function within the instance of download manager
@@ -99,6 +195,10 @@ DownloadManager::DownloadManager()
     m_storageDaemonToken(0),
     m_activeTaskCount(0),
     m_glibCurlInitialized(false),
+    m_handleTemplate(NULL),
+    m_handleTemplateCerts(0),
+    m_recvSpeedTimer(0),
+    m_idleRestartTimer(0),
     m_fscking(false),
     m_brickMode(false),
     m_msmExitClean(true),
@@ -109,12 +209,27 @@ DownloadManager::DownloadManager()
     m_mainLoop = gMainLoop;
 
     m_pDlDb = DownloadHistoryDb::instance();
+    m_queue.configure(DownloadSettings::instance().fairShareQuantumKB,ownerWeightOf,ownerMaxSlotsOf);
 }
 
 DownloadManager::~DownloadManager()
 {
     this->stopService();
+    if (m_idleRestartTimer != 0)
+        g_source_remove(m_idleRestartTimer);
     shutdownGlibCurl();
+    //the pool and the share outlive glibcurl restarts, not us; nor do handles the events still had to catch up on
+    for (std::vector<CURL*>::iterator it = m_releasedHandles.begin(); it != m_releasedHandles.end(); ++it)
+        curl_easy_cleanup(*it);
+    m_releasedHandles.clear();
+    dropHandles();
+    if (s_curlShareHandle != 0)
+        curl_share_cleanup(s_curlShareHandle);
+    s_curlShareHandle = 0;
+    DiskWriter::shutdown();
+    if (s_rehasher != 0)
+        g_thread_pool_free(s_rehasher,TRUE,TRUE);
+    s_rehasher = 0;
     delete m_pDlDb;
 }
 
@@ -152,6 +267,21 @@ void DownloadManager::init()
     if (m_userDiskRootPath.at(m_userDiskRootPath.size()-1) != '/')
         m_userDiskRootPath += "/";
 
+    DiskWriter::setup(DownloadSettings::instance().writeBehindThreads,
+                      (uint64_t)DownloadSettings::instance().writeBehindBudgetKB * 1024,
+                      &DownloadManager::cbWritesDrained,
+                      (DownloadSettings::instance().writeBehindBackend == "io_uring"));
+    ContentStore::setup(DownloadSettings::instance().contentStoreDir,
+                        (uint64_t)DownloadSettings::instance().contentStoreMaxMB * 1024 * 1024,
+                        &DownloadManager::cbContentStored);
+    m_recvBucket.setRate(DownloadSettings::instance().maxDownloadManagerRecvSpeed,DownloadSettings::instance().recvSpeedBurstMs);
+    GError * error = NULL;
+    s_rehasher = g_thread_pool_new(&DownloadManager::cbRehashPrefix,this,1,FALSE,&error);
+    if (s_rehasher == NULL) {
+        LOG_DEBUG ("%s: g_thread_pool_new failed (%s); hashing resumed downloads' files in place",__FUNCTION__, error ? error->message : "");
+        g_clear_error(&error);
+    }
+
     m_authCookie = "";
     if (g_mkdir_with_parents(m_downloadPath.c_str(), 0755) == -1) {
         LOG_DEBUG ("Function g_mkdir_with_parents() failed");
@@ -256,7 +386,16 @@ int DownloadManager::download (const std::string& caller,
     bool appendTargetFile,
     const std::string& cookieHeader,
     const std::pair<uint64_t,uint64_t> range,
-    const int remainingRedCounts)
+    const int remainingRedCounts,
+    const DurabilityMode durability,
+    const bool aggregate,
+    const std::vector<std::string>& mirrors,
+    const bool revalidate,
+    const std::string& hashAlgorithm,
+    const std::string& expectedHash,
+    const int priority,
+    const uint64_t maxRecvSpeed,
+    const bool useContentStore)
 {
     LOG_INFO_PAIRS_ONLY (LOGID_DOWNLOAD_START, 8, PMLOGKS("Caller", caller.c_str()),
                                                 PMLOGKFV("ticket", "%lu", ticket),
@@ -272,7 +411,16 @@ int DownloadManager::download (const std::string& caller,
         return DOWNLOADMANAGER_STARTSTATUS_QUEUEFULL;
     }
 
-    if (interface == ANY) {
+    //the hash is of what the download receives; appended to a file that had something, that isn't the file
+    std::string algorithm = (hashAlgorithm.empty() && !expectedHash.empty()) ? std::string("sha256") : hashAlgorithm;
+    if (!algorithm.empty() && (appendTargetFile || (StreamHash::digestLength(algorithm) == 0)
+            || (!expectedHash.empty() && (expectedHash.size() != StreamHash::digestLength(algorithm))))) {
+        LOG_DEBUG ("%s: can't hash with %s to %s",__FUNCTION__,algorithm.c_str(),expectedHash.c_str());
+        return DOWNLOADMANAGER_STARTSTATUS_GENERALERROR;
+    }
+
+    //an aggregate download is on ANY (the default route) until it is split; then its ranges are bound to each interface
+    if ((interface == ANY) && !aggregate) {
         //determine a good interface to use
     if (m_wiredConnectionStatus == DownloadManager::InetConnectionConnected)
         interface = Wired;
@@ -312,6 +460,20 @@ int DownloadManager::download (const std::string& caller,
         LOG_WARNING_PAIRS (LOGID_SECURITY_CHECK_FAIL, 2, PMLOGKS("uri", uri.c_str()), PMLOGKS("scheme", parsedUrl.scheme.c_str()), "this scheme is not allowed");
         return DOWNLOADMANAGER_STARTSTATUS_FAILEDSECURITYCHECK;
     }
+    //...and so should every mirror, which is fetched just like it
+    for (std::vector<std::string>::const_iterator it = mirrors.begin(); it != mirrors.end(); ++it) {
+        if (!isAllowedScheme(*it)) {
+            LOG_WARNING_PAIRS (LOGID_SECURITY_CHECK_FAIL, 2, PMLOGKS("uri", it->c_str()), PMLOGKS("scheme", UrlRep::fromUrl(it->c_str()).scheme.c_str()), "this scheme is not allowed for a mirror");
+            return DOWNLOADMANAGER_STARTSTATUS_FAILEDSECURITYCHECK;
+        }
+    }
+
+    //a link that redirected not long ago goes straight to where it led, and is named after that unless asked not to be.
+    //Not one with credentials: where it led for someone else is no place to send them (see cacheRedirect())
+    bool withCredentials = !authToken.empty() && !deviceId.empty();
+    std::string location = withCredentials ? std::string() : cachedRedirect(uri);
+    if (!location.empty() && !keepOriginalFilenameOnRedirect)
+        parsedUrl = UrlRep::fromUrl(location.c_str());
 
     DownloadTask* task = new DownloadTask;
     TransferTask * p_ttask = new TransferTask(task);
@@ -379,7 +541,10 @@ int DownloadManager::download (const std::string& caller,
         }
     }
 
-    task->url = uri;
+    task->url = location.empty() ? uri : location;
+    task->requestedUrl = uri;
+    if (!mirrors.empty())
+        task->setMirrors(mirrors);
     task->cookieHeader = cookieHeader;
     task->setMimeType("application/x-binary");  //default to this...pretty generic
     task->bytesCompleted = 0;
@@ -387,7 +552,44 @@ int DownloadManager::download (const std::string& caller,
     task->canHandlePause = canHandlePause;
     task->autoResume = autoResume;
     task->appendTargetFile = appendTargetFile;
+    task->durability = durability;
+    task->aggregate = aggregate;
+    task->priority = priority;
+    task->maxRecvSpeed = maxRecvSpeed;
+    task->useContentStore = useContentStore;
     task->rangeSpecified = range;
+    if (!algorithm.empty()) {
+        task->hashAlgorithm = algorithm;
+        task->expectedHash = expectedHash;
+        std::transform(task->expectedHash.begin(),task->expectedHash.end(),task->expectedHash.begin(),::tolower);
+        task->hash = StreamHash::create(algorithm);
+    }
+
+    //what the caller's last complete download of the url got may still be current; the server says so with a 304
+    //(not for one that wants its hash: that is taken of what comes in). Only a file where this one is going, under
+    //the name it asked for if it did, and as that download left it: the server vouches for what it sent, not for
+    //whatever the file has become since
+    std::string etag, lastModified, previousTarget;
+    uint64_t previousSize = 0;
+    int64_t previousMtimeNs = 0;
+    struct stat previousStat;
+    if (algorithm.empty() && revalidate && !appendTargetFile && (range.second == 0)
+            && m_pDlDb->getValidators(caller,uri,etag,lastModified,previousTarget,previousSize,previousMtimeNs)
+            && (previousTarget.substr(0,previousTarget.rfind('/') + 1) == task->destPath)
+            && (overrideTargetFile.empty() || createTempFile || (previousTarget.substr(task->destPath.size()) == task->destFile))
+            && (stat(previousTarget.c_str(),&previousStat) == 0) && S_ISREG(previousStat.st_mode)
+            && ((uint64_t)previousStat.st_size == previousSize) && (mtimeNsOf(previousStat) == previousMtimeNs)) {
+        task->revalidateTarget = previousTarget;
+    }
+    //or the content store has what the url had, and the server may say it still has that
+    else if (algorithm.empty() && useContentStore && ContentStore::enabled() && !appendTargetFile && (range.second == 0)) {
+        m_transferStats.storeLookups++;
+        std::string sha256;
+        etag.clear();
+        lastModified.clear();
+        if (m_pDlDb->getStoredContent(uri,etag,lastModified,sha256))
+            task->storedContent = ContentStore::lookup(sha256,task->destPath);
+    }
 
     if (createTempFile == false) { // only if filename is provided
         task->downloadPrefix = downloadPrefix;
@@ -401,51 +603,12 @@ int DownloadManager::download (const std::string& caller,
             {
                 // NOV-70363: Downloading the same file twice should not fail, must create unique file
                 //LOG_DEBUG ("file of name %s or %s exists, will rename", finalFilePath.c_str(), tmpFilePath.c_str());
+                std::string newFileName = uniqueFileName (task->destPath, task->downloadPrefix, task->destFile);
 
-                // file does exist. make a unique file adding [x] before the extension
-                size_t extPos = task->destFile.rfind ('.');
-                int addExt = 0;
-                std::string fileName, fileExt;
-                if (extPos == std::string::npos)  {
-                    fileName = task->destFile;
-                }
-                else {
-                    fileName = task->destFile.substr (0, extPos);
-                    fileExt = task->destFile.substr (extPos);
-                }
-
-                std::stringstream newFileName;
-                std::stringstream newTempFile;
-                std::stringstream newFinalFile;
-
-                do {
-                    ++ addExt;
-                    newFileName.str("");
-                    newFileName << fileName;
-                    newFileName << "_" << addExt;
-                    newFileName << fileExt;
-                    //LOG_DEBUG ("new file name :%s", newFileName.str().c_str());
-
-                    newTempFile.str("");
-                    newTempFile << task->destPath;
-                    newTempFile << task->downloadPrefix;
-                    newTempFile << newFileName.str();
-
-                    //LOG_DEBUG ("new temp file :%s", newTempFile.str().c_str());
-
-                    newFinalFile.str("");
-                    newFinalFile << task->destPath;
-                    newFinalFile << newFileName.str();
-
-                    //LOG_DEBUG ("new final file :%s", newFinalFile.str().c_str());
-
-                } while (g_file_test (newFinalFile.str().c_str(), G_FILE_TEST_EXISTS)
-                        || g_file_test (newTempFile.str().c_str(), G_FILE_TEST_EXISTS));
-
-                LOG_DEBUG ( " Download : File Exist - Renaming existing file %s to %s", task->destFile.c_str() ,newFileName.str().c_str() );
-                tmpFilePath = newTempFile.str();
-                finalFilePath = newFinalFile.str();
-                task->destFile = newFileName.str();
+                LOG_DEBUG ( " Download : File Exist - Renaming existing file %s to %s", task->destFile.c_str() ,newFileName.c_str() );
+                tmpFilePath = task->destPath + task->downloadPrefix + newFileName;
+                finalFilePath = task->destPath + newFileName;
+                task->destFile = newFileName;
             }
         }
 
@@ -503,9 +666,10 @@ int DownloadManager::download (const std::string& caller,
     }
 
     //LOG_DEBUG ("File pointer for [%s]/[%s] is %x\n",task->destPath.c_str(),task->destFile.c_str(),(int)(task->fp));
-    //allocate a curl handle for this download, and set its parameters
+    //take a curl handle for this download, already set up with what all downloads have, and set its own parameters
+    gint64 setupStartUs = g_get_monotonic_time();
     CURL * curlHandle;
-    curlHandle = curl_easy_init();
+    curlHandle = newDownloadHandle();
     
     if(curlHandle==NULL){
         LOG_DEBUG ("curlHandle is an nullptr");
@@ -513,12 +677,6 @@ int DownloadManager::download (const std::string& caller,
         return DOWNLOADMANAGER_STARTSTATUS_GENERALERROR;
     }
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_SHARE, s_curlShareHandle)) != CURLE_OK)
-        LOG_DEBUG ("curl set opt: CURLOPT_SHARE failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_CAPATH, DOWNLOADMANAGER_TRUSTED_CERT_PATH)) != CURLE_OK)
-        LOG_DEBUG ("curl set opt: CURLOPT_CAPATH failed [%d]\n",curlSetOptRc);
-
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_URL,task->url.c_str())) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_URL failed [%d]\n",curlSetOptRc);
 
@@ -527,45 +685,19 @@ int DownloadManager::download (const std::string& caller,
             LOG_DEBUG ("curl set opt: CURLOPT_COOKIE failed [%d]\n",curlSetOptRc);
         }
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_NOSIGNAL,1L)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_NOSIGNAL failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_CONNECTTIMEOUT,60L)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_CONNECTTIMEOUT failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_LOW_SPEED_LIMIT,10L)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_LOW_SPEED_LIMIT failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_LOW_SPEED_TIME,10L)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_LOW_SPEED_TIME failed [%d]\n",curlSetOptRc);
-
-    // if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_VERBOSE, 1)) != CURLE_OK )
-    //      LOG_DEBUG ("curl set opt: CURLOPT_VERBOSE failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 1)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_NOPROGRESS failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_BUFFERSIZE, DOWNLOADMANAGER_DLBUFFERSIZE)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_BUFFERSIZE failed [%d]\n",curlSetOptRc);
+    if ((remainingRedCounts != DownloadTask::MAXREDIRECTIONS)
+            && (curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_MAXREDIRS,(long)std::max(remainingRedCounts - 1,0))) != CURLE_OK)
+        LOG_DEBUG ("curl set opt: CURLOPT_MAXREDIRS failed [%d]\n",curlSetOptRc);
 
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_SOCKOPTDATA, task)) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_SOCKOPTDATA failed [%d]\n",curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_SOCKOPTFUNCTION, cbCurlSetSocketOptions)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_SOCKOPTFUNCTION failed [%d]\n",curlSetOptRc);
-
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA,curlHandle)) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_WRITEDATA failed [%d]\n",curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, cbCurlWriteToFile)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_WRITEFUNCTION failed [%d]\n",curlSetOptRc);
-
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_WRITEHEADER,curlHandle)) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_WRITEHEADER failed [%d]\n",curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_HEADERFUNCTION, cbCurlHeaderInfo)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_HEADERFUNCTION failed [%d]\n",curlSetOptRc);
-
     if (interface == Wired) {
         if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_INTERFACE,const_cast<char*>(m_wiredInterfaceName.c_str()))) != CURLE_OK )
                 LOG_DEBUG ("%s: [INTERFACE-CHOICE]: curl set opt: CURLOPT_INTERFACE failed [%d] for ticket %lu",__FUNCTION__,curlSetOptRc,task->ticket);
@@ -602,25 +734,34 @@ int DownloadManager::download (const std::string& caller,
             LOG_DEBUG ("Using range: %llu - %llu\n",range.first,range.second);
     }
 
+    struct curl_slist *slist=NULL;
     if (!authToken.empty() && !deviceId.empty()) {
-        struct curl_slist *slist=NULL;
         std::string authTokenHeader =  std::string("Auth-Token: ") + authToken;
         std::string deviceIdHeader =  std::string("Device-Id: ") + deviceId;
         slist = curl_slist_append(slist,authTokenHeader.c_str());
         slist = curl_slist_append(slist,deviceIdHeader.c_str());
-        if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, slist)) != CURLE_OK) {
-            LOG_DEBUG ("curl set opt: CURLOPT_HTTPHEADER failed [%d]\n",curlSetOptRc);
-        }
-
+        task->deviceId = deviceId;
+        task->authToken = authToken;
+        //LOG_DEBUG ("added deviceId %s and authToken %s", task->deviceId.c_str(), task->authToken.c_str());
+        //curl would send these to wherever a redirect points; completed_dl() follows it without them instead
+        if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_FOLLOWLOCATION,0L)) != CURLE_OK )
+            LOG_DEBUG ("curl set opt: CURLOPT_FOLLOWLOCATION failed [%d]\n",curlSetOptRc);
+    }
+    if (!task->revalidateTarget.empty() || !task->storedContent.empty()) {
+        if (!etag.empty())
+            slist = curl_slist_append(slist,(std::string("If-None-Match: ") + etag).c_str());
+        if (!lastModified.empty())
+            slist = curl_slist_append(slist,(std::string("If-Modified-Since: ") + lastModified).c_str());
+        LOG_DEBUG ("%s: ticket %lu revalidates %s",__FUNCTION__,task->ticket,
+                    task->revalidateTarget.empty() ? task->storedContent.c_str() : task->revalidateTarget.c_str());
+    }
+    if (slist != NULL) {
         if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, slist)) != CURLE_OK )
             LOG_DEBUG ("curl set opt: CURLOPT_HTTPHEADER failed [%d]\n",curlSetOptRc);
 
         if (!task->curlDesc.setHeaderList(slist)) {
             LOG_DEBUG ("Function setHeaderList() failed");
         }
-        task->deviceId = deviceId;
-        task->authToken = authToken;
-        //LOG_DEBUG ("added deviceId %s and authToken %s", task->deviceId.c_str(), task->authToken.c_str());
     }
     if (!task->curlDesc.setHandle(curlHandle)) {
         LOG_DEBUG ("Function setHandle() failed");
@@ -628,25 +769,30 @@ int DownloadManager::download (const std::string& caller,
 
     //map the curl handle to the download task here, so that we can find the task in the callback
     m_handleMap[task->curlDesc]=p_ttask;
+    curl_easy_setopt(curlHandle, CURLOPT_PRIVATE, p_ttask);
+    m_transferStats.handleSetups++;
+    m_transferStats.handleSetupTotalUs += g_get_monotonic_time() - setupStartUs;
     //..and also map ticket to the download task, so that it can be found by luna requests querying the download status of a ticket
     m_ticketMap[task->ticket]=task;
 
-    // check whether to enqueue this or start the download immediately
-    if (m_activeTaskCount < DownloadSettings::instance().maxDownloadManagerConcurrent) {
+    // check whether to enqueue this or start the download immediately (unless its caller has all the slots it may)
+    if ((m_activeTaskCount < DownloadSettings::instance().maxDownloadManagerConcurrent) && m_queue.mayStart(task->ownerId)) {
         //add it to the pool of inprogress handles (this is all inside glib curl)
         m_activeTaskCount++;
         requestWakeLock(true);
         task->queued = false;
-        if (glibcurl_add(task->curlDesc.getHandle()) != 0) {
-            LOG_DEBUG ("Function glibcurl_add() failed");
+        if (addDownload(task) != 0) {
+            LOG_DEBUG ("Function addDownload() failed");
         }
+        transferStarted(task);
         //LOG_DEBUG ("starting download of ticket [%lu] for url [%s]\n", task->ticket, task->url.c_str());
         m_pDlDb->addHistory(task->ticket,caller,task->connectionName,"running",task->toJSONString());
     } else {
         task->queued = true;
-        m_queue.push_back(task->ticket);
+        m_queue.push(task->ticket,task->priority,task->ownerId);
         //LOG_DEBUG ("queued download of ticket [%lu]\n", task->ticket);
         m_pDlDb->addHistory(task->ticket,caller,task->connectionName,"queued",task->toJSONString());
+        preemptForQueued();
     }
 
     return task->ticket;
@@ -764,6 +910,17 @@ int DownloadManager::resumeDownload(const DownloadHistoryDb::DownloadHistory& hi
         return DOWNLOADMANAGER_RESUMESTATUS_HISTORYCORRUPT;
     }
 
+    //the history record is a file on disk: what it would have fetched gets the same check download() made
+    pbnjson::JValue sources = root["sources"];
+    bool allowed = isAllowedScheme(uri);
+    for (int idx = 1; allowed && sources.isArray() && (idx < sources.arraySize()); ++idx)
+        allowed = isAllowedScheme(sources[idx]["url"].asString());
+    if (!allowed) {
+        LOG_WARNING_PAIRS (LOGID_SECURITY_CHECK_FAIL, 1, PMLOGKFV("ticket", "%lu", history.m_ticket), "a source of the download has a scheme that is not allowed");
+        r_err = "a source in the history record has a scheme that is not allowed";
+        return DOWNLOADMANAGER_RESUMESTATUS_FAILEDSECURITYCHECK;
+    }
+
     std::string cookieHeader = "";
     // if it's there, use it, but no problem if missing
     cookieHeader = root["cookieHeader"].asString();
@@ -864,6 +1021,16 @@ int DownloadManager::resumeDownload(const DownloadHistoryDb::DownloadHistory& hi
         return DOWNLOADMANAGER_RESUMESTATUS_QUEUEFULL;
     }
 
+    //only trust what actually made it to disk: with a relaxed Durability, a crash after the pause was recorded
+    //can leave the temp file shorter than its amountReceived
+    struct stat64 tempStat;
+    if ((completedSize > initialOffset) && (stat64(destTempFile.c_str(),&tempStat) == 0)
+            && ((uint64_t)tempStat.st_size < completedSize - initialOffset)) {
+        LOG_DEBUG ("%s: temp file holds %llu bytes, not %llu; resuming from there",__FUNCTION__,
+                (unsigned long long)tempStat.st_size,(unsigned long long)(completedSize - initialOffset));
+        completedSize = initialOffset + tempStat.st_size;
+    }
+
     FILE * fp = NULL;
     std::string wrmode;
     if (completedSize == 0)         //to deal with problems in the write to out-of-space disk issue
@@ -914,9 +1081,70 @@ int DownloadManager::resumeDownload(const DownloadHistoryDb::DownloadHistory& hi
     p_dlTask->ownerId = history.m_owner;
     p_dlTask->canHandlePause = canHandlePause;
     p_dlTask->autoResume = taskAutoResume;
+    p_dlTask->durability = DownloadTask::durabilityFromString(root["durability"].asString(), defaultDurability());
+    p_dlTask->aggregate = root["aggregate"].asBool();
+    p_dlTask->priority = root["priority"].asNumber<int>();
+    p_dlTask->maxRecvSpeed = root["maxRecvSpeed"].asNumber<int64_t>();
+    p_dlTask->hashAlgorithm = root["hashAlgorithm"].asString();
+    p_dlTask->expectedHash = root["expectedHash"].asString();
+    if (!p_dlTask->hashAlgorithm.empty()) {
+        uint64_t onDisk = (completedSize > initialOffset) ? completedSize - initialOffset : 0;
+        p_dlTask->hash = StreamHash::restore(root["hashState"].asString());
+        if ((p_dlTask->hash != NULL) && (p_dlTask->hash->length() == onDisk)
+                && (p_dlTask->hash->algorithmName() == p_dlTask->hashAlgorithm)) {
+            m_transferStats.hashStatesRestored++;
+        }
+        else {
+            //no state, or not of what the file holds (writes that never made it, a crash): what is there is hashed
+            //again, on a worker; the transfer holds its writes until that is done
+            delete p_dlTask->hash;
+            p_dlTask->hash = NULL;
+            StreamHash * rehashed = StreamHash::create(p_dlTask->hashAlgorithm);
+            if ((rehashed != NULL) && (onDisk > 0)) {
+                rehashPrefix(p_dlTask,rehashed,destTempFile,onDisk);
+                m_transferStats.hashPrefixesRehashed++;
+            }
+            else {
+                p_dlTask->hash = rehashed;
+            }
+        }
+    }
+    //the server sends the end of what the file has again and it is compared before anything is added (verifyResume);
+    //a crash can leave a tail that was never written out, whatever amountReceived says
+    uint64_t verifyBytes = std::min((uint64_t)DownloadSettings::instance().resumeVerifyKB * 1024,
+                                    (completedSize > initialOffset) ? completedSize - initialOffset : 0);
+    if (verifyBytes > 0) {
+        p_dlTask->verifyTail.resize(verifyBytes);
+        int fd = open(destTempFile.c_str(),O_RDONLY);
+        ssize_t got = -1;
+        if (fd >= 0) {
+            got = pread64(fd,&p_dlTask->verifyTail[0],verifyBytes,(off64_t)(completedSize - initialOffset - verifyBytes));
+            close(fd);
+        }
+        if (got != (ssize_t)verifyBytes) {
+            LOG_DEBUG ("%s: can't read the last %llu bytes of %s; resuming unchecked",__FUNCTION__,
+                    (unsigned long long)verifyBytes,destTempFile.c_str());
+            p_dlTask->verifyTail.clear();
+        }
+    }
+    if (sources.isArray() && (sources.arraySize() > 1)) {
+        std::vector<std::string> mirrors;
+        for (int idx = 1; idx < sources.arraySize(); ++idx)
+            mirrors.push_back(sources[idx]["url"].asString());
+        p_dlTask->setMirrors(mirrors);
+        //what each had served before the interruption still counts
+        for (int idx = 0; (idx < sources.arraySize()) && ((size_t)idx < p_dlTask->sourceCount()); ++idx) {
+            p_dlTask->sourceBytes[idx] = strtouq(sources[idx]["e_bytes"].asString().c_str(),0,10);
+            p_dlTask->sourceFailures[idx] = sources[idx]["failures"].asNumber<int>();
+        }
+    }
 
      //LOG_DEBUG ("%s: Interface %s and allow1x is %s",__FUNCTION__,history.m_interface.c_str(),(s_allow1x ? "TRUE" : "FALSE"));
-    if (isInterfaceUp(connectionName2Id(history.m_interface)))
+    if (p_dlTask->aggregate)
+    {
+        p_dlTask->connectionName = connectionId2Name (ANY);
+    }
+    else if (isInterfaceUp(connectionName2Id(history.m_interface)))
     {
         p_dlTask->connectionName = history.m_interface;
     }
@@ -934,8 +1162,9 @@ int DownloadManager::resumeDownload(const DownloadHistoryDb::DownloadHistory& hi
         p_dlTask->connectionName = connectionId2Name (Btpan);
     }
 
+    gint64 setupStartUs = g_get_monotonic_time();
     CURL * curlHandle;
-    curlHandle = curl_easy_init();
+    curlHandle = newDownloadHandle();
     int curlSetOptRc;
 
     if(curlHandle==NULL){
@@ -944,54 +1173,21 @@ int DownloadManager::resumeDownload(const DownloadHistoryDb::DownloadHistory& hi
         return DOWNLOADMANAGER_STARTSTATUS_GENERALERROR;
     }
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_SHARE, s_curlShareHandle)) != CURLE_OK)
-        LOG_DEBUG ("curl set opt: CURLOPT_SHARE failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_CAPATH, DOWNLOADMANAGER_TRUSTED_CERT_PATH)) != CURLE_OK)
-        LOG_DEBUG ("curl set opt: CURLOPT_CAPATH failed [%d]\n",curlSetOptRc);
-
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_URL,p_dlTask->url.c_str())) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_URL failed [%d]\n",curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_NOSIGNAL,1L)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_NOSIGNAL failed [%d]\n",curlSetOptRc);
-
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_CONNECTTIMEOUT,30L)) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_CONNECTTIMEOUT failed [%d]\n",curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_LOW_SPEED_LIMIT,10L)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_LOW_SPEED_LIMIT failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_LOW_SPEED_TIME,10L)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_LOW_SPEED_TIME failed [%d]\n",curlSetOptRc);
-
-    //  if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_VERBOSE, 1)) != CURLE_OK )
-    //      LOG_DEBUG ("curl set opt: CURLOPT_VERBOSE failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 1)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_NOPROGRESS failed [%d]\n",curlSetOptRc);
-
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_BUFFERSIZE, DOWNLOADMANAGER_DLBUFFERSIZE)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_BUFFERSIZE failed [%d]\n",curlSetOptRc);
-
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_SOCKOPTDATA, p_dlTask)) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_SOCKOPTDATA failed [%d]\n",curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_SOCKOPTFUNCTION, cbCurlSetSocketOptions)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_SOCKOPTFUNCTION failed [%d]\n",curlSetOptRc);
-
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA,curlHandle)) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_WRITEDATA failed [%d]\n",curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, cbCurlWriteToFile)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_WRITEFUNCTION failed [%d]\n",curlSetOptRc);
-
     if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_WRITEHEADER,curlHandle)) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_WRITEHEADER failed [%d]\n",curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_HEADERFUNCTION, cbCurlHeaderInfo)) != CURLE_OK )
-        LOG_DEBUG ("curl set opt: CURLOPT_HEADERFUNCTION failed [%d]\n",curlSetOptRc);
-
     if (DownloadManager::connectionName2Id(p_dlTask->connectionName) == Wired) {
                 if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_INTERFACE,const_cast<char*>(m_wiredInterfaceName.c_str()))) != CURLE_OK )
                         LOG_DEBUG ("curl set opt: CURLOPT_INTERFACE failed [%d]\n",curlSetOptRc);
@@ -1012,7 +1208,7 @@ int DownloadManager::resumeDownload(const DownloadHistoryDb::DownloadHistory& hi
 
     }
 
-    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)(p_dlTask->bytesCompleted))) != CURLE_OK )
+    if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)(p_dlTask->resumeOffset()))) != CURLE_OK )
         LOG_DEBUG ("curl set opt: CURLOPT_RESUME_FROM_LARGE failed [%d]\n",curlSetOptRc);
 
     if (!authTokenToUse.empty() && !deviceIdToUse.empty()) {
@@ -1024,6 +1220,9 @@ int DownloadManager::resumeDownload(const DownloadHistoryDb::DownloadHistory& hi
 
         if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, slist)) != CURLE_OK )
             LOG_DEBUG ("curl set opt: CURLOPT_HTTPHEADER failed [%d]\n",curlSetOptRc);
+        //as in download(): a redirect is followed by completed_dl(), without the headers
+        if ((curlSetOptRc = curl_easy_setopt(curlHandle, CURLOPT_FOLLOWLOCATION,0L)) != CURLE_OK )
+            LOG_DEBUG ("curl set opt: CURLOPT_FOLLOWLOCATION failed [%d]\n",curlSetOptRc);
 
         if (!p_dlTask->curlDesc.setHeaderList(slist)) {
             LOG_DEBUG ("Function setHeaderList() failed");
@@ -1037,23 +1236,27 @@ int DownloadManager::resumeDownload(const DownloadHistoryDb::DownloadHistory& hi
     
     //map the curl handle to the download task here, so that we can find the task in the callback
     m_handleMap[p_dlTask->curlDesc]=p_ttask;
+    curl_easy_setopt(curlHandle, CURLOPT_PRIVATE, p_ttask);
+    m_transferStats.handleSetups++;
+    m_transferStats.handleSetupTotalUs += g_get_monotonic_time() - setupStartUs;
     //..and also map ticket to the download task, so that it can be found by luna requests querying the download status of a ticket
     m_ticketMap[p_dlTask->ticket]=p_dlTask;
 
-    // check whether to enqueue this or start the download immediately
-    if (m_activeTaskCount < DownloadSettings::instance().maxDownloadManagerConcurrent) {
+    // check whether to enqueue this or start the download immediately (unless its caller has all the slots it may)
+    if ((m_activeTaskCount < DownloadSettings::instance().maxDownloadManagerConcurrent) && m_queue.mayStart(p_dlTask->ownerId)) {
         //add it to the pool of inprogress handles (this is all inside glib curl)
         m_activeTaskCount++;
         requestWakeLock(true);
         p_dlTask->queued = false;
-        if (glibcurl_add(p_dlTask->curlDesc.getHandle()) != 0) {
-            LOG_DEBUG ("Function glibcurl_add() failed");
+        if (addDownload(p_dlTask) != 0) {
+            LOG_DEBUG ("Function addDownload() failed");
         }
+        transferStarted(p_dlTask);
         //LOG_DEBUG ("starting (resuming) download of ticket [%lu] for url [%s] on interface [%s]\n", p_dlTask->ticket, p_dlTask->url.c_str(),p_dlTask->connectionName.c_str());
         m_pDlDb->addHistory(p_dlTask->ticket,p_dlTask->ownerId,p_dlTask->connectionName,"running",p_dlTask->toJSONString());
     } else {
         p_dlTask->queued = true;
-        m_queue.push_back(p_dlTask->ticket);
+        m_queue.push(p_dlTask->ticket,p_dlTask->priority,p_dlTask->ownerId);
         //LOG_DEBUG ("queued download of ticket [%lu]\n", p_dlTask->ticket);
         m_pDlDb->addHistory(p_dlTask->ticket,p_dlTask->ownerId,p_dlTask->connectionName,"queued",p_dlTask->toJSONString());
     }
@@ -1184,6 +1387,13 @@ int DownloadManager::pauseDownload(const unsigned long ticket,bool allowQueuedTo
     }
 
     DownloadTask * task = _task->p_downloadTask;
+    //the recorded amountReceived is what resume seeks to, so it has to be on disk (and, if it was split, without gaps)
+    uint64_t lostBytes = task->closeWriter();
+    task->bytesCompleted -= std::min(lostBytes,task->bytesCompleted);
+    task->trimToContiguous();
+    if (task->durability >= DURABILITY_PAUSE) {
+        task->syncFile();
+    }
     LOG_INFO_PAIRS_ONLY(LOGID_DOWNLOAD_PAUSE,2, PMLOGKFV("ticket","%lu",task->ticket), PMLOGKS("url",task->url.c_str()));
 
 
@@ -1209,6 +1419,9 @@ int DownloadManager::pauseDownload(const unsigned long ticket,bool allowQueuedTo
         }
     }
 
+    //where the hash got to, for the resume to carry on from
+    if (task->hash != NULL)
+        payloadJsonObj.put("hashState", task->hash->state());
     std::string historyString = JUtil::toSimpleString(payloadJsonObj);
     //add to database record
     m_pDlDb->addHistory(task->ticket,task->ownerId,task->connectionName,"interrupted",historyString);
@@ -1218,26 +1431,136 @@ int DownloadManager::pauseDownload(const unsigned long ticket,bool allowQueuedTo
     delete _task;
 
     // if an active task has been paused, the next download should start
-    if (!m_queue.empty() && (m_activeTaskCount < DownloadSettings::instance().maxDownloadManagerConcurrent) && allowQueuedToStart) {
-        unsigned long queuedTicket = m_queue.front();
-        m_queue.pop_front();
-        std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(queuedTicket);
-        if (iter != m_ticketMap.end()) {
-            DownloadTask* nextDownload = iter->second;
-            nextDownload->queued = false;
-            m_activeTaskCount++;
-            requestWakeLock(true);
-            if (glibcurl_add(nextDownload->curlDesc.getHandle()) != 0) {
-                LOG_DEBUG ("Function glibcurl_add() failed");
-            }
-            //LOG_DEBUG ("%s: starting download of ticket [%lu] for url [%s] deviceId %s authToken %s\n", __PRETTY_FUNCTION__,
-                //nextDownload->ticket, nextDownload->url.c_str(), nextDownload->authToken.c_str(), nextDownload->deviceId.c_str());
-            m_pDlDb->addHistory(nextDownload->ticket,nextDownload->ownerId,task->connectionName,"running",nextDownload->toJSONString());
-        }
-    }
+    if (allowQueuedToStart)
+        startNextQueued();
     return DOWNLOADMANAGER_PAUSESTATUS_OK;
 }
 
+/*
+ * Starts the queued download of the highest priority, if a slot is free; of those of equal priority, the first
+ * queued by the caller whose turn it is (DownloadQueue). Returns whether one was started.
+ *
+ */
+bool DownloadManager::startNextQueued()
+{
+    if (m_queue.empty() || (m_activeTaskCount >= DownloadSettings::instance().maxDownloadManagerConcurrent))
+        return false;
+
+    //0: whoever has something queued has all the slots it may
+    unsigned long queuedTicket = m_queue.pop();
+    std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(queuedTicket);
+    if ((queuedTicket == 0) || (iter == m_ticketMap.end()))
+        return false;
+
+    DownloadTask* nextDownload = iter->second;
+    nextDownload->queued = false;
+    m_activeTaskCount++;
+    requestWakeLock(true);
+    if (addDownload(nextDownload) != 0) {
+        LOG_DEBUG ("Function addDownload() failed");
+    }
+    transferStarted(nextDownload);
+    //LOG_DEBUG ("%s: un-Q-ing a task, starting download of ticket [%lu] for url [%s]\n", __PRETTY_FUNCTION__,
+    //      nextDownload->ticket, nextDownload->url.c_str());
+    m_pDlDb->addHistory(nextDownload->ticket,nextDownload->ownerId,nextDownload->connectionName,"running",nextDownload->toJSONString());
+    return true;
+}
+
+/*
+ * PreemptLowerPriority: with every slot taken, the running download of the lowest priority below that of the
+ * first queued one (the latest ticket of equals) is paused, the queued one takes its slot, and the paused one is
+ * resumed, which queues it again. Its subscribers see it interrupted, like any pause. Downloads that can't pause
+ * aren't preempted.
+ *
+ */
+void DownloadManager::preemptForQueued()
+{
+    int priority;
+    if (!DownloadSettings::instance().preemptLowerPriority || !m_queue.topPriority(priority)
+            || (m_activeTaskCount < DownloadSettings::instance().maxDownloadManagerConcurrent))
+        return;
+
+    DownloadTask * victim = NULL;
+    for (std::map<long,DownloadTask*>::iterator it = m_ticketMap.begin(); it != m_ticketMap.end(); ++it) {
+        DownloadTask * task = it->second;
+        if ((task == NULL) || task->queued || !task->canHandlePause || (task->priority >= priority))
+            continue;
+        if ((victim == NULL) || (task->priority < victim->priority)
+                || ((task->priority == victim->priority) && (task->ticket > victim->ticket)))
+            victim = task;
+    }
+    if (victim == NULL)
+        return;
+
+    unsigned long ticket = victim->ticket;
+    std::string authToken = victim->authToken;
+    std::string deviceId = victim->deviceId;
+    LOG_DEBUG ("%s: ticket %lu (priority %d) gives way to a download of priority %d",__FUNCTION__,ticket,victim->priority,priority);
+    if (pauseDownload(ticket,false) != DOWNLOADMANAGER_PAUSESTATUS_OK)
+        return;
+    m_transferStats.preemptions++;
+    startNextQueued();
+
+    std::string err;
+    if (resumeDownload(ticket,authToken,deviceId,err) != DOWNLOADMANAGER_RESUMESTATUS_OK)
+        LOG_DEBUG ("%s: ticket %lu couldn't be queued again: %s",__FUNCTION__,ticket,err.c_str());
+}
+
+/*
+ * Changes the priority of a queued or running download. A queued one moves to its new place in the queue; either
+ * way, a preemption (PreemptLowerPriority) may follow.
+ *
+ */
+int DownloadManager::setPriority(const unsigned long ticket, int priority)
+{
+    std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(ticket);
+    if ((iter == m_ticketMap.end()) || (iter->second == NULL))
+        return DOWNLOADMANAGER_PRIORITYSTATUS_NOSUCHDOWNLOADTASK;
+
+    DownloadTask * task = iter->second;
+    task->priority = priority;
+    if (task->queued)
+        m_queue.setPriority(ticket,priority);
+    //so that a resume keeps it
+    m_pDlDb->addHistory(task->ticket,task->ownerId,task->connectionName,task->queued ? "queued" : "running",task->toJSONString());
+
+    preemptForQueued();
+    return DOWNLOADMANAGER_PRIORITYSTATUS_OK;
+}
+
+/*
+ * Limits, in bytes per second (0: none), of one download, of everything an owner downloads, and of all transfers
+ * together. A download's own goes into its history record, so that a resume keeps it; the others last until the
+ * service restarts, when downloadManager.conf's apply again.
+ *
+ */
+int DownloadManager::setTicketRecvSpeed(const unsigned long ticket, uint64_t bytesPerSecond)
+{
+    std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(ticket);
+    if ((iter == m_ticketMap.end()) || (iter->second == NULL))
+        return DOWNLOADMANAGER_RECVSPEEDSTATUS_NOSUCHDOWNLOADTASK;
+
+    DownloadTask * task = iter->second;
+    task->maxRecvSpeed = bytesPerSecond;
+    m_pDlDb->addHistory(task->ticket,task->ownerId,task->connectionName,task->queued ? "queued" : "running",task->toJSONString());
+
+    redistributeRecvSpeeds();
+    return DOWNLOADMANAGER_RECVSPEEDSTATUS_OK;
+}
+
+void DownloadManager::setOwnerRecvSpeed(const std::string& owner, uint64_t bytesPerSecond)
+{
+    m_ownerRecvSpeeds[owner] = bytesPerSecond;
+    redistributeRecvSpeeds();
+}
+
+void DownloadManager::setRecvSpeed(uint64_t bytesPerSecond)
+{
+    m_recvBucket.setRate(bytesPerSecond,DownloadSettings::instance().recvSpeedBurstMs);
+    //those waiting on the old rate try again under the new one
+    resumeRecvSpeedPaused();
+}
+
 void DownloadManager::pauseAll()
 {
     //run through the whole ticket map and call pause download on all...flag pause() so that it doesn't start queued downloads
@@ -1291,13 +1614,32 @@ int DownloadManager::swapToInterface(const unsigned long int ticket,const Connec
     if (pDltask->connectionName == DownloadManager::connectionId2Name(newInterface))
         return SWAPTOIF_SUCCESS;        //already on the specified interface
 
-    if (pDltask->queued == false)
+    //a hedged download keeps only its own request, which is restarted on the new interface below
+    settleHedge(pDltask,pDltask->curlDesc.getHandle());
+    //a split download's own connection may already have all of its range; then only its segments move
+    bool restart = (pDltask->queued == false) && !(pDltask->isSplit() && (pDltask->primaryFilled || pDltask->primaryDone));
+    glibcurl_lock();
+    std::vector<DownloadSegment *> movingSegments;
+    for (std::vector<DownloadSegment *>::iterator sit = pDltask->segments.begin(); sit != pDltask->segments.end(); ++sit) {
+        if ((*sit)->handle == NULL)
+            continue;
+        if (glibcurl_remove((*sit)->handle) != 0) {
+            LOG_DEBUG ("Function glibcurl_remove() failed");
+        }
+        m_segmentMap.erase((*sit)->handle);
+        releaseDownloadHandle((*sit)->handle);
+        (*sit)->handle = NULL;
+        movingSegments.push_back(*sit);
+    }
+
+    if (restart)
     {
         //remove the curl descriptor from glib_curl temporarily         TODO: check for error
         if (glibcurl_remove(pDltask->curlDesc.getHandle()) != 0) {
             LOG_DEBUG ("Function glibcurl_remove() failed");
         }
     }
+    glibcurl_unlock();
     //change its interface option
 
     std::string ifaceName;
@@ -1323,15 +1665,23 @@ int DownloadManager::swapToInterface(const unsigned long int ticket,const Connec
     if (( curlSetOptRc = curl_easy_setopt(pDltask->curlDesc.getHandle(), CURLOPT_INTERFACE,const_cast<char*>(ifaceName.c_str()))) != CURLE_OK )
         LOG_DEBUG ("%s: curl set opt: CURLOPT_INTERFACE to if=[%s] failed [%d]",__FUNCTION__,ifaceName.c_str(),curlSetOptRc);
 
-    if ((curlSetOptRc = curl_easy_setopt(pDltask->curlDesc.getHandle(), CURLOPT_RESUME_FROM_LARGE, (uint64_t)(pDltask->bytesCompleted))) != CURLE_OK )
+    uint64_t resumeFrom = pDltask->isSplit() ? pDltask->primaryPos : pDltask->resumeOffset();
+    if ((curlSetOptRc = curl_easy_setopt(pDltask->curlDesc.getHandle(), CURLOPT_RESUME_FROM_LARGE, (uint64_t)resumeFrom)) != CURLE_OK )
             LOG_DEBUG ("%s: curl set opt: CURLOPT_RESUME_FROM_LARGE failed [%d]",__FUNCTION__,curlSetOptRc);
 
     if (pDltask->queued == false)
     {
+        glibcurl_lock();
         //re-add the handle
-        if (glibcurl_add(pDltask->curlDesc.getHandle()) != 0) {
-            LOG_DEBUG ("Function glibcurl_add() failed");
+        if (restart && (addDownload(pDltask) != 0)) {
+            LOG_DEBUG ("Function addDownload() failed");
+        }
+        //...and the segments beside it, copied from it again so they pick up the new interface
+        for (std::vector<DownloadSegment *>::iterator sit = movingSegments.begin(); sit != movingSegments.end(); ++sit) {
+            if (!startSegment(pDltask,*sit) && (pDltask->segmentResult == CURLE_OK))
+                pDltask->segmentResult = CURLE_OUT_OF_MEMORY;
         }
+        glibcurl_unlock();
         //change its history record to reflect the new interface
         m_pDlDb->addHistory(pDltask->ticket,pDltask->ownerId,pDltask->connectionName,"running",pDltask->toJSONString());
     }
@@ -1378,8 +1728,31 @@ size_t DownloadManager::cbHeader(CURL * taskHandle,size_t headerSize,const char
         return headerSize;
     }
 
+    //the extra connections of a split download only bring data; the ticket's own connection had the headers
+    if ((_task->type == TransferTask::DOWNLOAD_TASK) && (_task->p_downloadTask->segmentFor(taskHandle) != NULL))
+        return headerSize;
+
     std::string header = headerText;
 
+    //a redirect (followed by curl, or by completed_dl()): its headers (and body) are not about what is being downloaded
+    long responseCode = 0;
+    if ((curl_easy_getinfo(taskHandle, CURLINFO_RESPONSE_CODE, &responseCode) == CURLE_OK) && isRedirectCode(responseCode)) {
+        if (strncasecmp(headerText,"location:",9) == 0)
+            _task->setLocationHeader(trimWhitespace(header.substr(9)));
+        return headerSize;
+    }
+
+    if ((header == "\r\n") || (header == "\n")) {
+        //end of this response's headers: the body can be fetched over more connections now that its size is known.
+        //Not from inside curl's callback though, the handle gets duplicated for it
+        if ((_task->type == TransferTask::DOWNLOAD_TASK) && wantsSplit(_task->p_downloadTask,taskHandle)) {
+            _task->p_downloadTask->splitRequested = true;
+            if (m_transferEvents.push(new TransferEvent(TransferEvent::SPLIT,_task->p_downloadTask->ticket)))
+                g_idle_add(cbTransferEvents,this);
+        }
+        return headerSize;
+    }
+
     ////LOG_DEBUG ("cbHeader(): %s\n",header.c_str());
     //find the :
     size_t labelendpos = header.find(":",0);
@@ -1433,7 +1806,7 @@ size_t DownloadManager::cbHeader(CURL * taskHandle,size_t headerSize,const char
 
         if ((task->bytesCompleted > 0) && (task->bytesTotal == 0))
         {
-            task->bytesTotal = contentLength + task->bytesCompleted;
+            task->bytesTotal = contentLength + task->resumeOffset();
             task->setUpdateInterval();
             LOG_DEBUG ("%s: Fixing up Content-Length to %llu, and this looks like a Resume download",__FUNCTION__,task->bytesTotal);
         }
@@ -1444,98 +1817,1745 @@ size_t DownloadManager::cbHeader(CURL * taskHandle,size_t headerSize,const char
             task->bytesTotal = contentLength;
             task->setUpdateInterval();
             //LOG_DEBUG ("%s: Updated Content-Length = %lu, and this is a FreshStart download",__FUNCTION__,task->bytesTotal);
-            // 1.3.5 - try and "truncate" the file to the size reported, so that the space is "taken"
-            /*
-            int fdes;
-            if ((fdes = fileno(task->fp)) != -1)
-            {
-                ::ftruncate(fdes,task->bytesTotal);
-            }
-            */
+        }
 
+        //big enough to push everything else out of the page cache if it were left there
+        unsigned int streamingMB = DownloadSettings::instance().streamingThresholdMB;
+        task->streaming = (streamingMB > 0) && (task->bytesTotal >= ((uint64_t)streamingMB << 20));
+
+        //take the space for what is coming now, rather than finding out the disk is full halfway through
+        //(what a resume gets again to compare is in the file already)
+        uint64_t verifying = task->verifyTail.size() - task->verifyPos;
+        if (!reserveSpace(task,taskHandle,contentLength - std::min(verifying,contentLength))) {
+            task->diskFull = true;
+            return 0;       //aborts the transfer with CURLE_WRITE_ERROR; completed_dl() makes it FILESYSTEMFULL
         }
     }
     else if (headerLabel.compare("content-type") == 0) {
         //get the MIME type that the server is reporting
         task->setMimeType(headerContent);
     }
+    else if (headerLabel.compare("etag") == 0) {
+        task->etag = headerContent;
+    }
+    else if (headerLabel.compare("last-modified") == 0) {
+        task->lastModified = headerContent;
+    }
+    else if (headerLabel.compare("accept-ranges") == 0) {
+        std::transform(headerContent.begin(), headerContent.end(), headerContent.begin(), tolower);
+        task->acceptRanges = (headerContent.compare("bytes") == 0);
+    }
 
 //    LOG_DEBUG ("%s Function-Exit",__FUNCTION__);
     return headerSize;
 }
 
-void DownloadManager::cbGlib()
+/*
+ * Reserves the blocks for contentLength more bytes at the point the download writes from. FALLOC_FL_KEEP_SIZE
+ * leaves the file size alone: resumes append to the temp file, and resumeDownload() goes by its size.
+ * Only false if the filesystem is out of space (or quota); one that can't preallocate just doesn't.
+ *
+ */
+bool DownloadManager::reserveSpace(DownloadTask* task, CURL* handle, uint64_t contentLength)
 {
-    CURLMsg* msg;
-    int inQueue;
-    TransferTask * _task = NULL;
-    long l_httpCode = 0;
-    long l_httpConnectCode;
-    DownloadTask * dl_task = NULL;
-    UploadTask * ul_task = NULL;
-//    LOG_DEBUG ("%s Function-Entry",__FUNCTION__);
-
-    while (1) {
-        msg = curl_multi_info_read(glibcurl_handle(), &inQueue);
-        if (msg == 0) {
-            break;
-        }
-
-        if (msg->msg == CURLMSG_DONE)  {
+    //only the body of a successful response ends up in the file
+    long httpCode = 0;
+    if ((curl_easy_getinfo(handle,CURLINFO_RESPONSE_CODE,&httpCode) != CURLE_OK) || (httpCode < 200) || (httpCode >= 300))
+        return true;
+    if (task->fp == NULL)
+        return true;
 
-            //LOG_DEBUG ("%s: CURLMSG_DONE\n", __PRETTY_FUNCTION__);
-            /// Note: Error handling will NOT be done here...it will be done in completed()
-            ///...but store the results here before removeTask annihilates the curl handle
+    int fd = fileno(task->fp);
+    struct stat64 st;
+    if (fstat64(fd,&st) != 0)
+        return true;
 
-            l_httpCode = 0;
-            l_httpConnectCode = 0;
-            CURLcode inforc = curl_easy_getinfo(msg->easy_handle,CURLINFO_RESPONSE_CODE,&l_httpCode);
-            if (inforc != CURLE_OK) {
-                LOG_WARNING_PAIRS_ONLY (LOGID_CURL_FAIL_HTTP_STATUS, 1, PMLOGKS("reason", "failed to retrieve HTTP status code from handle"));
-            }
+    //nothing has been written yet, so the stream position is where the body goes (end of file when appending)
+    off64_t from = ftello64(task->fp);
+    if ((from < 0) || (fcntl(fd,F_GETFL) & O_APPEND))
+        from = st.st_size;
+    off64_t to = from + (off64_t)contentLength;
+    from = std::max(from,(off64_t)st.st_size);     //what's already in the file has its blocks
+    if (to <= from)
+        return true;
 
-            inforc = curl_easy_getinfo(msg->easy_handle,CURLINFO_HTTP_CONNECTCODE,&l_httpConnectCode);
-            if (inforc != CURLE_OK) {
-                LOG_WARNING_PAIRS_ONLY (LOGID_CURL_FAIL_HTTP_CONNECT, 1, PMLOGKS("reason", "failed to retrieve HTTP connect code from handle"));
-            }
+    if (fallocate64(fd,FALLOC_FL_KEEP_SIZE,from,to - from) == 0)
+        return true;
 
-            CURLcode resultCode = msg->data.result;
+    int err = errno;
+    if ((err == ENOSPC) || (err == EDQUOT)) {
+        LOG_WARNING_PAIRS_ONLY (LOGID_DOWNLOAD_FAIL, 3,
+            PMLOGKFV("ticket", "%lu", task->ticket),
+            PMLOGKFV("bytes", "%llu", (unsigned long long)(to - from)),
+            PMLOGKS("reason", "not enough space to preallocate the download"));
+        return false;
+    }
+    LOG_DEBUG ("%s: fallocate() failed (%d), not preallocating ticket %lu",__FUNCTION__,err,task->ticket);
+    return true;
+}
 
-            //is it a download or an upload
-            _task = removeTask(msg->easy_handle);
+/*
+ * Whether a download whose headers just came in should be split (DownloadSegments, mirrors or an aggregate download):
+ * a fresh, whole-file 200 from a server that takes byte ranges, with enough of it left for at least two
+ * SegmentMinMB segments.
+ *
+ */
+bool DownloadManager::wantsSplit(DownloadTask* task, CURL* handle)
+{
+    unsigned int maxSegments = DownloadSettings::instance().downloadSegments;
+    if (((maxSegments < 2) && !task->aggregate && !task->hasMirrors()) || task->splitRequested || !task->acceptRanges || (task->fp == NULL) || (task->hedge != NULL))
+        return false;
+    //resumes and ranged requests write where the file is, which is not where a segment would go; a hash is taken in order
+    if ((task->hash != NULL) || (task->rehash != NULL) || (task->bytesTotal == 0) || (task->initialOffsetBytes != 0) || task->appendTargetFile || (task->rangeSpecified.second != 0))
+        return false;
+    long httpCode = 0;
+    if ((curl_easy_getinfo(handle,CURLINFO_RESPONSE_CODE,&httpCode) != CURLE_OK) || (httpCode != 200))
+        return false;
+    //pwrite() goes to the end of an O_APPEND file, whatever the offset
+    if (fcntl(fileno(task->fp),F_GETFL) & O_APPEND)
+        return false;
 
-            if (_task == NULL)
-                break;
+    uint64_t minSegment = (uint64_t)std::max(DownloadSettings::instance().segmentMinMB,1u) << 20;
+    return (task->bytesTotal - std::min(task->bytesCompleted,task->bytesTotal) >= 2 * minSegment);
+}
 
-            if (_task->type == TransferTask::DOWNLOAD_TASK) {
+/*
+ * Splits what is left of a download over up to DownloadSegments connections. The ticket's own connection keeps
+ * the first part and is cut off at primaryEnd; each of the others asks for its own byte range and writes it to its
+ * place in the (preallocated) file. Everything else - progress, pause, history, completion - stays with the ticket.
+ *
+ */
+void DownloadManager::splitDownload(unsigned long ticket)
+{
+    std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(ticket);
+    if ((iter == m_ticketMap.end()) || (iter->second == NULL) || (iter->second->queued))
+        return;     //paused, cancelled or completed meanwhile
+
+    DownloadTask * task = iter->second;
+    if (task->isSplit() || (task->curlDesc.getHandle() == NULL) || (task->hedge != NULL))
+        return;
+
+    //the segments go to where the ticket's connection was redirected to, if it was
+    noteRedirect(task,task->curlDesc.getHandle());
+    uint64_t minSegment = (uint64_t)std::max(DownloadSettings::instance().segmentMinMB,1u) << 20;
+
+    //nothing gets written while the transfer threads are held, so bytesCompleted is where the ticket's connection is
+    glibcurl_lock();
+    uint64_t pos = task->bytesCompleted;
+    uint64_t remaining = task->bytesTotal - std::min(pos,task->bytesTotal);
+
+    if (task->aggregate) {
+        //the ticket's own connection stops here; the rest is shared out between the interfaces by their throughput
+        std::vector<Connection> links = aggregateLinks();
+        if (links.size() > remaining / minSegment)
+            links.resize(remaining / minSegment);
+        if (links.empty()) {
+            glibcurl_unlock();
+            return;
+        }
+
+        double totalWeight = 0;
+        for (std::vector<Connection>::iterator it = links.begin(); it != links.end(); ++it)
+            totalWeight += linkWeight(*it);
+
+        task->primaryPos = pos;
+        task->primaryEnd = pos;
+        uint64_t from = pos;
+        for (size_t i = 0; i < links.size(); ++i) {
+            uint64_t to = task->bytesTotal;
+            if (i < links.size() - 1)
+                to = std::min(from + std::max((uint64_t)(remaining * (linkWeight(links[i]) / totalWeight)),minSegment),
+                              task->bytesTotal - (links.size() - 1 - i) * minSegment);
+            DownloadSegment * segment = new DownloadSegment(NULL,from,to);
+            segment->link = links[i];
+            task->segments.push_back(segment);
+            if (!startSegment(task,segment)) {
+                task->segmentResult = CURLE_OUT_OF_MEMORY;
+                break;
+            }
+            from = to;
+        }
+        glibcurl_unlock();
+        glibcurl_start();
+
+        LOG_DEBUG ("%s: ticket %lu split over %u interfaces from %llu",__FUNCTION__,ticket,
+                    (unsigned int)links.size(),(unsigned long long)pos);
+        return;
+    }
+
+    //with mirrors, every source gets a range to begin with
+    uint64_t count = std::max((uint64_t)DownloadSettings::instance().downloadSegments,(uint64_t)task->sourceCount());
+    count = std::min(count,remaining / minSegment);
+    if (count < 2) {
+        glibcurl_unlock();
+        return;
+    }
+
+    uint64_t size = remaining / count;
+    task->primaryPos = pos;
+    task->primaryEnd = pos + size;
+    for (uint64_t i = 1; i < count; ++i) {
+        uint64_t from = pos + (i * size);
+        uint64_t to = (i == count - 1) ? task->bytesTotal : from + size;
+        DownloadSegment * segment = new DownloadSegment(NULL,from,to);
+        segment->source = i % task->sourceCount();
+        task->segments.push_back(segment);
+        if (!startSegment(task,segment)) {
+            //its range can't be had now; the ticket gets interrupted and can be resumed from the first gap
+            task->segmentResult = CURLE_OUT_OF_MEMORY;
+            break;
+        }
+    }
+    glibcurl_unlock();
+    glibcurl_start();
+
+    LOG_DEBUG ("%s: ticket %lu split into %llu segments of %llu bytes from %llu",__FUNCTION__,ticket,
+                (unsigned long long)count,(unsigned long long)size,(unsigned long long)pos);
+}
+
+/*
+ * (Re)starts a segment from where it got to, on a copy of the ticket's handle. It goes onto the same transfer
+ * thread as the ticket's own connection, so that all of a ticket's callbacks stay on one thread.
+ * Called with glibcurl_lock held.
+ *
+ */
+bool DownloadManager::startSegment(DownloadTask* task, DownloadSegment* segment)
+{
+    CURL * primary = task->curlDesc.getHandle();
+    CURL * handle = curl_easy_duphandle(primary);
+    if (handle == NULL) {
+        LOG_DEBUG ("Function curl_easy_duphandle() failed: id(%lu)", task->ticket);
+        return false;
+    }
+
+    char range[64];
+    snprintf(range,sizeof(range),"%llu-%llu",(unsigned long long)(segment->start + segment->received),
+             (unsigned long long)(segment->end - 1));
+
+    //the copy still points the callbacks at the ticket's handle, and its CURLOPT_PRIVATE finds the task
+    int curlSetOptRc;
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_WRITEDATA,handle)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_WRITEDATA failed [%d]\n",curlSetOptRc);
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_WRITEHEADER,handle)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_WRITEHEADER failed [%d]\n",curlSetOptRc);
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_RESUME_FROM_LARGE,(curl_off_t)0)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_RESUME_FROM_LARGE failed [%d]\n",curlSetOptRc);
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_RANGE,range)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_RANGE failed [%d]\n",curlSetOptRc);
+    //multiplexed onto the ticket's connection, it would be no faster than that
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_PIPEWAIT,0L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_PIPEWAIT failed [%d]\n",curlSetOptRc);
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_FRESH_CONNECT,1L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_FRESH_CONNECT failed [%d]\n",curlSetOptRc);
+    //source 0 too: the ticket's url may have been redirected since its handle was set up
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_URL,task->sourceUrl(segment->source).c_str())) != CURLE_OK)
+        LOG_DEBUG ("curl set opt: CURLOPT_URL failed [%d]\n",curlSetOptRc);
+    //a mirror is another host: the Auth-Token / Device-Id headers and the cookie are for the ticket's url only
+    //(see followRedirect()). The rest of the list is the If-None-Match / If-Modified-Since of a revalidating
+    //download, which are for the ticket's own request, not a range of it
+    if (segment->source != 0) {
+        if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_HTTPHEADER,(struct curl_slist *)NULL)) != CURLE_OK)
+            LOG_DEBUG ("curl set opt: CURLOPT_HTTPHEADER failed [%d]\n",curlSetOptRc);
+        if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_COOKIE,(char *)NULL)) != CURLE_OK)
+            LOG_DEBUG ("curl set opt: CURLOPT_COOKIE failed [%d]\n",curlSetOptRc);
+    }
+    if (segment->link != ANY) {
+        std::string device = linkDevice((Connection)segment->link);
+        if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_INTERFACE,const_cast<char*>(device.c_str()))) != CURLE_OK )
+            LOG_DEBUG ("curl set opt: CURLOPT_INTERFACE failed [%d]\n",curlSetOptRc);
+    }
+
+    segment->handle = handle;
+    if (task->recvSpeedShare > 0)
+        applyRecvSpeed(task);
+    segment->runStartUs = g_get_monotonic_time();
+    segment->runStartBytes = segment->received;
+    m_segmentMap[handle] = task->ticket;
+    if (glibcurl_add_beside(handle,primary) != 0) {
+        LOG_DEBUG ("Function glibcurl_add_beside() failed");
+    }
+    return true;
+}
+
+/*
+ * Write callback of a split download's extra connection. Returns what cbWriteEvent should give back to curl:
+ * short of payloadSize once the segment's range is full (which ends that transfer), 0 on an error.
+ *
+ */
+size_t DownloadManager::writeSegment(DownloadTask* task, DownloadSegment* segment, CURL* handle, unsigned char* payload, size_t payloadSize)
+{
+    //anything but the range that was asked for (a server that ignored it) would land in the wrong place
+    long httpCode = 0;
+    if ((curl_easy_getinfo(handle,CURLINFO_RESPONSE_CODE,&httpCode) != CURLE_OK) || (httpCode != 206))
+        return 0;
+    if (segment->complete())
+        return 0;
+
+    uint64_t offset = segment->start + segment->received;
+    size_t len = (size_t)std::min((uint64_t)payloadSize,segment->end - offset);
+
+    if (DiskWriter::enabled()) {
+        if (segment->writer == NULL)
+            segment->writer = new DiskWriter(task->ticket,fileno(task->fp),offset);
+
+        if (segment->writer->failed())
+            return 0;
+        if (!segment->writer->queue(payload,len))
+            return CURL_WRITEFUNC_PAUSE;        //unpaused by resumeThrottledTransfer(), same as the ticket's own
+    }
+    else {
+        size_t written = 0;
+        while (written < len) {
+            ssize_t rc = pwrite64(fileno(task->fp),payload + written,len - written,offset + written);
+            if ((rc < 0) && (errno == EINTR))
+                continue;
+            if (rc <= 0)
+                return 0;
+            written += rc;
+        }
+    }
+
+    segment->received += len;
+    if (task->hasMirrors())
+        task->sourceBytes[segment->source] += len;
+    return len;
+}
+
+/*
+ * A segment's transfer has ended. One that didn't get all of its range is restarted from where it got to, a few
+ * times (on another mirror, if there are any); after that, the ticket is interrupted. A segment of an aggregate or
+ * mirrored download that got all of its range takes over part of the largest one left, on the same interface and
+ * source. The ticket completes once its own connection and every segment are done.
+ *
+ */
+void DownloadManager::segmentDone(unsigned long ticket, CURL* handle, CURLcode resultCode, long httpCode)
+{
+    m_segmentMap.erase(handle);
+
+    std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(ticket);
+    if ((iter == m_ticketMap.end()) || (iter->second == NULL))
+        return;     //the ticket is gone, and the segment with it
+
+    DownloadTask * task = iter->second;
+    DownloadSegment * segment = task->segmentFor(handle);
+    if (segment == NULL)
+        return;
+
+    glibcurl_lock();
+    if (glibcurl_remove(handle) != 0) {
+        LOG_DEBUG ("Function glibcurl_remove() failed");
+    }
+    releaseDownloadHandle(handle);
+    segment->handle = NULL;
+    if (task->recvSpeedShare > 0)
+        applyRecvSpeed(task);
+    glibcurl_unlock();
+    noteSegmentRate(task,segment);
+
+    //a restart picks up from what is actually in the file. Nothing else touches the segment's writer now
+    uint64_t lostBytes = segment->closeWriter();
+
+    glibcurl_lock();
+    lostBytes = std::min(lostBytes,segment->received);
+    segment->received -= lostBytes;
+    task->bytesCompleted -= std::min(lostBytes,task->bytesCompleted);
+
+    bool restarted = false;
+    if (!segment->complete()) {
+        LOG_DEBUG ("%s: ticket %lu segment %llu-%llu stopped at %llu (curl %d, http %ld)",__FUNCTION__,ticket,
+                    (unsigned long long)segment->start,(unsigned long long)segment->end,
+                    (unsigned long long)(segment->start + segment->received),(int)resultCode,httpCode);
+        //with mirrors, the range is tried on each of the others too
+        int retries = DOWNLOADMANAGER_SEGMENTRETRIES + (int)task->sourceCount() - 1;
+        if (task->hasMirrors()) {
+            task->sourceFailures[segment->source]++;
+            segment->source = task->nextSource(segment->source);
+        }
+        if ((task->segmentResult == CURLE_OK) && (lostBytes == 0) && (segment->retries < retries)) {
+            segment->retries++;
+            //an aggregate download's range goes on over whichever interface is left if its own went away
+            if (task->aggregate && !isInterfaceUp((Connection)segment->link)) {
+                std::vector<Connection> links = aggregateLinks();
+                if (!links.empty())
+                    segment->link = links.front();
+            }
+            restarted = startSegment(task,segment);
+        }
+        if (!restarted && (task->segmentResult == CURLE_OK))
+            task->segmentResult = (resultCode != CURLE_OK) ? resultCode : CURLE_PARTIAL_FILE;
+    }
+    else if ((task->segmentResult == CURLE_OK)
+                && ((task->aggregate && isInterfaceUp((Connection)segment->link)) || task->hasMirrors())) {
+        restarted = stealRange(task,(Connection)segment->link,segment->source);
+    }
+    bool finished = task->primaryDone && !task->segmentsRunning();
+    glibcurl_unlock();
+
+    if (restarted)
+        glibcurl_start();
+    if (finished)
+        transferDone(task->curlDesc.getHandle(),task->primaryResult,task->primaryHttpCode,task->primaryHttpConnectCode,0);
+}
+
+/*
+ * The ticket's own connection of a split download with mirrors failed: what it had left of its range becomes a
+ * segment on another source, and the ticket goes on.
+ *
+ */
+bool DownloadManager::failOverPrimary(DownloadTask* task)
+{
+    if ((task->segmentResult != CURLE_OK) || (task->primaryPos >= task->primaryEnd))
+        return false;
+
+    glibcurl_lock();
+    task->sourceFailures[0]++;
+    DownloadSegment * segment = new DownloadSegment(NULL,task->primaryPos,task->primaryEnd);
+    segment->source = task->nextSource(0);
+    task->segments.insert(task->segments.begin(),segment);
+    task->primaryEnd = task->primaryPos;
+    task->primaryFilled = true;
+    bool started = startSegment(task,segment);
+    if (!started)
+        task->segmentResult = CURLE_OUT_OF_MEMORY;
+    glibcurl_unlock();
+
+    if (!started)
+        return false;
+    glibcurl_start();
+    LOG_DEBUG ("%s: ticket %lu: %llu-%llu goes to %s",__FUNCTION__,task->ticket,(unsigned long long)segment->start,
+                (unsigned long long)segment->end,task->sourceUrl(segment->source).c_str());
+    return true;
+}
+
+/*
+ * Takes a split download's segments out of the transfer engine; what they got stays in their DownloadSegment
+ * until closeWriter() / trimToContiguous(). Called before the ticket's own handle (whose header list they share) goes.
+ *
+ */
+void DownloadManager::stopSegments(DownloadTask* task)
+{
+    for (std::vector<DownloadSegment *>::iterator it = task->segments.begin(); it != task->segments.end(); ++it) {
+        DownloadSegment * segment = *it;
+        if (segment->handle == NULL)
+            continue;
+        if (glibcurl_remove(segment->handle) != 0) {
+            LOG_DEBUG ("Function glibcurl_remove() failed");
+        }
+        m_segmentMap.erase(segment->handle);
+        releaseDownloadHandle(segment->handle);
+        segment->handle = NULL;
+    }
+}
+
+/*
+ * The interfaces an aggregate download can use right now, fastest first.
+ *
+ */
+std::vector<DownloadManager::Connection> DownloadManager::aggregateLinks()
+{
+    static const Connection candidates[] = { Wired, Wifi, Wan, Btpan };
+    std::vector<Connection> links;
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i) {
+        if (!isInterfaceUp(candidates[i]) || linkDevice(candidates[i]).empty())
+            continue;
+        std::vector<Connection>::iterator it = links.begin();
+        while ((it != links.end()) && (linkWeight(*it) >= linkWeight(candidates[i])))
+            ++it;
+        links.insert(it,candidates[i]);
+    }
+    return links;
+}
+
+std::string DownloadManager::linkDevice(Connection link) const
+{
+    switch (link)
+    {
+    case Wired:
+        return m_wiredInterfaceName;
+    case Wifi:
+        return m_wifiInterfaceName;
+    case Wan:
+        return m_wanInterfaceName;
+    case Btpan:
+        return m_btpanInterfaceName;
+    default:
+        return std::string();
+    }
+}
+
+/*
+ * What share of an aggregate download an interface gets: its measured throughput, or, before it has any,
+ * the average of the ones that do (all the same if none have been measured yet).
+ *
+ */
+double DownloadManager::linkWeight(Connection link) const
+{
+    std::map<int,double>::const_iterator found = m_linkBytesPerSec.find(link);
+    if (found != m_linkBytesPerSec.end())
+        return found->second;
+    if (m_linkBytesPerSec.empty())
+        return 1.0;
+
+    double total = 0;
+    for (found = m_linkBytesPerSec.begin(); found != m_linkBytesPerSec.end(); ++found)
+        total += found->second;
+    return total / m_linkBytesPerSec.size();
+}
+
+/*
+ * Folds what a segment's transfer just did into its interface's throughput (an aggregate download has one
+ * segment per interface at a time, so that is the interface's) and its source's. Runs too short to tell are
+ * left out.
+ *
+ */
+void DownloadManager::noteSegmentRate(DownloadTask* task, DownloadSegment* segment)
+{
+    if (segment->runStartUs == 0)
+        return;
+
+    gint64 elapsedUs = g_get_monotonic_time() - segment->runStartUs;
+    uint64_t bytes = segment->received - std::min(segment->runStartBytes,segment->received);
+    if ((elapsedUs < G_USEC_PER_SEC / 4) || (bytes < (256 << 10)))
+        return;
+
+    double rate = (double)bytes * G_USEC_PER_SEC / elapsedUs;
+    if (task->hasMirrors())
+        task->noteSourceRate(segment->source,rate);
+    if (segment->link == ANY)
+        return;
+    std::map<int,double>::iterator found = m_linkBytesPerSec.find(segment->link);
+    if (found == m_linkBytesPerSec.end())
+        m_linkBytesPerSec[segment->link] = rate;
+    else
+        found->second = (found->second + rate) / 2;
+}
+
+/*
+ * How much of a range a segment on this interface and source should get, relative to others of its download.
+ *
+ */
+double DownloadManager::shareWeight(DownloadTask* task, int link, int source) const
+{
+    if (task->aggregate)
+        return linkWeight((Connection)link);
+    return task->sourceWeight(source);
+}
+
+/*
+ * Gives an interface (aggregate download) or source (mirrors) the tail of the segment with the most left to get,
+ * split by the two's throughput. The other segment's connection is cut short where its range now ends
+ * (writeSegment()). Called with glibcurl_lock held; false if there was nothing worth taking.
+ *
+ */
+bool DownloadManager::stealRange(DownloadTask* task, Connection link, int source)
+{
+    uint64_t minSegment = (uint64_t)std::max(DownloadSettings::instance().segmentMinMB,1u) << 20;
+
+    std::vector<DownloadSegment *>::iterator victim = task->segments.end();
+    uint64_t most = 0;
+    for (std::vector<DownloadSegment *>::iterator it = task->segments.begin(); it != task->segments.end(); ++it) {
+        if ((*it)->handle == NULL)
+            continue;
+        uint64_t left = (*it)->end - std::min((*it)->start + (*it)->received,(*it)->end);
+        if (left > most) {
+            most = left;
+            victim = it;
+        }
+    }
+    if ((victim == task->segments.end()) || (most < 2 * minSegment))
+        return false;
+
+    double victimWeight = shareWeight(task,(*victim)->link,(*victim)->source);
+    double weight = shareWeight(task,link,source);
+    double share = weight / (victimWeight + weight);
+    uint64_t give = std::min(std::max((uint64_t)(most * share),minSegment),most - minSegment);
+
+    //segments are kept in file order
+    DownloadSegment * segment = new DownloadSegment(NULL,(*victim)->end - give,(*victim)->end);
+    segment->link = link;
+    segment->source = source;
+    (*victim)->end = segment->start;
+    task->segments.insert(victim + 1,segment);
+
+    LOG_DEBUG ("%s: ticket %lu: %s / %s takes %llu-%llu",__FUNCTION__,task->ticket,connectionId2Name(link).c_str(),
+                task->sourceUrl(source).c_str(),(unsigned long long)segment->start,(unsigned long long)segment->end);
+    if (!startSegment(task,segment)) {
+        task->segmentResult = CURLE_OUT_OF_MEMORY;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Carries on with a running segment of an aggregate download over another interface, from what is in the file.
+ * The new connection is made before the old handle is freed, so that a late event for that one can't be taken
+ * for it.
+ *
+ */
+bool DownloadManager::moveSegment(DownloadTask* task, DownloadSegment* segment, Connection link)
+{
+    CURL * old = segment->handle;
+
+    glibcurl_lock();
+    if (glibcurl_remove(old) != 0) {
+        LOG_DEBUG ("Function glibcurl_remove() failed");
+    }
+    m_segmentMap.erase(old);
+    segment->handle = NULL;
+    glibcurl_unlock();
+
+    uint64_t lostBytes = segment->closeWriter();
+
+    glibcurl_lock();
+    lostBytes = std::min(lostBytes,segment->received);
+    segment->received -= lostBytes;
+    task->bytesCompleted -= std::min(lostBytes,task->bytesCompleted);
+
+    LOG_DEBUG ("%s: ticket %lu segment %llu-%llu moves from %s to %s at %llu",__FUNCTION__,task->ticket,
+                (unsigned long long)segment->start,(unsigned long long)segment->end,
+                connectionId2Name((Connection)segment->link).c_str(),connectionId2Name(link).c_str(),
+                (unsigned long long)(segment->start + segment->received));
+    segment->link = link;
+    bool started = !segment->complete() && startSegment(task,segment);
+    if (!started && !segment->complete() && (task->segmentResult == CURLE_OK))
+        task->segmentResult = CURLE_OUT_OF_MEMORY;
+    releaseDownloadHandle(old);
+    glibcurl_unlock();
+    return started;
+}
+
+/*
+ * Connection status changed: an aggregate download's ranges on an interface that went away carry on over the
+ * fastest one left, and an interface it isn't using yet takes over part of what is left. With no interface at
+ * all, they are left to fail; the download is paused by pauseAll() anyway.
+ *
+ */
+void DownloadManager::rebalanceAggregates()
+{
+    std::vector<Connection> links = aggregateLinks();
+    if (links.empty())
+        return;
+
+    bool started = false;
+    for (std::map<long,DownloadTask*>::iterator it = m_ticketMap.begin(); it != m_ticketMap.end(); ++it) {
+        DownloadTask * task = it->second;
+        if ((task == NULL) || !task->aggregate || task->queued || !task->isSplit() || (task->segmentResult != CURLE_OK))
+            continue;
+
+        //nothing is added to or taken from the list while the moves happen
+        for (size_t i = 0; i < task->segments.size(); ++i) {
+            DownloadSegment * segment = task->segments[i];
+            if ((segment->handle != NULL) && !isInterfaceUp((Connection)segment->link))
+                started = moveSegment(task,segment,links.front()) || started;
+        }
+
+        glibcurl_lock();
+        for (std::vector<Connection>::iterator link = links.begin(); link != links.end(); ++link) {
+            bool used = false;
+            for (size_t i = 0; i < task->segments.size(); ++i)
+                used = used || ((task->segments[i]->handle != NULL) && (task->segments[i]->link == *link));
+            if (!used)
+                started = stealRange(task,*link,task->nextSource(-1)) || started;
+        }
+        glibcurl_unlock();
+    }
+
+    if (started)
+        glibcurl_start();
+}
+
+/*
+ * The options every download handle starts with. The template is made with them, and a pooled handle gets them
+ * back after curl_easy_reset(); what is particular to a ticket (url, interface, range, headers...) is set on top.
+ *
+ */
+void DownloadManager::setTemplateOptions(CURL* handle)
+{
+    CURLcode curlSetOptRc;
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_SHARE, s_curlShareHandle)) != CURLE_OK)
+        LOG_DEBUG ("curl set opt: CURLOPT_SHARE failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = TrustedCerts::apply(handle)) != CURLE_OK)
+        LOG_DEBUG ("curl set opt: CURLOPT_CAPATH failed [%d]\n",curlSetOptRc);
+
+    if (DownloadSettings::instance().httpMultiplex) {
+        //wait for a connection to the host that is being set up, in case it can be shared, rather than open another
+        if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS)) != CURLE_OK)
+            LOG_DEBUG ("curl set opt: CURLOPT_HTTP_VERSION failed [%d]\n",curlSetOptRc);
+        if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L)) != CURLE_OK)
+            LOG_DEBUG ("curl set opt: CURLOPT_PIPEWAIT failed [%d]\n",curlSetOptRc);
+    }
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_NOSIGNAL,1L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_NOSIGNAL failed [%d]\n",curlSetOptRc);
+
+    //redirects are followed inside the transfer, to the schemes download() would take, up to the fifth one: a
+    //request that gets a redirect for the MAXREDIRECTIONS'th time fails with CURLE_TOO_MANY_REDIRECTS
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION,1L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_FOLLOWLOCATION failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_MAXREDIRS,(long)(DownloadTask::MAXREDIRECTIONS - 1))) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_MAXREDIRS failed [%d]\n",curlSetOptRc);
+
+#if LIBCURL_VERSION_NUM >= 0x075500
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_PROTOCOLS_STR,"http,https,ftp")) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_PROTOCOLS_STR failed [%d]\n",curlSetOptRc);
+#else
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_PROTOCOLS,(long)(CURLPROTO_HTTP | CURLPROTO_HTTPS | CURLPROTO_FTP))) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_PROTOCOLS failed [%d]\n",curlSetOptRc);
+#endif
+
+#if LIBCURL_VERSION_NUM >= 0x075500
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_REDIR_PROTOCOLS_STR,"http,https,ftp")) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_REDIR_PROTOCOLS_STR failed [%d]\n",curlSetOptRc);
+#else
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_REDIR_PROTOCOLS,(long)(CURLPROTO_HTTP | CURLPROTO_HTTPS | CURLPROTO_FTP))) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_REDIR_PROTOCOLS failed [%d]\n",curlSetOptRc);
+#endif
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT,60L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_CONNECTTIMEOUT failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_LOW_SPEED_LIMIT,10L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_LOW_SPEED_LIMIT failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_LOW_SPEED_TIME,10L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_LOW_SPEED_TIME failed [%d]\n",curlSetOptRc);
+
+    // if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_VERBOSE, 1)) != CURLE_OK )
+    //      LOG_DEBUG ("curl set opt: CURLOPT_VERBOSE failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_NOPROGRESS failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_BUFFERSIZE, DOWNLOADMANAGER_DLBUFFERSIZE)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_BUFFERSIZE failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_SOCKOPTFUNCTION, cbCurlSetSocketOptions)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_SOCKOPTFUNCTION failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, cbCurlWriteToFile)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_WRITEFUNCTION failed [%d]\n",curlSetOptRc);
+
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, cbCurlHeaderInfo)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_HEADERFUNCTION failed [%d]\n",curlSetOptRc);
+}
+
+/*
+ * A handle for a new download, with the template's options: one a finished download left in the pool if there is
+ * one (it keeps what curl holds in it beyond options), else a copy of the template. The template, and the pool,
+ * are made again when the trusted certificates have changed.
+ *
+ */
+CURL * DownloadManager::newDownloadHandle()
+{
+    TrustedCerts::refresh();
+    if ((m_handleTemplate != NULL) && (m_handleTemplateCerts != TrustedCerts::loads()))
+        dropHandles();
+
+    if (!m_handlePool.empty()) {
+        CURL * handle = m_handlePool.back();
+        m_handlePool.pop_back();
+        m_transferStats.handlesReused++;
+        return handle;
+    }
+
+    if (m_handleTemplate == NULL) {
+        if ((m_handleTemplate = curl_easy_init()) == NULL)
+            return NULL;
+        setTemplateOptions(m_handleTemplate);
+        m_handleTemplateCerts = TrustedCerts::loads();
+    }
+    CURL * handle = curl_easy_duphandle(m_handleTemplate);
+    if (handle != NULL)
+        m_transferStats.handlesCloned++;
+    return handle;
+}
+
+/*
+ * A download handle is out of the transfer engine and done with. The transfer thread may already have queued its
+ * DONE event, so it isn't reused or freed until the events queued so far have been handled (see cbTransferEvents()); a
+ * new download mustn't be taken for the one that event was about.
+ *
+ */
+void DownloadManager::releaseDownloadHandle(CURL* handle)
+{
+    if (handle == NULL)
+        return;
+    //even when it isn't pooled: freed now, its address could come back as a new handle before that event is handled
+    m_releasedHandles.push_back(handle);
+    if (m_releasedHandles.size() == 1)
+        g_idle_add(cbTransferEvents,this);
+}
+
+// released handles go back to the pool, reset and with the template's options, as far as there is room
+void DownloadManager::recycleHandles(std::vector<CURL*>& handles)
+{
+    for (std::vector<CURL*>::iterator it = handles.begin(); it != handles.end(); ++it) {
+        if (!m_glibCurlInitialized || (m_handleTemplate == NULL)
+                || (m_handlePool.size() >= DownloadSettings::instance().handlePoolSize)) {
+            curl_easy_cleanup(*it);
+            continue;
+        }
+        curl_easy_reset(*it);
+        setTemplateOptions(*it);
+        m_handlePool.push_back(*it);
+    }
+    handles.clear();
+}
+
+void DownloadManager::dropHandles()
+{
+    for (std::vector<CURL*>::iterator it = m_handlePool.begin(); it != m_handlePool.end(); ++it)
+        curl_easy_cleanup(*it);
+    m_handlePool.clear();
+    if (m_handleTemplate != NULL)
+        curl_easy_cleanup(m_handleTemplate);
+    m_handleTemplate = NULL;
+}
+
+/*
+ * Where a url that redirected recently ended up, if that is less than RedirectCacheSeconds ago; "" otherwise
+ *
+ */
+std::string DownloadManager::cachedRedirect(const std::string& url)
+{
+    std::map<std::string,CachedRedirect>::iterator iter = m_redirectCache.find(url);
+    if (iter == m_redirectCache.end())
+        return std::string();
+    if (iter->second.expiresUs <= g_get_monotonic_time()) {
+        m_redirectCache.erase(iter);
+        return std::string();
+    }
+    m_transferStats.redirectCacheHits++;
+    LOG_DEBUG ("[REDIRECT] %s goes to %s (cached)",url.c_str(),iter->second.location.c_str());
+    return iter->second.location;
+}
+
+/*
+ * The download's transfer has followed redirects: it is now about where they led. Main thread; the transfer may
+ * still be going (splitDownload()), hence the lock.
+ *
+ */
+void DownloadManager::noteRedirect(DownloadTask* task, CURL* handle)
+{
+    long redirects = 0;
+    char * effectiveUrl = NULL;
+    char * redirectUrl = NULL;
+    std::string location;
+    glibcurl_lock();
+    if ((curl_easy_getinfo(handle, CURLINFO_REDIRECT_COUNT, &redirects) == CURLE_OK) && (redirects > 0)
+            && (curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &effectiveUrl) == CURLE_OK) && (effectiveUrl != NULL))
+        location = effectiveUrl;
+    //one with credentials isn't followed by curl: keep where it points, made absolute, for followRedirect()
+    if (!task->authToken.empty() && (curl_easy_getinfo(handle, CURLINFO_REDIRECT_URL, &redirectUrl) == CURLE_OK)
+            && (redirectUrl != NULL))
+        task->setLocationHeader(redirectUrl);
+    glibcurl_unlock();
+
+    if (location.empty() || (location == task->url))
+        return;
+    LOG_DEBUG ("[REDIRECT] ticket [%lu]: %s is now %s",task->ticket,task->url.c_str(),location.c_str());
+    task->url = location;
+    if (!task->redirected)
+        m_transferStats.redirectsFollowed++;
+    task->redirected = true;
+}
+
+/*
+ * A download is over. If it worked and got somewhere other than where it was asked to, the next one from the same
+ * url goes straight there for a while; if it failed, a cached location it was sent to is dropped.
+ *
+ */
+void DownloadManager::cacheRedirect(DownloadTask* task, bool worked)
+{
+    if (task->requestedUrl.empty() || (task->requestedUrl == task->url))
+        return;
+    //the cache is shared by every caller; it's only for where urls lead anyone to
+    if (!task->authToken.empty())
+        return;
+
+    unsigned int ttl = DownloadSettings::instance().redirectCacheSeconds;
+    if (!worked || (ttl == 0)) {
+        m_redirectCache.erase(task->requestedUrl);
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    if ((m_redirectCache.size() >= DOWNLOADMANAGER_REDIRECTCACHESIZE)
+            && (m_redirectCache.find(task->requestedUrl) == m_redirectCache.end())) {
+        for (std::map<std::string,CachedRedirect>::iterator it = m_redirectCache.begin(); it != m_redirectCache.end(); ) {
+            if (it->second.expiresUs <= now)
+                m_redirectCache.erase(it++);
+            else
+                ++it;
+        }
+        if (m_redirectCache.size() >= DOWNLOADMANAGER_REDIRECTCACHESIZE)
+            m_redirectCache.clear();    //start over rather than keep track of which is the stalest
+    }
+    CachedRedirect& entry = m_redirectCache[task->requestedUrl];
+    entry.location = task->url;
+    entry.expiresUs = now + (gint64)ttl * G_USEC_PER_SEC;
+}
+
+/*
+ * A download with credentials got a redirect, which curl wasn't let follow: the Auth-Token / Device-Id headers
+ * are for the url they came with, not for whatever host it sends us to. Its Location is downloaded instead, under
+ * the same ticket and without them, counting against MAXREDIRECTIONS like the hops curl follows.
+ * false: there is no Location to go to
+ *
+ */
+bool DownloadManager::followRedirect(DownloadTask* task)
+{
+    if (task->httpHeader_Location.empty())
+        return false;
+
+    //what got written is the redirect's body; appending, it gets written over from the same offset again
+    if (!task->appendTargetFile)
+        Utils::remove_file(task->destPath + task->downloadPrefix + task->destFile);
+
+    int remainingRedCounts = task->getRemainingRedCounts() - 1;
+    if (remainingRedCounts <= 0) {
+        LOG_DEBUG ("It has been completed to try maximum of redirections %d.", DownloadTask::MAXREDIRECTIONS);
+        if (!cancel(task->ticket)) {
+            LOG_DEBUG ("Function cancel() failed: id(%lu)", task->ticket);
+        }
+        return true;
+    }
+
+    m_transferStats.redirectsFollowed++;
+    int ret = download (task->ownerId,
+            task->httpHeader_Location,
+            task->detectedMIMEType,
+            task->destPath,
+            task->opt_keepOriginalFilenameOnRedirect ? task->destFile : std::string(""),
+            task->ticket,
+            task->opt_keepOriginalFilenameOnRedirect,
+            std::string(""),
+            std::string(""),
+            DownloadManager::connectionName2Id(task->connectionName),
+            task->canHandlePause,
+            task->autoResume,
+            task->appendTargetFile,
+            task->cookieHeader,
+            task->rangeSpecified,
+            remainingRedCounts,
+            task->durability,
+            task->aggregate,
+            task->mirrors,
+            !task->revalidateTarget.empty(),
+            task->hashAlgorithm,
+            task->expectedHash,
+            task->priority,
+            task->maxRecvSpeed,
+            task->useContentStore);
+    if (ret < 0) {
+        LOG_DEBUG ("Function download() is failed (%d)", ret);
+    }
+    LOG_DEBUG ("[REDIRECT] ticket [%lu] is now [%s], without credentials",task->ticket,task->httpHeader_Location.c_str());
+    return true;
+}
+
+/*
+ * Hands a download to glibcurl. With several transfer shards, it goes onto the one already running a download
+ * from the same host, whose connection pool (and HTTP/2 connection) it can then share.
+ *
+ */
+CURLMcode DownloadManager::addDownload(DownloadTask* task)
+{
+    CURL * handle = task->curlDesc.getHandle();
+    if (glibcurl_shards() > 1) {
+        std::string key = hostKeyOf(task->url);
+        for (std::map<long,DownloadTask*>::iterator it = m_ticketMap.begin(); it != m_ticketMap.end(); ++it) {
+            DownloadTask * other = it->second;
+            if ((other == NULL) || (other == task) || other->queued || (other->curlDesc.getHandle() == NULL))
+                continue;
+            if (hostKeyOf(other->url) == key)
+                return glibcurl_add_beside(handle,other->curlDesc.getHandle());
+        }
+    }
+    return glibcurl_add(handle);
+}
+
+/*
+ * A download has just been handed to glibcurl. With HedgePercentile, and enough recent TTFBs from its host,
+ * a timer is set for when a second request goes out if no data has come by then.
+ *
+ */
+void DownloadManager::transferStarted(DownloadTask* task)
+{
+    m_queue.started(task->ownerId);
+    redistributeRecvSpeeds();
+    task->bytesAtStart = task->bytesCompleted;
+    task->startedUs = g_get_monotonic_time();
+    task->firstByteUs = 0;
+    task->hedgeDueUs = 0;
+
+    unsigned int percentile = DownloadSettings::instance().hedgePercentile;
+    if (percentile == 0)
+        return;
+
+    std::map<std::string,std::vector<uint32_t> >::iterator iter = m_hostTtfbUs.find(hostKeyOf(task->url));
+    if ((iter == m_hostTtfbUs.end()) || (iter->second.size() < std::max(DownloadSettings::instance().hedgeMinSamples,1u)))
+        return;
+
+    uint64_t delayUs = std::max(percentileOf(iter->second,percentile),(uint64_t)1000);
+    task->hedgeDueUs = task->startedUs + delayUs;
+    g_timeout_add(delayUs / 1000, cbHedgeTimer, GSIZE_TO_POINTER(task->ticket));
+}
+
+/*
+ * Keeps the last DOWNLOADMANAGER_HOSTTTFBSAMPLES times to first byte of each host, for transferStarted()
+ *
+ */
+void DownloadManager::recordTtfb(const std::string& url, curl_off_t ttfbUs)
+{
+    if ((ttfbUs <= 0) || (DownloadSettings::instance().hedgePercentile == 0))
+        return;
+
+    std::string key = hostKeyOf(url);
+    if ((m_hostTtfbUs.size() >= DOWNLOADMANAGER_HOSTTTFBHOSTS) && (m_hostTtfbUs.find(key) == m_hostTtfbUs.end()))
+        m_hostTtfbUs.clear();       //start over rather than keep track of which host is the stalest
+
+    std::vector<uint32_t>& samples = m_hostTtfbUs[key];
+    if (samples.size() >= DOWNLOADMANAGER_HOSTTTFBSAMPLES)
+        samples.erase(samples.begin());
+    samples.push_back((uint32_t)std::min(ttfbUs,(curl_off_t)G_MAXUINT32));
+}
+
+uint64_t DownloadManager::firstDataPercentileUs(unsigned int percent) const
+{
+    return percentileOf(m_transferStats.firstDataUs,percent);
+}
+
+//static
+gboolean DownloadManager::cbHedgeTimer(gpointer data)
+{
+    DownloadManager::instance().launchHedge(GPOINTER_TO_SIZE(data));
+    return false;
+}
+
+/*
+ * Sends the same request again for a download that has had no data by its hedgeDueUs. Both go on, on the same
+ * transfer thread; the first to bring data is kept (cbWriteEvent, settleHedge) and only its bytes are written.
+ *
+ */
+void DownloadManager::launchHedge(unsigned long ticket)
+{
+    std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(ticket);
+    if ((iter == m_ticketMap.end()) || (iter->second == NULL) || (iter->second->queued))
+        return;     //paused, cancelled or completed meanwhile
+
+    DownloadTask * task = iter->second;
+    CURL * primary = task->curlDesc.getHandle();
+    //the timer may be from an earlier run of the ticket (paused and resumed since)
+    if ((primary == NULL) || (task->hedge != NULL) || (task->hedgeDueUs == 0) || (g_get_monotonic_time() < task->hedgeDueUs - 1000))
+        return;
+
+    glibcurl_lock();
+    if ((task->firstByteUs != 0) || task->splitRequested) {
+        glibcurl_unlock();
+        return;
+    }
+
+    CURL * handle = curl_easy_duphandle(primary);
+    if (handle == NULL) {
+        glibcurl_unlock();
+        LOG_DEBUG ("Function curl_easy_duphandle() failed: id(%lu)", ticket);
+        return;
+    }
+
+    //as startSegment(): the copy's callbacks have to come back with its own handle
+    int curlSetOptRc;
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_WRITEDATA,handle)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_WRITEDATA failed [%d]\n",curlSetOptRc);
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_WRITEHEADER,handle)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_WRITEHEADER failed [%d]\n",curlSetOptRc);
+    //the stall may be the connection itself, so not onto that one
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_PIPEWAIT,0L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_PIPEWAIT failed [%d]\n",curlSetOptRc);
+    if ((curlSetOptRc = curl_easy_setopt(handle, CURLOPT_FRESH_CONNECT,1L)) != CURLE_OK )
+        LOG_DEBUG ("curl set opt: CURLOPT_FRESH_CONNECT failed [%d]\n",curlSetOptRc);
+
+    task->hedge = handle;
+    m_hedgeMap[handle] = ticket;
+    if (glibcurl_add_beside(handle,primary) != 0) {
+        LOG_DEBUG ("Function glibcurl_add_beside() failed");
+    }
+    m_transferStats.hedges++;
+    glibcurl_unlock();
+    glibcurl_start();
+
+    LOG_DEBUG ("%s: no data for ticket %lu after %lld ms, sent a second request",__FUNCTION__,ticket,
+                (long long)((task->hedgeDueUs - task->startedUs) / 1000));
+}
+
+/*
+ * Drops the request of a hedged download that didn't win; the winner becomes the ticket's own handle.
+ *
+ */
+void DownloadManager::settleHedge(DownloadTask* task, CURL* winner)
+{
+    if (task->hedge == NULL)
+        return;
+
+    glibcurl_lock();
+    CURL * primary = task->curlDesc.getHandle();
+    CURL * hedge = task->hedge;
+    CURL * loser = (winner == hedge) ? primary : hedge;
+
+    if (glibcurl_remove(loser) != 0) {
+        LOG_DEBUG ("Function glibcurl_remove() failed");
+    }
+    m_hedgeMap.erase(hedge);
+
+    if (winner == hedge) {
+        //the header list stays with the descriptor; the copy uses it
+        TransferTask * _task = getTask(task->curlDesc);
+        m_handleMap.erase(task->curlDesc);
+        task->curlDesc.setHandle(hedge);
+        m_handleMap[task->curlDesc] = _task;
+        m_transferStats.hedgeWins++;
+    }
+    releaseDownloadHandle(loser);
+    task->hedge = NULL;
+    task->hedgeWinner = NULL;
+    glibcurl_unlock();
+}
+
+/*
+ * One of a hedged download's two requests has ended before settleHedge() got to it. true: it is the one the
+ * ticket goes on with, and is now its own handle; false: it was dropped.
+ *
+ */
+bool DownloadManager::hedgeDone(DownloadTask* task, CURL* handle, CURLcode resultCode, long httpCode)
+{
+    glibcurl_lock();
+    CURL * other = (handle == task->hedge) ? task->curlDesc.getHandle() : task->hedge;
+    if (task->hedgeWinner == NULL) {
+        //one that got no response at all leaves it to the other; anything else (even an error status) is an answer
+        task->hedgeWinner = ((resultCode != CURLE_OK) && (httpCode == 0)) ? other : handle;
+    }
+    bool won = (task->hedgeWinner == handle);
+    settleHedge(task,task->hedgeWinner);
+    glibcurl_unlock();
+    return won;
+}
+
+void DownloadManager::cbGlib()
+{
+    CURLMsg* msg;
+    int inQueue;
+    long l_httpCode = 0;
+    long l_httpConnectCode;
+//    LOG_DEBUG ("%s Function-Entry",__FUNCTION__);
+
+    while (1) {
+        msg = curl_multi_info_read(glibcurl_shard_handle(glibcurl_current_shard()), &inQueue);
+        if (msg == 0) {
+            break;
+        }
+
+        if (msg->msg == CURLMSG_DONE)  {
+
+            //LOG_DEBUG ("%s: CURLMSG_DONE\n", __PRETTY_FUNCTION__);
+            /// Note: Error handling will NOT be done here...it will be done in completed()
+            ///...but store the results here before removeTask annihilates the curl handle
+
+            l_httpCode = 0;
+            l_httpConnectCode = 0;
+            CURLcode inforc = curl_easy_getinfo(msg->easy_handle,CURLINFO_RESPONSE_CODE,&l_httpCode);
+            if (inforc != CURLE_OK) {
+                LOG_WARNING_PAIRS_ONLY (LOGID_CURL_FAIL_HTTP_STATUS, 1, PMLOGKS("reason", "failed to retrieve HTTP status code from handle"));
+            }
+
+            inforc = curl_easy_getinfo(msg->easy_handle,CURLINFO_HTTP_CONNECTCODE,&l_httpConnectCode);
+            if (inforc != CURLE_OK) {
+                LOG_WARNING_PAIRS_ONLY (LOGID_CURL_FAIL_HTTP_CONNECT, 1, PMLOGKS("reason", "failed to retrieve HTTP connect code from handle"));
+            }
+
+            CURLcode resultCode = msg->data.result;
+
+            curl_off_t ttfbUs = 0;
+            if (curl_easy_getinfo(msg->easy_handle,CURLINFO_STARTTRANSFER_TIME_T,&ttfbUs) != CURLE_OK)
+                ttfbUs = 0;
+            long connects = -1;
+            if (curl_easy_getinfo(msg->easy_handle,CURLINFO_NUM_CONNECTS,&connects) != CURLE_OK)
+                connects = -1;
+            long httpVersion = 0;
+            if (curl_easy_getinfo(msg->easy_handle,CURLINFO_HTTP_VERSION,&httpVersion) != CURLE_OK)
+                httpVersion = 0;
+            //a connection of its own over TLS: how long the handshake took
+            curl_off_t connectUs = 0;
+            curl_off_t tlsUs = 0;
+            if ((connects > 0) && (curl_easy_getinfo(msg->easy_handle,CURLINFO_CONNECT_TIME_T,&connectUs) == CURLE_OK)
+                    && (curl_easy_getinfo(msg->easy_handle,CURLINFO_APPCONNECT_TIME_T,&tlsUs) == CURLE_OK))
+                tlsUs = (tlsUs > connectUs) ? (tlsUs - connectUs) : 0;
+            else
+                tlsUs = 0;
+
+            if (glibcurl_is_threaded()) {
+                //on the transfer thread: the rest of it talks to the bus and the db, so hand it to the main thread
+                if (m_transferEvents.push(new TransferEvent(msg->easy_handle,resultCode,l_httpCode,l_httpConnectCode,ttfbUs,
+                                                            connects,httpVersion,tlsUs)))
+                    g_idle_add(cbTransferEvents,this);
+                continue;
+            }
+
+            transferDone(msg->easy_handle,resultCode,l_httpCode,l_httpConnectCode,ttfbUs,connects,httpVersion,tlsUs);
+        }
+        else {
+            LOG_WARNING_PAIRS_ONLY (LOGID_UNKNOWN_MSG_CBGLIB, 1, PMLOGKFV("msg code", "%d", msg->msg));
+        }
+    }
+
+//  LOG_DEBUG ("%s Function-Exit",__FUNCTION__);
+}
+
+/*
+ * Finishes off a transfer that curl reported as done: removes the task and runs completed() on it.
+ * Always called on the main thread.
+ *
+ */
+void DownloadManager::transferDone(CURL * handle, CURLcode resultCode, long httpCode, long httpConnectCode, curl_off_t ttfbUs,
+                                   long connects, long httpVersion, curl_off_t tlsUs)
+{
+    TransferTask * _task = NULL;
+    DownloadTask * dl_task = NULL;
+    UploadTask * ul_task = NULL;
+
+    //every request that went out, segments and hedges included
+    if (connects > 0)
+        m_transferStats.newConnections += connects;
+    else if (connects == 0)
+        m_transferStats.reusedConnections++;
+    if (httpVersion >= CURL_HTTP_VERSION_2_0)
+        m_transferStats.http2Transfers++;
+    if (tlsUs > 0) {
+        m_transferStats.tlsHandshakes++;
+        m_transferStats.tlsHandshakeTotalUs += tlsUs;
+    }
+
+    std::map<CURL*,unsigned long>::iterator segmentIter = m_segmentMap.find(handle);
+    if (segmentIter != m_segmentMap.end()) {
+        segmentDone(segmentIter->second,handle,resultCode,httpCode);
+        return;
+    }
+
+    //a hedged download goes on with one of its two requests, whichever this is
+    DownloadTask * hedged = NULL;
+    std::map<CURL*,unsigned long>::iterator hedgeIter = m_hedgeMap.find(handle);
+    if (hedgeIter != m_hedgeMap.end()) {
+        std::map<long,DownloadTask*>::iterator ticketIter = m_ticketMap.find(hedgeIter->second);
+        if ((ticketIter == m_ticketMap.end()) || (ticketIter->second == NULL)) {
+            m_hedgeMap.erase(hedgeIter);
+            return;
+        }
+        hedged = ticketIter->second;
+    }
+    else {
+        CurlDescriptor primary(handle);
+        TransferTask * primaryTask = getTask(primary);
+        if (primaryTask && (primaryTask->type == TransferTask::DOWNLOAD_TASK) && primaryTask->p_downloadTask
+                && (primaryTask->p_downloadTask->hedge != NULL))
+            hedged = primaryTask->p_downloadTask;
+    }
+    if (hedged && !hedgeDone(hedged,handle,resultCode,httpCode))
+        return;
+
+    //if this was queued up by the transfer thread, the task may have been cancelled (and the handle freed) in the meantime
+    CurlDescriptor cd(handle);
+    TransferTask * found = getTask(cd);
+    if (found == NULL)
+        return;
+    if ((found->type == TransferTask::DOWNLOAD_TASK) && (found->p_downloadTask != NULL))
+        noteRedirect(found->p_downloadTask,handle);
+
+    //a split download is done once its own connection and all of its segments are
+    if ((found->type == TransferTask::DOWNLOAD_TASK) && (found->p_downloadTask != NULL) && found->p_downloadTask->isSplit()) {
+        dl_task = found->p_downloadTask;
+        if (dl_task->primaryFilled && (resultCode == CURLE_WRITE_ERROR))
+            resultCode = CURLE_OK;      //cut off on purpose where the segments take over
+        if ((resultCode != CURLE_OK) && dl_task->hasMirrors() && failOverPrimary(dl_task))
+            resultCode = CURLE_OK;      //the rest of its range went to a mirror
+        if ((resultCode == CURLE_OK) && dl_task->segmentsRunning()) {
+            dl_task->primaryDone = true;
+            dl_task->primaryResult = resultCode;
+            dl_task->primaryHttpCode = httpCode;
+            dl_task->primaryHttpConnectCode = httpConnectCode;
+            return;     //segmentDone() comes back here with these once the last one is in
+        }
+        //a segment that gave up stopped the ticket's connection too (cbWriteEvent)
+        if ((dl_task->segmentResult != CURLE_OK) && ((resultCode == CURLE_OK) || (resultCode == CURLE_WRITE_ERROR)))
+            resultCode = dl_task->segmentResult;
+        dl_task = NULL;
+    }
+
+    m_transferStats.completed++;
+    if (ttfbUs > 0) {
+        m_transferStats.ttfbSamples++;
+        m_transferStats.ttfbTotalUs += ttfbUs;
+        m_transferStats.ttfbLastUs = ttfbUs;
+        if ((uint64_t)ttfbUs > m_transferStats.ttfbMaxUs)
+            m_transferStats.ttfbMaxUs = ttfbUs;
+    }
+
+    //is it a download or an upload
+    glibcurl_lock();
+    _task = removeTask(handle);
+    glibcurl_unlock();
+
+    if (_task == NULL)
+        return;
+
+    if (_task->type == TransferTask::DOWNLOAD_TASK) {
+
+        //complete this transfer..remove the task...
+        dl_task = _task->p_downloadTask;
+        if (dl_task != NULL) {
+            recordTtfb(dl_task->url,ttfbUs);
+            if ((dl_task->firstByteUs != 0) && (dl_task->startedUs != 0)) {
+                std::vector<uint32_t>& samples = m_transferStats.firstDataUs;
+                uint32_t sample = (uint32_t)std::min(dl_task->firstByteUs - dl_task->startedUs,(gint64)G_MAXUINT32);
+                if (samples.size() < DOWNLOADMANAGER_FIRSTDATASAMPLES)
+                    samples.push_back(sample);
+                else
+                    samples[m_transferStats.firstDataNext] = sample;
+                m_transferStats.firstDataNext = (m_transferStats.firstDataNext + 1) % DOWNLOADMANAGER_FIRSTDATASAMPLES;
+            }
+            if (dl_task->curlDesc.setResultCode(resultCode) != 0) {
+                LOG_DEBUG ("Function setResultCode() failed");
+            }
+            dl_task->curlDesc.setHttpResultCode(httpCode);
+            dl_task->curlDesc.setHttpConnectCode(httpConnectCode);
+        }
+    }
+    else if (_task->type == TransferTask::UPLOAD_TASK) {
+        ul_task = _task->p_uploadTask;
+        if (ul_task != NULL) {
+            ul_task->setCURLCode(resultCode);
+            ul_task->setHTTPCode(httpCode);
+        }
+    }
+
+    //complete the task
+    completed(_task);
+}
+
+/*
+ * Posts a progress update from the curl write/read callbacks. On the transfer thread, this only queues it up
+ * for the main thread; the luna bus is never touched from there.
+ *
+ */
+bool DownloadManager::postTransferProgress(const std::string& owner, const unsigned long ticket, const std::string& payload)
+{
+    if (!glibcurl_is_threaded())
+        return postDownloadUpdate(owner,ticket,payload);
+
+    if (m_transferEvents.push(new TransferEvent(owner,ticket,payload)))
+        g_idle_add(cbTransferEvents,this);
+    return true;
+}
+
+//static
+gboolean DownloadManager::cbTransferEvents(gpointer userData)
+{
+    DownloadManager * dlm = (DownloadManager *)userData;
+    //handles released before these events were taken can't be what any later one is about
+    std::vector<CURL*> released;
+    released.swap(dlm->m_releasedHandles);
+    TransferEvent * event = dlm->m_transferEvents.takeAll();
+    while (event) {
+        TransferEvent * next = event->next;
+        if (event->type == TransferEvent::DONE) {
+            dlm->transferDone(event->handle,event->resultCode,event->httpCode,event->httpConnectCode,event->ttfbUs,
+                              event->connects,event->httpVersion,event->tlsUs);
+        }
+        else if (event->type == TransferEvent::WRITES_DRAINED) {
+            dlm->resumeThrottledTransfer(event->ticket);
+        }
+        else if (event->type == TransferEvent::RECV_SPEED_PAUSED) {
+            dlm->recvSpeedPaused(event->ticket);
+        }
+        else if (event->type == TransferEvent::RESUME_VERIFIED) {
+            dlm->resumeVerified(event->dropped,event->rehashed);
+        }
+        else if (event->type == TransferEvent::PREFIX_REHASHED) {
+            dlm->prefixRehashed((PrefixRehash *)event->rehash);
+        }
+        else if (event->type == TransferEvent::FILE_FINISHED) {
+            dlm->finishedDownload((FinishingDownload *)event->finishing);
+        }
+        else if (event->type == TransferEvent::SPLIT) {
+            dlm->splitDownload(event->ticket);
+        }
+        else if (event->type == TransferEvent::HEDGE_DECIDED) {
+            std::map<long,DownloadTask*>::iterator iter = dlm->m_ticketMap.find(event->ticket);
+            if ((iter != dlm->m_ticketMap.end()) && iter->second && iter->second->hedgeWinner)
+                dlm->settleHedge(iter->second,iter->second->hedgeWinner);
+        }
+        else if (!dlm->postDownloadUpdate(event->ownerId,event->ticket,event->payload)) {
+            std::string key = ConvertToString<unsigned long>(event->ticket);
+            LOG_WARNING_PAIRS (LOGID_SUBSCRIPTIONREPLY_FAIL_ON_WRITEDATA, 2, PMLOGKS("ticket", key.c_str()),
+                                                                            PMLOGKS("detail", event->payload.c_str()),
+                                                                            "failed to update progress to subscribers");
+        }
+        delete event;
+        event = next;
+    }
+    dlm->recycleHandles(released);
+    return false;   //one-shot; the next push onto an empty queue schedules another
+}
+
+//static
+DurabilityMode DownloadManager::defaultDurability()
+{
+    return DownloadTask::durabilityFromString(DownloadSettings::instance().durability, DURABILITY_INTERVAL);
+}
 
-                //complete this transfer..remove the task...
-                dl_task = _task->p_downloadTask;
-                if (dl_task != NULL) {
-                    if (dl_task->curlDesc.setResultCode(resultCode) != 0) {
-                        LOG_DEBUG ("Function setResultCode() failed");
-                    }
-                    dl_task->curlDesc.setHttpResultCode(l_httpCode);
-                    dl_task->curlDesc.setHttpConnectCode(l_httpConnectCode);
-                }
-            }
-            else if (_task->type == TransferTask::UPLOAD_TASK) {
-                ul_task = _task->p_uploadTask;
-                if (ul_task != NULL) {
-                    ul_task->setCURLCode(resultCode);
-                    ul_task->setHTTPCode(l_httpCode);
-                }
-            }
+//static
+//on a DiskWriter thread: the transfer can only be touched from the main thread
+void DownloadManager::cbWritesDrained(unsigned long ticket)
+{
+    DownloadManager& dlm = DownloadManager::instance();
+    if (dlm.m_transferEvents.push(new TransferEvent(TransferEvent::WRITES_DRAINED,ticket)))
+        g_idle_add(cbTransferEvents,&dlm);
+}
+
+/*
+ * Unpauses a transfer that cbWriteEvent paused because its write-behind backlog was over budget, because
+ * MaxRecvSpeed had nothing left for it, or because its hash was being taken over the file again (prefixRehashed()).
+ * curl hands the payload it was refused again from inside curl_easy_pause.
+ *
+ */
+void DownloadManager::resumeThrottledTransfer(unsigned long ticket)
+{
+    std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(ticket);
+    if ((iter == m_ticketMap.end()) || (iter->second == NULL) || (iter->second->queued))
+        return;     //paused, cancelled or completed meanwhile
+
+    CURL * handle = iter->second->curlDesc.getHandle();
+    if (handle == NULL)
+        return;
 
-            //complete the task
-            completed(_task);
+    glibcurl_lock();
+    if (curl_easy_pause(handle, CURLPAUSE_CONT) != CURLE_OK) {
+        LOG_DEBUG ("Function curl_easy_pause() failed: id(%lu)", ticket);
+    }
+    //the writers of a split download's segments share the ticket; unpausing one that isn't paused is harmless
+    std::vector<DownloadSegment *>& segments = iter->second->segments;
+    for (std::vector<DownloadSegment *>::iterator it = segments.begin(); it != segments.end(); ++it) {
+        if (((*it)->handle != NULL) && (curl_easy_pause((*it)->handle, CURLPAUSE_CONT) != CURLE_OK)) {
+            LOG_DEBUG ("Function curl_easy_pause() failed: id(%lu)", ticket);
         }
-        else {
-            LOG_WARNING_PAIRS_ONLY (LOGID_UNKNOWN_MSG_CBGLIB, 1, PMLOGKFV("msg code", "%d", msg->msg));
+    }
+    //...and a hedged one's second request, which MaxRecvSpeed may have paused too
+    if ((iter->second->hedge != NULL) && (curl_easy_pause(iter->second->hedge, CURLPAUSE_CONT) != CURLE_OK)) {
+        LOG_DEBUG ("Function curl_easy_pause() failed: id(%lu)", ticket);
+    }
+    glibcurl_unlock();
+    glibcurl_start();
+}
+
+/*
+ * A transfer found nothing left for it in the MaxRecvSpeed bucket and paused itself (cbWriteEvent). It waits with
+ * the others that did until the bucket has something again; then they are unpaused in the order they paused. The
+ * first one to take what there is leaves the bucket empty for the rest, and those pause again behind it.
+ *
+ */
+void DownloadManager::recvSpeedPaused(unsigned long ticket)
+{
+    m_transferStats.recvSpeedPauses++;
+    if (std::find(m_recvSpeedPaused.begin(),m_recvSpeedPaused.end(),ticket) == m_recvSpeedPaused.end())
+        m_recvSpeedPaused.push_back(ticket);
+    if (m_recvSpeedTimer == 0)
+        m_recvSpeedTimer = g_timeout_add(std::max((m_recvBucket.waitUs() + 999) / 1000,(uint64_t)1),cbRecvSpeedTimer,this);
+}
+
+// main thread, from verifyResume on the transfer thread by way of a RESUME_VERIFIED event
+void DownloadManager::resumeVerified(uint64_t dropped, bool rehashed)
+{
+    if (dropped == 0) {
+        m_transferStats.resumesVerified++;
+        return;
+    }
+    m_transferStats.resumeMismatches++;
+    m_transferStats.resumeBytesDropped += dropped;
+    if (rehashed)
+        m_transferStats.hashPrefixesRehashed++;
+}
+
+/*
+ * Takes a resumed download's hash over the first bytes of its temp file again, on s_rehasher rather than in the
+ * caller, which is the main thread (resumeDownload) or the transfer thread (verifyResume). task->rehash stays set
+ * until prefixRehashed() has handed the hash to the task, and cbWriteEvent pauses the transfer meanwhile.
+ *
+ */
+void DownloadManager::rehashPrefix(DownloadTask* task, StreamHash* hash, const std::string& path, uint64_t bytes)
+{
+    PrefixRehash * rehash = new PrefixRehash(task->ticket,hash,path,bytes);
+    g_atomic_pointer_set(&task->rehash,rehash);
+    if (s_rehasher != NULL)
+        g_thread_pool_push(s_rehasher,rehash,NULL);
+    else
+        cbRehashPrefix(rehash,this);
+}
+
+//static
+//on s_rehasher
+void DownloadManager::cbRehashPrefix(gpointer data, gpointer userData)
+{
+    DownloadManager * dlm = (DownloadManager *)userData;
+    PrefixRehash * rehash = (PrefixRehash *)data;
+    rehash->failed = !rehash->hash->updateFromFile(rehash->path,rehash->bytes);
+    if (dlm->m_transferEvents.push(new TransferEvent(TransferEvent::PREFIX_REHASHED,(void *)rehash)))
+        g_idle_add(cbTransferEvents,dlm);
+}
+
+// main thread, by way of a PREFIX_REHASHED event
+void DownloadManager::prefixRehashed(PrefixRehash * rehash)
+{
+    std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(rehash->ticket);
+    DownloadTask * task = (iter != m_ticketMap.end()) ? iter->second : NULL;
+    if ((task == NULL) || (g_atomic_pointer_get(&task->rehash) != rehash)) {
+        //cancelled or paused meanwhile; a later resume of the ticket has a rehash of its own
+        delete rehash->hash;
+        delete rehash;
+        return;
+    }
+    if (rehash->failed) {
+        LOG_DEBUG ("%s: can't read %llu bytes of %s to hash",__FUNCTION__,(unsigned long long)rehash->bytes,rehash->path.c_str());
+        task->numErrors = DOWNLOADMANAGER_ERRORTHRESHOLD;
+    }
+    delete task->hash;
+    task->hash = rehash->hash;
+    g_atomic_pointer_set(&task->rehash,NULL);
+    delete rehash;
+    resumeThrottledTransfer(task->ticket);
+}
+
+//static
+gboolean DownloadManager::cbRecvSpeedTimer(gpointer userData)
+{
+    DownloadManager * dlm = (DownloadManager *)userData;
+    dlm->m_recvSpeedTimer = 0;
+    dlm->resumeRecvSpeedPaused();
+    return false;
+}
+
+void DownloadManager::resumeRecvSpeedPaused()
+{
+    if (m_recvSpeedTimer != 0) {
+        g_source_remove(m_recvSpeedTimer);
+        m_recvSpeedTimer = 0;
+    }
+    std::vector<unsigned long> paused;
+    paused.swap(m_recvSpeedPaused);
+    for (std::vector<unsigned long>::iterator it = paused.begin(); it != paused.end(); ++it)
+        resumeThrottledTransfer(*it);
+}
+
+uint64_t DownloadManager::ownerRecvSpeed(const std::string& owner)
+{
+    std::map<std::string,uint64_t>::iterator it = m_ownerRecvSpeeds.find(owner);
+    return (it != m_ownerRecvSpeeds.end()) ? it->second : DownloadSettings::instance().ownerMaxRecvSpeed(owner);
+}
+
+/*
+ * Per-download and per-owner limits (maxRecvSpeed, [RecvSpeed] in downloadManager.conf, setRecvSpeed) go onto the
+ * transfers as CURLOPT_MAX_RECV_SPEED_LARGE. An owner's limit is shared out among its running downloads, none of
+ * them getting more than its own limit, and what one of those can't take is shared among the rest. Done again
+ * whenever a download starts or stops or a limit changes, so the shares follow what is running.
+ *
+ */
+void DownloadManager::redistributeRecvSpeeds()
+{
+    std::map<std::string,std::vector<DownloadTask*> > owners;
+    for (std::map<long,DownloadTask*>::iterator it = m_ticketMap.begin(); it != m_ticketMap.end(); ++it) {
+        DownloadTask * task = it->second;
+        if ((task != NULL) && !task->queued && (task->curlDesc.getHandle() != NULL))
+            owners[task->ownerId].push_back(task);
+    }
+
+    glibcurl_lock();
+    for (std::map<std::string,std::vector<DownloadTask*> >::iterator it = owners.begin(); it != owners.end(); ++it) {
+        std::vector<DownloadTask*>& tasks = it->second;
+        std::sort(tasks.begin(),tasks.end(),lowerRecvSpeed);
+        uint64_t ownerLimit = ownerRecvSpeed(it->first);
+        uint64_t left = ownerLimit;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            uint64_t share = tasks[i]->maxRecvSpeed;
+            if (ownerLimit > 0) {
+                uint64_t even = std::max(left / (tasks.size() - i),(uint64_t)1);
+                share = ((share > 0) && (share < even)) ? share : even;
+                left -= std::min(share,left);
+            }
+            if (share != tasks[i]->recvSpeedShare) {
+                tasks[i]->recvSpeedShare = share;
+                applyRecvSpeed(tasks[i]);
+            }
         }
     }
+    glibcurl_unlock();
+}
 
-//  LOG_DEBUG ("%s Function-Exit",__FUNCTION__);
+/*
+ * Splits a download's share of the limits (recvSpeedShare) evenly over its connections. Called with
+ * glibcurl_lock held.
+ *
+ */
+void DownloadManager::applyRecvSpeed(DownloadTask* task)
+{
+    std::vector<CURL*> handles;
+    if (task->curlDesc.getHandle() != NULL)
+        handles.push_back(task->curlDesc.getHandle());
+    for (std::vector<DownloadSegment *>::iterator it = task->segments.begin(); it != task->segments.end(); ++it) {
+        if ((*it)->handle != NULL)
+            handles.push_back((*it)->handle);
+    }
+    //a hedge races the ticket's own request for the same bytes: either may be the one kept, so each may have it all
+    if (task->hedge != NULL)
+        handles.push_back(task->hedge);
+    if (handles.empty())
+        return;
+
+    size_t connections = handles.size() - ((task->hedge != NULL) ? 1 : 0);
+    curl_off_t each = (task->recvSpeedShare == 0) ? 0 : (curl_off_t)std::max(task->recvSpeedShare / std::max(connections,(size_t)1),(uint64_t)1);
+    CURLcode curlSetOptRc;
+    for (std::vector<CURL*>::iterator it = handles.begin(); it != handles.end(); ++it) {
+        if ((curlSetOptRc = curl_easy_setopt(*it, CURLOPT_MAX_RECV_SPEED_LARGE, each)) != CURLE_OK)
+            LOG_DEBUG ("curl set opt: CURLOPT_MAX_RECV_SPEED_LARGE failed [%d]\n",curlSetOptRc);
+    }
+}
+
+/*
+ * Write-behind backlog of every download that has one, for getStats
+ *
+ */
+pbnjson::JValue DownloadManager::diskWriterStats()
+{
+    pbnjson::JValue writer = pbnjson::Object();
+    pbnjson::JValue tasks = pbnjson::Array();
+    uint64_t totalBacklog = 0;
+
+    writer.put("backend", DiskWriter::backendName());
+    writer.put("threads", DiskWriter::threads());
+    writer.put("budgetKB", (int64_t)(DiskWriter::budget() >> 10));
+    writer.put("writes", (int64_t)DiskWriter::writeCount());
+    pbnjson::JValue latency = pbnjson::Object();
+    latency.put("p50", (int64_t)DiskWriter::writeLatencyPercentileUs(50));
+    latency.put("p90", (int64_t)DiskWriter::writeLatencyPercentileUs(90));
+    latency.put("p99", (int64_t)DiskWriter::writeLatencyPercentileUs(99));
+    writer.put("writeLatencyUs", latency);
+
+    glibcurl_lock();
+    for (std::map<long,DownloadTask*>::iterator iter = m_ticketMap.begin(); iter != m_ticketMap.end(); ++iter) {
+        DownloadTask * task = iter->second;
+        if ((task == NULL) || (task->writer == NULL))
+            continue;
+        uint64_t backlog = task->writer->backlog();
+        totalBacklog += backlog;
+
+        pbnjson::JValue entry = pbnjson::Object();
+        entry.put("ticket", (int64_t)task->ticket);
+        entry.put("backlogBytes", (int64_t)backlog);
+        entry.put("throttled", task->writer->throttled());
+        entry.put("throttleCount", (int64_t)task->writer->throttleCount());
+        tasks.append(entry);
+    }
+    glibcurl_unlock();
+
+    writer.put("backlogBytes", (int64_t)totalBacklog);
+    writer.put("tasks", tasks);
+    return writer;
+}
+
+pbnjson::JValue DownloadManager::queueStats()
+{
+    std::vector<DownloadQueue::OwnerStats> owners;
+    m_queue.ownerStats(owners);
+
+    pbnjson::JValue queue = pbnjson::Object();
+    pbnjson::JValue entries = pbnjson::Array();
+    queue.put("queued", (int64_t)m_queue.size());
+    queue.put("quantumKB", (int64_t)DownloadSettings::instance().fairShareQuantumKB);
+    for (size_t i = 0; i < owners.size(); ++i) {
+        const DownloadQueue::OwnerStats& owner = owners[i];
+        pbnjson::JValue entry = pbnjson::Object();
+        entry.put("owner", owner.owner);
+        entry.put("weight", (int64_t)owner.weight);
+        entry.put("maxSlots", (int64_t)owner.maxSlots);
+        entry.put("maxRecvSpeed", (int64_t)ownerRecvSpeed(owner.owner));
+        entry.put("queued", (int64_t)owner.queued);
+        entry.put("running", (int64_t)owner.running);
+        entry.put("started", (int64_t)owner.started);
+        entry.put("waits", (int64_t)owner.waits);
+        entry.put("waitAvgMs", owner.waits ? (double)owner.waitTotalUs / owner.waits / 1000.0 : 0.0);
+        entry.put("waitMaxMs", (double)owner.waitMaxUs / 1000.0);
+        entry.put("bytes", (int64_t)owner.bytes);
+        entry.put("deficitKB", (int64_t)(owner.deficit / 1024));
+        entries.append(entry);
+    }
+    queue.put("owners", entries);
+    return queue;
+}
+
+/*
+ * A resumed transfer starts verifyTail's length before the end of the temp file (resumeDownload); what comes
+ * first is compared with verifyTail instead of being written. Where the two differ (the tail of a write a crash
+ * tore, most likely), the file is cut back to there and the transfer goes on writing from that byte; if the
+ * download has a hash, that is taken over what is left on a worker (rehashPrefix()) and the rest of the payload
+ * waits for it. Returns how much of the payload was compared; the rest is new. Transfer thread, before anything
+ * has been written on this resume (so before task->writer exists); the outcome goes to the main thread as a
+ * RESUME_VERIFIED event, which counts it (resumeVerified).
+ *
+ */
+size_t DownloadManager::verifyResume(DownloadTask* task, const unsigned char* payload, size_t payloadSize)
+{
+    size_t left = task->verifyTail.size() - task->verifyPos;
+    size_t len = std::min(left,payloadSize);
+    const unsigned char * local = &task->verifyTail[task->verifyPos];
+    size_t same = std::mismatch(payload,payload + len,local).first - payload;
+    if (same == len) {
+        task->verifyPos += len;
+        if (task->verifyPos == task->verifyTail.size()) {
+            if (m_transferEvents.push(new TransferEvent(task->ticket,0,false)))
+                g_idle_add(cbTransferEvents,this);
+            std::vector<unsigned char>().swap(task->verifyTail);
+            task->verifyPos = 0;
+        }
+        return len;
+    }
+
+    uint64_t dropped = left - same;
+    task->bytesCompleted -= dropped;
+    off64_t keep = (off64_t)(task->bytesCompleted - task->initialOffsetBytes);
+    if ((ftruncate64(fileno(task->fp),keep) != 0) || (fseeko64(task->fp,keep,SEEK_SET) != 0)) {
+        LOG_DEBUG ("%s: can't cut ticket %lu back to %lld bytes [%d]",__FUNCTION__,task->ticket,(long long)keep,errno);
+        task->numErrors = DOWNLOADMANAGER_ERRORTHRESHOLD;
+    }
+    task->syncedTo = std::min(task->syncedTo,keep);
+    task->droppedTo = std::min(task->droppedTo,keep);
+    task->lastSyncAt = std::min(task->lastSyncAt,task->bytesCompleted);
+    task->lastUpdateAt = std::min(task->lastUpdateAt,task->bytesCompleted);
+    bool rehashed = (task->hash != NULL);
+    if (rehashed) {
+        StreamHash * hash = StreamHash::create(task->hash->algorithmName());
+        delete task->hash;
+        task->hash = NULL;
+        rehashPrefix(task,hash,task->destPath + task->downloadPrefix + task->destFile,keep);
+    }
+    if (m_transferEvents.push(new TransferEvent(task->ticket,dropped,rehashed)))
+        g_idle_add(cbTransferEvents,this);
+    LOG_WARNING_PAIRS_ONLY (LOGID_DOWNLOAD_RESUME, 3,
+        PMLOGKFV("ticket", "%lu", task->ticket),
+        PMLOGKFV("bytes", "%llu", (unsigned long long)dropped),
+        PMLOGKS("reason", "end of the partial file differs from the server's; cut back and fetched again"));
+
+    std::vector<unsigned char>().swap(task->verifyTail);
+    task->verifyPos = 0;
+    return same;
 }
 
 size_t DownloadManager::cbWriteEvent (CURL * taskHandle,size_t payloadSize,unsigned char * payload)
@@ -1565,9 +3585,100 @@ size_t DownloadManager::cbWriteEvent (CURL * taskHandle,size_t payloadSize,unsig
     }
     DownloadTask * task = _task->p_downloadTask;
 
+    if (task->firstByteUs == 0)
+        task->firstByteUs = g_get_monotonic_time();
+    //the hash is being taken over the file again (rehashPrefix()); curl offers this payload again once prefixRehashed()
+    //has unpaused the transfer
+    if (g_atomic_pointer_get(&task->rehash) != NULL)
+        return CURL_WRITEFUNC_PAUSE;
+    if (task->hedge != NULL) {
+        //hedged: whichever of the two requests brings data first is kept, the other one is dropped
+        if (task->hedgeWinner == NULL) {
+            task->hedgeWinner = taskHandle;
+            if (m_transferEvents.push(new TransferEvent(TransferEvent::HEDGE_DECIDED,task->ticket)))
+                g_idle_add(cbTransferEvents,this);
+        }
+        else if (task->hedgeWinner != taskHandle) {
+            return 0;
+        }
+    }
+
+    //MaxRecvSpeed: with nothing left for it the transfer pauses, and curl offers this payload again once
+    //resumeRecvSpeedPaused() has unpaused it. What the disk writer turned away has been let through already
+    size_t prepaid = std::min(task->recvPrepaid,payloadSize);
+    if ((payloadSize > prepaid) && !m_recvBucket.take(payloadSize - prepaid)) {
+        if (m_transferEvents.push(new TransferEvent(TransferEvent::RECV_SPEED_PAUSED,task->ticket)))
+            g_idle_add(cbTransferEvents,this);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    task->recvPrepaid -= prepaid;
+    size_t received = payloadSize;
+
     //write to file if the fp is not null
     size_t nwritten = 0;
-    if (task->fp) {
+    DownloadSegment * segment = NULL;
+    //a resume gets the end of what the file has again first: that is compared, not written. The writer doesn't exist
+    //before the first write, so the rest of this payload can't be turned away (CURL_WRITEFUNC_PAUSE) below
+    size_t verified = 0;
+    if (task->rehashSkip > 0) {
+        //offered again after the rehash a mismatch started; what was compared of it is still in the file
+        verified = std::min(task->rehashSkip,payloadSize);
+        task->rehashSkip = 0;
+    }
+    else if ((task->verifyPos < task->verifyTail.size()) && (task->fp != NULL)) {
+        verified = verifyResume(task,payload,payloadSize);
+        if (verified == payloadSize)
+            return payloadSize;
+        if (g_atomic_pointer_get(&task->rehash) != NULL) {
+            //the rest waits for the hash to be taken over what was kept; curl offers all of it again
+            task->rehashSkip = verified;
+            task->recvPrepaid += received;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+    }
+    payload += verified;
+    payloadSize -= verified;
+    if (task->isSplit()) {
+        //one of the connections gave up; the rest stop too and the ticket is interrupted (transferDone)
+        if (task->segmentResult != CURLE_OK)
+            return 0;
+
+        segment = task->segmentFor(taskHandle);
+        if (segment != NULL) {
+            payloadSize = writeSegment(task,segment,taskHandle,payload,payloadSize);
+            if (payloadSize == CURL_WRITEFUNC_PAUSE)
+                task->recvPrepaid += received;
+            if ((payloadSize == 0) || (payloadSize == CURL_WRITEFUNC_PAUSE))
+                return payloadSize;
+            goto Written_cbWriteEvent;
+        }
+
+        //the ticket's own connection stops where the first segment starts; the short return below ends it
+        if (task->primaryPos >= task->primaryEnd) {
+            task->primaryFilled = true;
+            return 0;
+        }
+        payloadSize = (size_t)std::min((uint64_t)payloadSize,task->primaryEnd - task->primaryPos);
+    }
+
+    if (task->fp && DiskWriter::enabled()) {
+        //hand it to the write-behind stage; the disk is never waited on here
+        if (task->writer == NULL)
+            task->writer = new DiskWriter(task->ticket,fileno(task->fp),ftello64(task->fp));
+
+        if (task->writer->failed()) {
+            task->numErrors = DOWNLOADMANAGER_ERRORTHRESHOLD;
+        }
+        else if (!task->writer->queue(payload,payloadSize)) {
+            //backlog over budget...curl keeps this payload and offers it again after resumeThrottledTransfer()
+            task->recvPrepaid += received;
+            return CURL_WRITEFUNC_PAUSE;
+        }
+        else {
+            nwritten = payloadSize;
+        }
+    }
+    else if (task->fp) {
         nwritten = fwrite(payload,1,payloadSize,task->fp);
         if ((nwritten < (size_t)payloadSize))
         {
@@ -1586,8 +3697,49 @@ size_t DownloadManager::cbWriteEvent (CURL * taskHandle,size_t payloadSize,unsig
         goto Return_cbWriteEvent;
     }
 
-    //update the bytesCompleted
+    //hashed as it comes, so the file never has to be read again for it (a hashed download is never split)
+    if (task->hash != NULL)
+        task->hash->update(payload,payloadSize);
+
+    if (segment == NULL && task->isSplit()) {
+        task->primaryPos += payloadSize;
+        task->primaryFilled = (task->primaryPos >= task->primaryEnd);
+    }
+    if ((segment == NULL) && task->hasMirrors())
+        task->sourceBytes[0] += payloadSize;
+
+Written_cbWriteEvent:
+
+    //update the bytesCompleted (all of the connections' together, for a split download)
     task->bytesCompleted += payloadSize;
+
+    //streaming downloads get the writeback whatever their durability, so their pages can be dropped behind it
+    if ((task->durability == DURABILITY_INTERVAL) || task->streaming) {
+        gint64 now = g_get_monotonic_time();
+        if (task->lastSyncTimeUs == 0)
+            task->lastSyncTimeUs = now;
+        bool due = (task->bytesCompleted - task->lastSyncAt >= ((uint64_t)DownloadSettings::instance().durabilitySyncMB << 20));
+        if (task->durability == DURABILITY_INTERVAL)
+            due = due || (now - task->lastSyncTimeUs >= (gint64)DownloadSettings::instance().durabilitySyncSeconds * G_USEC_PER_SEC);
+        if (due) {
+            if (task->writer) {
+                task->writer->requestSync(task->streaming);
+                for (std::vector<DownloadSegment *>::iterator it = task->segments.begin(); it != task->segments.end(); ++it) {
+                    if ((*it)->writer)
+                        (*it)->writer->requestSync(task->streaming);
+                }
+            }
+            else {
+                if (fflush(task->fp) != 0) {
+                    LOG_DEBUG ("Function fflush() failed");
+                }
+                DiskWriter::writebackRange(fileno(task->fp),task->syncedTo,ftello64(task->fp),
+                                           task->streaming ? &task->droppedTo : NULL);
+            }
+            task->lastSyncAt = task->bytesCompleted;
+            task->lastSyncTimeUs = now;
+        }
+    }
 //    LOG_DEBUG ("%s: Task bytes completed now = %ld",__FUNCTION__,task->bytesCompleted);
 
     if ((task->lastUpdateAt == 0) || (task->bytesCompleted - task->lastUpdateAt >= task->updateInterval)) {
@@ -1610,10 +3762,7 @@ size_t DownloadManager::cbWriteEvent (CURL * taskHandle,size_t payloadSize,unsig
             +e_bytesTotalStr + std::string("\"")
             +std::string(" }");
 
-        if (fdatasync(fileno(task->fp)) != 0) {
-            LOG_DEBUG ("Function fdatasync() failed");
-        }
-        if (!postDownloadUpdate (task->ownerId, task->ticket, response)) {
+        if (!postTransferProgress (task->ownerId, task->ticket, response)) {
             LOG_WARNING_PAIRS (LOGID_SUBSCRIPTIONREPLY_FAIL_ON_WRITEDATA, 2, PMLOGKS("ticket", key.c_str()),
                                                                             PMLOGKS("detail", response.c_str()),
                                                                             "failed to update write-progress to subscribers");
@@ -1628,7 +3777,7 @@ size_t DownloadManager::cbWriteEvent (CURL * taskHandle,size_t payloadSize,unsig
 Return_cbWriteEvent:
 
 //  LOG_DEBUG ("%s Function-Exit",__FUNCTION__);
-    return payloadSize;
+    return (payloadSize == 0) ? 0 : verified + payloadSize;
 }
 
 size_t DownloadManager::cbReadEvent(CURL* taskHandle,size_t payloadSize,unsigned char * payload)
@@ -1700,7 +3849,7 @@ size_t DownloadManager::cbReadEvent(CURL* taskHandle,size_t payloadSize,unsigned
                 +std::string(" , \"e_amountTotal\":\"")+e_bytesTotalStr + std::string("\"")
                 +std::string(" }");
 
-        if (!postDownloadUpdate (task->ownerId, task->ticket, response)) {
+        if (!postTransferProgress (task->ownerId, task->ticket, response)) {
             LOG_WARNING_PAIRS (LOGID_SUBSCRIPTIONREPLY_FAIL_ON_READDATA, 2, PMLOGKS("ticket", key.c_str()),
                                                                             PMLOGKS("detail", response.c_str()),
                                                                             "failed to update read-progress to subscribers");
@@ -1749,8 +3898,8 @@ void DownloadManager::completed (TransferTask * task)
         return;
     }
 
-    if (task->type == TransferTask::DOWNLOAD_TASK)
-        completed_dl(task->p_downloadTask);
+    if ((task->type == TransferTask::DOWNLOAD_TASK) && !completed_dl(task->p_downloadTask))
+        task->p_downloadTask = NULL;        //its file is still being finished; finishedDownload() deletes it
     if (task->type == TransferTask::UPLOAD_TASK)
         completed_ul(task->p_uploadTask);
 
@@ -1759,16 +3908,32 @@ void DownloadManager::completed (TransferTask * task)
 //  LOG_DEBUG ("%s Function-Exit",__FUNCTION__);
 }
 
-void DownloadManager::completed_dl(DownloadTask* task)
+/*
+ * false: the DiskWriter (or, for a 304 from the content store, the store's thread) is finishing off the file in
+ * the background and the task must be kept around until finishedDownload() gets it back
+ *
+ */
+bool DownloadManager::completed_dl(DownloadTask* task)
 {
     if (task == NULL)
-        return;
+        return true;
 
-    LSError lserror;
     bool transferError=false;
     bool interrupted=false;
-    //close the file being written to
+    //let the write-behind backlog hit the file first; whatever didn't make it turns this into a write error
+    uint64_t lostBytes = task->closeWriter();
+    if (lostBytes > 0) {
+        task->bytesCompleted -= std::min(lostBytes,task->bytesCompleted);
+        if (task->curlDesc.getResultCode() == CURLE_OK) {
+            task->curlDesc.setResultCode(CURLE_WRITE_ERROR);
+        }
+    }
+    //a split download that didn't get everything is left the way a resume expects it
+    task->trimToContiguous();
+    //close the file being written to; fd stays open for syncing it, further down
+    int fd = -1;
     if (task->fp) {
+        fd = dup(fileno(task->fp));
         if (fclose(task->fp) != 0) {
             LOG_DEBUG ("function fclose() failed");
         }
@@ -1786,61 +3951,66 @@ void DownloadManager::completed_dl(DownloadTask* task)
         LOG_DEBUG ("HTTP status code was %ld, HTTP connect code was %ld",resultCode,httpConnectCode);
 
         //now handle specific http error codes, or at least the ones I can do something about
-        if ((resultCode == 301) || (resultCode == 302) || (resultCode == 303) || (resultCode == 307)) {
+        if ((resultCode == 304) && !task->revalidateTarget.empty()) {
 
-            // Counting redirections to avoid an infinite loop for redirections
-            task->decreaseRedCounts();
+            //not modified: the file the last download of the url left is the result, the one opened for this goes
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+            Utils::remove_file(task->destPath + task->downloadPrefix + task->destFile);
 
-            LOG_DEBUG ("remainRedirections : %d", task->getRemainingRedCounts());
+            size_t slash = task->revalidateTarget.rfind('/');
+            task->destPath = task->revalidateTarget.substr(0,slash + 1);
+            task->destFile = task->revalidateTarget.substr(slash + 1);
+            task->downloadPrefix = "";
+            struct stat targetStat;
+            if (stat(task->revalidateTarget.c_str(),&targetStat) == 0) {
+                task->bytesCompleted = targetStat.st_size;
+                task->bytesTotal = targetStat.st_size;
+            }
+            task->revalidated = true;
+            m_transferStats.revalidated++;
+            LOG_DEBUG ("%s: ticket %lu: %s not modified",__FUNCTION__,task->ticket,task->revalidateTarget.c_str());
+            reportCompletedDownload(task,resultCode,httpResultCode,false,false,0);
+            return true;
+        }
+        else if ((resultCode == 304) && !task->storedContent.empty()) {
 
-            if (task->getRemainingRedCounts() == 0)
-            {
-                LOG_DEBUG ("It has been completed to try maximum of redirections 5.");
-                if (!cancel(task->ticket)) {
-                    LOG_DEBUG ("Function cancel() failed: id(%lu)", task->ticket);
-                }
-                return;
+            //not modified: the target becomes a reflink or copy of the content store's, in place of the file opened for this.
+            //A copy can take a while; it is made on the store's thread, and finishedDownload() reports the download
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
             }
+            Utils::remove_file(task->destPath + task->downloadPrefix + task->destFile);
 
-            //HTTP Redirect. If there was a "Location" specified in the headers, then go try it. Otherwise, it's an error
-            if (task->httpHeader_Location != std::string("")) {
-                //delete the "downloaded" file...probably just a fragment of html that was sent by the server as an informative "moved" message.
-                //since I'm not a browser, i'll ignore this
-                std::string oldfile = task->destPath +task->destFile;
-                int ret = g_remove((const gchar *)(oldfile.c_str()));
+            FinishingDownload * finishing = new FinishingDownload(task,resultCode,httpResultCode,false,false);
+            ContentStore::place(task->storedContent,task->destPath + task->destFile,&DownloadManager::cbFileFinished,finishing);
+            return false;
+        }
+        else if (isRedirectCode(resultCode) && (task->curlDesc.getResultCode() == CURLE_TOO_MANY_REDIRECTS)) {
 
-                if (0 != ret) {
-                    //LOG_DEBUG ("DownloadManager::completed_dl : g_remove error");
-                }
+            //curl followed the others; whatever got written is thrown away
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
 
-                //LOG_DEBUG ("Redirect to [%s]... restarting download\n",task->httpHeader_Location.c_str());
-                if (task->opt_keepOriginalFilenameOnRedirect == false)
-                    task->destFile = std::string("");
-
-                //LOG_DEBUG ("task: location [%s], destPath [%s], destFile [%s], ticket [%lu]\n",
-                //      task->httpHeader_Location.c_str(),task->destPath.c_str(),task->destFile.c_str(), task->ticket);
-                ret = download (task->ownerId,
-                        task->httpHeader_Location,
-                        task->detectedMIMEType,
-                        task->destPath,
-                        task->destFile,
-                        task->ticket,
-                        task->opt_keepOriginalFilenameOnRedirect,
-                        std::string(""),
-                        std::string(""),
-                        DownloadManager::connectionName2Id(task->connectionName),
-                        task->canHandlePause,
-                        task->autoResume,
-                        task->appendTargetFile,
-                        task->cookieHeader,
-                        task->rangeSpecified,
-                        task->getRemainingRedCounts());
-                if (ret < 0) {
-                    LOG_DEBUG ("Function download() is failed (%d)", ret);
-                }
-                LOG_DEBUG ("[REDIRECT] ticket [%s] is now [%lu]",(task->httpHeader_Location).c_str(),(task->ticket));
-                return;
+            LOG_DEBUG ("It has been completed to try maximum of redirections %d.", task->getRemainingRedCounts());
+            if (!cancel(task->ticket)) {
+                LOG_DEBUG ("Function cancel() failed: id(%lu)", task->ticket);
+            }
+            return true;
+        }
+        else if (isRedirectCode(resultCode) && !task->authToken.empty() && (task->curlDesc.getResultCode() == CURLE_OK)) {
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
             }
+            if (followRedirect(task))
+                return true;
+            //no Location: an error like any other 3xx
         }
         else if (resultCode >= 400) {
             LOG_DEBUG ("DownloadManager::completed(): Transfer error: HTTP error code = %d\n",(int)resultCode);
@@ -1861,6 +4031,13 @@ void DownloadManager::completed_dl(DownloadTask* task)
             transferError = false;
             interrupted = true;
         }
+        else if ((resultCode == CURLE_WRITE_ERROR) && task->diskFull)
+        {
+            //refused up front; a resume keeps what it already has, for when space has been freed up
+            resultCode = DOWNLOADMANAGER_COMPLETIONSTATUS_FILESYSTEMFULL;
+            transferError = (task->bytesCompleted == 0);
+            interrupted = !transferError;
+        }
         else if (resultCode == CURLE_WRITE_ERROR)
         {
             resultCode = DOWNLOADMANAGER_COMPLETIONSTATUS_WRITEERROR;
@@ -1893,9 +4070,149 @@ void DownloadManager::completed_dl(DownloadTask* task)
         resultCode = DOWNLOADMANAGER_COMPLETIONSTATUS_GENERALERROR;
     }
 
+    //the hash is complete with the last byte; one that isn't what was expected fails here, before it gets its name
+    if (!transferError && !interrupted && !checkHash(task)) {
+        resultCode = DOWNLOADMANAGER_COMPLETIONSTATUS_HASHMISMATCH;
+        transferError = true;
+    }
+
+    //one that was redirected is named after where it ended up, as if it had been asked for from there
+    if (!transferError && !interrupted && task->redirected && !task->opt_keepOriginalFilenameOnRedirect) {
+        UrlRep parsedUrl = UrlRep::fromUrl(task->url.c_str());
+        if (parsedUrl.valid && !parsedUrl.resource.empty() && (parsedUrl.resource != task->destFile)) {
+            std::string newFile = uniqueFileName(task->destPath,task->downloadPrefix,parsedUrl.resource);
+            std::string oldPath = task->destPath + task->downloadPrefix + task->destFile;
+            std::string newPath = task->destPath + task->downloadPrefix + newFile;
+            if (rename(oldPath.c_str(),newPath.c_str()) == 0)
+                task->destFile = newFile;
+            else
+                LOG_DEBUG ("[REDIRECT] ticket [%lu]: can't rename %s to %s [%d]",task->ticket,oldPath.c_str(),newPath.c_str(),errno);
+        }
+    }
+    cacheRedirect(task,!transferError && !interrupted);
+
+    //onto the disk, if the download's durability asks for it (an unsuccessful end may get resumed), then to the final name
+    bool syncIt = (task->durability >= DURABILITY_PAUSE)
+                    || (!transferError && !interrupted && (task->durability == DURABILITY_COMPLETION));
+    bool renameIt = !transferError && !interrupted && !task->downloadPrefix.empty();
+    std::string tempPath = task->destPath + task->downloadPrefix + task->destFile;
+    std::string finalPath = task->destPath + task->destFile;
+
+    if (fd >= 0) {
+        FinishingDownload * finishing = new FinishingDownload(task,resultCode,httpResultCode,transferError,interrupted);
+        if (DiskWriter::finishFile(fd, syncIt, renameIt ? tempPath : std::string(""), finalPath,
+                                   &DownloadManager::cbFileFinished, finishing)) {
+            return false;
+        }
+        delete finishing;
+
+        if (syncIt && (fdatasync(fd) != 0)) {
+            LOG_DEBUG ("Function fdatasync() failed");
+        }
+        if (close(fd) != 0) {
+            LOG_DEBUG ("function close() failed");
+        }
+    }
+
+    int renameError = 0;
+    if (renameIt && (rename(tempPath.c_str(), finalPath.c_str()) != 0))
+        renameError = errno;
+
+    reportCompletedDownload(task,resultCode,httpResultCode,transferError,interrupted,renameError);
+    return true;
+}
+
+//static
+//on the DiskWriter's io_uring thread, or the content store's
+void DownloadManager::cbFileFinished(void * data, int renameError)
+{
+    DownloadManager& dlm = DownloadManager::instance();
+    FinishingDownload * finishing = (FinishingDownload *)data;
+    finishing->renameError = renameError;
+    if (dlm.m_transferEvents.push(new TransferEvent((void *)finishing)))
+        g_idle_add(cbTransferEvents,&dlm);
+}
+
+/*
+ * Finishes the hash of a download that asked for one; false if it didn't come to its expectedHash
+ *
+ */
+bool DownloadManager::checkHash(DownloadTask* task)
+{
+    if (task->hash == NULL)
+        return true;
+
+    task->hashValue = task->hash->digest();
+    delete task->hash;
+    task->hash = NULL;
+    if (task->expectedHash.empty())
+        return true;
+
+    if (task->hashValue != task->expectedHash) {
+        m_transferStats.hashMismatches++;
+        LOG_WARNING_PAIRS (LOGID_DOWNLOAD_FAIL, 3, PMLOGKFV("ticket", "%lu", task->ticket),
+                                                   PMLOGKS("expected", task->expectedHash.c_str()),
+                                                   PMLOGKS("hash", task->hashValue.c_str()),
+                                                   "download doesn't match its expected hash");
+        return false;
+    }
+    m_transferStats.hashesVerified++;
+    return true;
+}
+
+//static
+//a completed download went into the content store, or was replaced by a reflink to what it had
+void DownloadManager::cbContentStored(const std::string& url, const std::string& etag, const std::string& lastModified,
+                                      const std::string& sha256, uint64_t deduplicated)
+{
+    DownloadManager& dlm = DownloadManager::instance();
+    if (deduplicated > 0) {
+        dlm.m_transferStats.storeDedups++;
+        dlm.m_transferStats.storeBytesSaved += deduplicated;
+    }
+    if (!url.empty() && (!etag.empty() || !lastModified.empty()))
+        dlm.m_pDlDb->addStoredContent(url,etag,lastModified,sha256);
+}
+
+void DownloadManager::finishedDownload(FinishingDownload * finishing)
+{
+    //a 304 with the content store's copy put in place (completed_dl()): a failed copy is reported by its renameError
+    DownloadTask * task = finishing->task;
+    if ((finishing->httpResultCode == 304) && !task->storedContent.empty()) {
+        std::string finalPath = task->destPath + task->destFile;
+        struct stat targetStat;
+        if (finishing->renameError != 0) {
+            LOG_DEBUG ("%s: ticket %lu: can't copy %s to %s [%d]",__FUNCTION__,task->ticket,
+                        task->storedContent.c_str(),finalPath.c_str(),finishing->renameError);
+        }
+        else {
+            if (stat(finalPath.c_str(),&targetStat) == 0) {
+                task->bytesCompleted = targetStat.st_size;
+                task->bytesTotal = targetStat.st_size;
+            }
+            m_transferStats.storeHits++;
+            m_transferStats.storeBytesSaved += task->bytesCompleted;
+            LOG_DEBUG ("%s: ticket %lu: %s not modified, linked from %s",__FUNCTION__,task->ticket,
+                        finalPath.c_str(),task->storedContent.c_str());
+        }
+    }
+    reportCompletedDownload(finishing->task,finishing->resultCode,finishing->httpResultCode,
+                            finishing->transferError,finishing->interrupted,finishing->renameError);
+    delete finishing->task;
+    delete finishing;
+}
+
+/*
+ * Second half of completed_dl(), once the file is where it's going to be: history, subscribers, and the next queued download
+ *
+ */
+void DownloadManager::reportCompletedDownload(DownloadTask* task, long resultCode, long httpResultCode, bool transferError,
+                                              bool interrupted, int renameError)
+{
+    LSError lserror;
     pbnjson::JValue payloadJsonObj = task->toJSON();
 
-    //if transfer error, get rid of the file, otherwise rename to the final name
+    //if transfer error, get rid of the file; it has been renamed to the final name otherwise
 
     if (transferError) {            //TODO: key on whether resultCode was a connection-establish related error, rather than bytesTotal=0. This works for now because bytesTotal
                                     // is only populated if the server was successfully contacted at least long enough to get headers
@@ -1904,31 +4221,11 @@ void DownloadManager::completed_dl(DownloadTask* task)
         payloadJsonObj.put("errorCode", (int)task->curlDesc.getResultCode());
         payloadJsonObj.put("errorText", curl_easy_strerror(task->curlDesc.getResultCode()));
         }
-    else if (!task->downloadPrefix.empty() && !interrupted) {
-        //LOG_DEBUG ("renaming %s to %s", std::string(task->destPath + task->downloadPrefix + task->destFile).c_str(),
-        //      std::string(task->destPath+task->destFile).c_str());
-
-        int retVal = rename( std::string(task->destPath + task->downloadPrefix + task->destFile).c_str(),
-                std::string(task->destPath + task->destFile).c_str());
-
-        if (0 != retVal) {
-            LOG_DEBUG ("renaming failed, setting file system error (%d)", DOWNLOADMANAGER_COMPLETIONSTATUS_FILESYSTEMERROR);
-            Utils::remove_file(task->destPath + task->downloadPrefix + task->destFile);
-            transferError = true;
-            resultCode = DOWNLOADMANAGER_COMPLETIONSTATUS_FILESYSTEMERROR;
-        }
-
-        // file sync after rename()
-        FILE *fp = fopen(std::string(task->destPath + task->destFile).c_str(), "r+b");
-        if (fp) {
-            if (fdatasync(fileno(fp)) != 0) {
-                LOG_DEBUG ("Function fdatasync() failed");
-            }
-            if (fclose(fp) != 0) {
-                LOG_DEBUG ("Function fclose() failed");
-            }
-            fp = NULL;
-        }
+    else if (renameError != 0) {
+        LOG_DEBUG ("renaming failed (%d), setting file system error (%d)", renameError, DOWNLOADMANAGER_COMPLETIONSTATUS_FILESYSTEMERROR);
+        Utils::remove_file(task->destPath + task->downloadPrefix + task->destFile);
+        transferError = true;
+        resultCode = DOWNLOADMANAGER_COMPLETIONSTATUS_FILESYSTEMERROR;
     }
 
     if ( !transferError && !interrupted && (httpResultCode == 200 || httpResultCode == 206) )
@@ -1968,11 +4265,29 @@ void DownloadManager::completed_dl(DownloadTask* task)
     }
     payloadJsonObj.put("interrupted", interrupted);
     payloadJsonObj.put("completed", !(interrupted));
+    payloadJsonObj.put("revalidated", task->revalidated);
     payloadJsonObj.put("aborted", false);
     payloadJsonObj.put("target", dest);
 
     payload = JUtil::toSimpleString(payloadJsonObj);
 
+    //a whole file fresh from the server: what a later "revalidate" download of the url asks the server about
+    if (!transferError && !interrupted && (httpResultCode == 200) && !task->appendTargetFile
+            && (task->rangeSpecified.second == 0) && !task->requestedUrl.empty()
+            && (!task->etag.empty() || !task->lastModified.empty())) {
+        struct stat destStat;
+        if (stat(dest.c_str(),&destStat) == 0)
+            m_pDlDb->addValidators(task->ownerId,task->requestedUrl,task->etag,task->lastModified,dest,destStat.st_size,mtimeNsOf(destStat));
+    }
+    //...and what goes into the content store, or is reflinked to what it has already, if it asked for that
+    if (!transferError && !interrupted && (httpResultCode == 200) && task->useContentStore && !task->appendTargetFile
+            && (task->rangeSpecified.second == 0)) {
+        ContentStore::add(dest,task->requestedUrl,task->etag,task->lastModified,
+                          (task->hashAlgorithm == "sha256") ? task->hashValue : std::string(""));
+    }
+
+    if (interrupted && (task->hash != NULL))
+        payloadJsonObj.put("hashState", task->hash->state());
     std::string historyString = JUtil::toSimpleString(payloadJsonObj);
     //add to database record
     if (interrupted)
@@ -1992,24 +4307,7 @@ void DownloadManager::completed_dl(DownloadTask* task)
 
 
 
-    if (!m_queue.empty() && m_activeTaskCount < DownloadSettings::instance().maxDownloadManagerConcurrent) {
-        unsigned long queuedTicket = m_queue.front();
-        m_queue.pop_front();
-        std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(queuedTicket);
-        if (iter != m_ticketMap.end()) {
-            DownloadTask* nextDownload = iter->second;
-            nextDownload->queued = false;
-            m_activeTaskCount++;
-            requestWakeLock(true);
-            if (glibcurl_add(nextDownload->curlDesc.getHandle()) != 0) {
-                LOG_DEBUG ("Function glibcurl_add() failed");
-            }
-            //LOG_DEBUG ("%s: un-Q-ing a task, starting download of ticket [%lu] for url [%s]\n", __PRETTY_FUNCTION__,
-            //      nextDownload->ticket, nextDownload->url.c_str());
-            m_pDlDb->addHistory(nextDownload->ticket,nextDownload->ownerId,task->connectionName,"running",nextDownload->toJSONString());
-        }
-    }
-    else if (m_queue.empty() && m_activeTaskCount == 0) {
+    if (!startNextQueued() && m_queue.empty() && m_activeTaskCount == 0) {
         if (g_idle_add (DownloadManager::cbIdleSourceGlibcurlCleanup, this) == 0) {
             LOG_DEBUG ("Function g_idle_add() failed");
         }
@@ -2036,11 +4334,29 @@ void DownloadManager::completed_ul(UploadTask* task)
 gboolean DownloadManager::cbIdleSourceGlibcurlCleanup (gpointer data)
 {
     DownloadManager* dlm = (DownloadManager*) data;
+    if (dlm->m_queue.empty() && dlm->m_activeTaskCount == 0) {
+        //the restart drops the engines' idle connections, so give the next download a while to reuse them
+        unsigned int seconds = DownloadSettings::instance().idleRestartSeconds;
+        if (dlm->m_idleRestartTimer != 0)
+            g_source_remove(dlm->m_idleRestartTimer);
+        dlm->m_idleRestartTimer = 0;
+        if (seconds == 0)
+            cbIdleRestartTimer(dlm);
+        else
+            dlm->m_idleRestartTimer = g_timeout_add_seconds(seconds, cbIdleRestartTimer, dlm);
+        dlm->requestWakeLock(false);
+    }
+    return false;
+}
+
+gboolean DownloadManager::cbIdleRestartTimer (gpointer data)
+{
+    DownloadManager* dlm = (DownloadManager*) data;
+    dlm->m_idleRestartTimer = 0;
     if (dlm->m_queue.empty() && dlm->m_activeTaskCount == 0) {
         LOG_DEBUG ("%s: Restarting glibcurl for cleanup", __PRETTY_FUNCTION__);
         dlm->shutdownGlibCurl();
         dlm->startupGlibCurl();
-        dlm->requestWakeLock(false);
     }
     return false;
 }
@@ -2105,22 +4421,7 @@ bool DownloadManager::cancel( unsigned long ticket )
     delete _task;
 
     // if an active task has been cancelled, the next download should start
-    if (!m_queue.empty() && (m_activeTaskCount < DownloadSettings::instance().maxDownloadManagerConcurrent)) {
-        unsigned long queuedTicket = m_queue.front();
-        m_queue.pop_front();
-        std::map<long,DownloadTask*>::iterator iter = m_ticketMap.find(queuedTicket);
-        if (iter != m_ticketMap.end()) {
-        DownloadTask* nextDownload = iter->second;
-        nextDownload->queued = false;
-        m_activeTaskCount++;
-        requestWakeLock(true);
-        if (glibcurl_add(nextDownload->curlDesc.getHandle()) != 0) {
-            LOG_DEBUG ("Function glibcurl_add() failed");
-        }
-        //LOG_DEBUG ("%s: starting download of ticket [%lu] for url [%s]\n", __PRETTY_FUNCTION__,
-        //      nextDownload->ticket, nextDownload->url.c_str());
-        }
-    }
+    startNextQueued();
     return true;
 }
 
@@ -2215,6 +4516,9 @@ void DownloadManager::cancelAll()
 
 int DownloadManager::getJSONListOfAllDownloads(std::vector<std::string>& downloadList) {
 
+    //the curl callbacks update the tasks; keep them out while reading
+    glibcurl_lock();
+
     //walk one of the download maps via an iterator
     std::map<long,DownloadTask*>::iterator iter = m_ticketMap.begin();
     int i =0;
@@ -2235,6 +4539,7 @@ int DownloadManager::getJSONListOfAllDownloads(std::vector<std::string>& downloa
         iter++;
         ++i;
     }
+    glibcurl_unlock();
     return i;
 }
 
@@ -2364,19 +4669,25 @@ TransferTask * DownloadManager::removeTask_dl(uint32_t ticket) {
         }
         // only decrement the active task count if this was in fact downloading
         m_activeTaskCount--;
+        m_queue.ended(task->ownerId,task->bytesCompleted - std::min(task->bytesAtStart,task->bytesCompleted));
+        redistributeRecvSpeeds();
     }
     else {
         m_queue.remove(task->ticket);
     }
 
+    //a split download's segments, or a hedged one's second request, were duplicated from the handle, header list and all
+    stopSegments(task);
+    settleHedge(task,task->curlDesc.getHandle());
+
     //if the curl handle had a header list associated w/ it, free it
     struct curl_slist * headerList;
     if ( (headerList = task->curlDesc.getHeaderList()) != NULL) {
         curl_slist_free_all(headerList);
     }
 
-    //clean it curl-wise
-    curl_easy_cleanup(task->curlDesc.getHandle());
+    //back to the pool with it, once it is safe to (see releaseDownloadHandle())
+    releaseDownloadHandle(task->curlDesc.getHandle());
 
     //now that it is no longer valid, mark it null
     if (!task->curlDesc.setHandle(NULL)) {
@@ -2434,6 +4745,11 @@ TransferTask * DownloadManager::getTask(CURL * handle)
     if (handle == NULL)
         return NULL;
 
+    //every handle carries its task; the curl callbacks (maybe on the transfer thread) never need the map
+    char * priv = NULL;
+    if ((curl_easy_getinfo(handle, CURLINFO_PRIVATE, &priv) == CURLE_OK) && (priv != NULL))
+        return (TransferTask *)priv;
+
     CurlDescriptor cd(handle);
     std::map<CurlDescriptor,TransferTask*>::iterator iter = m_handleMap.find(cd);
     if (iter == m_handleMap.end())
@@ -2469,6 +4785,7 @@ bool DownloadManager::getDownloadTaskCopy(unsigned long ticket,DownloadTask& tas
         return false;
     }
 
+    glibcurl_lock();
     task.curlDesc = ptrFoundTask->curlDesc;
     task.bytesCompleted = ptrFoundTask->bytesCompleted;
     task.bytesTotal = ptrFoundTask->bytesTotal;
@@ -2477,6 +4794,7 @@ bool DownloadManager::getDownloadTaskCopy(unsigned long ticket,DownloadTask& tas
     task.ticket = ptrFoundTask->ticket;
     task.url = ptrFoundTask->url.c_str();                   //Prevent CoW  (DEBUGGING)
     task.setMimeType(ptrFoundTask->detectedMIMEType);   //Prevent CoW  (DEBUGGING)
+    glibcurl_unlock();
 
     return true;
 }
@@ -2631,31 +4949,57 @@ void DownloadManager::startupGlibCurl()
     m_glibCurlInitialized = true;
     m_activeTaskCount = 0;
 
+    if (DownloadSettings::instance().curlBackend == "fdset") {
+        glibcurl_set_backend(GLIBCURL_BACKEND_FDSET);
+    } else {
+        glibcurl_set_backend(GLIBCURL_BACKEND_SOCKET);
+    }
+    glibcurl_set_threaded(DownloadSettings::instance().transferThread ? 1 : 0);
+    glibcurl_set_shards(DownloadSettings::instance().transferShards);
     glibcurl_init();
     glibcurl_set_callback(&cbGlibcurl,this);
 
-    s_curlShareHandle = curl_share_init();
-    if (curl_share_setopt(s_curlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) != 0) {
-        LOG_DEBUG ("Function curl_share_setopt() failed");
-    }
+    //made once: the DNS and TLS session caches in it, and the pooled handles using it, outlive glibcurl restarts
+    if (s_curlShareHandle == 0) {
+        s_curlShareHandle = curl_share_init();
+        curl_share_setopt(s_curlShareHandle, CURLSHOPT_LOCKFUNC, cbCurlShareLock);
+        curl_share_setopt(s_curlShareHandle, CURLSHOPT_UNLOCKFUNC, cbCurlShareUnlock);
+        if (curl_share_setopt(s_curlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) != 0) {
+            LOG_DEBUG ("Function curl_share_setopt() failed");
+        }
+        //a host's TLS session is resumed by the next connection to it, whichever shard that is on
+        if (curl_share_setopt(s_curlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION) != 0) {
+            LOG_DEBUG ("Function curl_share_setopt() failed");
+        }
 #ifdef CURL_COOKIE_SHARING
-    if (curl_share_setopt(s_curlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE) != 0) {
-        LOG_DEBUG ("Function curl_share_setopt() failed");
-    }
+        if (curl_share_setopt(s_curlShareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE) != 0) {
+            LOG_DEBUG ("Function curl_share_setopt() failed");
+        }
 #endif
+    }
 
+    //connection pool policy; each shard has its own pool, so the total is shared out between them
+    const DownloadSettings& settings = DownloadSettings::instance();
+    long totalPerShard = (settings.maxTotalConnections + glibcurl_shards() - 1) / glibcurl_shards();
     CURLMcode retVal;
-    retVal = curl_multi_setopt(glibcurl_handle(), CURLMOPT_MAXCONNECTS, 4L);
-    if (CURLM_OK != retVal) {
-        LOG_WARNING_PAIRS (LOGID_CURL_FAIL_MAXCONNECTION, 1, PMLOGKFV("error code", "%d", retVal),
-                                                    "curl_multi_setopt: CURLMOPT_MAXCONNECTS failed");
-    }
-//
-// commented out per my co-worker due to bug in libcurl
-//  retVal = curl_multi_setopt(glibcurl_handle(), CURLMOPT_PIPELINING, 1L);
-//  if (CURLM_OK != retVal) {
-//      LOG_DEBUG ("curl_multi_setopt: CURLMOPT_PIPELINING failed[%d]\n", retVal);
-//  }
+    glibcurl_lock();
+    for (int shard = 0; shard < glibcurl_shards(); ++shard) {
+        CURLM * multi = glibcurl_shard_handle(shard);
+        retVal = curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)std::max(settings.connectionCacheSize,1u));
+        if (CURLM_OK != retVal) {
+            LOG_WARNING_PAIRS (LOGID_CURL_FAIL_MAXCONNECTION, 1, PMLOGKFV("error code", "%d", retVal),
+                                                        "curl_multi_setopt: CURLMOPT_MAXCONNECTS failed");
+        }
+        if ((retVal = curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)settings.maxHostConnections)) != CURLM_OK)
+            LOG_DEBUG ("curl_multi_setopt: CURLMOPT_MAX_HOST_CONNECTIONS failed[%d]\n", retVal);
+        if ((retVal = curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, totalPerShard)) != CURLM_OK)
+            LOG_DEBUG ("curl_multi_setopt: CURLMOPT_MAX_TOTAL_CONNECTIONS failed[%d]\n", retVal);
+        //HTTP/1.1 pipelining stays off (it was buggy in libcurl and is gone from it); HTTP/2 multiplexing is fine
+        if ((retVal = curl_multi_setopt(multi, CURLMOPT_PIPELINING,
+                                        settings.httpMultiplex ? (long)CURLPIPE_MULTIPLEX : (long)CURLPIPE_NOTHING)) != CURLM_OK)
+            LOG_DEBUG ("curl_multi_setopt: CURLMOPT_PIPELINING failed[%d]\n", retVal);
+    }
+    glibcurl_unlock();
 }
 
 void DownloadManager::shutdownGlibCurl()
@@ -2673,6 +5017,9 @@ void DownloadManager::shutdownGlibCurl()
     m_glibCurlInitialized = false;
     glibcurl_cleanup();
 
+    //the handle pool and the template aren't tied to the multi handles, so they stay for after the restart.
+    //Released handles wait for cbTransferEvents() as usual, events about them may still be queued
+
     return;
 }
 
@@ -2707,7 +5054,9 @@ uint32_t DownloadManager::uploadPOSTFile(const std::string& file,
     m_uploadTaskMap[p_ult->id()] = p_ult;
 
     //and the general map, by curl handle
-    m_handleMap[CurlDescriptor(p_ult->getCURLHandlePtr())] = new TransferTask(p_ult);
+    TransferTask * p_ttask = new TransferTask(p_ult);
+    m_handleMap[CurlDescriptor(p_ult->getCURLHandlePtr())] = p_ttask;
+    curl_easy_setopt(p_ult->getCURLHandlePtr(), CURLOPT_PRIVATE, p_ttask);
 
     //start the transfer
     LOG_DEBUG("Starting upload - uploading file [%s] to target url [%s]",p_ult->source().c_str(), p_ult->url().c_str() );
@@ -2739,7 +5088,9 @@ uint32_t DownloadManager::uploadPOSTBuffer(const std::string& buffer,
     m_uploadTaskMap[p_ult->id()] = p_ult;
 
     //and the general map, by curl handle
-    m_handleMap[CurlDescriptor(p_ult->getCURLHandlePtr())] = new TransferTask(p_ult);
+    TransferTask * p_ttask = new TransferTask(p_ult);
+    m_handleMap[CurlDescriptor(p_ult->getCURLHandlePtr())] = p_ttask;
+    curl_easy_setopt(p_ult->getCURLHandlePtr(), CURLOPT_PRIVATE, p_ttask);
 
     //start the transfer
         //LOG_DEBUG ("%s: starting upload of file [%s] to url [%s]\n", __PRETTY_FUNCTION__,
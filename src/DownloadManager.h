@@ -30,7 +30,10 @@
 #include <luna-service2/lunaservice.h>
 
 #include "TransferTask.h"
+#include "TransferEventQueue.h"
 #include "DownloadHistoryDb.h"
+#include "DownloadQueue.h"
+#include "TokenBucket.h"
 #include "Watchdog.h"
 #include "Singleton.hpp"
 
@@ -38,6 +41,11 @@
 #define     DOWNLOADMANAGER_UPDATEINTERVAL      1024*100
 #define     DOWNLOADMANAGER_UPDATENUM           20
 #define     DOWNLOADMANAGER_ERRORTHRESHOLD      10
+#define     DOWNLOADMANAGER_SEGMENTRETRIES      2
+#define     DOWNLOADMANAGER_HOSTTTFBSAMPLES     32
+#define     DOWNLOADMANAGER_HOSTTTFBHOSTS       256
+#define     DOWNLOADMANAGER_FIRSTDATASAMPLES    1024
+#define     DOWNLOADMANAGER_REDIRECTCACHESIZE   256
 
 #define     DOWNLOADMANAGER_TRUSTED_CERT_PATH   "/var/ssl/trustedcerts"
 
@@ -55,6 +63,8 @@
 #define     DOWNLOADMANAGER_COMPLETIONSTATUS_FILESYSTEMERROR    -4
 #define     DOWNLOADMANAGER_COMPLETIONSTATUS_HTTPERROR          -5
 #define     DOWNLOADMANAGER_COMPLETIONSTATUS_WRITEERROR         -6
+#define     DOWNLOADMANAGER_COMPLETIONSTATUS_FILESYSTEMFULL     -7
+#define     DOWNLOADMANAGER_COMPLETIONSTATUS_HASHMISMATCH       -8
 #define     DOWNLOADMANAGER_COMPLETIONSTATUS_INTERRUPTED        11
 #define     DOWNLOADMANAGER_COMPLETIONSTATUS_CANCELLED          12
 
@@ -67,12 +77,21 @@
 #define     DOWNLOADMANAGER_RESUMESTATUS_CANNOTACCESSTEMP       -6
 #define     DOWNLOADMANAGER_RESUMESTATUS_INTERFACEDOWN          -7
 #define     DOWNLOADMANAGER_RESUMESTATUS_FILESYSTEMFULL         -8
+#define     DOWNLOADMANAGER_RESUMESTATUS_FAILEDSECURITYCHECK    -9
 #define     DOWNLOADMANAGER_RESUMESTATUS_OK                     1
 
 #define     DOWNLOADMANAGER_PAUSESTATUS_GENERALERROR            0
 #define     DOWNLOADMANAGER_PAUSESTATUS_NOSUCHDOWNLOADTASK      -1
 #define     DOWNLOADMANAGER_PAUSESTATUS_OK                      1
 
+#define     DOWNLOADMANAGER_PRIORITYSTATUS_GENERALERROR         0
+#define     DOWNLOADMANAGER_PRIORITYSTATUS_NOSUCHDOWNLOADTASK   -1
+#define     DOWNLOADMANAGER_PRIORITYSTATUS_OK                   1
+
+#define     DOWNLOADMANAGER_RECVSPEEDSTATUS_GENERALERROR        0
+#define     DOWNLOADMANAGER_RECVSPEEDSTATUS_NOSUCHDOWNLOADTASK  -1
+#define     DOWNLOADMANAGER_RECVSPEEDSTATUS_OK                  1
+
 #define     DOWNLOADMANAGER_UPLOADSTATUS_OK                      0
 #define     DOWNLOADMANAGER_UPLOADSTATUS_GENERALERROR            1
 #define     DOWNLOADMANAGER_UPLOADSTATUS_INVALIDPARAM            2
@@ -121,7 +140,16 @@ public:
             bool appendTargetFile,
             const std::string& cookieHeader,
             const std::pair<uint64_t,uint64_t> range,
-            const int remainingRedCounts);
+            const int remainingRedCounts,
+            const DurabilityMode durability,
+            const bool aggregate = false,
+            const std::vector<std::string>& mirrors = std::vector<std::string>(),
+            const bool revalidate = false,
+            const std::string& hashAlgorithm = "",
+            const std::string& expectedHash = "",
+            const int priority = 0,
+            const uint64_t maxRecvSpeed = 0,
+            const bool useContentStore = false);
 
     int resumeDownload(const unsigned long ticket,const std::string& authToken,const std::string& deviceId,std::string& r_err);
     int resumeDownload(const DownloadHistoryDb::DownloadHistory& history,bool autoResume,std::string& r_err);
@@ -133,6 +161,13 @@ public:
     int pauseDownload(const unsigned long ticket,bool allowQueuedToStart=true);
     void pauseAll();
     void pauseAllForInterface(Connection interface);
+    int setPriority(const unsigned long ticket, int priority);
+    // bytes per second, 0: no limit; see MaxRecvSpeed in downloadManager.conf
+    int setTicketRecvSpeed(const unsigned long ticket, uint64_t bytesPerSecond);
+    void setOwnerRecvSpeed(const std::string& owner, uint64_t bytesPerSecond);
+    void setRecvSpeed(uint64_t bytesPerSecond);
+    uint64_t recvSpeed() { return m_recvBucket.rate(); }
+    void rebalanceAggregates();
 
 #define SWAPTOIF_ERROR_INVALIDIF        -1
 #define SWAPTOIF_ERROR_NOSUCHTICKET     -2
@@ -183,8 +218,64 @@ public:
     unsigned int howManyTasksActive();
     int          howManyTasksInterrupted();
 
+    // transfer counters reported by getStats
+    struct TransferStats {
+        TransferStats() : completed(0), ttfbSamples(0), ttfbTotalUs(0), ttfbMaxUs(0), ttfbLastUs(0)
+                        , hedges(0), hedgeWins(0), firstDataNext(0)
+                        , newConnections(0), reusedConnections(0), http2Transfers(0)
+                        , tlsHandshakes(0), tlsHandshakeTotalUs(0)
+                        , handleSetups(0), handleSetupTotalUs(0), handlesCloned(0), handlesReused(0)
+                        , redirectsFollowed(0), redirectCacheHits(0), revalidated(0)
+                        , storeLookups(0), storeHits(0), storeDedups(0), storeBytesSaved(0)
+                        , hashesVerified(0), hashMismatches(0), hashStatesRestored(0), hashPrefixesRehashed(0)
+                        , resumesVerified(0), resumeMismatches(0), resumeBytesDropped(0), preemptions(0)
+                        , recvSpeedPauses(0) {}
+        uint64_t completed;         // transfers that reached CURLMSG_DONE
+        uint64_t ttfbSamples;       // ...of those, the ones that received a first byte
+        uint64_t ttfbTotalUs;       // time-to-first-byte (CURLINFO_STARTTRANSFER_TIME_T) sum
+        uint64_t ttfbMaxUs;
+        uint64_t ttfbLastUs;
+        uint64_t hedges;            // second requests sent (HedgePercentile)...
+        uint64_t hedgeWins;         // ...and how many of them brought data first
+        std::vector<uint32_t> firstDataUs;  // last few downloads' time from start to first data, hedges included
+        size_t firstDataNext;
+        uint64_t newConnections;    // connections opened (each a TCP, and for https a TLS, handshake)...
+        uint64_t reusedConnections; // ...and transfers that went over one already open instead
+        uint64_t http2Transfers;    // transfers done over HTTP/2, so possibly multiplexed
+        uint64_t tlsHandshakes;     // new connections' TLS handshakes...
+        uint64_t tlsHandshakeTotalUs;   // ...and their time (CURLINFO_APPCONNECT_TIME_T - CONNECT_TIME_T) sum
+        uint64_t handleSetups;      // curl handles set up for download() / resumeDownload()...
+        uint64_t handleSetupTotalUs;    // ...the time that took...
+        uint64_t handlesCloned;     // ...and how many of them were copies of the template...
+        uint64_t handlesReused;     // ...or came from the pool
+        uint64_t redirectsFollowed; // downloads whose transfer followed redirects...
+        uint64_t redirectCacheHits; // ...and those that went straight to where an earlier one ended up
+        uint64_t revalidated;       // "revalidate" downloads the server said were not modified (304)
+        uint64_t storeLookups;      // whole-file downloads looked for in the content store by url...
+        uint64_t storeHits;         // ...and those linked from it on a 304, not fetched
+        uint64_t storeDedups;       // downloads whose content the store had, replaced by a link to it
+        uint64_t storeBytesSaved;   // ...bytes of both not fetched or not stored again
+        uint64_t hashesVerified;    // downloads that came to their expectedHash...
+        uint64_t hashMismatches;    // ...and those that didn't
+        uint64_t hashStatesRestored;    // resumes that carried on with the hash state their pause left...
+        uint64_t hashPrefixesRehashed;  // ...and those that had to read what was there already again
+        uint64_t resumesVerified;   // resumes whose file ended in what the server sent again (ResumeVerifyKB)...
+        uint64_t resumeMismatches;  // ...and those whose file didn't, cut back to where it stopped matching...
+        uint64_t resumeBytesDropped;    // ...by this much in all
+        uint64_t preemptions;       // running downloads paused for a queued one of higher priority (PreemptLowerPriority)
+        uint64_t recvSpeedPauses;   // transfers paused because MaxRecvSpeed had nothing left for them
+    };
+    const TransferStats& transferStats() const { return m_transferStats; }
+    uint64_t firstDataPercentileUs(unsigned int percent) const;
+    pbnjson::JValue diskWriterStats();
+    pbnjson::JValue queueStats();
+    void resetTransferStats() { m_transferStats = TransferStats(); m_queue.resetStats(); }
+
     bool    currentlyInBrickMode() { return m_brickMode; }
 
+    // [DownloadManager] Durability, for downloads that don't ask for their own
+    static DurabilityMode defaultDurability();
+
     bool postDownloadUpdate (const std::string& owner, const unsigned long ticket, const std::string& payload);
 
     friend class UploadTask;
@@ -196,11 +287,15 @@ public:
     static bool cbDownloadAndLaunch(LSHandle* lshandle, LSMessage *message,void *user_data);
     static bool cbResumeDownload(LSHandle* lshandle, LSMessage *message,void *user_data);
     static bool cbPauseDownload(LSHandle* lshandle, LSMessage *message,void *user_data);
+    static bool cbSetPriority(LSHandle* lshandle, LSMessage *message,void *user_data);
+    static bool cbSetRecvSpeed(LSHandle* lshandle, LSMessage *message,void *user_data);
+    static bool cbSetMaxRecvSpeed(LSHandle* lshandle, LSMessage *message,void *user_data);
     static bool cbCancelDownload(LSHandle* lshandle, LSMessage *message,void *user_data);
     static bool cbCancelAllDownloads(LSHandle* lshandle, LSMessage *message,void *user_data);
     static bool cbListPendingDownloads(LSHandle * lshandle,LSMessage *msg,void * user_data);
     static bool cbGetAllHistory(LSHandle * lshandle,LSMessage *msg, void * user_data);
     static bool cbClearDownloadHistory(LSHandle * lshandle,LSMessage *msg,void * user_data);
+    static bool cbGetStats(LSHandle * lshandle,LSMessage *msg,void * user_data);
 
     void filesystemStatusCheck(const uint64_t& spaceFreeKB,const uint64_t& spaceTotalKB,bool * criticalAlertRaised = 0, bool * stopMarkReached = 0);
 
@@ -223,6 +318,7 @@ public:
     bool canDownloadNow();
     static bool cbConnectionType(LSHandle* lshandle, LSMessage *message,void *user_data);
     static gboolean     cbIdleSourceGlibcurlCleanup (gpointer userData);
+    static gboolean     cbIdleRestartTimer (gpointer userData);
     // msm
 
     static bool msmAvailCallback(LSHandle* handle, LSMessage* message, void* ctxt);
@@ -258,21 +354,118 @@ private:
     std::string m_btpanInterfaceName;
     std::string m_wiredInterfaceName;
 
-    std::list<unsigned long> m_queue;
+    DownloadQueue m_queue;
     std::map<CurlDescriptor,TransferTask*> m_handleMap;
     std::map<long,DownloadTask*> m_ticketMap;
+    std::map<CURL*,unsigned long> m_segmentMap;     //extra connections of split downloads, to their ticket
+    std::map<CURL*,unsigned long> m_hedgeMap;       //second requests of hedged downloads, to their ticket
+    std::map<std::string,std::vector<uint32_t> > m_hostTtfbUs;     //recent TTFBs by host:port, oldest first
+    std::map<int,double> m_linkBytesPerSec;         //throughput of aggregate downloads' segments, by Connection
+    struct CachedRedirect {
+        std::string location;
+        gint64 expiresUs;
+    };
+    std::map<std::string,CachedRedirect> m_redirectCache;  //where urls that redirected ended up, see cacheRedirect()
 
     std::map<uint32_t,UploadTask *> m_uploadTaskMap;
 
     std::string m_authCookie;
 
+    // a completed download whose file is being synced, closed and renamed by the io_uring DiskWriter;
+    // finishedDownload() reports it once that is done
+    struct FinishingDownload {
+        FinishingDownload(DownloadTask * t, long result, long httpResult, bool error, bool intr)
+            : task(t) , resultCode(result) , httpResultCode(httpResult) , transferError(error) , interrupted(intr)
+            , renameError(0) {}
+        DownloadTask * task;
+        long resultCode;
+        long httpResultCode;
+        bool transferError;
+        bool interrupted;
+        int renameError;
+    };
+
+    // a resumed download's hash being taken over what its temp file holds on a worker (rehashPrefix());
+    // prefixRehashed() hands it to the download, if that is still the one it was for
+    struct PrefixRehash {
+        PrefixRehash(unsigned long t, StreamHash * h, const std::string& p, uint64_t b)
+            : ticket(t) , hash(h) , path(p) , bytes(b) , failed(false) {}
+        unsigned long ticket;
+        StreamHash * hash;
+        std::string path;
+        uint64_t bytes;
+        bool failed;
+    };
+
+    bool startNextQueued();
+    void preemptForQueued();
+    bool reserveSpace(DownloadTask* task, CURL* handle, uint64_t contentLength);
+
+    bool wantsSplit(DownloadTask* task, CURL* handle);
+    void splitDownload(unsigned long ticket);
+    bool startSegment(DownloadTask* task, DownloadSegment* segment);
+    size_t writeSegment(DownloadTask* task, DownloadSegment* segment, CURL* handle, unsigned char* payload, size_t payloadSize);
+    void segmentDone(unsigned long ticket, CURL* handle, CURLcode resultCode, long httpCode);
+    void stopSegments(DownloadTask* task);
+    bool failOverPrimary(DownloadTask* task);
+
+    std::vector<Connection> aggregateLinks();
+    std::string linkDevice(Connection link) const;
+    double linkWeight(Connection link) const;
+    void noteSegmentRate(DownloadTask* task, DownloadSegment* segment);
+    double shareWeight(DownloadTask* task, int link, int source) const;
+    bool stealRange(DownloadTask* task, Connection link, int source);
+    bool moveSegment(DownloadTask* task, DownloadSegment* segment, Connection link);
+
+    std::string cachedRedirect(const std::string& url);
+    void noteRedirect(DownloadTask* task, CURL* handle);
+    void cacheRedirect(DownloadTask* task, bool worked);
+    bool followRedirect(DownloadTask* task);
+
+    void setTemplateOptions(CURL* handle);
+    CURL * newDownloadHandle();
+    void releaseDownloadHandle(CURL* handle);
+    void recycleHandles(std::vector<CURL*>& handles);
+    void dropHandles();
+    CURLMcode addDownload(DownloadTask* task);
+    void transferStarted(DownloadTask* task);
+    void recordTtfb(const std::string& url, curl_off_t ttfbUs);
+    static gboolean cbHedgeTimer(gpointer data);
+    void launchHedge(unsigned long ticket);
+    void settleHedge(DownloadTask* task, CURL* winner);
+    bool hedgeDone(DownloadTask* task, CURL* handle, CURLcode resultCode, long httpCode);
+
     void completed(TransferTask* );
-    void completed_dl(DownloadTask*);
+    bool completed_dl(DownloadTask*);
+    bool checkHash(DownloadTask* task);
+    void reportCompletedDownload(DownloadTask* task, long resultCode, long httpResultCode, bool transferError,
+                                 bool interrupted, int renameError);
+    static void cbFileFinished(void * data, int renameError);
+    static void cbContentStored(const std::string& url, const std::string& etag, const std::string& lastModified,
+                                const std::string& sha256, uint64_t deduplicated);
+    void finishedDownload(FinishingDownload * finishing);
     void completed_ul(UploadTask*);
 
     void cbGlib ();
+    void transferDone(CURL * handle, CURLcode resultCode, long httpCode, long httpConnectCode, curl_off_t ttfbUs,
+                      long connects = -1, long httpVersion = 0, curl_off_t tlsUs = 0);
+    bool postTransferProgress(const std::string& owner, const unsigned long ticket, const std::string& payload);
+    static gboolean cbTransferEvents(gpointer userData);
+    static void cbWritesDrained(unsigned long ticket);
+    void resumeThrottledTransfer(unsigned long ticket);
+    void recvSpeedPaused(unsigned long ticket);
+    static gboolean cbRecvSpeedTimer(gpointer userData);
+    void resumeRecvSpeedPaused();
+    void redistributeRecvSpeeds();
+    void applyRecvSpeed(DownloadTask* task);
+    uint64_t ownerRecvSpeed(const std::string& owner);
     size_t cbReadEvent (CURL* taskHandle, size_t payloadSize=0, unsigned char * payload=NULL);
     size_t cbWriteEvent (CURL* taskHandle, size_t payloadSize=0, unsigned char * payload=NULL);
+    size_t verifyResume(DownloadTask* task, const unsigned char* payload, size_t payloadSize);
+    void resumeVerified(uint64_t dropped, bool rehashed);
+    void rehashPrefix(DownloadTask* task, StreamHash* hash, const std::string& path, uint64_t bytes);
+    static void cbRehashPrefix(gpointer data, gpointer userData);
+    void prefixRehashed(PrefixRehash * rehash);
 
     size_t cbHeader(CURL* taskHandle, size_t headerSize, const char * headerText);
     int cbSetSocketOptions(void *clientp,curl_socket_t curlfd,curlsocktype purpose);
@@ -298,6 +491,17 @@ private:
     DownloadHistoryDb * m_pDlDb;
     int m_activeTaskCount;
     bool m_glibCurlInitialized;
+    CURL * m_handleTemplate;                // what every download handle starts as, see newDownloadHandle()
+    uint64_t m_handleTemplateCerts;         // TrustedCerts::loads() when it was made
+    std::vector<CURL*> m_handlePool;        // finished downloads' handles, reset to the template's options
+    std::vector<CURL*> m_releasedHandles;   // ...and those that can't be reused yet, see releaseDownloadHandle()
+    TransferStats m_transferStats;
+    TransferEventQueue m_transferEvents;    // transfer thread => main thread, see glibcurl_set_threaded()
+    TokenBucket m_recvBucket;               // MaxRecvSpeed, taken from by every transfer (cbWriteEvent)
+    std::vector<unsigned long> m_recvSpeedPaused;   // ...the tickets it paused, in the order they were...
+    guint m_recvSpeedTimer;                 // ...and the timeout that unpauses them
+    guint m_idleRestartTimer;               // restarts glibcurl once nothing has run for IdleRestartSeconds
+    std::map<std::string,uint64_t> m_ownerRecvSpeeds;   // setRecvSpeed's, over [RecvSpeed]
     GMainLoop* m_mainLoop;
 
     std::string generateTempPath( const std::string& resourceName );
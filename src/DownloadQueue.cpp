@@ -0,0 +1,318 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+
+#include "DownloadQueue.h"
+
+void TicketHeap::push(const Entry& entry)
+{
+    m_heap.push_back(entry);
+    m_index[entry.ticket] = m_heap.size() - 1;
+    siftUp(m_heap.size() - 1);
+}
+
+bool TicketHeap::remove(unsigned long ticket)
+{
+    std::map<unsigned long,size_t>::iterator it = m_index.find(ticket);
+    if (it == m_index.end())
+        return false;
+
+    removeAt(it->second);
+    return true;
+}
+
+bool TicketHeap::setPriority(unsigned long ticket, int priority)
+{
+    std::map<unsigned long,size_t>::iterator it = m_index.find(ticket);
+    if (it == m_index.end())
+        return false;
+
+    size_t at = it->second;
+    int was = m_heap[at].priority;
+    m_heap[at].priority = priority;
+    if (priority > was)
+        siftUp(at);
+    else if (priority < was)
+        siftDown(at);
+    return true;
+}
+
+bool TicketHeap::before(size_t a, size_t b) const
+{
+    if (m_heap[a].priority != m_heap[b].priority)
+        return m_heap[a].priority > m_heap[b].priority;
+    return m_heap[a].arrival < m_heap[b].arrival;
+}
+
+void TicketHeap::place(size_t at, const Entry& entry)
+{
+    m_heap[at] = entry;
+    m_index[entry.ticket] = at;
+}
+
+void TicketHeap::siftUp(size_t at)
+{
+    while (at > 0) {
+        size_t parent = (at - 1) / 2;
+        if (!before(at,parent))
+            break;
+        Entry moving = m_heap[at];
+        place(at,m_heap[parent]);
+        place(parent,moving);
+        at = parent;
+    }
+}
+
+void TicketHeap::siftDown(size_t at)
+{
+    while (true) {
+        size_t first = at;
+        size_t left = 2 * at + 1;
+        size_t right = left + 1;
+        if ((left < m_heap.size()) && before(left,first))
+            first = left;
+        if ((right < m_heap.size()) && before(right,first))
+            first = right;
+        if (first == at)
+            break;
+        Entry moving = m_heap[at];
+        place(at,m_heap[first]);
+        place(first,moving);
+        at = first;
+    }
+}
+
+void TicketHeap::removeAt(size_t at)
+{
+    m_index.erase(m_heap[at].ticket);
+    size_t last = m_heap.size() - 1;
+    if (at == last) {
+        m_heap.pop_back();
+        return;
+    }
+
+    Entry moved = m_heap[last];
+    m_heap.pop_back();
+    place(at,moved);
+    //the one moved in from the end may belong above or below where it landed
+    siftUp(at);
+    siftDown(m_index[moved.ticket]);
+}
+
+void DownloadQueue::configure(unsigned int quantumKB, OwnerSettingFn weightOf, OwnerSettingFn maxSlotsOf)
+{
+    m_quantum = (int64_t)quantumKB * 1024;
+    m_weightOf = weightOf;
+    m_maxSlotsOf = maxSlotsOf;
+}
+
+DownloadQueue::Owner& DownloadQueue::ownerFor(const std::string& owner)
+{
+    std::map<std::string,Owner>::iterator it = m_owners.find(owner);
+    if (it != m_owners.end())
+        return it->second;
+
+    Owner& created = m_owners[owner];
+    created.weight = m_weightOf ? std::max(m_weightOf(owner),1u) : 1;
+    created.maxSlots = m_maxSlotsOf ? m_maxSlotsOf(owner) : 0;
+    m_round.push_back(owner);
+    return created;
+}
+
+bool DownloadQueue::eligible(const Owner& owner) const
+{
+    return !owner.queue.empty() && ((owner.maxSlots == 0) || (owner.running < owner.maxSlots));
+}
+
+// an owner with nothing queued or running drops out of the round: what it had to its credit (or debt) goes
+void DownloadQueue::idleCheck(Owner& owner)
+{
+    if (owner.queue.empty() && (owner.running == 0))
+        owner.deficit = 0;
+}
+
+void DownloadQueue::push(unsigned long ticket, int priority, const std::string& owner)
+{
+    if (contains(ticket))
+        return;
+
+    TicketHeap::Entry entry;
+    entry.priority = priority;
+    entry.arrival = m_arrivals++;
+    entry.ticket = ticket;
+    entry.queuedUs = g_get_monotonic_time();
+    ownerFor(owner).queue.push(entry);
+    m_ticketOwner[ticket] = owner;
+    m_size++;
+}
+
+bool DownloadQueue::topPriority(int& priority) const
+{
+    bool found = false;
+    for (std::map<std::string,Owner>::const_iterator it = m_owners.begin(); it != m_owners.end(); ++it) {
+        if (!eligible(it->second))
+            continue;
+        if (!found || (it->second.queue.top().priority > priority))
+            priority = it->second.queue.top().priority;
+        found = true;
+    }
+    return found;
+}
+
+unsigned long DownloadQueue::pop()
+{
+    int priority;
+    if (m_round.empty() || !topPriority(priority))
+        return 0;
+
+    //the owners in the running, and how many turns it takes for the first of them to have credit; the turns before
+    //that one are handed out at once instead of going round for them
+    uint64_t turns = 0;
+    bool any = false;
+    for (size_t i = 0; i < m_round.size(); ++i) {
+        Owner& owner = m_owners[m_round[i]];
+        if (!eligible(owner) || (owner.queue.top().priority != priority))
+            continue;
+        int64_t quantum = m_quantum * owner.weight;
+        uint64_t needed = (owner.deficit > 0) ? 0 : (uint64_t)(-owner.deficit / std::max(quantum,(int64_t)1)) + 1;
+        turns = any ? std::min(turns,needed) : needed;
+        any = true;
+    }
+    if (turns > 1) {
+        for (size_t i = 0; i < m_round.size(); ++i) {
+            Owner& owner = m_owners[m_round[i]];
+            if (eligible(owner) && (owner.queue.top().priority == priority))
+                owner.deficit += (int64_t)(turns - 1) * m_quantum * owner.weight;
+        }
+    }
+
+    //an owner with credit is served; one without gets its quantum and the next one's turn comes
+    for (size_t visits = 0; visits <= 2 * m_round.size(); ++visits) {
+        if (m_next >= m_round.size())
+            m_next = 0;
+        Owner& owner = m_owners[m_round[m_next]];
+        if (!eligible(owner) || (owner.queue.top().priority != priority)) {
+            m_next++;
+            continue;
+        }
+        if (owner.deficit > 0) {
+            TicketHeap::Entry entry = owner.queue.top();
+            owner.queue.pop();
+            m_ticketOwner.erase(entry.ticket);
+            m_size--;
+            uint64_t waitedUs = g_get_monotonic_time() - entry.queuedUs;
+            owner.waits++;
+            owner.waitTotalUs += waitedUs;
+            owner.waitMaxUs = std::max(owner.waitMaxUs,waitedUs);
+            return entry.ticket;
+        }
+        owner.deficit += m_quantum * owner.weight;
+        m_next++;
+    }
+    return 0;
+}
+
+bool DownloadQueue::remove(unsigned long ticket)
+{
+    std::map<unsigned long,std::string>::iterator it = m_ticketOwner.find(ticket);
+    if (it == m_ticketOwner.end())
+        return false;
+
+    Owner& owner = m_owners[it->second];
+    owner.queue.remove(ticket);
+    m_ticketOwner.erase(it);
+    m_size--;
+    idleCheck(owner);
+    return true;
+}
+
+bool DownloadQueue::setPriority(unsigned long ticket, int priority)
+{
+    std::map<unsigned long,std::string>::iterator it = m_ticketOwner.find(ticket);
+    if (it == m_ticketOwner.end())
+        return false;
+    return m_owners[it->second].queue.setPriority(ticket,priority);
+}
+
+void DownloadQueue::started(const std::string& owner)
+{
+    Owner& o = ownerFor(owner);
+    o.running++;
+    o.started++;
+    //what it will fetch isn't known yet: it is charged a quantum now and put right in ended()
+    o.deficit -= m_quantum;
+}
+
+void DownloadQueue::ended(const std::string& owner, uint64_t bytes)
+{
+    Owner& o = ownerFor(owner);
+    if (o.running > 0)
+        o.running--;
+    o.deficit += m_quantum - (int64_t)bytes;
+    o.bytes += bytes;
+    idleCheck(o);
+}
+
+bool DownloadQueue::mayStart(const std::string& owner) const
+{
+    std::map<std::string,Owner>::const_iterator it = m_owners.find(owner);
+    unsigned int maxSlots = (it != m_owners.end()) ? it->second.maxSlots : (m_maxSlotsOf ? m_maxSlotsOf(owner) : 0);
+    unsigned int running = (it != m_owners.end()) ? it->second.running : 0;
+    return (maxSlots == 0) || (running < maxSlots);
+}
+
+void DownloadQueue::ownerStats(std::vector<OwnerStats>& stats) const
+{
+    for (std::map<std::string,Owner>::const_iterator it = m_owners.begin(); it != m_owners.end(); ++it) {
+        OwnerStats s;
+        s.owner = it->first;
+        s.weight = it->second.weight;
+        s.maxSlots = it->second.maxSlots;
+        s.queued = it->second.queue.size();
+        s.running = it->second.running;
+        s.deficit = it->second.deficit;
+        s.started = it->second.started;
+        s.waits = it->second.waits;
+        s.waitTotalUs = it->second.waitTotalUs;
+        s.waitMaxUs = it->second.waitMaxUs;
+        s.bytes = it->second.bytes;
+        stats.push_back(s);
+    }
+}
+
+void DownloadQueue::resetStats()
+{
+    std::vector<std::string> round;
+    std::string at = (m_next < m_round.size()) ? m_round[m_next] : std::string();
+    m_next = 0;
+    for (size_t i = 0; i < m_round.size(); ++i) {
+        Owner& owner = m_owners[m_round[i]];
+        if (owner.queue.empty() && (owner.running == 0)) {
+            m_owners.erase(m_round[i]);
+            continue;
+        }
+        if (m_round[i] == at)
+            m_next = round.size();
+        owner.started = 0;
+        owner.waits = 0;
+        owner.waitTotalUs = 0;
+        owner.waitMaxUs = 0;
+        owner.bytes = 0;
+        round.push_back(m_round[i]);
+    }
+    m_round.swap(round);
+}
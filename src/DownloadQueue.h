@@ -0,0 +1,152 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef DOWNLOADQUEUE_H_
+#define DOWNLOADQUEUE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <glib.h>
+
+// Tickets of one owner waiting for a download slot, highest priority first and,
+// among equal priorities, in the order they came. A binary heap with each
+// ticket's place in it kept on the side, so one can be taken out or have its
+// priority changed wherever it is.
+class TicketHeap {
+
+public:
+
+    struct Entry {
+        int priority;
+        uint64_t arrival;
+        unsigned long ticket;
+        gint64 queuedUs;
+    };
+
+    void push(const Entry& entry);
+    // next to start; only when not empty
+    const Entry& top() const { return m_heap[0]; }
+    void pop() { removeAt(0); }
+    bool remove(unsigned long ticket);
+    // keeps its place among those of the new priority that came before it
+    bool setPriority(unsigned long ticket, int priority);
+
+    size_t size() const { return m_heap.size(); }
+    bool empty() const { return m_heap.empty(); }
+
+private:
+
+    bool before(size_t a, size_t b) const;
+    void place(size_t at, const Entry& entry);
+    void siftUp(size_t at);
+    void siftDown(size_t at);
+    void removeAt(size_t at);
+
+    std::vector<Entry> m_heap;
+    std::map<unsigned long,size_t> m_index;     // ticket -> its place in m_heap
+};
+
+// Downloads waiting for a slot, and who gets the next one. Priority goes first: only owners (callers) whose first
+// queued download has the highest priority waiting are in the running. Among those, slots are shared by deficit
+// round robin over the owners, weighted by their FairShare weight in downloadManager.conf (see configure()): each
+// turn an owner gets its weight in FairShareQuantumKB of credit, starting a download costs one quantum, and once it
+// ends it costs what it actually fetched instead. So an owner gets slots in proportion to its weight, however many
+// downloads it queued, and one whose downloads are big gets fewer of them. An owner at its FairShare slot cap waits.
+class DownloadQueue {
+
+public:
+
+    // what getStats reports of an owner
+    struct OwnerStats {
+        std::string owner;
+        unsigned int weight;
+        unsigned int maxSlots;
+        size_t queued;
+        unsigned int running;
+        int64_t deficit;
+        uint64_t started;
+        uint64_t waits;             // downloads that started from the queue...
+        uint64_t waitTotalUs;       // ...and how long they were in it
+        uint64_t waitMaxUs;
+        uint64_t bytes;
+    };
+
+    // an owner's weight or slot cap (0: none)
+    typedef unsigned int (*OwnerSettingFn)(const std::string& owner);
+
+    DownloadQueue() : m_quantum(1024 * 1024) , m_weightOf(NULL) , m_maxSlotsOf(NULL) , m_arrivals(0) , m_size(0) , m_next(0) {}
+
+    // FairShareQuantumKB and where the FairShare weights and caps come from; until then (or given NULL) every
+    // owner has weight 1 and no cap. Before anything is queued: owners already seen keep what they got
+    void configure(unsigned int quantumKB, OwnerSettingFn weightOf, OwnerSettingFn maxSlotsOf);
+
+    void push(unsigned long ticket, int priority, const std::string& owner);
+    // the ticket to start next; 0 if nothing queued can start (empty, or every owner with something queued is at its cap)
+    unsigned long pop();
+    bool remove(unsigned long ticket);
+    bool setPriority(unsigned long ticket, int priority);
+    bool contains(unsigned long ticket) const { return m_ticketOwner.find(ticket) != m_ticketOwner.end(); }
+    // priority of what pop() would start; false if nothing can start
+    bool topPriority(int& priority) const;
+
+    // a download of the owner got a slot / gave it up having fetched that many bytes
+    void started(const std::string& owner);
+    void ended(const std::string& owner, uint64_t bytes);
+    // whether the owner is below its slot cap
+    bool mayStart(const std::string& owner) const;
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    void ownerStats(std::vector<OwnerStats>& stats) const;
+    // zeroes the counters and forgets owners with nothing queued or running
+    void resetStats();
+
+private:
+
+    struct Owner {
+        Owner() : weight(1) , maxSlots(0) , running(0) , deficit(0) , started(0) , waits(0) , waitTotalUs(0) , waitMaxUs(0) , bytes(0) {}
+        TicketHeap queue;
+        unsigned int weight;
+        unsigned int maxSlots;      // 0: no cap
+        unsigned int running;
+        int64_t deficit;            // bytes it may still start downloads for
+        uint64_t started;
+        uint64_t waits;
+        uint64_t waitTotalUs;
+        uint64_t waitMaxUs;
+        uint64_t bytes;
+    };
+
+    Owner& ownerFor(const std::string& owner);
+    bool eligible(const Owner& owner) const;
+    void idleCheck(Owner& owner);
+
+    int64_t m_quantum;                          // credit per turn of an owner of weight 1, bytes
+    OwnerSettingFn m_weightOf;
+    OwnerSettingFn m_maxSlotsOf;
+    std::map<std::string,Owner> m_owners;
+    std::vector<std::string> m_round;           // owners in the order the round robin visits them...
+    std::map<unsigned long,std::string> m_ticketOwner;
+    uint64_t m_arrivals;
+    size_t m_size;
+    size_t m_next;                              // ...and the one it is at
+};
+
+#endif /*DOWNLOADQUEUE_H_*/
@@ -26,6 +26,7 @@
 #include "DownloadUtils.h"
 #include "DownloadSettings.h"
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
 #include <cstring>
@@ -44,6 +45,9 @@
 #include "Logging.h"
 #include "JUtil.h"
 #include "Utils.h"
+#include "TrustedCerts.h"
+#include "ContentStore.h"
+#include "StreamHash.h"
 
 bool DownloadManager::s_allow1x = false;                //a lunabus fn can set this to true to allow 1x connections
 
@@ -58,6 +62,8 @@ static LSMethod s_methods[]  = {
     { "download",                   DownloadManager::cbDownload },
     { "resumeDownload",             DownloadManager::cbResumeDownload },
     { "pauseDownload",              DownloadManager::cbPauseDownload },
+    { "setPriority",                DownloadManager::cbSetPriority },
+    { "setRecvSpeed",               DownloadManager::cbSetRecvSpeed },
     { "cancelDownload",             DownloadManager::cbCancelDownload },
     { "cancelUpload",               DownloadManager::cbCancelDownload },                //just an alias and a bit of a misnomer: cancelDownload will cancel either an upload or download
     { "cancelAllDownloads",         DownloadManager::cbCancelAllDownloads },
@@ -67,6 +73,8 @@ static LSMethod s_methods[]  = {
     { "upload",                     DownloadManager::cbUpload },
     { "is1xMode",                   DownloadManager::cbConnectionType},
     { "allow1x",                    cbAllow1x },
+    { "getStats",                   DownloadManager::cbGetStats },
+    { "setMaxRecvSpeed",            DownloadManager::cbSetMaxRecvSpeed },
     { 0, 0 },
 };
 
@@ -183,9 +191,17 @@ targetFilename | no | String | target file name that the download file will have
 keepFilenameOnRedirect | Boolean | String | If True, it will follow redirects until it download the actual file.
 canHandlePause | no | Boolean | True if it can be paused.
 appendTargetFile | no | Boolean | if true and if target file already exist, append download data not create new one.
+durability | no | String | "never", "completion", "pause" or "interval": when downloaded data is forced to disk. Default is Durability in downloadManager.conf
+revalidate | no | Boolean | if true and the file the caller's last complete download of target left is still there unchanged, in targetDir (and named targetFilename, if given), the server is asked whether it has changed since (If-None-Match / If-Modified-Since). If it hasn't (304), the download completes at once with that file as its target, and "revalidated" true in the completion payload. If it has, it is downloaded as usual
+hashAlgorithm | no | String | "sha256" (default) or "crc32c": the download's hash is taken as it comes in and given as "hash" in the completion payload. Not with appendTargetFile; a download with a hash isn't revalidated, taken from the content store or split over more connections
+expectedHash | no | String | hex digest the download has to come to (implies hashAlgorithm "sha256" if that isn't given). If it doesn't, the file is removed and the download completes with completionStatusCode -8
+priority | no | Integer | when every download slot (MaxConcurrent) is taken, downloads waiting for one start highest priority first, in the order they came among equals. Default 0. With PreemptLowerPriority in downloadManager.conf, a download that has to wait pauses the running one of the lowest lower priority (if it can pause), which is queued again. See setPriority
+maxRecvSpeed | no | Integer | bytes per second the download may receive at most, over all of its connections. Default 0: no limit of its own, but it still shares its caller's limit and MaxRecvSpeed in downloadManager.conf with the others. See setRecvSpeed and setMaxRecvSpeed
+contentStore | no | Boolean | if true and ContentStoreDir is set in downloadManager.conf: if the store has what target had, the server is asked whether that is still current, and on a 304 the download completes with a copy (a reflink where the filesystem has them) of it. Once complete, the download goes into the store, or is replaced by a reflink to the copy there. Not with appendTargetFile, a range or a hash
+mirrors | no | Array | more URLs holding the same content as target. If the server takes byte ranges, ranges are fetched from all of them at once, more from the faster ones, and a range that fails on one is retried on another. The completion payload's "sources" tells how many bytes each served
 e_rangeLow | no | String | the offset in number of bytes that you want the transfer to start from. used for curl option (refer curl_easy_setopt(), CURLOPT_RESUME_FROM_LARGE)
 e_rangeHigh | no | String | not used now, but must be bigger than e_rangeLow
-interface | no | String | one of the following state - ("wifi", "wan", "btpan"), it internally set to ANY if it is not one of them. If it is any it will determin a good interface as follows in order ( wifi, wan, btpan )
+interface | no | String | one of the following state - ("wifi", "wan", "btpan"), it internally set to ANY if it is not one of them. If it is any it will determin a good interface as follows in order ( wifi, wan, btpan ). "aggregate" spreads byte ranges of the download over every connected interface by their throughput (needs a server that takes ranges; otherwise it is an ANY download)
 
 @par Returns(Call)
 Name | Required | Type | Description
@@ -233,6 +249,16 @@ bool DownloadManager::cbDownload(LSHandle* lshandle, LSMessage *msg, void *user_
     bool canHandlePause = false;
     bool autoResume = true;
     bool appendTargetFile = false;
+    bool aggregate = false;
+    bool revalidate = false;
+    std::string hashAlgorithm = "";
+    std::string expectedHash = "";
+    int priority = 0;
+    uint64_t maxRecvSpeed = 0;
+    bool useContentStore = false;
+    std::vector<std::string> mirrors;
+    pbnjson::JValue jo_mirrors;
+    DurabilityMode durability = DownloadManager::defaultDurability();
     unsigned long ticket_id=0;
     int start_rc=0;
     const char * ccptr = NULL;
@@ -288,6 +314,19 @@ bool DownloadManager::cbDownload(LSHandle* lshandle, LSMessage *msg, void *user_
     canHandlePause = root["canHandlePause"].asBool();
     autoResume = root["autoResume"].asBool();
     appendTargetFile = root["appendTargetFile"].asBool();
+    durability = DownloadTask::durabilityFromString(root["durability"].asString(), durability);
+    revalidate = root["revalidate"].asBool();
+    hashAlgorithm = root["hashAlgorithm"].asString();
+    expectedHash = root["expectedHash"].asString();
+    priority = root["priority"].asNumber<int>();
+    maxRecvSpeed = std::max(root["maxRecvSpeed"].asNumber<int64_t>(),(int64_t)0);
+    useContentStore = root["contentStore"].asBool();
+
+    jo_mirrors = root["mirrors"];
+    for (int idx = 0; jo_mirrors.isArray() && (idx < jo_mirrors.arraySize()); ++idx) {
+        if (jo_mirrors[idx].isString())
+            mirrors.push_back(jo_mirrors[idx].asString());
+    }
 
     strInt = root["e_rangeLow"].asString();
     range.first = strtouq(strInt.c_str(),0,10);
@@ -296,6 +335,7 @@ bool DownloadManager::cbDownload(LSHandle* lshandle, LSMessage *msg, void *user_
     range.second = strtouq(strInt.c_str(),0,10);
 
     interfaceName = root["interface"].asString();
+    aggregate = (interfaceName == "aggregate");
     if (interfaceName == "wired")
         conn = Wired;
     else if (interfaceName == "wifi")
@@ -317,7 +357,8 @@ bool DownloadManager::cbDownload(LSHandle* lshandle, LSMessage *msg, void *user_
     start_rc = DownloadManager::instance().download(caller, targetUrl, targetMime, overrideTargetDir, overrideTargetFile,
                                   ticket_id, shouldKeepOriginalFilename, authToken, deviceId, conn,
                                   canHandlePause, autoResume, appendTargetFile, cookieHeader,range,
-                                  DownloadTask::MAXREDIRECTIONS);
+                                  DownloadTask::MAXREDIRECTIONS, durability, aggregate, mirrors, revalidate,
+                                  hashAlgorithm, expectedHash, priority, maxRecvSpeed, useContentStore);
 
     if (start_rc < 0) {
         //error!
@@ -580,6 +621,251 @@ Done_cbPauseDownload:
     return true;
 }
 
+//static
+//->Start of API documentation comment block
+/**
+@page com_webos_service_downloadmanager com.webos.service.downloadmanager
+@{
+@section com_webos_service_downloadmanager_setPriority setPriority
+
+change the priority of a queued or running download
+
+@par Parameters
+Name | Required | Type | Description
+-----|--------|------|----------
+ticket | yes | Integer | Download ID from download
+priority | yes | Integer | new priority (see download). A queued download moves to its place among the others; a running one keeps going, but with PreemptLowerPriority it may now be paused for, or pause, another
+
+@par Returns (Call)
+Name | Required | Type | Description
+-----|--------|------|----------
+returnValue | yes | Boolean | Indicates if the call was successful
+errorCode | no | String | Describes the error if call was not successful
+errorText | no | String | Describes the error if call was not successful
+
+@par Returns (Subscription)
+None
+@}
+*/
+//->End of API documentation comment block
+bool DownloadManager::cbSetPriority(LSHandle* lshandle, LSMessage *message,void *user_data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    const char* str = LSMessageGetPayload(message);
+    if( !str )
+        return false;
+
+    std::string errorCode;
+    std::string errorText;
+
+    int rc = 0;
+    int ticket = 0;
+
+    JUtil::Error error;
+
+    pbnjson::JValue root = JUtil::parse(str, "DownloadService.setPriority", &error);
+    if (root.isNull()) {
+        errorCode = ConvertToString<int>(DOWNLOADMANAGER_PRIORITYSTATUS_GENERALERROR);
+        errorText = error.detail();
+        goto Done_cbSetPriority;
+    }
+
+    ticket = root["ticket"].asNumber<int>();
+
+    rc = DownloadManager::instance().setPriority(ticket,root["priority"].asNumber<int>());
+
+    if (rc == DOWNLOADMANAGER_PRIORITYSTATUS_NOSUCHDOWNLOADTASK) {
+        errorCode = ConvertToString<int>(rc);
+        errorText = "Ticket provided does not correspond to a queued or downloading transfer";
+    }
+
+Done_cbSetPriority:
+
+    root = pbnjson::Object();
+    if (rc <= 0) {
+        root.put("returnValue", false);
+        root.put("errorCode", errorCode);
+        root.put("errorText", errorText);
+    }
+    else
+        root.put("returnValue", true);
+
+    if (!LSMessageReply( lshandle, message, JUtil::toSimpleString(root).c_str(), &lserror ))  {
+        LSErrorPrint (&lserror, stderr);
+        LSErrorFree(&lserror);
+    }
+
+    return true;
+}
+
+//static
+//->Start of API documentation comment block
+/**
+@page com_webos_service_downloadmanager com.webos.service.downloadmanager
+@{
+@section com_webos_service_downloadmanager_setRecvSpeed setRecvSpeed
+
+limit how fast one download may receive, while it runs. See setMaxRecvSpeed for the limits of a caller's downloads and of all transfers together
+
+@par Parameters
+Name | Required | Type | Description
+-----|--------|------|----------
+maxRecvSpeed | yes | Integer | bytes per second, 0 for no limit
+ticket | yes | Integer | Download ID from download: the limit is that download's own (see maxRecvSpeed in download), and a resume keeps it
+
+@par Returns (Call)
+Name | Required | Type | Description
+-----|--------|------|----------
+returnValue | yes | Boolean | Indicates if the call was successful
+errorCode | no | String | Describes the error if call was not successful
+errorText | no | String | Describes the error if call was not successful
+
+@par Returns (Subscription)
+None
+@}
+*/
+//->End of API documentation comment block
+bool DownloadManager::cbSetRecvSpeed(LSHandle* lshandle, LSMessage *message,void *user_data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    const char* str = LSMessageGetPayload(message);
+    if( !str )
+        return false;
+
+    std::string errorCode;
+    std::string errorText;
+
+    int rc = 0;
+    uint64_t maxRecvSpeed = 0;
+
+    JUtil::Error error;
+
+    pbnjson::JValue root = JUtil::parse(str, "DownloadService.setRecvSpeed", &error);
+    if (root.isNull()) {
+        errorCode = ConvertToString<int>(DOWNLOADMANAGER_RECVSPEEDSTATUS_GENERALERROR);
+        errorText = error.detail();
+        goto Done_cbSetRecvSpeed;
+    }
+
+    //the limits of a caller's downloads and of all of them are setMaxRecvSpeed's, which not every client may call
+    if (!root.hasKey("ticket")) {
+        errorCode = ConvertToString<int>(DOWNLOADMANAGER_RECVSPEEDSTATUS_GENERALERROR);
+        errorText = "ticket is required; see setMaxRecvSpeed";
+        goto Done_cbSetRecvSpeed;
+    }
+
+    maxRecvSpeed = std::max(root["maxRecvSpeed"].asNumber<int64_t>(),(int64_t)0);
+
+    rc = DownloadManager::instance().setTicketRecvSpeed(root["ticket"].asNumber<int64_t>(),maxRecvSpeed);
+
+    if (rc == DOWNLOADMANAGER_RECVSPEEDSTATUS_NOSUCHDOWNLOADTASK) {
+        errorCode = ConvertToString<int>(rc);
+        errorText = "Ticket provided does not correspond to a queued or downloading transfer";
+    }
+
+Done_cbSetRecvSpeed:
+
+    root = pbnjson::Object();
+    if (rc <= 0) {
+        root.put("returnValue", false);
+        root.put("errorCode", errorCode);
+        root.put("errorText", errorText);
+    }
+    else
+        root.put("returnValue", true);
+
+    if (!LSMessageReply( lshandle, message, JUtil::toSimpleString(root).c_str(), &lserror ))  {
+        LSErrorPrint (&lserror, stderr);
+        LSErrorFree(&lserror);
+    }
+
+    return true;
+}
+
+//static
+//->Start of API documentation comment block
+/**
+@page com_webos_service_downloadmanager com.webos.service.downloadmanager
+@{
+@section com_webos_service_downloadmanager_setMaxRecvSpeed setMaxRecvSpeed
+
+limit how fast all transfers together, or one caller's downloads, may receive. See setRecvSpeed for one download's limit
+
+@par Parameters
+Name | Required | Type | Description
+-----|--------|------|----------
+maxRecvSpeed | yes | Integer | bytes per second, 0 for no limit
+owner | no | String | id of a caller (app or service): the limit is shared out among that caller's running downloads, overriding [RecvSpeed] in downloadManager.conf until the service restarts
+
+Without owner, the limit is that of all transfers together, overriding MaxRecvSpeed in downloadManager.conf until the service restarts.
+
+@par Returns (Call)
+Name | Required | Type | Description
+-----|--------|------|----------
+returnValue | yes | Boolean | Indicates if the call was successful
+errorCode | no | String | Describes the error if call was not successful
+errorText | no | String | Describes the error if call was not successful
+
+@par Returns (Subscription)
+None
+@}
+*/
+//->End of API documentation comment block
+bool DownloadManager::cbSetMaxRecvSpeed(LSHandle* lshandle, LSMessage *message,void *user_data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+
+    const char* str = LSMessageGetPayload(message);
+    if( !str )
+        return false;
+
+    std::string errorCode;
+    std::string errorText;
+
+    int rc = 0;
+    uint64_t maxRecvSpeed = 0;
+
+    JUtil::Error error;
+
+    pbnjson::JValue root = JUtil::parse(str, "DownloadService.setMaxRecvSpeed", &error);
+    if (root.isNull()) {
+        errorCode = ConvertToString<int>(DOWNLOADMANAGER_RECVSPEEDSTATUS_GENERALERROR);
+        errorText = error.detail();
+        goto Done_cbSetMaxRecvSpeed;
+    }
+
+    maxRecvSpeed = std::max(root["maxRecvSpeed"].asNumber<int64_t>(),(int64_t)0);
+
+    if (root.hasKey("owner"))
+        DownloadManager::instance().setOwnerRecvSpeed(root["owner"].asString(),maxRecvSpeed);
+    else
+        DownloadManager::instance().setRecvSpeed(maxRecvSpeed);
+    rc = DOWNLOADMANAGER_RECVSPEEDSTATUS_OK;
+
+Done_cbSetMaxRecvSpeed:
+
+    root = pbnjson::Object();
+    if (rc <= 0) {
+        root.put("returnValue", false);
+        root.put("errorCode", errorCode);
+        root.put("errorText", errorText);
+    }
+    else
+        root.put("returnValue", true);
+
+    if (!LSMessageReply( lshandle, message, JUtil::toSimpleString(root).c_str(), &lserror ))  {
+        LSErrorPrint (&lserror, stderr);
+        LSErrorFree(&lserror);
+    }
+
+    return true;
+}
+
 //static
 //->Start of API documentation comment block
 /**
@@ -1063,6 +1349,144 @@ Done:
     return true;
 }
 
+//->Start of API documentation comment block
+/**
+@page com_webos_service_downloadmanager com.webos.service.downloadmanager
+@{
+@section com_webos_service_downloadmanager_getStats getStats
+
+get transfer engine statistics
+
+@par Parameters
+Name | Required | Type | Description
+-----|--------|------|----------
+reset | no | Boolean | If true, all counters are zeroed after they are reported
+
+@par Returns (Call)
+Name | Required | Type | Description
+-----|--------|------|----------
+returnValue | yes | Boolean | Indicates if the call was successful
+curlBackend | yes | String | "socket" or "fdset", see CurlBackend in downloadManager.conf
+transferThread | yes | Boolean | true if transfers run on a dedicated thread, see TransferThread in downloadManager.conf
+shards | yes | Array | number of transfers currently on each transfer shard, see TransferShards in downloadManager.conf
+mainLoop | yes | Object | prepares, dispatches, timerDispatches (dispatches due to curl timeouts alone), intervalMs (time the counters cover), wakeupsPerSecond and timerWakeupsPerSecond
+transfers | yes | Object | active, completed, ttfbSamples, ttfbAvgMs, ttfbMaxMs, ttfbLastMs (time to first byte of finished transfers), firstDataP50Ms, firstDataP99Ms (time from start to first data of recent downloads, hedges included), hedges, hedgeWins, hedgeRate (hedges per completed transfer), see HedgePercentile in downloadManager.conf; newConnections, reusedConnections, connectionReuseRate (requests that went over an open connection instead of a new one), http2Transfers, tlsHandshakes, tlsHandshakeAvgMs (new connections' TLS handshakes), trustedCerts (CA certificates held in memory, 0: read from their directory); handleSetups, handleSetupAvgUs (setting up a new download's curl handle), handlesCloned, handlesReused (copied from the template or taken from the pool, see HandlePoolSize in downloadManager.conf); redirectsFollowed, redirectCacheHits (downloads that went straight to where the url redirected last time, see RedirectCacheSeconds); revalidated ("revalidate" downloads completed with the file already there, on a 304); hashesVerified, hashMismatches (downloads with an expectedHash that did / didn't come to it), hashStatesRestored, hashPrefixesRehashed (resumes of hashed downloads that carried on with the hash their pause left / had to read what they had again); resumesVerified, resumeMismatches, resumeBytesDropped (resumes whose file ended in what the server sent again / didn't and was cut back, by that many bytes in all, see ResumeVerifyKB); preemptions (running downloads paused for a queued one of higher priority, see PreemptLowerPriority); maxRecvSpeed (bytes per second all transfers may receive together, 0: no limit), recvSpeedPauses (transfers paused because that was used up, see MaxRecvSpeed); sha256Kernel, crc32cKernel (implementation in use: "sha-ni", "sse4.2", "armv8" or "c")
+contentStore | yes | Object | enabled, files, bytes (what the store holds), lookups (whole-file downloads looked for in it by url), hits (of those, copied from it on a 304 instead of fetched), dedups (downloads whose content it had, replaced by a reflink to it), hitRate ((hits + dedups) / lookups), bytesSaved (not fetched or not stored again), see ContentStoreDir in downloadManager.conf
+diskWriter | yes | Object | backend, threads, budgetKB, writes, writeLatencyUs (p50, p90, p99), backlogBytes and per download (tasks) ticket, backlogBytes, throttled, throttleCount, see WriteBehindThreads in downloadManager.conf
+queue | yes | Object | queued, quantumKB and per caller (owners) owner, weight, maxSlots, maxRecvSpeed (its downloads' limit, see setMaxRecvSpeed), queued, running, started, waits, waitAvgMs, waitMaxMs (downloads that started from the queue and how long they were in it), bytes (fetched by its downloads since their start), deficitKB (what it may fetch before the next caller's turn), see FairShareQuantumKB and [FairShare] in downloadManager.conf
+
+@par Returns (Subscription)
+None
+@}
+*/
+//->End of API documentation comment block
+bool DownloadManager::cbGetStats(LSHandle * lshandle,LSMessage *msg,void * user_data)
+{
+    LSError lserror;
+    LSErrorInit(&lserror);
+    JUtil::Error error;
+
+    if (msg == NULL || LSMessageGetPayload(msg) == NULL) {
+       return false;
+    }
+
+    pbnjson::JValue replyJsonObj = pbnjson::Object();
+    pbnjson::JValue root = JUtil::parse(LSMessageGetPayload(msg), "DownloadService.getStats", &error);
+    if (root.isNull()) {
+        replyJsonObj.put("returnValue", false);
+        replyJsonObj.put("errorText", error.detail());
+    }
+    else {
+        GlibcurlStats curlStats;
+        glibcurl_get_stats(&curlStats);
+        double intervalSec = (double)(g_get_monotonic_time() - curlStats.sinceUs) / 1000000.0;
+
+        pbnjson::JValue mainLoop = pbnjson::Object();
+        mainLoop.put("prepares", (int64_t)curlStats.prepares);
+        mainLoop.put("dispatches", (int64_t)curlStats.dispatches);
+        mainLoop.put("timerDispatches", (int64_t)curlStats.timerDispatches);
+        mainLoop.put("intervalMs", (int64_t)(intervalSec * 1000.0));
+        mainLoop.put("wakeupsPerSecond", (intervalSec > 0) ? (double)curlStats.dispatches / intervalSec : 0.0);
+        mainLoop.put("timerWakeupsPerSecond", (intervalSec > 0) ? (double)curlStats.timerDispatches / intervalSec : 0.0);
+
+        const TransferStats& stats = DownloadManager::instance().transferStats();
+        pbnjson::JValue transfers = pbnjson::Object();
+        transfers.put("active", (int64_t)DownloadManager::instance().howManyTasksActive());
+        transfers.put("completed", (int64_t)stats.completed);
+        transfers.put("ttfbSamples", (int64_t)stats.ttfbSamples);
+        transfers.put("ttfbAvgMs", stats.ttfbSamples ? (double)stats.ttfbTotalUs / stats.ttfbSamples / 1000.0 : 0.0);
+        transfers.put("ttfbMaxMs", (double)stats.ttfbMaxUs / 1000.0);
+        transfers.put("ttfbLastMs", (double)stats.ttfbLastUs / 1000.0);
+        transfers.put("firstDataP50Ms", (double)DownloadManager::instance().firstDataPercentileUs(50) / 1000.0);
+        transfers.put("firstDataP99Ms", (double)DownloadManager::instance().firstDataPercentileUs(99) / 1000.0);
+        transfers.put("hedges", (int64_t)stats.hedges);
+        transfers.put("hedgeWins", (int64_t)stats.hedgeWins);
+        transfers.put("hedgeRate", stats.completed ? (double)stats.hedges / stats.completed : 0.0);
+        transfers.put("newConnections", (int64_t)stats.newConnections);
+        transfers.put("reusedConnections", (int64_t)stats.reusedConnections);
+        transfers.put("connectionReuseRate", (stats.newConnections + stats.reusedConnections)
+                        ? (double)stats.reusedConnections / (stats.newConnections + stats.reusedConnections) : 0.0);
+        transfers.put("http2Transfers", (int64_t)stats.http2Transfers);
+        transfers.put("tlsHandshakes", (int64_t)stats.tlsHandshakes);
+        transfers.put("tlsHandshakeAvgMs", stats.tlsHandshakes ? (double)stats.tlsHandshakeTotalUs / stats.tlsHandshakes / 1000.0 : 0.0);
+        transfers.put("trustedCerts", (int64_t)TrustedCerts::certificates());
+        transfers.put("handleSetups", (int64_t)stats.handleSetups);
+        transfers.put("handleSetupAvgUs", stats.handleSetups ? (double)stats.handleSetupTotalUs / stats.handleSetups : 0.0);
+        transfers.put("handlesCloned", (int64_t)stats.handlesCloned);
+        transfers.put("handlesReused", (int64_t)stats.handlesReused);
+        transfers.put("redirectsFollowed", (int64_t)stats.redirectsFollowed);
+        transfers.put("redirectCacheHits", (int64_t)stats.redirectCacheHits);
+        transfers.put("revalidated", (int64_t)stats.revalidated);
+        transfers.put("hashesVerified", (int64_t)stats.hashesVerified);
+        transfers.put("hashMismatches", (int64_t)stats.hashMismatches);
+        transfers.put("hashStatesRestored", (int64_t)stats.hashStatesRestored);
+        transfers.put("hashPrefixesRehashed", (int64_t)stats.hashPrefixesRehashed);
+        transfers.put("resumesVerified", (int64_t)stats.resumesVerified);
+        transfers.put("resumeMismatches", (int64_t)stats.resumeMismatches);
+        transfers.put("resumeBytesDropped", (int64_t)stats.resumeBytesDropped);
+        transfers.put("preemptions", (int64_t)stats.preemptions);
+        transfers.put("maxRecvSpeed", (int64_t)DownloadManager::instance().recvSpeed());
+        transfers.put("recvSpeedPauses", (int64_t)stats.recvSpeedPauses);
+        transfers.put("sha256Kernel", StreamHash::kernel(StreamHash::SHA256));
+        transfers.put("crc32cKernel", StreamHash::kernel(StreamHash::CRC32C));
+
+        pbnjson::JValue contentStore = pbnjson::Object();
+        contentStore.put("enabled", ContentStore::enabled());
+        contentStore.put("files", (int64_t)ContentStore::files());
+        contentStore.put("bytes", (int64_t)ContentStore::bytes());
+        contentStore.put("lookups", (int64_t)stats.storeLookups);
+        contentStore.put("hits", (int64_t)stats.storeHits);
+        contentStore.put("dedups", (int64_t)stats.storeDedups);
+        contentStore.put("hitRate", stats.storeLookups ? (double)(stats.storeHits + stats.storeDedups) / stats.storeLookups : 0.0);
+        contentStore.put("bytesSaved", (int64_t)stats.storeBytesSaved);
+
+        replyJsonObj.put("returnValue", true);
+        replyJsonObj.put("curlBackend", (glibcurl_get_backend() == GLIBCURL_BACKEND_SOCKET) ? "socket" : "fdset");
+        replyJsonObj.put("transferThread", glibcurl_is_threaded() != 0);
+        pbnjson::JValue shards = pbnjson::Array();
+        for (int shard = 0; shard < glibcurl_shards(); ++shard)
+            shards.append((int64_t)glibcurl_shard_load(shard));
+        replyJsonObj.put("shards", shards);
+        replyJsonObj.put("mainLoop", mainLoop);
+        replyJsonObj.put("transfers", transfers);
+        replyJsonObj.put("contentStore", contentStore);
+        replyJsonObj.put("diskWriter", DownloadManager::instance().diskWriterStats());
+        replyJsonObj.put("queue", DownloadManager::instance().queueStats());
+
+        if (root["reset"].asBool()) {
+            glibcurl_reset_stats();
+            DownloadManager::instance().resetTransferStats();
+        }
+    }
+
+    if (!LSMessageReply( lshandle, msg, JUtil::toSimpleString(replyJsonObj).c_str(), &lserror ))  {
+        LSErrorPrint (&lserror, stderr);
+        LSErrorFree(&lserror);
+    }
+
+    return true;
+}
+
 void DownloadManager::filesystemStatusCheck(const uint64_t& freeSpaceKB,const uint64_t& totalSpaceKB, bool * criticalAlertRaised, bool * stopMarkReached)
 {
     uint32_t pctFull = 100 - (uint32_t)(0.5 + ((double)freeSpaceKB / (double)totalSpaceKB) * (double)100.0);
@@ -1145,6 +1569,10 @@ httpStatus | no | Integer| http status result code if not interrupted.
 interrupted | yes | Boolean | True if it is interrupted.
 completed | yes | Boolean | True if it is completed.
 aborted | yes | Boolean | True if it is aborted.
+revalidated | no | Boolean | in the completion payload: true if the server said the file a "revalidate" download's target had was still current (304), so it wasn't downloaded again.
+hashAlgorithm | no | String | the download's hashAlgorithm, if it asked for a hash.
+expectedHash | no | String | the download's expectedHash (lower case), if it gave one.
+hash | no | String | in the completion payload of a hashed download: what it came to (lower case hex), taken as the data came in.
 target | yes | String | target url to download.
 
 @}
@@ -1344,7 +1772,7 @@ ticket | yes | Integer | A number uniquely identifying the upload
 returnValue | yes | Boolean | Indicates if the call was successful
 sourceFile | no | String | Path to the local file uploaded
 url | no | string | The URL to which to post the file
-completionCode | no | Integer | Completion status code : 0 -- Success -1 -- General error -2 -- Connect timeout -3 -- Corrupt file -4 -- File system error -5 -- HTTP error 11 -- Interrupted 12 -- Cancelled
+completionCode | no | Integer | Completion status code : 0 -- Success -1 -- General error -2 -- Connect timeout -3 -- Corrupt file -4 -- File system error -5 -- HTTP error -6 -- Write error -7 -- File system full (no room for Content-Length) -8 -- Hash mismatch (expectedHash) 11 -- Interrupted 12 -- Cancelled
 completed | no | Boolean | True if completed
 httpCode | no | Integer | HTTP return code, as described at http://www.w3.org/Protocols/HTTP/HTRESP.html
 responseString | No | String | Server response to the POST request.
@@ -1785,6 +2213,9 @@ bool DownloadManager::cbConnectionManagerConnectionStatus(LSHandle* lshandle, LS
         return true;
     }
 
+    //aggregate downloads aren't bound to one interface; their ranges follow the ones that are up
+    dlManager.rebalanceAggregates();
+
     Connection altInterface = ANY;
     if (dlManager.m_wiredConnectionStatus == InetConnectionConnected)
         altInterface = Wired;
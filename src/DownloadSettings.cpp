@@ -106,7 +106,37 @@ DownloadSettings::DownloadSettings()
       , localPackageInstallNoSafety(false)
       , maxDownloadManagerQueueLength(128)
       , maxDownloadManagerConcurrent(2)
-      , maxDownloadManagerRecvSpeed(64 * 1024)
+      , maxDownloadManagerRecvSpeed(0)
+      , recvSpeedBurstMs(100)
+      , curlBackend("socket")
+      , transferThread(false)
+      , transferShards(1)
+      , writeBehindThreads(2)
+      , writeBehindBudgetKB(4096)
+      , writeBehindBackend("threads")
+      , durability("interval")
+      , durabilitySyncMB(16)
+      , durabilitySyncSeconds(5)
+      , streamingThresholdMB(512)
+      , downloadSegments(1)
+      , segmentMinMB(16)
+      , hedgePercentile(0)
+      , hedgeMinSamples(8)
+      , httpMultiplex(true)
+      , maxHostConnections(8)
+      , maxTotalConnections(0)
+      , connectionCacheSize(16)
+      , idleRestartSeconds(30)
+      , handlePoolSize(16)
+      , redirectCacheSeconds(600)
+      , contentStoreDir("")
+      , contentStoreMaxMB(1024)
+      , resumeVerifyKB(64)
+      , preemptLowerPriority(false)
+      , fairShareQuantumKB(1024)
+      , defaultOwnerWeight(1)
+      , defaultOwnerMaxSlots(0)
+      , defaultOwnerMaxRecvSpeed(0)
       , freespaceLowmarkFullPercent(FREESPACE_LOWMARK_FULL_PCT)
       , freespaceMedmarkFullPercent(FREESPACE_MEDMARK_FULL_PCT)
       , freespaceHighmarkFullPercent(FREESPACE_HIGHMARK_FULL_PCT)
@@ -222,6 +252,38 @@ void DownloadSettings::load( )
     KEY_INTEGER("DownloadManager", "MaxQueueLength", maxDownloadManagerQueueLength);
     KEY_INTEGER("DownloadManager", "MaxConcurrent", maxDownloadManagerConcurrent);
     KEY_INTEGER("DownloadManager", "MaxRecvSpeed", maxDownloadManagerRecvSpeed);
+    KEY_INTEGER("DownloadManager", "RecvSpeedBurstMs", recvSpeedBurstMs);
+    KEY_STRING("DownloadManager", "CurlBackend", curlBackend);
+    KEY_BOOLEAN("DownloadManager", "TransferThread", transferThread);
+    KEY_INTEGER("DownloadManager", "TransferShards", transferShards);
+    KEY_INTEGER("DownloadManager", "WriteBehindThreads", writeBehindThreads);
+    KEY_INTEGER("DownloadManager", "WriteBehindBudgetKB", writeBehindBudgetKB);
+    KEY_STRING("DownloadManager", "WriteBehindBackend", writeBehindBackend);
+    KEY_STRING("DownloadManager", "Durability", durability);
+    KEY_INTEGER("DownloadManager", "DurabilitySyncMB", durabilitySyncMB);
+    KEY_INTEGER("DownloadManager", "DurabilitySyncSeconds", durabilitySyncSeconds);
+    KEY_INTEGER("DownloadManager", "StreamingThresholdMB", streamingThresholdMB);
+    KEY_INTEGER("DownloadManager", "DownloadSegments", downloadSegments);
+    KEY_INTEGER("DownloadManager", "SegmentMinMB", segmentMinMB);
+    KEY_INTEGER("DownloadManager", "HedgePercentile", hedgePercentile);
+    KEY_INTEGER("DownloadManager", "HedgeMinSamples", hedgeMinSamples);
+    KEY_BOOLEAN("DownloadManager", "HttpMultiplex", httpMultiplex);
+    KEY_INTEGER("DownloadManager", "MaxHostConnections", maxHostConnections);
+    KEY_INTEGER("DownloadManager", "MaxTotalConnections", maxTotalConnections);
+    KEY_INTEGER("DownloadManager", "ConnectionCacheSize", connectionCacheSize);
+    KEY_INTEGER("DownloadManager", "IdleRestartSeconds", idleRestartSeconds);
+    KEY_INTEGER("DownloadManager", "HandlePoolSize", handlePoolSize);
+    KEY_INTEGER("DownloadManager", "RedirectCacheSeconds", redirectCacheSeconds);
+    KEY_STRING("DownloadManager", "ContentStoreDir", contentStoreDir);
+    KEY_INTEGER("DownloadManager", "ContentStoreMaxMB", contentStoreMaxMB);
+    KEY_INTEGER("DownloadManager", "ResumeVerifyKB", resumeVerifyKB);
+    KEY_BOOLEAN("DownloadManager", "PreemptLowerPriority", preemptLowerPriority);
+    KEY_INTEGER("DownloadManager", "FairShareQuantumKB", fairShareQuantumKB);
+    KEY_INTEGER("DownloadManager", "DefaultOwnerWeight", defaultOwnerWeight);
+    KEY_INTEGER("DownloadManager", "DefaultOwnerMaxSlots", defaultOwnerMaxSlots);
+    loadOwnerShares(keyfile);
+    KEY_INTEGER("DownloadManager", "DefaultOwnerMaxRecvSpeed", defaultOwnerMaxRecvSpeed);
+    loadOwnerRecvSpeeds(keyfile);
 
     KEY_INTEGER("Filesystem","SpaceFullLowmarkPercent",freespaceLowmarkFullPercent);
     KEY_INTEGER("Filesystem","SpaceFullMedmarkPercent",freespaceMedmarkFullPercent);
@@ -310,6 +372,38 @@ void DownloadSettings::load( )
     KEY_INTEGER("DownloadManager", "MaxQueueLength", maxDownloadManagerQueueLength);
     KEY_INTEGER("DownloadManager", "MaxConcurrent", maxDownloadManagerConcurrent);
     KEY_INTEGER("DownloadManager", "MaxRecvSpeed", maxDownloadManagerRecvSpeed);
+    KEY_INTEGER("DownloadManager", "RecvSpeedBurstMs", recvSpeedBurstMs);
+    KEY_STRING("DownloadManager", "CurlBackend", curlBackend);
+    KEY_BOOLEAN("DownloadManager", "TransferThread", transferThread);
+    KEY_INTEGER("DownloadManager", "TransferShards", transferShards);
+    KEY_INTEGER("DownloadManager", "WriteBehindThreads", writeBehindThreads);
+    KEY_INTEGER("DownloadManager", "WriteBehindBudgetKB", writeBehindBudgetKB);
+    KEY_STRING("DownloadManager", "WriteBehindBackend", writeBehindBackend);
+    KEY_STRING("DownloadManager", "Durability", durability);
+    KEY_INTEGER("DownloadManager", "DurabilitySyncMB", durabilitySyncMB);
+    KEY_INTEGER("DownloadManager", "DurabilitySyncSeconds", durabilitySyncSeconds);
+    KEY_INTEGER("DownloadManager", "StreamingThresholdMB", streamingThresholdMB);
+    KEY_INTEGER("DownloadManager", "DownloadSegments", downloadSegments);
+    KEY_INTEGER("DownloadManager", "SegmentMinMB", segmentMinMB);
+    KEY_INTEGER("DownloadManager", "HedgePercentile", hedgePercentile);
+    KEY_INTEGER("DownloadManager", "HedgeMinSamples", hedgeMinSamples);
+    KEY_BOOLEAN("DownloadManager", "HttpMultiplex", httpMultiplex);
+    KEY_INTEGER("DownloadManager", "MaxHostConnections", maxHostConnections);
+    KEY_INTEGER("DownloadManager", "MaxTotalConnections", maxTotalConnections);
+    KEY_INTEGER("DownloadManager", "ConnectionCacheSize", connectionCacheSize);
+    KEY_INTEGER("DownloadManager", "IdleRestartSeconds", idleRestartSeconds);
+    KEY_INTEGER("DownloadManager", "HandlePoolSize", handlePoolSize);
+    KEY_INTEGER("DownloadManager", "RedirectCacheSeconds", redirectCacheSeconds);
+    KEY_STRING("DownloadManager", "ContentStoreDir", contentStoreDir);
+    KEY_INTEGER("DownloadManager", "ContentStoreMaxMB", contentStoreMaxMB);
+    KEY_INTEGER("DownloadManager", "ResumeVerifyKB", resumeVerifyKB);
+    KEY_BOOLEAN("DownloadManager", "PreemptLowerPriority", preemptLowerPriority);
+    KEY_INTEGER("DownloadManager", "FairShareQuantumKB", fairShareQuantumKB);
+    KEY_INTEGER("DownloadManager", "DefaultOwnerWeight", defaultOwnerWeight);
+    KEY_INTEGER("DownloadManager", "DefaultOwnerMaxSlots", defaultOwnerMaxSlots);
+    loadOwnerShares(keyfile);
+    KEY_INTEGER("DownloadManager", "DefaultOwnerMaxRecvSpeed", defaultOwnerMaxRecvSpeed);
+    loadOwnerRecvSpeeds(keyfile);
 
     g_key_file_free( keyfile );
 
@@ -319,6 +413,62 @@ void DownloadSettings::load( )
 }
 
 
+// [FairShare] lines are <owner>=<weight>[,<slot cap>]
+void DownloadSettings::loadOwnerShares(GKeyFile * keyfile)
+{
+    gchar ** owners = g_key_file_get_keys(keyfile,"FairShare",NULL,NULL);
+    if (owners == NULL)
+        return;
+
+    for (gchar ** owner = owners; *owner != NULL; ++owner) {
+        gchar * value = g_key_file_get_value(keyfile,"FairShare",*owner,NULL);
+        if (value == NULL)
+            continue;
+        char * rest = NULL;
+        unsigned int weight = g_ascii_strtoull(value,&rest,10);
+        unsigned int maxSlots = defaultOwnerMaxSlots;
+        if ((rest != NULL) && (*rest == ','))
+            maxSlots = g_ascii_strtoull(rest + 1,NULL,10);
+        ownerShares[*owner] = std::make_pair(weight > 0 ? weight : 1,maxSlots);
+        g_free(value);
+    }
+    g_strfreev(owners);
+}
+
+void DownloadSettings::loadOwnerRecvSpeeds(GKeyFile * keyfile)
+{
+    gchar ** owners = g_key_file_get_keys(keyfile,"RecvSpeed",NULL,NULL);
+    if (owners == NULL)
+        return;
+
+    for (gchar ** owner = owners; *owner != NULL; ++owner) {
+        gchar * value = g_key_file_get_value(keyfile,"RecvSpeed",*owner,NULL);
+        if (value == NULL)
+            continue;
+        ownerRecvSpeeds[*owner] = g_ascii_strtoull(value,NULL,10);
+        g_free(value);
+    }
+    g_strfreev(owners);
+}
+
+unsigned int DownloadSettings::ownerWeight(const std::string& owner) const
+{
+    std::map<std::string,std::pair<unsigned int,unsigned int> >::const_iterator it = ownerShares.find(owner);
+    return (it != ownerShares.end()) ? it->second.first : defaultOwnerWeight;
+}
+
+unsigned int DownloadSettings::ownerMaxSlots(const std::string& owner) const
+{
+    std::map<std::string,std::pair<unsigned int,unsigned int> >::const_iterator it = ownerShares.find(owner);
+    return (it != ownerShares.end()) ? it->second.second : defaultOwnerMaxSlots;
+}
+
+unsigned int DownloadSettings::ownerMaxRecvSpeed(const std::string& owner) const
+{
+    std::map<std::string,unsigned int>::const_iterator it = ownerRecvSpeeds.find(owner);
+    return (it != ownerRecvSpeeds.end()) ? it->second : defaultOwnerMaxRecvSpeed;
+}
+
 // Expands "1MB" --> 1048576, "2k" --> 2048, etc.
 unsigned long MemStringToBytes( const char* ptr )
 {
@@ -20,6 +20,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
 #include <glib.h>
 #include <stdint.h>
 #include "Singleton.hpp"
@@ -56,7 +57,43 @@ public:
 
     unsigned int    maxDownloadManagerQueueLength;
     int             maxDownloadManagerConcurrent;
-    unsigned int    maxDownloadManagerRecvSpeed;
+    unsigned int    maxDownloadManagerRecvSpeed;    //bytes per second shared by all transfers (0: no limit)
+    unsigned int    recvSpeedBurstMs;               //...of which at most this long's worth is saved up while they are idle
+    std::string     curlBackend;                    //"socket" (curl_multi_socket_action) or "fdset" (curl_multi_fdset scanning)
+    bool            transferThread;                 //run the curl multi loop on its own thread instead of the main loop
+    int             transferShards;                 //number of curl multi handles, each on its own thread if > 1
+    int             writeBehindThreads;             //disk writer threads behind the curl write callback; 0 = write in the callback
+    unsigned int    writeBehindBudgetKB;            //unwritten data per download before its transfer is paused
+    std::string     writeBehindBackend;             //"threads" or "io_uring" (falls back to "threads")
+    std::string     durability;                     //default DurabilityMode: "never", "completion", "pause" or "interval"
+    unsigned int    durabilitySyncMB;               //"interval": start writeback after this much data...
+    unsigned int    durabilitySyncSeconds;          //...or this much time, whichever comes first
+    unsigned int    streamingThresholdMB;           //downloads this big are dropped from the page cache once written back (0: never)
+    unsigned int    downloadSegments;               //byte-range connections a download may be split over (1: never split)...
+    unsigned int    segmentMinMB;                   //...each getting at least this much of it
+    unsigned int    hedgePercentile;                //send a second request if no data by this percentile of the host's recent TTFBs (0: never)...
+    unsigned int    hedgeMinSamples;                //...once that many have been seen
+    bool            httpMultiplex;                  //HTTP/2: downloads from one host share a connection
+    unsigned int    maxHostConnections;             //connections open to one host, per transfer engine (0: no limit)
+    unsigned int    maxTotalConnections;            //connections open in all, shared out over the engines (0: no limit)
+    unsigned int    connectionCacheSize;            //idle connections kept for reuse, per transfer engine
+    unsigned int    idleRestartSeconds;             //glibcurl is restarted, dropping those, once nothing has run this long (0: at once)
+    unsigned int    handlePoolSize;                 //finished downloads' curl handles kept for the next ones (0: none)
+    unsigned int    redirectCacheSeconds;           //how long a url that redirected goes straight to where it led (0: never)
+    std::string     contentStoreDir;                //completed downloads' content, stored once and linked to (empty: no store)...
+    unsigned int    contentStoreMaxMB;              //...dropping what went in first past this much (0: no limit)
+    unsigned int    resumeVerifyKB;                 //a resume fetches this much before where it left off again, to compare (0: don't)
+    bool            preemptLowerPriority;           //a queued download pauses a running one of lower priority to start
+    unsigned int    fairShareQuantumKB;             //credit per turn of an owner of weight 1 in the queue's round robin
+    unsigned int    defaultOwnerWeight;             //[FairShare] weight and slot cap (0: none) of owners not listed there
+    unsigned int    defaultOwnerMaxSlots;
+    std::map<std::string,std::pair<unsigned int,unsigned int> > ownerShares;   //[FairShare]: owner -> weight, slot cap
+    unsigned int    defaultOwnerMaxRecvSpeed;       //[RecvSpeed] bytes per second (0: no limit) of owners not listed there
+    std::map<std::string,unsigned int> ownerRecvSpeeds;
+
+    unsigned int    ownerWeight(const std::string& owner) const;
+    unsigned int    ownerMaxSlots(const std::string& owner) const;
+    unsigned int    ownerMaxRecvSpeed(const std::string& owner) const;
 
     uint32_t        freespaceLowmarkFullPercent;
     uint32_t        freespaceMedmarkFullPercent;
@@ -69,6 +106,8 @@ public:
 
 private:
     void load();
+    void loadOwnerShares(GKeyFile * keyfile);
+    void loadOwnerRecvSpeeds(GKeyFile * keyfile);
     DownloadSettings();
     ~DownloadSettings();
 
@@ -20,6 +20,8 @@
 #include "JUtil.h"
 #include "Utils.h"
 #include <pbnjson.hpp>
+#include <unistd.h>
+#include <algorithm>
 
 DownloadTask::DownloadTask()
     : ticket(0)
@@ -33,17 +35,56 @@ DownloadTask::DownloadTask()
     , applicationPackage(0)
     , curlDesc(0)
     , fp(0)
+    , writer(0)
+    , durability(DURABILITY_INTERVAL)
+    , lastSyncAt(0)
+    , lastSyncTimeUs(0)
+    , syncedTo(0)
+    , diskFull(false)
+    , streaming(false)
+    , acceptRanges(false)
+    , splitRequested(false)
+    , primaryPos(0)
+    , primaryEnd(0)
+    , primaryFilled(false)
+    , primaryDone(false)
+    , primaryResult(CURLE_OK)
+    , primaryHttpCode(0)
+    , primaryHttpConnectCode(0)
+    , segmentResult(CURLE_OK)
+    , hedge(0)
+    , hedgeWinner(0)
+    , startedUs(0)
+    , hedgeDueUs(0)
+    , firstByteUs(0)
+    , droppedTo(0)
+    , redirected(false)
+    , useContentStore(false)
+    , revalidated(false)
+    , hash(0)
+    , verifyPos(0)
+    , rehash(0)
+    , rehashSkip(0)
     , queued(false)
+    , priority(0)
+    , bytesAtStart(0)
+    , maxRecvSpeed(0)
+    , recvSpeedShare(0)
+    , recvPrepaid(0)
     , numErrors(0)
     , canHandlePause (false)
     , autoResume(true)
     , appendTargetFile(false)
+    , aggregate(false)
     , remainingRedCounts(MAXREDIRECTIONS)
 {
 }
 
 DownloadTask::~DownloadTask()
 {
+        closeWriter();
+        dropSegments();
+        delete hash;
         if (fp) {
             if (fclose(fp) != 0) {
                 LOG_DEBUG ("Function fclose() failed");
@@ -51,6 +92,202 @@ DownloadTask::~DownloadTask()
         }
 }
 
+uint64_t DownloadTask::closeWriter()
+{
+    uint64_t lost = 0;
+    for (std::vector<DownloadSegment *>::iterator it = segments.begin(); it != segments.end(); ++it) {
+        uint64_t segmentLost = std::min((*it)->closeWriter(),(*it)->received);
+        (*it)->received -= segmentLost;
+        lost += segmentLost;
+    }
+
+    if (writer == NULL)
+        return lost;
+
+    uint64_t primaryLost = writer->drain();
+    delete writer;
+    writer = NULL;
+    if (isSplit())
+        primaryPos -= std::min(primaryLost,primaryPos);
+    return lost + primaryLost;
+}
+
+uint64_t DownloadSegment::closeWriter()
+{
+    if (writer == NULL)
+        return 0;
+
+    uint64_t lost = writer->drain();
+    delete writer;
+    writer = NULL;
+    return lost;
+}
+
+DownloadSegment * DownloadTask::segmentFor(CURL * handle)
+{
+    for (std::vector<DownloadSegment *>::iterator it = segments.begin(); it != segments.end(); ++it) {
+        if ((*it)->handle == handle)
+            return *it;
+    }
+    return NULL;
+}
+
+bool DownloadTask::segmentsRunning() const
+{
+    for (std::vector<DownloadSegment *>::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+        if ((*it)->handle != NULL)
+            return true;
+    }
+    return false;
+}
+
+uint64_t DownloadTask::contiguousBytes() const
+{
+    if (!isSplit())
+        return bytesCompleted;
+    if (primaryPos < primaryEnd)
+        return primaryPos;
+
+    //segments are kept in file order
+    uint64_t upTo = primaryEnd;
+    for (std::vector<DownloadSegment *>::const_iterator it = segments.begin(); it != segments.end(); ++it) {
+        if ((*it)->start != upTo)
+            break;
+        upTo += (*it)->received;
+        if (!(*it)->complete())
+            break;
+    }
+    return upTo;
+}
+
+void DownloadTask::trimToContiguous()
+{
+    if (!isSplit())
+        return;
+
+    uint64_t upTo = contiguousBytes();
+    if ((upTo < bytesTotal) && fp) {
+        //whatever the segments got past the first gap goes
+        if (fflush(fp) != 0) {
+            LOG_DEBUG ("Function fflush() failed");
+        }
+        if (ftruncate64(fileno(fp),upTo) != 0) {
+            LOG_DEBUG ("Function ftruncate64() failed: id(%lu)", ticket);
+        }
+    }
+    bytesCompleted = upTo;
+
+    dropSegments();
+    primaryPos = 0;
+    primaryEnd = 0;
+    primaryFilled = false;
+    primaryDone = false;
+}
+
+void DownloadTask::dropSegments()
+{
+    for (std::vector<DownloadSegment *>::iterator it = segments.begin(); it != segments.end(); ++it) {
+        if ((*it)->handle)
+            curl_easy_cleanup((*it)->handle);
+        delete *it;
+    }
+    segments.clear();
+}
+
+void DownloadTask::setMirrors(const std::vector<std::string>& urls)
+{
+    mirrors.clear();
+    for (std::vector<std::string>::const_iterator it = urls.begin(); it != urls.end(); ++it) {
+        if (!it->empty() && (*it != url) && (std::find(mirrors.begin(),mirrors.end(),*it) == mirrors.end()))
+            mirrors.push_back(*it);
+    }
+    sourceBytes.assign(sourceCount(),0);
+    sourceBytesPerSec.assign(sourceCount(),0);
+    sourceFailures.assign(sourceCount(),0);
+}
+
+double DownloadTask::sourceWeight(int source) const
+{
+    if ((source >= 0) && ((size_t)source < sourceBytesPerSec.size()) && (sourceBytesPerSec[source] > 0))
+        return sourceBytesPerSec[source];
+
+    double total = 0;
+    int measured = 0;
+    for (std::vector<double>::const_iterator it = sourceBytesPerSec.begin(); it != sourceBytesPerSec.end(); ++it) {
+        if (*it > 0) {
+            total += *it;
+            ++measured;
+        }
+    }
+    return measured ? (total / measured) : 1.0;
+}
+
+int DownloadTask::nextSource(int failed) const
+{
+    int best = -1;
+    for (int source = 0; (size_t)source < sourceFailures.size(); ++source) {
+        if (source == failed)
+            continue;
+        if ((best < 0) || (sourceFailures[source] < sourceFailures[best])
+                || ((sourceFailures[source] == sourceFailures[best]) && (sourceWeight(source) > sourceWeight(best))))
+            best = source;
+    }
+    return (best < 0) ? failed : best;
+}
+
+void DownloadTask::noteSourceRate(int source, double bytesPerSec)
+{
+    if ((source < 0) || ((size_t)source >= sourceBytesPerSec.size()))
+        return;
+    if (sourceBytesPerSec[source] > 0)
+        sourceBytesPerSec[source] = (sourceBytesPerSec[source] + bytesPerSec) / 2;
+    else
+        sourceBytesPerSec[source] = bytesPerSec;
+}
+
+void DownloadTask::syncFile()
+{
+    if (fp == NULL)
+        return;
+
+    if (fflush(fp) != 0) {
+        LOG_DEBUG ("Function fflush() failed");
+    }
+    if (fdatasync(fileno(fp)) != 0) {
+        LOG_DEBUG ("Function fdatasync() failed");
+    }
+}
+
+//static
+DurabilityMode DownloadTask::durabilityFromString(const std::string& mode, DurabilityMode fallback)
+{
+    if (mode == "never")
+        return DURABILITY_NEVER;
+    if (mode == "completion")
+        return DURABILITY_COMPLETION;
+    if (mode == "pause")
+        return DURABILITY_PAUSE;
+    if (mode == "interval")
+        return DURABILITY_INTERVAL;
+    return fallback;
+}
+
+//static
+const char * DownloadTask::durabilityToString(DurabilityMode mode)
+{
+    switch (mode) {
+    case DURABILITY_NEVER:
+        return "never";
+    case DURABILITY_COMPLETION:
+        return "completion";
+    case DURABILITY_PAUSE:
+        return "pause";
+    case DURABILITY_INTERVAL:
+    default:
+        return "interval";
+    }
+}
+
 void DownloadTask::setMimeType(const std::string& type)
 {
         detectedMIMEType = type;
@@ -117,6 +354,29 @@ pbnjson::JValue DownloadTask::toJSON()
     jobj.put("canHandlePause", canHandlePause);
     jobj.put("autoResume", autoResume);
     jobj.put("cookieHeader", cookieHeader);
+    jobj.put("durability", durabilityToString(durability));
+    jobj.put("aggregate", aggregate);
+    jobj.put("priority", (int32_t)priority);
+    jobj.put("maxRecvSpeed", (int64_t)maxRecvSpeed);
+    if (!hashAlgorithm.empty()) {
+        jobj.put("hashAlgorithm", hashAlgorithm);
+        if (!expectedHash.empty())
+            jobj.put("expectedHash", expectedHash);
+        if (!hashValue.empty())
+            jobj.put("hash", hashValue);
+    }
+    if (hasMirrors()) {
+        //which of the sources served how much
+        pbnjson::JValue sources = pbnjson::Array();
+        for (size_t i = 0; i < sourceCount(); ++i) {
+            pbnjson::JValue source = pbnjson::Object();
+            source.put("url", sourceUrl(i));
+            source.put("e_bytes", Utils::toString(i < sourceBytes.size() ? sourceBytes[i] : 0));
+            source.put("failures", (int32_t)(i < sourceFailures.size() ? sourceFailures[i] : 0));
+            sources.append(source);
+        }
+        jobj.put("sources", sources);
+    }
 
     return jobj;
 
@@ -20,8 +20,11 @@
 #include "glib.h"
 #include "glibcurl.h"
 #include <string>
+#include <vector>
 #include <pbnjson.hpp>
 #include "Time.h"
+#include "DiskWriter.h"
+#include "StreamHash.h"
 
 /* COMMENT:
  *
@@ -112,6 +115,40 @@ private:
     long _httpConnectCode;
 };
 
+// When a download's data is forced to disk. Each mode also syncs where the ones before it do.
+enum DurabilityMode {
+    DURABILITY_NEVER,           // leave it to the kernel
+    DURABILITY_COMPLETION,      // fdatasync once the download has completed successfully
+    DURABILITY_PAUSE,           // ...and when it is paused or interrupted
+    DURABILITY_INTERVAL         // ...and start writeback every DurabilitySyncMB / DurabilitySyncSeconds
+};
+
+// One extra byte-range connection of a split ticket (see DownloadManager::splitDownload). Offsets are into
+// the temp file; the ticket's own handle keeps the range in front of the first segment.
+class DownloadSegment {
+
+public:
+    DownloadSegment(CURL * h, uint64_t from, uint64_t to)
+        : handle(h) , start(from) , end(to) , received(0) , writer(0) , retries(0)
+        , link(0) , source(0) , runStartUs(0) , runStartBytes(0) {}
+    ~DownloadSegment() { closeWriter(); }
+
+    // as DownloadTask::closeWriter()
+    uint64_t closeWriter();
+    bool complete() const { return (start + received >= end); }
+
+    CURL * handle;              // NULL once it has finished (or been given up on)
+    uint64_t start;
+    uint64_t end;               // exclusive
+    uint64_t received;          // written at start.. so far
+    DiskWriter * writer;
+    int retries;
+    int link;                   // DownloadManager::Connection it is bound to (aggregate tickets), ANY: the ticket's
+    int source;                 // DownloadTask::sourceUrl() it is fetched from
+    gint64 runStartUs;          // when its current transfer was started...
+    uint64_t runStartBytes;     // ...and received at that point, for the link's throughput
+};
+
 class DownloadTask {
 
 public:
@@ -141,10 +178,41 @@ public:
 
     void setLocationHeader(const std::string& s) { httpHeader_Location = s; }
     void setUpdateInterval(uint64_t interval = 0);
+    // waits for the write-behind backlog to hit the file, then drops the writer; returns bytes that never made it
+    uint64_t closeWriter();
+    // forces what has been written so far to disk; call after closeWriter()
+    void syncFile();
+
+    // segmented downloads (the helpers are called with glibcurl_lock held, or from the ticket's curl callbacks)
+    bool isSplit() const { return !segments.empty(); }
+    DownloadSegment * segmentFor(CURL * handle);
+    bool segmentsRunning() const;
+    // bytes from the start of the file up to the first gap
+    uint64_t contiguousBytes() const;
+    // once the segments are stopped and closeWriter() has been called: cuts the file back to the first gap and
+    // makes this an ordinary download again, which a resume can append to
+    void trimToContiguous();
+    void dropSegments();
+
+    // multi-source downloads: source 0 is url, the others are mirrors
+    void setMirrors(const std::vector<std::string>& urls);
+    bool hasMirrors() const { return !mirrors.empty(); }
+    size_t sourceCount() const { return mirrors.size() + 1; }
+    const std::string& sourceUrl(int source) const { return (source <= 0) ? url : mirrors[source - 1]; }
+    // share of the work a source gets: its measured throughput, else the average of the measured ones
+    double sourceWeight(int source) const;
+    // where a range goes after 'failed' let it down: the fastest of the sources that have failed the least
+    int nextSource(int failed) const;
+    void noteSourceRate(int source, double bytesPerSec);
+
+    // where the transfer asks the server to start: bytesCompleted, less the part of verifyTail not compared yet
+    uint64_t resumeOffset() const { return bytesCompleted - (verifyTail.size() - verifyPos); }
+
+    static DurabilityMode durabilityFromString(const std::string& mode, DurabilityMode fallback);
+    static const char * durabilityToString(DurabilityMode mode);
 
     // functions for counting maximum redirections.
     int getRemainingRedCounts() { return remainingRedCounts; }
-    void decreaseRedCounts() { remainingRedCounts--; }
     void setRemainingRedCounts(const int currentRedCounts) { remainingRedCounts = currentRedCounts; }
 
     //the following do NOT go into the json record of the task
@@ -153,14 +221,65 @@ public:
     int applicationPackage;     //  > 0 if the download represents an application package
     CurlDescriptor curlDesc;
     FILE * fp;
+    DiskWriter * writer;            // write-behind stage in front of fp, created on the first write if enabled
+    DurabilityMode durability;
+    uint64_t lastSyncAt;            // bytesCompleted when the last interval writeback was started
+    gint64 lastSyncTimeUs;          //  "" monotonic time
+    off64_t syncedTo;               // writebackRange() state when writing without a DiskWriter
+    bool diskFull;                  // space for the Content-Length couldn't be reserved; the transfer was aborted
+    bool streaming;                 // at least StreamingThresholdMB: written back and dropped from the page cache as it goes
+    bool acceptRanges;              // server said Accept-Ranges: bytes
+    bool splitRequested;
+    uint64_t primaryPos;            // split: where curlDesc's handle writes next...
+    uint64_t primaryEnd;            //  ...and where it stops
+    bool primaryFilled;             // ...reached primaryEnd; its transfer was cut off there on purpose
+    bool primaryDone;               // ...finished, but segments were still running; its results are below
+    CURLcode primaryResult;
+    long primaryHttpCode;
+    long primaryHttpConnectCode;
+    CURLcode segmentResult;         // != CURLE_OK: a segment gave up, so the ticket is interrupted
+    std::vector<DownloadSegment *> segments;
+    CURL * hedge;                   // duplicate request racing curlDesc's handle for the first byte (HedgePercentile)
+    CURL * hedgeWinner;             // ...whichever of the two brought data first; the other one is dropped
+    gint64 startedUs;               // monotonic time the transfer was handed to glibcurl...
+    gint64 hedgeDueUs;              // ...when it gets hedged if no data has come by then (0: never)...
+    gint64 firstByteUs;             // ...and when data did come (0: not yet)
+    off64_t droppedTo;              // writebackRange() state, streaming without a DiskWriter
+    std::string requestedUrl;       // url as asked for, before a cached redirect or the ones followed...
+    bool redirected;                // ...which there were; url is where they ended up
+    std::string etag;               // validators the server sent with the file...
+    std::string lastModified;
+    std::string revalidateTarget;   // ...and of a "revalidate" download, the file the last one of the url left, sent
+                                    //  along as If-None-Match / If-Modified-Since; a 304 completes the ticket with it
+    std::string storedContent;      // ...or of a url the content store has, its file there, which a 304 copies to the target
+    bool useContentStore;           // "contentStore": looked up in the content store, and put into it once complete
+    bool revalidated;
+    std::string hashAlgorithm;      // "sha256" / "crc32c" of a download that asked for its hash...
+    std::string expectedHash;       // ...what it has to come to (lower case hex; "": just report it)...
+    StreamHash * hash;              // ...taken over what it has received so far (cbWriteEvent)...
+    std::string hashValue;          // ...and what it came to, once complete
+    std::vector<unsigned char> verifyTail;  // a resume's last ResumeVerifyKB of the file, which the server sends again...
+    size_t verifyPos;               // ...and how much of it has been compared with what came (cbWriteEvent)
+    void * volatile rehash;         // DownloadManager::PrefixRehash taking the hash over the temp file again; writes wait for it...
+    size_t rehashSkip;              // ...and of the payload they were paused on, what verifyResume had compared
     bool queued;
-    std::string httpHeader_Location; //for 301/302 Redirect codes, unused otherwise
+    int priority;                   // queued downloads start highest first (DownloadQueue)
+    uint64_t bytesAtStart;          // bytesCompleted when it got its slot; what it fetches from there is charged to its owner
+    uint64_t maxRecvSpeed;          // "maxRecvSpeed", bytes per second (0: no limit of its own)...
+    uint64_t recvSpeedShare;        // ...and what it gets of that and its owner's limit (redistributeRecvSpeeds())
+    size_t recvPrepaid;             // payload curl offers again (paused by the disk writer) that MaxRecvSpeed has let through already
+    std::string httpHeader_Location; //last Location header seen (redirects are followed by curl)
     int  numErrors;
     std::string ownerId;
     std::string connectionName;
     bool canHandlePause;
     bool autoResume;
     bool appendTargetFile;
+    bool aggregate;                 // byte ranges spread over every connected interface ("interface":"aggregate")
+    std::vector<std::string> mirrors;       // more URLs for the same content ("mirrors")
+    std::vector<uint64_t> sourceBytes;      // by source: bytes it served...
+    std::vector<double> sourceBytesPerSec;  // ...throughput of its ranges (0: not measured yet)...
+    std::vector<int> sourceFailures;        // ...and ranges it failed
 
     // rfc2616 (HTTP/1.1) recommends maximum of five redirections.
     static const int MAXREDIRECTIONS = 5;
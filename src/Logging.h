@@ -30,7 +30,7 @@
 #define LOGID_REQ_DOWNLOAD_HISTORY_JSON_FAIL            "DNLD_HIST_JSON_FAIL"                // Failed to find param in message - getAllHistory
 #define LOGID_DNLD_HIST_DB_STMT_PREPARE_FAIL            "DNLD_HIST_DBSTMT_FAIL"              // Failed to prepare sql statement
 #define LOGID_DNLD_STATUS_QUERY_JSON_FAIL               "DNLD_STATUS_QUERY_FAIL"             // "ticket" Parameter not found in downloadStatusQuery
-#define LOGID_GCURL_FDMAX_WARNING                       "GLIBCURL_FDMAX_REGISTER_WARNING"    // FD's reached max - registerUnregisterFds
+#define LOGID_GCURL_FDMAX_WARNING                       "GLIBCURL_FDMAX_REGISTER_WARNING"    // curl_multi_fdset returned an invalid fdMax - registerUnregisterFds
 #define LOGID_DB_OPEN_ERROR                             "DB_OPEN_ERROR"                      // downloadhistory db open error
 #define LOGID_DB_INTEGRITY_ERROR                        "DB_INTEGRITY_ERROR"                 // failed to check download DB integrity and couldn't recreate it
 #define LOGID_DB_RECREATION_FAIL                        "DB_RECREATION_FAIL"                 // failed to create downloadhistory table
@@ -43,11 +43,31 @@ static void handle_sigterm(int signal)
     g_main_loop_quit(gMainLoop);
 }
 
+// every concurrent transfer holds at least one socket plus its target file, on top of
+// sqlite, LS2 and log descriptors; lift the soft limit as far as the hard limit allows
+static void raiseFileDescriptorLimit()
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        LOG_DEBUG ("Function getrlimit() failed");
+        return;
+    }
+    if (rl.rlim_cur == rl.rlim_max)
+        return;
+    rl.rlim_cur = rl.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+        LOG_DEBUG ("Function setrlimit() failed");
+        return;
+    }
+    LOG_DEBUG ("%s: RLIMIT_NOFILE raised to %llu", __FUNCTION__, (unsigned long long)rl.rlim_cur);
+}
+
 int main( int argc, char** argv)
 {
     LOG_DEBUG ("LunaDownloadMgr STARTING");
 
     signal(SIGTERM, handle_sigterm);
+    raiseFileDescriptorLimit();
 
     gMainLoop = g_main_loop_new (NULL, FALSE);
     LOG_DEBUG ("%s:%d gMainLoop = %p", __FILE__, __LINE__, gMainLoop);
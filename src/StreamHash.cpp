@@ -0,0 +1,515 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define STREAMHASH_X86
+#endif
+
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#include <arm_neon.h>
+#define STREAMHASH_ARM_SHA2
+#endif
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define STREAMHASH_ARM_CRC32
+#endif
+#endif
+
+#include "StreamHash.h"
+
+#define STREAMHASH_READBUFFER   (256 * 1024)
+
+namespace {
+
+typedef void (*Sha256Blocks)(uint32_t state[8], const unsigned char * data, size_t blocks);
+typedef uint32_t (*Crc32cUpdate)(uint32_t crc, const unsigned char * data, size_t len);
+
+Sha256Blocks s_sha256Blocks = NULL;
+const char * s_sha256Kernel = "c";
+Crc32cUpdate s_crc32c = NULL;
+const char * s_crc32cKernel = "c";
+
+const uint32_t s_sha256Init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+const uint32_t s_sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+uint32_t s_crc32cTable[8][256];
+
+inline uint32_t ror32(uint32_t x, unsigned int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+void sha256BlocksC(uint32_t state[8], const unsigned char * data, size_t blocks)
+{
+    uint32_t w[64];
+    while (blocks--) {
+        for (int i = 0; i < 16; ++i)
+            w[i] = ((uint32_t)data[4 * i] << 24) | ((uint32_t)data[4 * i + 1] << 16)
+                    | ((uint32_t)data[4 * i + 2] << 8) | (uint32_t)data[4 * i + 3];
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = ror32(w[i - 15],7) ^ ror32(w[i - 15],18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ror32(w[i - 2],17) ^ ror32(w[i - 2],19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (ror32(e,6) ^ ror32(e,11) ^ ror32(e,25)) + ((e & f) ^ (~e & g)) + s_sha256K[i] + w[i];
+            uint32_t t2 = (ror32(a,2) ^ ror32(a,13) ^ ror32(a,22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+// slicing-by-8 over the reflected Castagnoli polynomial
+uint32_t crc32cC(uint32_t crc, const unsigned char * data, size_t len)
+{
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        uint32_t hi = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+        crc = s_crc32cTable[7][lo & 0xff] ^ s_crc32cTable[6][(lo >> 8) & 0xff]
+                ^ s_crc32cTable[5][(lo >> 16) & 0xff] ^ s_crc32cTable[4][lo >> 24]
+                ^ s_crc32cTable[3][hi & 0xff] ^ s_crc32cTable[2][(hi >> 8) & 0xff]
+                ^ s_crc32cTable[1][(hi >> 16) & 0xff] ^ s_crc32cTable[0][hi >> 24];
+        data += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = (crc >> 8) ^ s_crc32cTable[0][(crc ^ *data++) & 0xff];
+    return crc;
+}
+
+#ifdef STREAMHASH_X86
+
+// the SHA extensions keep the state as ABEF / CDGH and take 4 rounds' message words at a time
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256BlocksShaNi(uint32_t state[8], const unsigned char * data, size_t blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]),0xB1);      //CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]),0x1B);   //EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp,state1,8);                                         //ABEF
+    state1 = _mm_blend_epi16(state1,tmp,0xF0);                                              //CDGH
+
+    while (blocks--) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        __m128i w[4];
+
+        for (int group = 0; group < 16; ++group) {
+            __m128i& words = w[group & 3];
+            if (group < 4) {
+                words = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * group)),byteSwap);
+            }
+            else {
+                __m128i previous = w[(group + 3) & 3];
+                words = _mm_add_epi32(_mm_sha256msg1_epu32(words,w[(group + 1) & 3]),
+                                      _mm_alignr_epi8(previous,w[(group + 2) & 3],4));
+                words = _mm_sha256msg2_epu32(words,previous);
+            }
+            __m128i msg = _mm_add_epi32(words,_mm_loadu_si128((const __m128i *)&s_sha256K[4 * group]));
+            state1 = _mm_sha256rnds2_epu32(state1,state0,msg);
+            state0 = _mm_sha256rnds2_epu32(state0,state1,_mm_shuffle_epi32(msg,0x0E));
+        }
+
+        state0 = _mm_add_epi32(state0,abefSave);
+        state1 = _mm_add_epi32(state1,cdghSave);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0,0x1B);                       //FEBA
+    state1 = _mm_shuffle_epi32(state1,0xB1);                    //DCHG
+    _mm_storeu_si128((__m128i *)&state[0],_mm_blend_epi16(tmp,state1,0xF0));    //DCBA
+    _mm_storeu_si128((__m128i *)&state[4],_mm_alignr_epi8(state1,tmp,8));       //HGFE
+}
+
+__attribute__((target("sse4.2")))
+uint32_t crc32cSse42(uint32_t crc, const unsigned char * data, size_t len)
+{
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word,data,8);
+        crc64 = _mm_crc32_u64(crc64,word);
+        data += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while (len--)
+        crc = _mm_crc32_u8(crc,*data++);
+    return crc;
+}
+
+#endif
+
+#ifdef STREAMHASH_ARM_SHA2
+
+void sha256BlocksArmv8(uint32_t state[8], const unsigned char * data, size_t blocks)
+{
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+
+    while (blocks--) {
+        uint32x4_t abcdSave = state0;
+        uint32x4_t efghSave = state1;
+        uint32x4_t w[4];
+
+        for (int group = 0; group < 16; ++group) {
+            uint32x4_t& words = w[group & 3];
+            if (group < 4)
+                words = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * group)));
+            else
+                words = vsha256su1q_u32(vsha256su0q_u32(words,w[(group + 1) & 3]),w[(group + 2) & 3],w[(group + 3) & 3]);
+            uint32x4_t msg = vaddq_u32(words,vld1q_u32(&s_sha256K[4 * group]));
+            uint32x4_t abcd = state0;
+            state0 = vsha256hq_u32(state0,state1,msg);
+            state1 = vsha256h2q_u32(state1,abcd,msg);
+        }
+
+        state0 = vaddq_u32(state0,abcdSave);
+        state1 = vaddq_u32(state1,efghSave);
+        data += 64;
+    }
+
+    vst1q_u32(&state[0],state0);
+    vst1q_u32(&state[4],state1);
+}
+
+#endif
+
+#ifdef STREAMHASH_ARM_CRC32
+
+uint32_t crc32cArmv8(uint32_t crc, const unsigned char * data, size_t len)
+{
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word,data,8);
+        crc = __crc32cd(crc,word);
+        data += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = __crc32cb(crc,*data++);
+    return crc;
+}
+
+#endif
+
+std::string toHex(const unsigned char * bytes, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(2 * len);
+    for (size_t i = 0; i < len; ++i) {
+        hex += digits[bytes[i] >> 4];
+        hex += digits[bytes[i] & 0x0f];
+    }
+    return hex;
+}
+
+bool fromHex(const std::string& hex, unsigned char * bytes, size_t len)
+{
+    if (hex.size() != 2 * len)
+        return false;
+    for (size_t i = 0; i < len; ++i) {
+        char pair[3] = { hex[2 * i], hex[2 * i + 1], 0 };
+        char * end = NULL;
+        bytes[i] = (unsigned char)strtoul(pair,&end,16);
+        if (*end != 0)
+            return false;
+    }
+    return true;
+}
+
+void putBigEndian(uint32_t value, unsigned char * to)
+{
+    to[0] = (unsigned char)(value >> 24);
+    to[1] = (unsigned char)(value >> 16);
+    to[2] = (unsigned char)(value >> 8);
+    to[3] = (unsigned char)value;
+}
+
+}
+
+StreamHash::StreamHash(Algorithm algorithm)
+    : m_algorithm(algorithm)
+    , m_length(0)
+    , m_crc(0xffffffff)
+{
+    memcpy(m_sha,s_sha256Init,sizeof(m_sha));
+    memset(m_block,0,sizeof(m_block));
+}
+
+void StreamHash::selectKernels()
+{
+    if (s_sha256Blocks != NULL)
+        return;
+
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t crc = n;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82f63b78 : (crc >> 1);
+        s_crc32cTable[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; ++n)
+        for (int k = 1; k < 8; ++k)
+            s_crc32cTable[k][n] = (s_crc32cTable[k - 1][n] >> 8) ^ s_crc32cTable[0][s_crc32cTable[k - 1][n] & 0xff];
+
+    s_sha256Blocks = &sha256BlocksC;
+    s_crc32c = &crc32cC;
+
+#ifdef STREAMHASH_X86
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    bool ssse3 = false, sse41 = false, sse42 = false, sha = false;
+    if (__get_cpuid(1,&eax,&ebx,&ecx,&edx)) {
+        ssse3 = (ecx & (1u << 9)) != 0;
+        sse41 = (ecx & (1u << 19)) != 0;
+        sse42 = (ecx & (1u << 20)) != 0;
+    }
+    if (__get_cpuid_max(0,NULL) >= 7) {
+        __cpuid_count(7,0,eax,ebx,ecx,edx);
+        sha = (ebx & (1u << 29)) != 0;
+    }
+    if (sha && sse41 && ssse3) {
+        s_sha256Blocks = &sha256BlocksShaNi;
+        s_sha256Kernel = "sha-ni";
+    }
+    if (sse42) {
+        s_crc32c = &crc32cSse42;
+        s_crc32cKernel = "sse4.2";
+    }
+#endif
+
+#if defined(__aarch64__)
+    unsigned long hwcaps = getauxval(AT_HWCAP);
+#ifdef STREAMHASH_ARM_SHA2
+    if (hwcaps & HWCAP_SHA2) {
+        s_sha256Blocks = &sha256BlocksArmv8;
+        s_sha256Kernel = "armv8";
+    }
+#endif
+#ifdef STREAMHASH_ARM_CRC32
+    if (hwcaps & HWCAP_CRC32) {
+        s_crc32c = &crc32cArmv8;
+        s_crc32cKernel = "armv8";
+    }
+#endif
+    (void)hwcaps;
+#endif
+}
+
+StreamHash * StreamHash::create(const std::string& algorithm)
+{
+    selectKernels();
+    if (algorithm == "sha256")
+        return new StreamHash(SHA256);
+    if (algorithm == "crc32c")
+        return new StreamHash(CRC32C);
+    return NULL;
+}
+
+StreamHash * StreamHash::restore(const std::string& state)
+{
+    //<algorithm>:<bytes taken>:<hex of the state>[:<hex of the partial block>]
+    std::vector<std::string> fields;
+    size_t from = 0;
+    while (true) {
+        size_t colon = state.find(':',from);
+        fields.push_back(state.substr(from,colon == std::string::npos ? std::string::npos : colon - from));
+        if (colon == std::string::npos)
+            break;
+        from = colon + 1;
+    }
+    if (fields.size() < 3)
+        return NULL;
+
+    StreamHash * hash = create(fields[0]);
+    if (hash == NULL)
+        return NULL;
+
+    char * end = NULL;
+    hash->m_length = strtoull(fields[1].c_str(),&end,10);
+    bool valid = !fields[1].empty() && (*end == 0);
+    if (valid && (hash->m_algorithm == SHA256)) {
+        unsigned char words[32];
+        valid = (fields.size() == 4) && fromHex(fields[2],words,sizeof(words))
+                && fromHex(fields[3],hash->m_block,hash->m_length % 64);
+        for (int i = 0; valid && (i < 8); ++i)
+            hash->m_sha[i] = ((uint32_t)words[4 * i] << 24) | ((uint32_t)words[4 * i + 1] << 16)
+                            | ((uint32_t)words[4 * i + 2] << 8) | (uint32_t)words[4 * i + 3];
+    }
+    else if (valid) {
+        unsigned char crc[4];
+        valid = (fields.size() == 3) && fromHex(fields[2],crc,sizeof(crc));
+        if (valid)
+            hash->m_crc = ((uint32_t)crc[0] << 24) | ((uint32_t)crc[1] << 16) | ((uint32_t)crc[2] << 8) | (uint32_t)crc[3];
+    }
+
+    if (!valid) {
+        delete hash;
+        return NULL;
+    }
+    return hash;
+}
+
+size_t StreamHash::digestLength(const std::string& algorithm)
+{
+    if (algorithm == "sha256")
+        return 64;
+    if (algorithm == "crc32c")
+        return 8;
+    return 0;
+}
+
+const char * StreamHash::kernel(Algorithm algorithm)
+{
+    selectKernels();
+    return (algorithm == SHA256) ? s_sha256Kernel : s_crc32cKernel;
+}
+
+std::string StreamHash::algorithmName() const
+{
+    return (m_algorithm == SHA256) ? "sha256" : "crc32c";
+}
+
+void StreamHash::update(const unsigned char * data, size_t len)
+{
+    if (m_algorithm == CRC32C) {
+        m_crc = s_crc32c(m_crc,data,len);
+        m_length += len;
+        return;
+    }
+
+    size_t have = m_length % 64;
+    m_length += len;
+    if (have > 0) {
+        size_t take = std::min(len,64 - have);
+        memcpy(m_block + have,data,take);
+        data += take;
+        len -= take;
+        if (have + take < 64)
+            return;
+        s_sha256Blocks(m_sha,m_block,1);
+    }
+    if (len >= 64) {
+        s_sha256Blocks(m_sha,data,len / 64);
+        data += len - len % 64;
+        len %= 64;
+    }
+    if (len > 0)
+        memcpy(m_block,data,len);
+}
+
+bool StreamHash::updateFromFile(const std::string& path, uint64_t bytes)
+{
+    int fd = open(path.c_str(),O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    std::vector<unsigned char> buffer(STREAMHASH_READBUFFER);
+    while (bytes > 0) {
+        ssize_t got = read(fd,&buffer[0],(size_t)std::min((uint64_t)buffer.size(),bytes));
+        if ((got < 0) && (errno == EINTR))
+            continue;
+        if (got <= 0)
+            break;
+        update(&buffer[0],got);
+        bytes -= got;
+    }
+    close(fd);
+    return (bytes == 0);
+}
+
+std::string StreamHash::state() const
+{
+    char length[24];
+    snprintf(length,sizeof(length),"%llu",(unsigned long long)m_length);
+    if (m_algorithm == CRC32C) {
+        unsigned char crc[4];
+        putBigEndian(m_crc,crc);
+        return std::string("crc32c:") + length + ":" + toHex(crc,sizeof(crc));
+    }
+
+    unsigned char words[32];
+    for (int i = 0; i < 8; ++i)
+        putBigEndian(m_sha[i],words + 4 * i);
+    return std::string("sha256:") + length + ":" + toHex(words,sizeof(words)) + ":" + toHex(m_block,m_length % 64);
+}
+
+std::string StreamHash::digest()
+{
+    if (m_algorithm == CRC32C) {
+        unsigned char crc[4];
+        putBigEndian(~m_crc,crc);
+        return toHex(crc,sizeof(crc));
+    }
+
+    //0x80, zeros up to 56 bytes into a block, then the length in bits
+    unsigned char padding[72];
+    size_t have = m_length % 64;
+    size_t zeros = (have < 56) ? 55 - have : 119 - have;
+    uint64_t bits = m_length * 8;
+    padding[0] = 0x80;
+    memset(padding + 1,0,zeros);
+    for (int i = 0; i < 8; ++i)
+        padding[1 + zeros + i] = (unsigned char)(bits >> (56 - 8 * i));
+    update(padding,1 + zeros + 8);
+
+    unsigned char words[32];
+    for (int i = 0; i < 8; ++i)
+        putBigEndian(m_sha[i],words + 4 * i);
+    return toHex(words,sizeof(words));
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef STREAMHASH_H_
+#define STREAMHASH_H_
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * SHA-256 or CRC32C of a download, taken a payload at a time as the data comes in (cbWriteEvent), so that nobody
+ * has to read the file again to check it.
+ *
+ * The blocks go through the CPU's own instructions where it has them (x86 SHA-NI / SSE4.2, ARMv8 SHA2 / CRC32;
+ * picked once, at the first create()), through plain C otherwise. The state can be written out as a string and
+ * taken up again (a paused download's history record), so a resume carries on from where the pause left it.
+ *
+ */
+class StreamHash {
+
+public:
+
+    enum Algorithm { SHA256 , CRC32C };
+
+    // "sha256" or "crc32c"; NULL for anything else
+    static StreamHash * create(const std::string& algorithm);
+    // from what state() gave; NULL if it can't be read
+    static StreamHash * restore(const std::string& state);
+    // hex digits of a digest of the algorithm ("" for an unknown one: 0)
+    static size_t digestLength(const std::string& algorithm);
+    // the implementation in use: "sha-ni", "armv8" or "c" for SHA-256, "sse4.2", "armv8" or "c" for CRC32C
+    static const char * kernel(Algorithm algorithm);
+
+    void update(const unsigned char * data, size_t len);
+    // reads the first bytes of a file into it; false if it holds fewer
+    bool updateFromFile(const std::string& path, uint64_t bytes);
+
+    Algorithm algorithm() const { return m_algorithm; }
+    std::string algorithmName() const;
+    // bytes taken so far
+    uint64_t length() const { return m_length; }
+
+    std::string state() const;
+    // lower case hex; nothing can be added afterwards
+    std::string digest();
+
+private:
+
+    explicit StreamHash(Algorithm algorithm);
+    static void selectKernels();
+
+    Algorithm m_algorithm;
+    uint64_t m_length;
+    uint32_t m_sha[8];
+    unsigned char m_block[64];      // SHA-256 input short of a whole block (m_length % 64 bytes)
+    uint32_t m_crc;
+};
+
+#endif /* STREAMHASH_H_ */
@@ -0,0 +1,93 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+
+#include "TokenBucket.h"
+
+TokenBucket::TokenBucket()
+    : m_rate(0)
+    , m_burst(0)
+    , m_tokens(0)
+    , m_refilledUs(0)
+{
+    g_mutex_init(&m_lock);
+}
+
+TokenBucket::~TokenBucket()
+{
+    g_mutex_clear(&m_lock);
+}
+
+void TokenBucket::setRate(uint64_t bytesPerSecond, unsigned int burstMs, gint64 nowUs)
+{
+    g_mutex_lock(&m_lock);
+    refill(nowUs);
+    m_rate = bytesPerSecond;
+    m_burst = std::max((int64_t)(m_rate * burstMs / 1000),(int64_t)1);
+    //a new rate starts from a full bucket, but one in debt stays there: what was let through was let through
+    m_tokens = (m_tokens < 0) ? m_tokens : m_burst;
+    g_mutex_unlock(&m_lock);
+}
+
+uint64_t TokenBucket::rate()
+{
+    g_mutex_lock(&m_lock);
+    uint64_t rc = m_rate;
+    g_mutex_unlock(&m_lock);
+    return rc;
+}
+
+//with m_lock
+void TokenBucket::refill(gint64 nowUs)
+{
+    if ((m_rate > 0) && (nowUs > m_refilledUs)) {
+        //past a minute the bucket is full whatever the rate; the cap keeps the product in range
+        uint64_t elapsedUs = std::min((uint64_t)(nowUs - m_refilledUs),(uint64_t)60000000);
+        int64_t added = (int64_t)(elapsedUs * m_rate / 1000000);
+        if (added == 0)
+            return;         //less than a byte's worth: the time isn't used up
+        m_tokens = std::min(m_tokens + added,m_burst);
+    }
+    m_refilledUs = nowUs;
+}
+
+bool TokenBucket::take(size_t bytes, gint64 nowUs)
+{
+    g_mutex_lock(&m_lock);
+    bool rc = true;
+    if (m_rate > 0) {
+        refill(nowUs);
+        rc = (m_tokens > 0);
+        if (rc)
+            m_tokens -= bytes;
+    }
+    g_mutex_unlock(&m_lock);
+    return rc;
+}
+
+uint64_t TokenBucket::waitUs(gint64 nowUs)
+{
+    g_mutex_lock(&m_lock);
+    uint64_t rc = 0;
+    if (m_rate > 0) {
+        refill(nowUs);
+        if (m_tokens <= 0)
+            rc = (uint64_t)(1 - m_tokens) * 1000000 / m_rate + 1;
+    }
+    g_mutex_unlock(&m_lock);
+    return rc;
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef TOKENBUCKET_H_
+#define TOKENBUCKET_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <glib.h>
+
+// A rate in bytes per second shared by everyone who takes from it, with at most burstMs worth saved up while
+// nobody does. A take is never split: while there is anything left, it goes through whole and may leave the
+// bucket in debt, which the following takes wait out. Any thread.
+class TokenBucket {
+
+public:
+
+    TokenBucket();
+    ~TokenBucket();
+
+    // 0: no limit (every take goes through)
+    void setRate(uint64_t bytesPerSecond, unsigned int burstMs) { setRate(bytesPerSecond,burstMs,g_get_monotonic_time()); }
+    uint64_t rate();
+
+    // false, with nothing taken, while the bucket is empty
+    bool take(size_t bytes) { return take(bytes,g_get_monotonic_time()); }
+    // how long until take() goes through again; 0: it does now
+    uint64_t waitUs() { return waitUs(g_get_monotonic_time()); }
+
+    // the same at a given g_get_monotonic_time(), which never goes back
+    void setRate(uint64_t bytesPerSecond, unsigned int burstMs, gint64 nowUs);
+    bool take(size_t bytes, gint64 nowUs);
+    uint64_t waitUs(gint64 nowUs);
+
+private:
+
+    void refill(gint64 nowUs);
+
+    GMutex m_lock;
+    uint64_t m_rate;
+    int64_t m_burst;
+    int64_t m_tokens;
+    gint64 m_refilledUs;
+};
+
+#endif /* TOKENBUCKET_H_ */
@@ -0,0 +1,58 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <glib.h>
+
+#include "TransferEventQueue.h"
+
+TransferEventQueue::~TransferEventQueue()
+{
+    TransferEvent * event = takeAll();
+    while (event) {
+        TransferEvent * next = event->next;
+        delete event;
+        event = next;
+    }
+}
+
+bool TransferEventQueue::push(TransferEvent * event)
+{
+    TransferEvent * head;
+    do {
+        head = (TransferEvent *)g_atomic_pointer_get(&m_head);
+        event->next = head;
+    } while (!g_atomic_pointer_compare_and_exchange(&m_head, head, event));
+
+    return (head == NULL);
+}
+
+TransferEvent * TransferEventQueue::takeAll()
+{
+    TransferEvent * head;
+    do {
+        head = (TransferEvent *)g_atomic_pointer_get(&m_head);
+    } while (head && !g_atomic_pointer_compare_and_exchange(&m_head, head, NULL));
+
+    //pushed newest first...hand them out in the order they happened
+    TransferEvent * ordered = NULL;
+    while (head) {
+        TransferEvent * next = head->next;
+        head->next = ordered;
+        ordered = head;
+        head = next;
+    }
+    return ordered;
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef TRANSFEREVENTQUEUE_H_
+#define TRANSFEREVENTQUEUE_H_
+
+#include <string>
+#include <stdint.h>
+#include <curl/curl.h>
+
+// Something that happened on the glibcurl transfer thread and has to be
+// acted upon on the main (luna bus) thread
+class TransferEvent {
+
+public:
+
+    enum TransferEventType { PROGRESS , DONE , WRITES_DRAINED , FILE_FINISHED , SPLIT , HEDGE_DECIDED , RECV_SPEED_PAUSED ,
+                             RESUME_VERIFIED , PREFIX_REHASHED };
+
+    // progress update to be posted to the subscribers of a ticket
+    TransferEvent(const std::string& owner, unsigned long ticket, const std::string& payload)
+        : type(PROGRESS) , ownerId(owner) , ticket(ticket) , payload(payload) , handle(0)
+        , resultCode(CURLE_OK) , httpCode(0) , httpConnectCode(0) , ttfbUs(0) , connects(-1) , httpVersion(0) , tlsUs(0) , finishing(0) , dropped(0) , rehashed(false) , rehash(0) , next(0) {}
+    // WRITES_DRAINED: the write-behind backlog of a transfer paused by its write callback has drained
+    // SPLIT: a transfer's headers say it can be fetched over more connections
+    // HEDGE_DECIDED: one of a hedged transfer's two requests brought data first
+    TransferEvent(TransferEventType type, unsigned long ticket)
+        : type(type) , ticket(ticket) , handle(0)
+        , resultCode(CURLE_OK) , httpCode(0) , httpConnectCode(0) , ttfbUs(0) , connects(-1) , httpVersion(0) , tlsUs(0) , finishing(0) , dropped(0) , rehashed(false) , rehash(0) , next(0) {}
+    // the DiskWriter is done syncing/closing/renaming a completed download's file
+    explicit TransferEvent(void * finishing)
+        : type(FILE_FINISHED) , ticket(0) , handle(0)
+        , resultCode(CURLE_OK) , httpCode(0) , httpConnectCode(0) , ttfbUs(0) , connects(-1) , httpVersion(0) , tlsUs(0) , finishing(finishing) , dropped(0) , rehashed(false) , rehash(0) , next(0) {}
+    // curl finished with a handle; the results are read out on the transfer
+    // thread since the handle may be gone by the time the event is handled
+    TransferEvent(CURL * handle, CURLcode result, long http, long httpConnect, curl_off_t ttfb, long connects, long httpVersion,
+                  curl_off_t tls)
+        : type(DONE) , ticket(0) , handle(handle) , resultCode(result)
+        , httpCode(http) , httpConnectCode(httpConnect) , ttfbUs(ttfb) , connects(connects) , httpVersion(httpVersion)
+        , tlsUs(tls) , finishing(0) , dropped(0) , rehashed(false) , rehash(0) , next(0) {}
+    // RESUME_VERIFIED: a resume's tail, fetched again, matched the file (dropped 0), or didn't and the file was cut
+    // back by dropped bytes; rehashed: the download's hash is taken over what was left again (PREFIX_REHASHED)
+    TransferEvent(unsigned long ticket, uint64_t dropped, bool rehashed)
+        : type(RESUME_VERIFIED) , ticket(ticket) , handle(0)
+        , resultCode(CURLE_OK) , httpCode(0) , httpConnectCode(0) , ttfbUs(0) , connects(-1) , httpVersion(0) , tlsUs(0) , finishing(0)
+        , dropped(dropped) , rehashed(rehashed) , rehash(0) , next(0) {}
+
+    // PREFIX_REHASHED: a worker has taken a resumed download's hash over its temp file again
+    TransferEvent(TransferEventType type, void * rehash)
+        : type(type) , ticket(0) , handle(0)
+        , resultCode(CURLE_OK) , httpCode(0) , httpConnectCode(0) , ttfbUs(0) , connects(-1) , httpVersion(0) , tlsUs(0) , finishing(0)
+        , dropped(0) , rehashed(false) , rehash(rehash) , next(0) {}
+
+    TransferEventType type;
+    std::string ownerId;
+    unsigned long ticket;
+    std::string payload;
+    CURL * handle;
+    CURLcode resultCode;
+    long httpCode;
+    long httpConnectCode;
+    curl_off_t ttfbUs;
+    long connects;          // new connections the transfer made (0: it reused one)
+    long httpVersion;       // CURL_HTTP_VERSION_* it ended up with
+    curl_off_t tlsUs;       // TLS handshake time of its new connection, 0: none
+    void * finishing;       // DownloadManager::FinishingDownload, opaque here
+    uint64_t dropped;
+    bool rehashed;
+    void * rehash;          // DownloadManager::PrefixRehash, opaque here
+
+    TransferEvent * next;
+};
+
+// Multiple producer, single consumer queue. push() is a lock free CAS and
+// never blocks, so it is safe to call from inside the curl callbacks. The
+// producer allocates each event (and copies its strings) before pushing it;
+// the consumer deletes it after dispatch.
+class TransferEventQueue {
+
+public:
+
+    TransferEventQueue() : m_head(0) {}
+    ~TransferEventQueue();
+
+    // returns true if the queue was empty, i.e. the consumer needs waking up
+    bool push(TransferEvent * event);
+    // detaches every queued event; the returned list is oldest first
+    TransferEvent * takeAll();
+
+private:
+
+    TransferEvent * volatile m_head;   // newest first
+
+    TransferEventQueue(const TransferEventQueue&);
+    TransferEventQueue& operator=(const TransferEventQueue&);
+};
+
+#endif /*TRANSFEREVENTQUEUE_H_*/
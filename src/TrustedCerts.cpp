@@ -0,0 +1,128 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <set>
+#include <utility>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <glib.h>
+
+#include "TrustedCerts.h"
+#include "DownloadManager.h"
+#include "Logging.h"
+
+#define TRUSTEDCERTS_CHECKSECONDS   5
+
+// CURLOPT_CAINFO_BLOB came with curl 7.77.0
+#if LIBCURL_VERSION_NUM >= 0x074d00
+#define TRUSTEDCERTS_BLOB
+#endif
+
+std::string TrustedCerts::s_path = DOWNLOADMANAGER_TRUSTED_CERT_PATH;
+std::string TrustedCerts::s_pem;
+unsigned int TrustedCerts::s_certificates = 0;
+uint64_t TrustedCerts::s_loads = 0;
+int64_t TrustedCerts::s_mtimeNs = -1;
+int64_t TrustedCerts::s_checkedUs = 0;
+
+CURLcode TrustedCerts::apply(CURL * handle)
+{
+#ifdef TRUSTEDCERTS_BLOB
+    refresh();
+    if (s_certificates > 0) {
+        struct curl_blob blob;
+        blob.data = const_cast<char *>(s_pem.data());
+        blob.len = s_pem.size();
+        blob.flags = CURL_BLOB_COPY;        //a reload mustn't pull it from under a handle
+        CURLcode rc = curl_easy_setopt(handle, CURLOPT_CAINFO_BLOB, &blob);
+        if (rc == CURLE_OK)
+            return rc;
+        //a TLS backend that doesn't take blobs
+        LOG_DEBUG ("%s: CURLOPT_CAINFO_BLOB failed [%d]; using %s",__FUNCTION__,rc,s_path.c_str());
+    }
+#endif
+    return curl_easy_setopt(handle, CURLOPT_CAPATH, s_path.c_str());
+}
+
+void TrustedCerts::refresh()
+{
+    gint64 now = g_get_monotonic_time();
+    if ((s_mtimeNs >= 0) && (now - s_checkedUs < (gint64)TRUSTEDCERTS_CHECKSECONDS * G_USEC_PER_SEC))
+        return;
+    s_checkedUs = now;
+
+    struct stat dirStat;
+    int64_t mtimeNs = 0;
+    if (stat(s_path.c_str(),&dirStat) == 0)
+        mtimeNs = (int64_t)dirStat.st_mtim.tv_sec * 1000000000LL + dirStat.st_mtim.tv_nsec;
+    if (mtimeNs == s_mtimeNs)
+        return;
+
+    s_mtimeNs = mtimeNs;
+    if (!load())
+        LOG_DEBUG ("%s: no certificates could be read from %s; using it as CAPATH",__FUNCTION__,s_path.c_str());
+}
+
+/*
+ * Reads every PEM file in the directory into one bundle. The hash-named links c_rehash makes point at files
+ * that are there under their own names too, so each file is taken once.
+ *
+ */
+bool TrustedCerts::load()
+{
+    s_pem.clear();
+    s_certificates = 0;
+    s_loads++;
+
+    GDir * dir = g_dir_open(s_path.c_str(),0,NULL);
+    if (dir == NULL)
+        return false;
+
+    std::set<std::pair<dev_t,ino_t> > seen;
+    const gchar * name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        std::string file = s_path + "/" + name;
+        struct stat fileStat;
+        if ((stat(file.c_str(),&fileStat) != 0) || !S_ISREG(fileStat.st_mode))
+            continue;
+        if (!seen.insert(std::make_pair(fileStat.st_dev,fileStat.st_ino)).second)
+            continue;
+
+        gchar * contents = NULL;
+        gsize length = 0;
+        if (!g_file_get_contents(file.c_str(),&contents,&length,NULL))
+            continue;
+
+        std::string pem(contents,length);
+        g_free(contents);
+        unsigned int count = 0;
+        for (size_t at = pem.find("-----BEGIN CERTIFICATE-----"); at != std::string::npos;
+                at = pem.find("-----BEGIN CERTIFICATE-----",at + 1))
+            ++count;
+        if (count == 0)
+            continue;       //not a certificate (a CRL, a README...)
+
+        s_pem += pem;
+        if (pem[pem.size() - 1] != '\n')
+            s_pem += '\n';
+        s_certificates += count;
+    }
+    g_dir_close(dir);
+
+    LOG_DEBUG ("%s: %u trusted certificates (%u bytes) from %s",__FUNCTION__,s_certificates,
+                (unsigned int)s_pem.size(),s_path.c_str());
+    return (s_certificates > 0);
+}
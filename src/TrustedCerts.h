@@ -0,0 +1,60 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef TRUSTEDCERTS_H_
+#define TRUSTEDCERTS_H_
+
+#include <string>
+#include <stdint.h>
+#include <curl/curl.h>
+
+/*
+ * The trusted CA certificates (DOWNLOADMANAGER_TRUSTED_CERT_PATH), read into memory once and handed to every
+ * transfer as a blob (CURLOPT_CAINFO_BLOB), so that a handshake doesn't go looking through the directory.
+ *
+ * Setting up a transfer looks at the directory's mtime again, at most every TRUSTEDCERTS_CHECKSECONDS, and
+ * re-reads it if it changed (certificates added or removed, c_rehash run). Without a curl that takes blobs, or if
+ * nothing could be read, transfers get CURLOPT_CAPATH as before. Main thread only.
+ *
+ */
+class TrustedCerts {
+
+public:
+
+    // sets the trusted CAs on a handle
+    static CURLcode apply(CURL * handle);
+
+    static const std::string& path() { return s_path; }
+    // certificates in the blob; 0: CURLOPT_CAPATH is used
+    static unsigned int certificates() { return s_certificates; }
+    static uint64_t loads() { return s_loads; }
+
+    // re-reads the directory if it changed (loads() goes up)
+    static void refresh();
+
+private:
+
+    static bool load();
+
+    static std::string s_path;
+    static std::string s_pem;
+    static unsigned int s_certificates;
+    static uint64_t s_loads;
+    static int64_t s_mtimeNs;
+    static int64_t s_checkedUs;
+};
+
+#endif /* TRUSTEDCERTS_H_ */
@@ -17,6 +17,7 @@
 #include "UploadTask.h"
 #include <stdlib.h>
 #include "DownloadManager.h"
+#include "TrustedCerts.h"
 
 // 0 (zero) is an INVALID upload id...
 uint32_t UploadTask::s_genid = 1;
@@ -106,7 +107,7 @@ UploadTask * UploadTask::newFileUploadTask(const std::string& targeturl,const st
     }
     if ((rc = curl_easy_setopt(p_curl, CURLOPT_COOKIE,cookiestr.c_str())) != CURLE_OK)
         LOG_DEBUG("curl set opt: CURLOPT_HTTPPOST failed [%d]\n", rc);
-    if ((rc = curl_easy_setopt(p_curl, CURLOPT_CAPATH, DOWNLOADMANAGER_TRUSTED_CERT_PATH)) != CURLE_OK)
+    if ((rc = TrustedCerts::apply(p_curl)) != CURLE_OK)
         LOG_DEBUG("curl set opt: CURLOPT_CAPATH failed [%d]\n", rc);
     if ((rc = curl_easy_setopt(p_curl, CURLOPT_WRITEFUNCTION, DownloadManager::cbUploadResponse)) != CURLE_OK)
         LOG_DEBUG("curl set opt: CURLOPT_WRITEFUNCTION failed [%d]\n", rc);
@@ -157,7 +158,7 @@ UploadTask * UploadTask::newBufferUploadTask(const std::string& targeturl,const
     // set http headers
     p_ult->setHTTPHeaders(httpheaders);
 
-    if ((rc = curl_easy_setopt(p_curl, CURLOPT_CAPATH, DOWNLOADMANAGER_TRUSTED_CERT_PATH)) != CURLE_OK)
+    if ((rc = TrustedCerts::apply(p_curl)) != CURLE_OK)
         LOG_DEBUG("curl set opt: DOWNLOADMANAGER_TRUSTED_CERT_PATH failed [%d]\n", rc);
     if ((rc = curl_easy_setopt(p_curl, CURLOPT_WRITEFUNCTION, DownloadManager::cbUploadResponse)) != CURLE_OK)
         LOG_DEBUG("curl set opt: CURLOPT_WRITEFUNCTION failed [%d]\n", rc);
@@ -167,6 +167,12 @@ CURLMcode glibcurl_add(CURL *easy_handle) {
 }
 /*______________________________________________________________________*/
 
+CURLMcode glibcurl_add_beside(CURL *easy_handle, CURL *sibling) {
+  (void)sibling;
+  return glibcurl_add(easy_handle);
+}
+/*______________________________________________________________________*/
+
 CURLMcode glibcurl_remove(CURL *easy_handle) {
   D((stderr, "glibcurl_remove %p\n", easy_handle));
   assert(curlSrc != 0);
@@ -189,6 +195,63 @@ void glibcurl_set_callback(GlibcurlCallback function, void* data) {
 }
 /*______________________________________________________________________*/
 
+/* Only the select() thread integration is available here */
+void glibcurl_set_backend(GlibcurlBackend backend) {
+  (void)backend;
+}
+
+GlibcurlBackend glibcurl_get_backend() {
+  return GLIBCURL_BACKEND_FDSET;
+}
+/*______________________________________________________________________*/
+
+/* No counters are kept here */
+void glibcurl_get_stats(GlibcurlStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+}
+
+void glibcurl_reset_stats() {
+}
+
+/* The select() thread already keeps libcurl off the GTK thread */
+void glibcurl_set_threaded(int threaded) {
+  (void)threaded;
+}
+
+int glibcurl_is_threaded() {
+  return 0;
+}
+
+/* Only one multi handle here */
+void glibcurl_set_shards(int shards) {
+  (void)shards;
+}
+
+int glibcurl_shards() {
+  return 1;
+}
+
+CURLM* glibcurl_shard_handle(int shard) {
+  (void)shard;
+  return glibcurl_handle();
+}
+
+int glibcurl_shard_load(int shard) {
+  (void)shard;
+  return 0;
+}
+
+int glibcurl_current_shard() {
+  return 0;
+}
+
+void glibcurl_lock() {
+}
+
+void glibcurl_unlock() {
+}
+/*______________________________________________________________________*/
+
 static gpointer selectThread(gpointer data) {
   int fdCount;
   struct timeval timeout;
@@ -314,30 +377,55 @@ void finalize(GSource* source) {
 
 #else /* !G_OS_WIN32 */
 
-/* Number of highest allowed fd */
-#define GLIBCURL_FDMAX 1023
-
-/* Timeout for the fds passed to glib's poll() call, in millisecs.
-   curl_multi_fdset(3) says we should call curl_multi_perform() at regular
-   intervals. */
-#define GLIBCURL_TIMEOUT 1000
+/* How long to wait, in millisecs, when transfers are pending but libcurl
+   has neither an fd for us to poll nor a timeout of its own. This is the
+   short wait curl_multi_fdset(3) recommends for that case. All other waits
+   are exactly what curl_multi_timeout()/CURLMOPT_TIMERFUNCTION ask for. */
+#define GLIBCURL_NOFD_TIMEOUT 100
 
 /* GIOCondition event masks */
 #define GLIBCURL_READ  (G_IO_IN | G_IO_PRI | G_IO_ERR | G_IO_HUP)
 #define GLIBCURL_WRITE (G_IO_OUT | G_IO_ERR | G_IO_HUP)
 #define GLIBCURL_EXC   (G_IO_ERR | G_IO_HUP)
 
-/** A structure which "derives" (in glib speak) from GSource */
+/** One entry per fd libcurl wants watched. With GLIBCURL_BACKEND_SOCKET it
+    is also attached to the socket with curl_multi_assign(), so libcurl hands
+    it back to us in every socket callback for that socket. */
+typedef struct CurlSocket_ {
+  GPollFD pollFd; /* Registered with g_source_add_poll() */
+} CurlSocket;
+
+/** A structure which "derives" (in glib speak) from GSource. There is one of
+    these per shard; the shards share nothing but the callback. */
 typedef struct CurlGSource_ {
   GSource source; /* First: The type we're deriving from */
 
+  int index; /* Into s_shards */
   CURLM* multiHandle;
+  GlibcurlBackend backend; /* Fixed between glibcurl_init/_cleanup */
 
-  /* Previously seen FDs, for comparing with libcurl's current fd_sets */
-  GPollFD lastPollFd[GLIBCURL_FDMAX + 1];
-  int lastPollFdMax; /* Index of highest non-empty entry in lastPollFd */
+  /* Context we are attached to: the default one, or with
+     glibcurl_set_threaded() one run by transferThread */
+  GMainContext* context;
+  GMainLoop* loop;
+  GThread* transferThread;
+
+  /* Held while inside libcurl or the callbacks, see glibcurl_lock() */
+  GRecMutex lock;
+
+  /* fd => CurlSocket for every fd registered with glib. Sized dynamically,
+     so there is no limit on the fd numbers or the number of fds. */
+  GHashTable* sockets;
+  /* GLIBCURL_BACKEND_SOCKET: scratch space for the fds glib reported ready in
+     the current iteration */
+  GArray* readyFds;
 
   int callPerform; /* Non-zero => curl_multi_perform() gets called */
+  int fdActivity; /* check() saw revents on at least one fd */
+  gint numEasyHandles; /* Currently added to multiHandle, g_atomic_int_* */
+
+  /* Wakeup counters, summed up by glibcurl_get_stats() */
+  GlibcurlStats stats;
 
   /* For data returned by curl_multi_fdset */
   fd_set fdRead;
@@ -347,82 +435,265 @@ typedef struct CurlGSource_ {
 
 } CurlGSource;
 
-/* Global state: Our CurlGSource object */
-static CurlGSource* curlSrc = 0;
+/* Global state: Our CurlGSource objects, s_numShards of them while
+   initialized */
+static CurlGSource* s_shards[GLIBCURL_MAX_SHARDS];
+static int s_numShards = 0;
 
-// Number of easy handles currently active
-static int s_numEasyHandles = 0;
+// Backend to use for the next glibcurl_init()
+static GlibcurlBackend s_backend = GLIBCURL_BACKEND_SOCKET;
 
-// Current timeout value to wait in poll
-static int s_currTimeout = 0;
+// Run the next glibcurl_init() on a dedicated thread
+static int s_threaded = 0;
 
-// Time when last dispatch was made
-static struct timespec s_timeAtLastDispatch;
+// Number of shards for the next glibcurl_init()
+static int s_wantedShards = 1;
 
+// easy handle => 1 + index of the shard it was added to
+static GHashTable* s_handleShards = 0;
+static GMutex s_handleShardsLock;
 
-/* The "methods" of CurlGSource */
+// CurlGSource whose callbacks are running on this thread, if any
+static GPrivate s_currentShard = G_PRIVATE_INIT(NULL);
+
+// glibcurl_reset_stats() time
+static gint64 s_statsSinceUs = 0;
+
+
+/* The "methods" of CurlGSource. All but finalize hold the shard's transfer
+   lock around the matching do*() function. */
 static gboolean prepare(GSource* source, gint* timeout);
 static gboolean check(GSource* source);
 static gboolean dispatch(GSource* source, GSourceFunc callback,
                          gpointer user_data);
 static void finalize(GSource* source);
+static gboolean doPrepare(CurlGSource* src, gint* timeout);
+static gboolean doCheck(CurlGSource* src);
+static gboolean doDispatch(CurlGSource* src, GSourceFunc callback,
+                           gpointer user_data);
 
 static GSourceFuncs curlFuncs = {
   &prepare, &check, &dispatch, &finalize, 0, 0
 };
+
+/* libcurl callbacks for GLIBCURL_BACKEND_SOCKET; userp is the CurlGSource */
+static int cbSocket(CURL* easy, curl_socket_t s, int what, void* userp,
+                    void* socketp);
+static int cbTimer(CURLM* multi, long timeoutMs, void* userp);
 /*______________________________________________________________________*/
 
-void glibcurl_init() {
-  int fd;
+void glibcurl_set_backend(GlibcurlBackend backend) {
+  s_backend = backend;
+}
+/*______________________________________________________________________*/
+
+GlibcurlBackend glibcurl_get_backend() {
+  return s_numShards > 0 ? s_shards[0]->backend : s_backend;
+}
+/*______________________________________________________________________*/
+
+void glibcurl_set_threaded(int threaded) {
+  s_threaded = threaded;
+}
+/*______________________________________________________________________*/
+
+int glibcurl_is_threaded() {
+  return s_numShards > 0 ? (s_shards[0]->transferThread != 0)
+                         : (s_threaded || s_wantedShards > 1);
+}
+/*______________________________________________________________________*/
+
+void glibcurl_set_shards(int shards) {
+  if (shards < 1) shards = 1;
+  if (shards > GLIBCURL_MAX_SHARDS) shards = GLIBCURL_MAX_SHARDS;
+  s_wantedShards = shards;
+}
+/*______________________________________________________________________*/
+
+int glibcurl_shards() {
+  return s_numShards > 0 ? s_numShards : s_wantedShards;
+}
+/*______________________________________________________________________*/
+
+CURLM* glibcurl_shard_handle(int shard) {
+  assert(shard >= 0 && shard < s_numShards);
+  return s_shards[shard]->multiHandle;
+}
+/*______________________________________________________________________*/
+
+int glibcurl_shard_load(int shard) {
+  if (shard < 0 || shard >= s_numShards) return 0;
+  return g_atomic_int_get(&s_shards[shard]->numEasyHandles);
+}
+/*______________________________________________________________________*/
+
+int glibcurl_current_shard() {
+  CurlGSource* src = (CurlGSource*)g_private_get(&s_currentShard);
+  return src != 0 ? src->index : 0;
+}
+/*______________________________________________________________________*/
+
+/* Always in index order, so two threads locking all shards can't deadlock;
+   the shard threads only ever take their own */
+void glibcurl_lock() {
+  int i;
+  for (i = 0; i < s_numShards; ++i) g_rec_mutex_lock(&s_shards[i]->lock);
+}
+/*______________________________________________________________________*/
+
+void glibcurl_unlock() {
+  int i;
+  for (i = s_numShards - 1; i >= 0; --i)
+    g_rec_mutex_unlock(&s_shards[i]->lock);
+}
+/*______________________________________________________________________*/
+
+/* Body of a shard's dedicated thread: just run its context's main loop */
+static gpointer transferThread(gpointer data) {
+  GMainLoop* loop = (GMainLoop*)data;
+  GMainContext* context = g_main_loop_get_context(loop);
+
+  g_main_context_push_thread_default(context);
+  g_main_loop_run(loop);
+  g_main_context_pop_thread_default(context);
+  return NULL;
+}
+/*______________________________________________________________________*/
+
+static CurlGSource* newShard(int index, int threaded) {
+  GMainContext* context = threaded ? g_main_context_new() : NULL;
+
   /* Create source object for curl file descriptors, and hook it into the
-     default main context. */
-  curlSrc = (CurlGSource*)g_source_new(&curlFuncs, sizeof(CurlGSource));
-  g_source_attach(&curlSrc->source, NULL);
+     default main context, or its own if threaded. */
+  CurlGSource* src = (CurlGSource*)g_source_new(&curlFuncs,
+                                                sizeof(CurlGSource));
+  src->index = index;
+  src->context = context;
+  src->loop = 0;
+  src->transferThread = 0;
+  g_rec_mutex_init(&src->lock);
+  g_source_attach(&src->source, context);
 
   /* Init rest of our data */
-  memset(&curlSrc->lastPollFd, 0, sizeof(curlSrc->lastPollFd));
+  src->callPerform = 0;
+  src->fdActivity = 0;
+  src->numEasyHandles = 0;
+  memset(&src->stats, 0, sizeof(src->stats));
+  src->backend = s_backend;
+  src->sockets = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                       NULL, g_free);
+  src->readyFds = g_array_new(FALSE, FALSE, sizeof(GPollFD));
+
+  src->multiHandle = curl_multi_init();
+  if (src->backend == GLIBCURL_BACKEND_SOCKET) {
+    curl_multi_setopt(src->multiHandle, CURLMOPT_SOCKETFUNCTION, &cbSocket);
+    curl_multi_setopt(src->multiHandle, CURLMOPT_SOCKETDATA, src);
+    curl_multi_setopt(src->multiHandle, CURLMOPT_TIMERFUNCTION, &cbTimer);
+    curl_multi_setopt(src->multiHandle, CURLMOPT_TIMERDATA, src);
+  }
+  g_source_set_priority(&src->source, G_PRIORITY_DEFAULT_IDLE);
+  return src;
+}
+/*______________________________________________________________________*/
 
-  for (fd = 1; fd <= GLIBCURL_FDMAX; ++fd)
-    curlSrc->lastPollFd[fd].fd = fd;
-  curlSrc->lastPollFdMax = 0;
-  curlSrc->callPerform = 0;
+void glibcurl_init() {
+  int i;
+  int threaded = s_threaded || s_wantedShards > 1;
 
   /* Init libcurl */
   curl_global_init(CURL_GLOBAL_ALL);
-  curlSrc->multiHandle = curl_multi_init();
-  g_source_set_priority(&curlSrc->source, G_PRIORITY_DEFAULT_IDLE);
   D((stderr, "events: R=%x W=%x X=%x\n", GLIBCURL_READ, GLIBCURL_WRITE,
      GLIBCURL_EXC));
 
-  s_numEasyHandles = 0;
-  s_currTimeout = 0;
-  s_timeAtLastDispatch.tv_sec = 0;
-  s_timeAtLastDispatch.tv_nsec = 0;
+  for (i = 0; i < s_wantedShards; ++i) s_shards[i] = newShard(i, threaded);
+  s_numShards = s_wantedShards;
+  s_handleShards = g_hash_table_new(g_direct_hash, g_direct_equal);
+  glibcurl_reset_stats();
+
+  /* Only now: the threads see a complete s_shards */
+  if (threaded) {
+    for (i = 0; i < s_numShards; ++i) {
+      CurlGSource* src = s_shards[i];
+      src->loop = g_main_loop_new(src->context, FALSE);
+      src->transferThread = g_thread_new("glibcurl", &transferThread,
+                                         src->loop);
+    }
+  }
 }
 /*______________________________________________________________________*/
 
 CURLM* glibcurl_handle() {
-  return curlSrc->multiHandle;
+  return s_shards[0]->multiHandle;
 }
 /*______________________________________________________________________*/
 
-CURLMcode glibcurl_add(CURL *easy_handle) {
-  assert(curlSrc->multiHandle != 0);
-  curlSrc->callPerform = -1;
-  s_numEasyHandles++;
-  CURLMcode ret = curl_multi_add_handle(curlSrc->multiHandle, easy_handle);
-  g_main_context_wakeup(g_main_context_default());
+static CURLMcode addToShard(CurlGSource* src, CURL *easy_handle) {
+  CURLMcode ret;
+
+  assert(src->multiHandle != 0);
+  g_rec_mutex_lock(&src->lock);
+  src->callPerform = -1;
+  g_atomic_int_inc(&src->numEasyHandles);
+  ret = curl_multi_add_handle(src->multiHandle, easy_handle);
+  g_rec_mutex_unlock(&src->lock);
+
+  g_mutex_lock(&s_handleShardsLock);
+  g_hash_table_insert(s_handleShards, easy_handle,
+                      GINT_TO_POINTER(src->index + 1));
+  g_mutex_unlock(&s_handleShardsLock);
+
+  g_main_context_wakeup(src->context);
   return ret;
 }
+
+CURLMcode glibcurl_add(CURL *easy_handle) {
+  int i;
+  CurlGSource* src = s_shards[0];
+
+  assert(s_numShards > 0);
+  /* Least loaded shard. glibcurl_remove() may drop a count from any
+     thread, so the counts are only touched atomically. A stale read just
+     picks a slightly busier shard. */
+  for (i = 1; i < s_numShards; ++i) {
+    if (g_atomic_int_get(&s_shards[i]->numEasyHandles)
+        < g_atomic_int_get(&src->numEasyHandles)) src = s_shards[i];
+  }
+  return addToShard(src, easy_handle);
+}
+/*______________________________________________________________________*/
+
+CURLMcode glibcurl_add_beside(CURL *easy_handle, CURL *sibling) {
+  int shard;
+
+  assert(s_numShards > 0);
+  g_mutex_lock(&s_handleShardsLock);
+  shard = GPOINTER_TO_INT(g_hash_table_lookup(s_handleShards, sibling));
+  g_mutex_unlock(&s_handleShardsLock);
+  if (shard == 0) return glibcurl_add(easy_handle); /* sibling not added */
+  return addToShard(s_shards[shard - 1], easy_handle);
+}
 /*______________________________________________________________________*/
 
 CURLMcode glibcurl_remove(CURL *easy_handle) {
-  assert(curlSrc != 0);
-  assert(curlSrc->multiHandle != 0);
-  assert(s_numEasyHandles > 0);
-  s_numEasyHandles--;
-  CURLMcode ret = curl_multi_remove_handle(curlSrc->multiHandle, easy_handle);
-  g_main_context_wakeup(g_main_context_default());
+  CurlGSource* src;
+  CURLMcode ret;
+  int shard;
+
+  assert(s_numShards > 0);
+  g_mutex_lock(&s_handleShardsLock);
+  shard = GPOINTER_TO_INT(g_hash_table_lookup(s_handleShards, easy_handle));
+  g_hash_table_remove(s_handleShards, easy_handle);
+  g_mutex_unlock(&s_handleShardsLock);
+  if (shard == 0) return CURLM_BAD_EASY_HANDLE; /* Never added */
+  src = s_shards[shard - 1];
+
+  assert(src->multiHandle != 0);
+  assert(g_atomic_int_get(&src->numEasyHandles) > 0);
+  g_rec_mutex_lock(&src->lock);
+  g_atomic_int_add(&src->numEasyHandles, -1);
+  ret = curl_multi_remove_handle(src->multiHandle, easy_handle);
+  g_rec_mutex_unlock(&src->lock);
+  g_main_context_wakeup(src->context);
   return ret;
 }
 /*______________________________________________________________________*/
@@ -432,16 +703,75 @@ CURLMcode glibcurl_remove(CURL *easy_handle) {
    to curl_multi_perform() even in the case where no open fds cause that
    function to be called anyway. */
 void glibcurl_start() {
-  curlSrc->callPerform = -1;
-
-  // Wake up event loop if it is suspended in a poll
-  g_main_context_wakeup(g_main_context_default());
+  int i;
+  for (i = 0; i < s_numShards; ++i) {
+    CurlGSource* src = s_shards[i];
+    g_rec_mutex_lock(&src->lock);
+    src->callPerform = -1;
+    g_rec_mutex_unlock(&src->lock);
+
+    // Wake up event loop if it is suspended in a poll
+    g_main_context_wakeup(src->context);
+  }
 }
 /*______________________________________________________________________*/
 
 void glibcurl_set_callback(GlibcurlCallback function, void* data) {
-  g_source_set_callback(&curlSrc->source, (GSourceFunc)function, data,
-                        NULL);
+  int i;
+  for (i = 0; i < s_numShards; ++i) {
+    g_source_set_callback(&s_shards[i]->source, (GSourceFunc)function, data,
+                          NULL);
+  }
+}
+/*______________________________________________________________________*/
+
+void glibcurl_get_stats(GlibcurlStats* stats) {
+  int i;
+  memset(stats, 0, sizeof(*stats));
+  glibcurl_lock();
+  for (i = 0; i < s_numShards; ++i) {
+    stats->prepares += s_shards[i]->stats.prepares;
+    stats->dispatches += s_shards[i]->stats.dispatches;
+    stats->timerDispatches += s_shards[i]->stats.timerDispatches;
+  }
+  stats->sinceUs = s_statsSinceUs;
+  glibcurl_unlock();
+}
+/*______________________________________________________________________*/
+
+void glibcurl_reset_stats() {
+  int i;
+  glibcurl_lock();
+  for (i = 0; i < s_numShards; ++i)
+    memset(&s_shards[i]->stats, 0, sizeof(s_shards[i]->stats));
+  s_statsSinceUs = g_get_monotonic_time();
+  glibcurl_unlock();
+}
+/*______________________________________________________________________*/
+
+static void freeShard(CurlGSource* src) {
+  GHashTableIter iter;
+  gpointer value;
+  GMainContext* context = src->context;
+
+  assert(src->transferThread == 0);
+  curl_multi_cleanup(src->multiHandle);
+  src->multiHandle = 0;
+
+  /* Fds libcurl did not get around to telling us about */
+  g_hash_table_iter_init(&iter, src->sockets);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    g_source_remove_poll(&src->source, &((CurlSocket*)value)->pollFd);
+    g_hash_table_iter_remove(&iter);
+  }
+  g_array_free(src->readyFds, TRUE);
+  src->readyFds = 0;
+
+  g_source_destroy(&src->source);
+  g_hash_table_destroy(src->sockets);
+  g_rec_mutex_clear(&src->lock);
+  g_source_unref(&src->source);
+  if (context != NULL) g_main_context_unref(context);
 }
 /*______________________________________________________________________*/
 
@@ -449,106 +779,192 @@ void glibcurl_cleanup() {
   /* You must call curl_multi_remove_handle() and curl_easy_cleanup() for all
      requests before calling this. */
 /*   assert(curlSrc->callPerform == 0); */
+  int i;
+  int numShards = s_numShards;
+
+  /* Threads first: glibcurl_lock() from them must still see every shard */
+  for (i = 0; i < numShards; ++i) {
+    CurlGSource* src = s_shards[i];
+    if (src->transferThread == 0) continue;
+    g_main_loop_quit(src->loop);
+    g_thread_join(src->transferThread);
+    g_main_loop_unref(src->loop);
+    src->transferThread = 0;
+    src->loop = 0;
+  }
 
-  curl_multi_cleanup(curlSrc->multiHandle);
-  curlSrc->multiHandle = 0;
+  s_numShards = 0;
+  for (i = 0; i < numShards; ++i) {
+    freeShard(s_shards[i]);
+    s_shards[i] = 0;
+  }
+  g_hash_table_destroy(s_handleShards);
+  s_handleShards = 0;
   curl_global_cleanup();
-
-  g_source_destroy(&curlSrc->source);
-  g_source_unref(&curlSrc->source);
-  curlSrc = 0;
 }
 /*______________________________________________________________________*/
 
-static void registerUnregisterFds() {
-  int fd, fdMax;
-
-  FD_ZERO(&curlSrc->fdRead);
-  FD_ZERO(&curlSrc->fdWrite);
-  FD_ZERO(&curlSrc->fdExc);
-  curlSrc->fdMax = -1;
-  /* What fds does libcurl want us to poll? */
-  curl_multi_fdset(curlSrc->multiHandle, &curlSrc->fdRead,
-                   &curlSrc->fdWrite, &curlSrc->fdExc, &curlSrc->fdMax);
-  if ((curlSrc->fdMax < -1) || (curlSrc->fdMax > GLIBCURL_FDMAX)) {
-      LOG_WARNING_PAIRS_ONLY (LOGID_GCURL_FDMAX_WARNING, 1, PMLOGKFV ("fdMax", "%d", curlSrc->fdMax));
+static void registerUnregisterFds(CurlGSource* src) {
+  int fd;
+  GHashTableIter iter;
+  gpointer value;
+
+  FD_ZERO(&src->fdRead);
+  FD_ZERO(&src->fdWrite);
+  FD_ZERO(&src->fdExc);
+  src->fdMax = -1;
+  /* What fds does libcurl want us to poll? Note that curl_multi_fdset()
+     cannot report fds >= FD_SETSIZE; use GLIBCURL_BACKEND_SOCKET when that
+     many descriptors are expected. */
+  curl_multi_fdset(src->multiHandle, &src->fdRead,
+                   &src->fdWrite, &src->fdExc, &src->fdMax);
+  if (src->fdMax < -1) {
+      LOG_WARNING_PAIRS_ONLY (LOGID_GCURL_FDMAX_WARNING, 1, PMLOGKFV ("fdMax", "%d", src->fdMax));
+      src->fdMax = -1;
+  }
+  /*fprintf(stderr, "registerUnregisterFds: fdMax=%d\n", src->fdMax);*/
+
+  /* Unregister fds libcurl is no longer interested in */
+  g_hash_table_iter_init(&iter, src->sockets);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    CurlSocket* sock = (CurlSocket*)value;
+    fd = sock->pollFd.fd;
+    if (fd <= src->fdMax &&
+        (FD_ISSET(fd, &src->fdRead) || FD_ISSET(fd, &src->fdWrite) ||
+         FD_ISSET(fd, &src->fdExc)))
+      continue;
+    g_source_remove_poll(&src->source, &sock->pollFd);
+    g_hash_table_iter_remove(&iter);
+    D((stderr, "unregister fd %d\n", fd));
   }
-  /*fprintf(stderr, "registerUnregisterFds: fdMax=%d\n", curlSrc->fdMax);*/
-  assert(curlSrc->fdMax >= -1 && curlSrc->fdMax <= GLIBCURL_FDMAX);
-
-  fdMax = curlSrc->fdMax;
-  if (fdMax < curlSrc->lastPollFdMax) fdMax = curlSrc->lastPollFdMax;
 
-  /* Has the list of required events for any of the fds changed? */
-  for (fd = 0; fd <= fdMax; ++fd) {
+  /* Register new fds, update the events of known ones */
+  for (fd = 0; fd <= src->fdMax; ++fd) {
+    CurlSocket* sock;
     gushort events = 0;
-    if (FD_ISSET(fd, &curlSrc->fdRead))  events |= GLIBCURL_READ;
-    if (FD_ISSET(fd, &curlSrc->fdWrite)) events |= GLIBCURL_WRITE;
-    if (FD_ISSET(fd, &curlSrc->fdExc))   events |= GLIBCURL_EXC;
-
-    /* List of events unchanged => no (de)registering */
-    if (events == curlSrc->lastPollFd[fd].events) continue;
-
-    DD((stdout, "registerUnregisterFds: fd %d: old events %x, "
-       "new events %x\n", fd, curlSrc->lastPollFd[fd].events, events));
-
-    /* fd is already a lastPollFd, but event type has changed => do nothing.
-       Due to the implementation of g_main_context_query(), the new event
-       flags will be picked up automatically. */
-    if (events != 0 && curlSrc->lastPollFd[fd].events != 0) {
-      curlSrc->lastPollFd[fd].events = events;
+    if (FD_ISSET(fd, &src->fdRead))  events |= GLIBCURL_READ;
+    if (FD_ISSET(fd, &src->fdWrite)) events |= GLIBCURL_WRITE;
+    if (FD_ISSET(fd, &src->fdExc))   events |= GLIBCURL_EXC;
+    if (events == 0) continue;
+
+    sock = (CurlSocket*)g_hash_table_lookup(src->sockets,
+                                            GINT_TO_POINTER(fd));
+    if (sock != 0) {
+      DD((stdout, "registerUnregisterFds: fd %d: old events %x, "
+         "new events %x\n", fd, sock->pollFd.events, events));
+      /* Due to the implementation of g_main_context_query(), the new event
+         flags will be picked up automatically. */
+      sock->pollFd.events = events;
       continue;
     }
-    curlSrc->lastPollFd[fd].events = events;
-
-    /* Otherwise, (de)register as appropriate */
-    if (events == 0) {
-      g_source_remove_poll(&curlSrc->source, &curlSrc->lastPollFd[fd]);
-      curlSrc->lastPollFd[fd].revents = 0;
-      D((stderr, "unregister fd %d\n", fd));
-    } else {
-      g_source_add_poll(&curlSrc->source, &curlSrc->lastPollFd[fd]);
-      D((stderr, "register fd %d\n", fd));
+
+    sock = g_new0(CurlSocket, 1);
+    sock->pollFd.fd = fd;
+    sock->pollFd.events = events;
+    g_source_add_poll(&src->source, &sock->pollFd);
+    g_hash_table_insert(src->sockets, GINT_TO_POINTER(fd), sock);
+    D((stderr, "register fd %d\n", fd));
+  }
+}
+
+/* CURLMOPT_SOCKETFUNCTION: libcurl tells us about a single socket whose
+   wanted events changed. Only this socket's poll entry is touched. */
+static int cbSocket(CURL* easy, curl_socket_t s, int what, void* userp,
+                    void* socketp) {
+  CurlGSource* src = (CurlGSource*)userp;
+  CurlSocket* sock = (CurlSocket*)socketp;
+  gushort events = 0;
+  (void)easy;
+
+  if (what == CURL_POLL_REMOVE) {
+    if (sock != 0) {
+      g_source_remove_poll(&src->source, &sock->pollFd);
+      g_hash_table_remove(src->sockets, GINT_TO_POINTER(s));
+      D((stderr, "unregister socket %d\n", s));
     }
+    return 0;
+  }
+
+  if (what & CURL_POLL_IN)  events |= GLIBCURL_READ;
+  if (what & CURL_POLL_OUT) events |= GLIBCURL_WRITE;
+
+  if (sock == 0) {
+    sock = g_new0(CurlSocket, 1);
+    sock->pollFd.fd = s;
+    sock->pollFd.events = events;
+    g_source_add_poll(&src->source, &sock->pollFd);
+    g_hash_table_insert(src->sockets, GINT_TO_POINTER(s), sock);
+    curl_multi_assign(src->multiHandle, s, sock);
+    D((stderr, "register socket %d\n", s));
+  } else {
+    /* Picked up by the next g_main_context_query() */
+    sock->pollFd.events = events;
   }
+  return 0;
+}
+/*______________________________________________________________________*/
 
-  curlSrc->lastPollFdMax = curlSrc->fdMax;
+/* CURLMOPT_TIMERFUNCTION: libcurl wants curl_multi_socket_action() called
+   with CURL_SOCKET_TIMEOUT after timeoutMs, or not at all if it is -1. glib
+   dispatches us at the ready time without any help from prepare()/check(). */
+static int cbTimer(CURLM* multi, long timeoutMs, void* userp) {
+  CurlGSource* src = (CurlGSource*)userp;
+  (void)multi;
+
+  if (timeoutMs < 0)
+    g_source_set_ready_time(&src->source, -1);
+  else
+    g_source_set_ready_time(&src->source,
+                            g_get_monotonic_time() + (gint64)timeoutMs * 1000);
+  return 0;
 }
+/*______________________________________________________________________*/
 
 /* Called before all the file descriptors are polled by the glib main loop.
    We must have a look at all fds that libcurl wants polled. If any of them
    are new/no longer needed, we have to (de)register them with glib. */
-gboolean prepare(GSource* source, gint* timeout) {
+gboolean doPrepare(CurlGSource* src, gint* timeout) {
   D((stderr, "prepare\n"));
-  assert(source == &curlSrc->source);
 
-  if (curlSrc->multiHandle == 0) return FALSE;
+  if (src->multiHandle == 0) return FALSE;
 
-  registerUnregisterFds();
+  src->stats.prepares++;
+  src->fdActivity = 0; /* check() is skipped if we return TRUE */
+
+  if (src->backend == GLIBCURL_BACKEND_SOCKET) {
+    /* Poll entries and the ready time are kept current by cbSocket() and
+       cbTimer(); only an explicit glibcurl_start() needs handling here */
+    *timeout = (src->callPerform == -1) ? 0 : -1;
+    return (src->callPerform == -1);
+  }
+
+  registerUnregisterFds(src);
 
   // Handle has been added. we are ready
-  if (curlSrc->callPerform == -1) {
-      s_currTimeout = *timeout = 0;
+  if (src->callPerform == -1) {
+      *timeout = 0;
       return TRUE;
   }
 
-  long curlTimeout = 0;
-  curl_multi_timeout(curlSrc->multiHandle, &curlTimeout);
+  long curlTimeout = -1;
+  curl_multi_timeout(src->multiHandle, &curlTimeout);
 
   // Curl tells us it is ready
   if (curlTimeout == 0) {
-      s_currTimeout = *timeout = 0;
+      *timeout = 0;
       return TRUE;
   }
 
-  // Curl says wait forever. do it only when if we don't have pending
-  // connections
-  if (curlTimeout < 0) {
-      s_currTimeout = *timeout = (s_numEasyHandles > 0) ? GLIBCURL_TIMEOUT : -1;
-      return FALSE;
-  }
+  // Transfers pending but nothing to wait on
+  if (curlTimeout < 0 && src->fdMax == -1
+      && g_atomic_int_get(&src->numEasyHandles) > 0)
+      curlTimeout = GLIBCURL_NOFD_TIMEOUT;
 
-  s_currTimeout = *timeout = MIN(GLIBCURL_TIMEOUT, curlTimeout);
+  // glib dispatches us when the ready time passes, so neither a poll timeout
+  // nor a clock check in check() is needed. -1 => wait for fd activity only.
+  g_source_set_ready_time(&src->source, (curlTimeout < 0) ? -1 :
+                          g_get_monotonic_time() + (gint64)curlTimeout * 1000);
+  *timeout = -1;
   return FALSE;
 }
 /*______________________________________________________________________*/
@@ -558,76 +974,126 @@ gboolean prepare(GSource* source, gint* timeout) {
    poll() call) to our GPollFD objects. How inefficient all that copying
    is... let's add some more and copy the results of these revents into
    libcurl's fd_sets! */
-gboolean check(GSource* source) {
+gboolean doCheck(CurlGSource* src) {
   int fd, somethingHappened = 0;
+  GHashTableIter iter;
+  gpointer value;
 
-  assert(source == &curlSrc->source);
-
-  if (curlSrc->multiHandle == 0 || s_numEasyHandles <= 0) {
-      curlSrc->callPerform = 0;
+  if (src->multiHandle == 0
+      || g_atomic_int_get(&src->numEasyHandles) <= 0) {
+      src->callPerform = 0;
       return FALSE;
   }
 
-  FD_ZERO(&curlSrc->fdRead);
-  FD_ZERO(&curlSrc->fdWrite);
-  FD_ZERO(&curlSrc->fdExc);
-  for (fd = 0; fd <= curlSrc->fdMax; ++fd) {
-    gushort revents = curlSrc->lastPollFd[fd].revents;
+  g_hash_table_iter_init(&iter, src->sockets);
+
+  if (src->backend == GLIBCURL_BACKEND_SOCKET) {
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+      if (((CurlSocket*)value)->pollFd.revents != 0) {
+        src->fdActivity = 1;
+        break;
+      }
+    }
+    return (src->callPerform == -1 || src->fdActivity);
+  }
+
+  FD_ZERO(&src->fdRead);
+  FD_ZERO(&src->fdWrite);
+  FD_ZERO(&src->fdExc);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    gushort revents = ((CurlSocket*)value)->pollFd.revents;
+    fd = ((CurlSocket*)value)->pollFd.fd;
     if (revents == 0) continue;
     somethingHappened = 1;
     if (revents & (G_IO_IN | G_IO_PRI))
-      FD_SET((unsigned)fd, &curlSrc->fdRead);
+      FD_SET((unsigned)fd, &src->fdRead);
     if (revents & G_IO_OUT)
-      FD_SET((unsigned)fd, &curlSrc->fdWrite);
+      FD_SET((unsigned)fd, &src->fdWrite);
     if (revents & (G_IO_ERR | G_IO_HUP))
-      FD_SET((unsigned)fd, &curlSrc->fdExc);
+      FD_SET((unsigned)fd, &src->fdExc);
   }
 
 /*   return TRUE; */
 /*   return FALSE; */
 
-  if (curlSrc->callPerform == -1) {
+  src->fdActivity = somethingHappened;
+
+  if (src->callPerform == -1) {
       return TRUE;
   }
 
-  if (somethingHappened != 0) {
-      return TRUE;
+  // A due curl timeout is handled by glib through the ready time
+  return (somethingHappened != 0);
+}
+/*______________________________________________________________________*/
+
+/* Hand every socket glib reported ready, and a due timeout, to
+   curl_multi_socket_action(). */
+static void dispatchSocketAction(CurlGSource* src) {
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+  int running = 0;
+  gint64 readyTime = g_source_get_ready_time(&src->source);
+
+  /* Collect first: libcurl may add or remove sockets (and free their
+     CurlSocket) from within curl_multi_socket_action() */
+  g_array_set_size(src->readyFds, 0);
+  g_hash_table_iter_init(&iter, src->sockets);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    CurlSocket* sock = (CurlSocket*)value;
+    if (sock->pollFd.revents == 0) continue;
+    g_array_append_val(src->readyFds, sock->pollFd);
+    sock->pollFd.revents = 0;
   }
 
-  struct timespec currTime;
-  if (clock_gettime(CLOCK_MONOTONIC, &currTime) != 0) {
-      LOG_DEBUG ("Function clock_gettime() failed");
+  for (i = 0; i < src->readyFds->len; ++i) {
+    GPollFD* pfd = &g_array_index(src->readyFds, GPollFD, i);
+    int action = 0;
+    if (pfd->revents & (G_IO_IN | G_IO_PRI)) action |= CURL_CSELECT_IN;
+    if (pfd->revents & G_IO_OUT)             action |= CURL_CSELECT_OUT;
+    if (pfd->revents & (G_IO_ERR | G_IO_HUP)) action |= CURL_CSELECT_ERR;
+    curl_multi_socket_action(src->multiHandle, pfd->fd, action, &running);
   }
 
-  // Curl wants us to call it regularly even if there is no data available
-  if (((currTime.tv_sec - s_timeAtLastDispatch.tv_sec) * 1000 +
-       (currTime.tv_nsec - s_timeAtLastDispatch.tv_nsec) / 1000000) >=
-      s_currTimeout) {
-      return TRUE;
+  if (src->callPerform == -1 ||
+      (readyTime >= 0 && readyTime <= g_source_get_time(&src->source))) {
+    /* Disarm before the call: cbTimer() may want to re-arm */
+    g_source_set_ready_time(&src->source, -1);
+    curl_multi_socket_action(src->multiHandle, CURL_SOCKET_TIMEOUT, 0,
+                             &running);
   }
 
-  return FALSE;
+  src->callPerform = running;
 }
 /*______________________________________________________________________*/
 
-gboolean dispatch(GSource* source, GSourceFunc callback,
-                  gpointer user_data) {
+gboolean doDispatch(CurlGSource* src, GSourceFunc callback,
+                    gpointer user_data) {
   CURLMcode x;
 
-  assert(source == &curlSrc->source);
-  assert(curlSrc->multiHandle != 0);
+  assert(src->multiHandle != 0);
+
+  src->stats.dispatches++;
+  if (!src->fdActivity && src->callPerform != -1)
+    src->stats.timerDispatches++;
 
-  if (clock_gettime(CLOCK_MONOTONIC, &s_timeAtLastDispatch) != 0) {
-      LOG_DEBUG ("Function clock_gettime() failed");
+  if (src->backend == GLIBCURL_BACKEND_SOCKET) {
+    dispatchSocketAction(src);
+    if (callback != 0) (*callback)(user_data);
+    return TRUE; /* "Do not destroy me" */
   }
 
+  /* prepare() re-arms this from curl_multi_timeout() */
+  g_source_set_ready_time(&src->source, -1);
+
   do {
-    x = curl_multi_perform(curlSrc->multiHandle, &curlSrc->callPerform);
+    x = curl_multi_perform(src->multiHandle, &src->callPerform);
 /*     D((stderr, "dispatched %d\n", x)); */
   } while (x == CURLM_CALL_MULTI_PERFORM);
 
   /* If no more calls to curl_multi_perform(), unregister left-over fds */
-  if (curlSrc->callPerform == 0) registerUnregisterFds();
+  if (src->callPerform == 0) registerUnregisterFds(src);
 
   if (callback != 0) (*callback)(user_data);
 
@@ -635,9 +1101,45 @@ gboolean dispatch(GSource* source, GSourceFunc callback,
 }
 /*______________________________________________________________________*/
 
+gboolean prepare(GSource* source, gint* timeout) {
+  CurlGSource* src = (CurlGSource*)source;
+  gboolean ret;
+  g_rec_mutex_lock(&src->lock);
+  ret = doPrepare(src, timeout);
+  g_rec_mutex_unlock(&src->lock);
+  return ret;
+}
+/*______________________________________________________________________*/
+
+gboolean check(GSource* source) {
+  CurlGSource* src = (CurlGSource*)source;
+  gboolean ret;
+  g_rec_mutex_lock(&src->lock);
+  ret = doCheck(src);
+  g_rec_mutex_unlock(&src->lock);
+  return ret;
+}
+/*______________________________________________________________________*/
+
+/* If threaded, this is where a shard's thread spends its time: with the
+   lock held, inside libcurl and the user's callbacks */
+gboolean dispatch(GSource* source, GSourceFunc callback,
+                  gpointer user_data) {
+  CurlGSource* src = (CurlGSource*)source;
+  gboolean ret;
+  g_rec_mutex_lock(&src->lock);
+  g_private_set(&s_currentShard, src);
+  ret = doDispatch(src, callback, user_data);
+  g_private_set(&s_currentShard, NULL);
+  g_rec_mutex_unlock(&src->lock);
+  return ret;
+}
+/*______________________________________________________________________*/
+
 void finalize(GSource* source) {
-  assert(source == &curlSrc->source);
-  registerUnregisterFds();
+  CurlGSource* src = (CurlGSource*)source;
+  if (src->backend == GLIBCURL_BACKEND_FDSET && src->multiHandle != 0)
+    registerUnregisterFds(src);
 }
 
 #endif
@@ -37,19 +37,85 @@
 extern "C" {
 #endif
 
+/** Ways of integrating the multi handle with the glib main loop */
+typedef enum {
+  /** Ask libcurl for its fd_sets with curl_multi_fdset() on every main loop
+      iteration and drive transfers with curl_multi_perform() */
+  GLIBCURL_BACKEND_FDSET,
+  /** Let libcurl tell us which sockets to watch through
+      CURLMOPT_SOCKETFUNCTION/CURLMOPT_TIMERFUNCTION and drive transfers with
+      curl_multi_socket_action(). Per-iteration cost scales with the number of
+      sockets in use rather than with the highest fd number. This is the
+      default. */
+  GLIBCURL_BACKEND_SOCKET
+} GlibcurlBackend;
+
+/** Select the backend used by the next call to glibcurl_init(). Has no
+    effect on an already initialized glibcurl. */
+void glibcurl_set_backend(GlibcurlBackend backend);
+
+/** Return the backend glibcurl is (or will be) running with */
+GlibcurlBackend glibcurl_get_backend();
+
+/** Select whether the next call to glibcurl_init() drives the multi handle
+    from glib's default main context (threaded == 0, the default) or from a
+    main loop of its own, running on a dedicated thread. In the threaded case
+    the callback set with glibcurl_set_callback() and all libcurl
+    write/header/read callbacks run on that thread. */
+void glibcurl_set_threaded(int threaded);
+
+/** Return non-zero if glibcurl runs on a dedicated thread */
+int glibcurl_is_threaded();
+
+/** Upper limit for glibcurl_set_shards() */
+#define GLIBCURL_MAX_SHARDS 16
+
+/** Select how many independent multi handles ("shards") the next call to
+    glibcurl_init() creates, 1 (the default) to GLIBCURL_MAX_SHARDS. Each
+    shard has its own transfer lock, main loop and thread, so transfers are
+    spread over that many cores. More than one shard implies
+    glibcurl_set_threaded(1). */
+void glibcurl_set_shards(int shards);
+
+/** Return the number of shards glibcurl is (or will be) running with */
+int glibcurl_shards();
+
+/** Return the multi handle of a shard, 0 <= shard < glibcurl_shards() */
+CURLM* glibcurl_shard_handle(int shard);
+
+/** Return the number of easy handles currently added to a shard, 0 if
+    glibcurl is not initialized */
+int glibcurl_shard_load(int shard);
+
+/** Return the shard whose callbacks are running on the calling thread, i.e.
+    the one to curl_multi_info_read() from in the glibcurl_set_callback()
+    function. 0 when called from outside the callbacks. */
+int glibcurl_current_shard();
+
+/** Take/release the transfer locks of all shards. Each shard holds its own
+    for as long as it is inside libcurl or the callbacks (on its own thread
+    if threaded). Hold them from other threads while touching a multi handle,
+    an easy handle that has been added to one, or data shared with the
+    callbacks. glibcurl_add/_remove/_start lock by themselves. Recursive. */
+void glibcurl_lock();
+void glibcurl_unlock();
+
 /** Initialize libcurl. Call this once at the beginning of your program. This
     function makes calls to curl_global_init() and curl_multi_init() */
 void glibcurl_init();
 
-/** Return global multi handle */
+/** Return the multi handle of shard 0 */
 CURLM* glibcurl_handle();
 
-/** Convenience function, just executes
-    curl_multi_add_handle(glibcurl_handle(), easy_handle); glibcurl_start()*/
+/** curl_multi_add_handle() to the shard with the fewest easy handles, then
+    glibcurl_start() that shard */
 CURLMcode glibcurl_add(CURL* easy_handle);
 
-/** Convenience function, just executes
-    curl_multi_remove_handle(glibcurl_handle(), easy_handle) */
+/** Like glibcurl_add(), but onto the shard sibling was added to, so the
+    callbacks of both only ever run on the same thread */
+CURLMcode glibcurl_add_beside(CURL* easy_handle, CURL* sibling);
+
+/** curl_multi_remove_handle() from the shard easy_handle was added to */
 CURLMcode glibcurl_remove(CURL* easy_handle);
 
 /** Call this whenever you have added a request using
@@ -68,6 +134,26 @@ typedef void (*GlibcurlCallback)(void*);
     argument. */
 void glibcurl_set_callback(GlibcurlCallback function, void* data);
 
+/** Counters describing how often glibcurl had the main loop call into
+    libcurl, for measuring wakeup behaviour */
+typedef struct GlibcurlStats_ {
+  /** Main loop iterations that consulted glibcurl */
+  unsigned long long prepares;
+  /** Calls into curl_multi_perform()/curl_multi_socket_action() */
+  unsigned long long dispatches;
+  /** Dispatches caused only by a curl timeout falling due, without any socket
+      activity */
+  unsigned long long timerDispatches;
+  /** g_get_monotonic_time() when the counters were last reset */
+  long long sinceUs;
+} GlibcurlStats;
+
+/** Copy the current counters into *stats */
+void glibcurl_get_stats(GlibcurlStats* stats);
+
+/** Zero the counters */
+void glibcurl_reset_stats();
+
 /** You must call glibcurl_remove() and curl_easy_cleanup() for all requests
     before calling this. This function makes calls to curl_multi_cleanup()
     and curl_global_cleanup(). */
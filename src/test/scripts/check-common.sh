@@ -0,0 +1,119 @@
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Sourced by the check-*.sh scripts, which run against the download manager
+# on the device, with check-server.py as the server. Each check prints
+# "ok" or "FAIL" and the script exits with the number of failed ones.
+
+SERVICE=luna://com.webos.service.downloadmanager
+SCRIPTS=$(cd "$(dirname "$0")" && pwd)
+PORT=${PORT:-8080}
+TARGET_DIR=${TARGET_DIR:-/media/internal/downloads/checks}
+SERVER_LOG=$(mktemp)
+SERVER=http://localhost:$PORT
+FAILURES=0
+
+# luna call: call METHOD JSON
+call() {
+    luna-send -n 1 $SERVICE/$1 "$2"
+}
+
+# value of a number, boolean or string field of a reply: field NAME REPLY
+field() {
+    echo "$2" | sed -n "s/.*\"$1\": *\"\{0,1\}\([^\",}]*\).*/\1/p" | head -n 1
+}
+
+# start_server [CERT KEY]: over HTTPS with them
+start_server() {
+    python3 "$SCRIPTS/check-server.py" $PORT "$SERVER_LOG" "$@" &
+    SERVER_PID=$!
+    trap 'kill $SERVER_PID 2>/dev/null; rm -rf "$TARGET_DIR" "$SERVER_LOG"' EXIT
+    mkdir -p "$TARGET_DIR"
+    [ $# -eq 2 ] && SERVER=https://localhost:$PORT
+    for (( i = 0; i < 50; i++ ))
+    do
+        (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null && return 0
+        sleep 0.1
+    done
+    echo "check-server.py didn't start"
+    exit 1
+}
+
+# starts a download and prints its ticket: start_download JSON (targetDir is added)
+start_download() {
+    local reply
+    reply=$(call download "{\"targetDir\":\"$TARGET_DIR\",${1#\{}")
+    field ticket "$reply"
+}
+
+# waits for a ticket to be over (completed, interrupted or cancelled), at most SECONDS (default 60);
+# STATUS is its downloadStatusQuery reply then: wait_done TICKET [SECONDS]
+wait_done() {
+    local deadline=$(( $(date +%s) + ${2:-60} ))
+    while [ $(date +%s) -lt $deadline ]
+    do
+        STATUS=$(call downloadStatusQuery "{\"ticket\":$1}")
+        case "$STATUS" in
+            *'"state"'*) return 0 ;;
+        esac
+        sleep 0.1
+    done
+    return 1
+}
+
+# wait_done, and then the ticket has to have completed: completes TICKET [SECONDS]
+completes() {
+    wait_done "$@" && [ "$(field completed "$STATUS")" = "true" ]
+}
+
+# what the server sends for a url, straight from it: sha256 URL
+sha256_of_url() {
+    python3 -c 'import sys, ssl, urllib.request, hashlib; print(hashlib.sha256(urllib.request.urlopen(sys.argv[1], context=ssl._create_unverified_context()).read()).hexdigest())' "$1"
+}
+
+sha256_of_file() {
+    sha256sum "$1" | cut -d ' ' -f 1
+}
+
+# getStats into STATS (reset: get_stats true), and a counter from it: stat_of NAME
+get_stats() {
+    STATS=$(call getStats "{\"reset\":${1:-false}}")
+}
+stat_of() {
+    field "$1" "$STATS"
+}
+
+# check DESCRIPTION COMMAND...: runs the command, counts a failure if it fails
+check() {
+    local description=$1
+    shift
+    if "$@"; then
+        echo "ok   - $description"
+    else
+        echo "FAIL - $description"
+        FAILURES=$((FAILURES + 1))
+    fi
+}
+
+# requests the server logged for a path (substring) that match a pattern: logged PATH [PATTERN]
+logged() {
+    grep -F -- "$1" "$SERVER_LOG" | grep -E -- "${2:-.}"
+}
+
+finish() {
+    [ $FAILURES -eq 0 ] && echo "all checks passed" || echo "$FAILURES check(s) failed"
+    exit $FAILURES
+}
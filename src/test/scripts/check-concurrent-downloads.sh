@@ -0,0 +1,81 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Concurrent downloads: COUNT downloads of different files at once, slow
+# enough that they are all in flight together, each of which has to come
+# out complete and byte for byte what the server sent. With more than one
+# TransferShards, each shard has to carry some of them. Expects
+# MaxConcurrent and MaxQueueLength >= COUNT; run it with each CurlBackend
+# and each WriteBehindBackend.
+#
+# usage: check-concurrent-downloads.sh [COUNT] (PORT and TARGET_DIR from the environment)
+
+COUNT=${1:-64}
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+# 1 MB each at 128 KB/s: about 8 s, all of them at the same time
+TICKETS=()
+for (( i = 0; i < COUNT; i++ ))
+do
+    TICKETS[$i]=$(start_download "{\"target\":\"$SERVER/file/concurrent-$i.bin?size=1048576&rate=131072\"}")
+done
+check "all $COUNT downloads started" [ $(echo ${TICKETS[@]} | wc -w) -eq $COUNT ]
+
+PEAK=0
+for (( i = 0; i < 20; i++ ))
+do
+    get_stats
+    ACTIVE=$(stat_of active)
+    if [ "${ACTIVE:-0}" -gt $PEAK ]; then
+        PEAK=$ACTIVE
+        SHARDS=$(echo "$STATS" | sed -n 's/.*"shards": *\[\([0-9, ]*\)\].*/\1/p' | tr ',' ' ')
+    fi
+    sleep 0.2
+done
+check "...and were all in flight at once" [ $PEAK -eq $COUNT ]
+check "...on the transfer shards, which had them all" [ $(( $(echo ${SHARDS:-0} | tr ' ' '+') )) -eq $PEAK ]
+for LOAD in $SHARDS
+do
+    check "...spread out: none of the shards left idle" [ $LOAD -gt 0 ]
+done
+
+COMPLETE=0
+TARGETS=()
+for (( i = 0; i < COUNT; i++ ))
+do
+    wait_done "${TICKETS[$i]}" 120 && [ "$(field completed "$STATUS")" = "true" ] || continue
+    COMPLETE=$((COMPLETE + 1))
+    TARGETS[$i]=$(field target "$STATUS")
+done
+check "all of them completed" [ $COMPLETE -eq $COUNT ]
+check "...over one request each" [ $(logged "/file/concurrent-" | wc -l) -eq $COUNT ]
+
+INTACT=0
+for (( i = 0; i < COUNT; i++ ))
+do
+    [ -n "${TARGETS[$i]}" ] && [ "$(sha256_of_file "${TARGETS[$i]}")" = "$(sha256_of_url "$SERVER/file/concurrent-$i.bin?size=1048576")" ] \
+        && INTACT=$((INTACT + 1))
+done
+check "...each with what the server sent" [ $INTACT -eq $COUNT ]
+get_stats
+check "the data went through the DiskWriter ($(stat_of backend))" [ "$(stat_of writes)" -gt 0 ]
+check "...which has none of it left to write" [ "$(stat_of backlogBytes)" = "0" ]
+
+finish
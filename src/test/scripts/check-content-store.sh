@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Content store: only downloads asking for it ("contentStore") use it; one
+# of a url the store has is answered by a 304 and copied from it; a stored
+# file is never a hardlink of a download, so writing to the download leaves
+# the store alone. Needs ContentStoreDir set in downloadManager.conf, and
+# STORE_DIR (default /media/internal/.downloadstore) to be it.
+#
+# usage: check-content-store.sh (PORT, TARGET_DIR and STORE_DIR from the environment)
+
+source "$(dirname "$0")/check-common.sh"
+STORE_DIR=${STORE_DIR:-/media/internal/.downloadstore}
+start_server
+
+get_stats true
+if [ "$(field enabled "$(echo "$STATS" | sed -n 's/.*"contentStore": *{\([^}]*\)}.*/\1/p')")" != "true" ]
+then
+    echo "ContentStoreDir isn't set; nothing to check"
+    exit 0
+fi
+
+URL="$SERVER/file/stored.bin?size=1048576&etag=check-$$"
+EXPECTED=$(sha256_of_url "$URL")
+: > "$SERVER_LOG"
+
+TICKET=$(start_download "{\"target\":\"$URL\"}")
+wait_done "$TICKET"
+check "a download that didn't ask for the store completed" [ "$(field completed "$STATUS")" = "true" ]
+sleep 1
+check "...and didn't go into it" [ ! -e "$STORE_DIR/$EXPECTED" ]
+
+TICKET=$(start_download "{\"target\":\"$URL\",\"contentStore\":true}")
+wait_done "$TICKET"
+FIRST=$(field target "$STATUS")
+sleep 1     # hashed and stored in the background
+check "one that did went into it" [ "$(sha256_of_file "$STORE_DIR/$EXPECTED")" = "$EXPECTED" ]
+check "...as a file of its own, not a hardlink of the download" [ -z "$(find "$STORE_DIR" -samefile "$FIRST")" ]
+
+: > "$SERVER_LOG"
+TICKET=$(start_download "{\"target\":\"$URL\",\"contentStore\":true}")
+wait_done "$TICKET"
+SECOND=$(field target "$STATUS")
+get_stats
+check "the next download of the url was answered by a 304" logged "/file/stored.bin" "status=304"
+check "...and has the content" [ "$(sha256_of_file "$SECOND")" = "$EXPECTED" ]
+check "...counted as a store hit" [ "$(stat_of hits)" = "1" ]
+
+: > "$SERVER_LOG"
+TICKET=$(start_download "{\"target\":\"$URL\"}")
+wait_done "$TICKET"
+check "without contentStore, the store isn't asked" logged "/file/stored.bin" "status=200"
+
+echo "appended" >> "$FIRST"
+echo "appended" >> "$SECOND"
+check "writing to the downloads leaves the stored content as it was" \
+    [ "$(sha256_of_file "$STORE_DIR/$EXPECTED")" = "$EXPECTED" ]
+
+finish
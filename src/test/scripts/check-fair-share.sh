@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+# Fair share: one caller (app id FLOOD_APP) queues FLOOD downloads, each
+# of them held to 256 KB/s by the server, and right after that another
+# caller (OTHER_APP) queues OTHER of the same size. With the slots shared
+# out between the callers, the other's downloads have to start interleaved
+# with the first one's, not after all of them: no more than OTHER + 1 of
+# the first caller's may start between the other queueing and its last
+# download starting. All of them have to complete, and getStats has to
+# have counted each caller's. Expects both callers at the same weight and
+# with no slot cap, and MaxQueueLength >= FLOOD + OTHER.
+#
+# usage: check-fair-share.sh [FLOOD] [OTHER] (PORT and TARGET_DIR from the environment)
+
+FLOOD=${1:-40}
+OTHER=${2:-4}
+FLOOD_APP=com.example.flood
+OTHER_APP=com.example.other
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+# queues downloads as an app: queue APP NAME COUNT; their tickets go into TICKETS
+TICKETS=()
+queue() {
+    local reply
+    for (( i = 0; i < $3; i++ ))
+    do
+        reply=$(luna-send -n 1 -a $1 $SERVICE/download \
+                "{\"target\":\"$SERVER/file/$2-$i.bin?size=1048576&rate=262144\",\"targetDir\":\"$TARGET_DIR\"}")
+        TICKETS+=($(field ticket "$reply"))
+    done
+}
+
+# the names of the files the server was asked for, in the order it was first asked for each
+started() {
+    logged "/file/" | sed 's,^[A-Z]* /file/\([^?]*\)?.*,\1,' | awk '!seen[$0]++'
+}
+
+get_stats true
+queue $FLOOD_APP flood $FLOOD
+BEFORE=$(started | grep -c "^flood-")
+queue $OTHER_APP other $OTHER
+
+DONE=0
+for TICKET in "${TICKETS[@]}"
+do
+    completes "$TICKET" $((FLOOD * 4)) && DONE=$((DONE + 1))
+done
+check "all $((FLOOD + OTHER)) downloads completed" [ $DONE -eq $((FLOOD + OTHER)) ]
+
+LAST=$(started | grep -n "^other-" | tail -n 1 | cut -d : -f 1)
+BETWEEN=$(( ${LAST:-0} - OTHER - BEFORE ))
+check "the second caller's started interleaved ($BETWEEN of the first's between)" \
+    [ -n "$LAST" -a $BETWEEN -le $((OTHER + 1)) ]
+
+get_stats
+# STARTED WAITS of an owner in the queue stats: owner_stats APP
+owner_stats() {
+    echo "$STATS" | python3 -c '
+import json, sys
+for owner in json.load(sys.stdin)["queue"]["owners"]:
+    if owner["owner"] == sys.argv[1]:
+        print(owner["started"], owner["waits"])' "$1"
+}
+check "each caller's downloads were counted" \
+    [ "$(owner_stats $FLOOD_APP | cut -d ' ' -f 1)" = "$FLOOD" -a "$(owner_stats $OTHER_APP | cut -d ' ' -f 1)" = "$OTHER" ]
+check "...the second one's having waited in the queue" [ "$(owner_stats $OTHER_APP | cut -d ' ' -f 2)" -gt 0 ]
+
+finish
@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+# Handle pool: COUNT small downloads one after the other. Each of them has
+# to set up a handle, all but the first taking it from the pool, and come
+# out as what the server sent; and a handle that carried an authToken and
+# a byte range mustn't hand either on to the download that gets it next.
+# Expects HandlePoolSize > 0.
+#
+# usage: check-handle-pool.sh [COUNT] (PORT and TARGET_DIR from the environment)
+
+COUNT=${1:-32}
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+get_stats true
+INTACT=0
+for (( i = 0; i < COUNT; i++ ))
+do
+    URL="$SERVER/file/pooled-$i.bin?size=16384"
+    completes "$(start_download "{\"target\":\"$URL\"}")" \
+        && [ "$(sha256_of_file "$(field target "$STATUS")")" = "$(sha256_of_url "$URL")" ] && INTACT=$((INTACT + 1))
+done
+get_stats
+check "$COUNT downloads completed with what the server sent" [ $INTACT -eq $COUNT ]
+check "...each setting up a handle" [ "$(stat_of handleSetups)" = "$COUNT" ]
+check "...copying $(stat_of handlesCloned) from the template" [ "$(stat_of handlesCloned)" -le 1 ]
+check "...and taking the others from the pool" [ "$(stat_of handlesReused)" -ge $((COUNT - 1)) ]
+
+# a paused download leaves a handle behind with its token, and resumes with a range
+: > "$SERVER_LOG"
+TICKET=$(start_download "{\"target\":\"$SERVER/file/pooled-token.bin?size=1048576&rate=262144\",\"authToken\":\"check-token\",\"canHandlePause\":true}")
+sleep 1
+call pauseDownload "{\"ticket\":$TICKET}" >/dev/null
+call resumeDownload "{\"ticket\":$TICKET}" >/dev/null
+check "a download with a token completed after a pause" completes "$TICKET"
+check "...asking for the rest by range" logged "/file/pooled-token.bin" "range=bytes=[1-9]"
+URL="$SERVER/file/pooled-plain.bin?size=16384"
+check "the download after it completed" completes "$(start_download "{\"target\":\"$URL\"}")"
+check "...without that token" logged "/file/pooled-plain.bin" "auth=- range=- "
+check "...whole" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$(sha256_of_url "$URL")" ]
+
+finish
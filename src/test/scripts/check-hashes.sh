@@ -0,0 +1,78 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+# Hashes: a SIZE_MB file downloaded with the right expectedHash, as SHA-256
+# (also in upper case) and as CRC-32C, has to complete and report that hash;
+# with a wrong one it has to fail with a hash mismatch (-8) and leave no
+# file behind, neither under its name nor under the temp one.
+#
+# usage: check-hashes.sh [SIZE_MB] (PORT and TARGET_DIR from the environment)
+
+SIZE_MB=${1:-16}
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+# what the server sends for a url, as CRC-32C (Castagnoli): crc32c URL
+crc32c_of_url() {
+    python3 -c '
+import sys, ssl, urllib.request
+table = []
+for i in range(256):
+    crc = i
+    for _ in range(8):
+        crc = (crc >> 1) ^ (0x82f63b78 if crc & 1 else 0)
+    table.append(crc)
+crc = 0xffffffff
+for byte in urllib.request.urlopen(sys.argv[1], context=ssl._create_unverified_context()).read():
+    crc = table[(crc ^ byte) & 0xff] ^ (crc >> 8)
+print("%08x" % (crc ^ 0xffffffff))' "$1"
+}
+
+URL="$SERVER/file/hashed.bin?size=$((SIZE_MB * 1024 * 1024))"
+SHA256=$(sha256_of_url "$URL")
+CRC32C=$(crc32c_of_url "$URL")
+WRONG=$(echo -n "$SHA256" | tr '0-9a-f' '1-9a-f0')
+
+get_stats true
+check "download with the right SHA-256 completed" completes "$(start_download "{\"target\":\"$URL\",\"expectedHash\":\"$SHA256\"}")"
+check "...with no error" [ "$(field completionStatusCode "$STATUS")" = "0" ]
+check "...reporting that hash" [ "$(field hash "$STATUS")" = "$SHA256" ]
+check "...which the file has" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$SHA256" ]
+
+UPPER=$(echo -n "$SHA256" | tr 'a-f' 'A-F')
+check "download with it in upper case completed" completes "$(start_download "{\"target\":\"$URL\",\"expectedHash\":\"$UPPER\"}")"
+check "...with no error" [ "$(field completionStatusCode "$STATUS")" = "0" ]
+
+check "download with the right CRC-32C completed" \
+    completes "$(start_download "{\"target\":\"$URL\",\"hashAlgorithm\":\"crc32c\",\"expectedHash\":\"$CRC32C\"}")"
+check "...with no error" [ "$(field completionStatusCode "$STATUS")" = "0" ]
+check "...reporting that hash" [ "$(field hash "$STATUS")" = "$CRC32C" ]
+check "...and the file is what the server sent" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$SHA256" ]
+
+TICKET=$(start_download "{\"target\":\"$URL\",\"targetFilename\":\"mismatched.bin\",\"expectedHash\":\"$WRONG\"}")
+check "download with a wrong SHA-256 was over" wait_done "$TICKET"
+check "...failing on the hash" [ "$(field completionStatusCode "$STATUS")" = "-8" ]
+check "...reporting the hash it got" [ "$(field hash "$STATUS")" = "$SHA256" ]
+check "...leaving no file" [ ! -e "$TARGET_DIR/mismatched.bin" ]
+check "...nor a temp one" [ -z "$(ls -A "$TARGET_DIR" | grep mismatched)" ]
+
+get_stats
+check "three hashes verified" [ "$(stat_of hashesVerified)" = "3" ]
+check "one mismatch" [ "$(stat_of hashMismatches)" = "1" ]
+
+finish
@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Hedged downloads: after WARMUP quick downloads from the server, one whose
+# first request stalls for 20 s. A second request has to be sent for it,
+# win, and bring the download in well before the stall is over, and the
+# file has to be what the server sent; the quick ones mustn't be hedged.
+# Expects HedgePercentile > 0 and HedgeMinSamples <= WARMUP.
+#
+# usage: check-hedged.sh [WARMUP] (PORT and TARGET_DIR from the environment)
+
+WARMUP=${1:-16}
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+get_stats true
+WARM=0
+for (( i = 0; i < WARMUP; i++ ))
+do
+    completes "$(start_download "{\"target\":\"$SERVER/file/warmup-$i.bin?size=16384\"}")" && WARM=$((WARM + 1))
+done
+get_stats true
+check "$WARMUP quick downloads completed" [ $WARM -eq $WARMUP ]
+check "...none of them hedged" [ "$(stat_of hedges)" = "0" ]
+
+URL="$SERVER/file/stalled.bin?size=16384"
+START=$(date +%s)
+TICKET=$(start_download "{\"target\":\"$URL&stall=20\"}")
+check "the stalled download completed" completes "$TICKET" 30
+ELAPSED=$(( $(date +%s) - START ))
+get_stats
+check "...in less than half the stall (${ELAPSED} s)" [ $ELAPSED -lt 10 ]
+check "...hedged once" [ "$(stat_of hedges)" = "1" ]
+check "...by the second request, which won" [ "$(stat_of hedgeWins)" = "1" ]
+check "...and is what the server sent" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$(sha256_of_url "$URL")" ]
+
+finish
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Mirrors: a SIZE_MB file from three hosts (localhost, 127.0.0.1 and
+# 127.0.0.2, all check-server.py), each holding a connection to 1 MB/s,
+# the second of which drops every connection after 1 MB. The download has
+# to come out as what the server sent, with both good mirrors having served
+# some of it, the bad one's failures counted, and what the sources served
+# adding up to the file.
+#
+# usage: check-mirrors.sh [SIZE_MB] (PORT and TARGET_DIR from the environment)
+
+SIZE_MB=${1:-32}
+SIZE=$((SIZE_MB * 1024 * 1024))
+RATE=$((1024 * 1024))
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+# one line per source of a downloadStatusQuery reply: URL BYTES FAILURES
+sources_of() {
+    echo "$1" | python3 -c '
+import json, sys
+for source in json.load(sys.stdin).get("sources", []):
+    print(source["url"], source["e_bytes"], source["failures"])'
+}
+
+FILE="file/mirrored.bin?size=$SIZE&rate=$RATE"
+TICKET=$(start_download "{\"target\":\"http://localhost:$PORT/$FILE\",\"mirrors\":[\"http://127.0.0.1:$PORT/$FILE&drop=$RATE\",\"http://127.0.0.2:$PORT/$FILE\"]}")
+check "download started" [ -n "$TICKET" ]
+check "...and completed" completes "$TICKET" $((SIZE / RATE * 2))
+check "...as what the server sent" \
+    [ "$(sha256_of_file "$(field target "$STATUS")")" = "$(sha256_of_url "$SERVER/file/mirrored.bin?size=$SIZE")" ]
+
+SOURCES=$(sources_of "$STATUS")
+check "...reporting its three sources" [ $(echo "$SOURCES" | wc -l) -eq 3 ]
+check "...which served all of it between them" [ $(echo "$SOURCES" | awk '{ sum += $2 } END { print sum }') -eq $SIZE ]
+check "...the first one some of it" [ $(echo "$SOURCES" | grep "//localhost:" | cut -d ' ' -f 2) -gt 0 ]
+check "...the third one some of it" [ $(echo "$SOURCES" | grep "//127.0.0.2:" | cut -d ' ' -f 2) -gt 0 ]
+check "...and the second one failed" [ $(echo "$SOURCES" | grep "//127.0.0.1:" | cut -d ' ' -f 3) -gt 0 ]
+check "all three were asked for ranges" \
+    [ $(for HOST in localhost 127.0.0.1 127.0.0.2; do logged "/file/mirrored.bin" "host=$HOST:$PORT" | head -n 1; done | wc -l) -eq 3 ]
+
+finish
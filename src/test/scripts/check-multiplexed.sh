@@ -0,0 +1,67 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Multiplexing: COUNT small files queued at once from one HTTP/2 server
+# (nghttpd over TLS with CERT / KEY, which the device has to trust for
+# HOST). Every one of them has to come over HTTP/2 and be what the server
+# has, and they have to share a handful of connections instead of taking
+# one each. Expects HttpMultiplex=true and MaxQueueLength >= COUNT.
+#
+# usage: CERT=server.crt KEY=server.key check-multiplexed.sh [COUNT] [HOST] (PORT and TARGET_DIR from the environment)
+
+COUNT=${1:-64}
+HOST=${2:-localhost}
+
+PORT=${PORT:-8443}
+source "$(dirname "$0")/check-common.sh"
+
+if [ -z "$CERT" ] || [ -z "$KEY" ] || ! which nghttpd >/dev/null; then
+    echo "needs nghttpd, and CERT / KEY for $HOST"
+    exit 1
+fi
+
+WWW=$(mktemp -d)
+for (( i = 0; i < COUNT; i++ ))
+do
+    head -c 8192 /dev/urandom > $WWW/file-$i.bin
+done
+nghttpd -d $WWW $PORT $KEY $CERT >/dev/null 2>&1 &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null; rm -rf "$WWW" "$TARGET_DIR" "$SERVER_LOG"' EXIT
+mkdir -p "$TARGET_DIR"
+sleep 1
+
+get_stats true
+TICKETS=()
+for (( i = 0; i < COUNT; i++ ))
+do
+    TICKETS[$i]=$(start_download "{\"target\":\"https://$HOST:$PORT/file-$i.bin\"}")
+done
+
+INTACT=0
+for (( i = 0; i < COUNT; i++ ))
+do
+    completes "${TICKETS[$i]}" && cmp -s "$WWW/file-$i.bin" "$(field target "$STATUS")" && INTACT=$((INTACT + 1))
+done
+get_stats
+check "all $COUNT downloads completed with what the server has" [ $INTACT -eq $COUNT ]
+check "...each of them over HTTP/2" [ "$(stat_of http2Transfers)" = "$COUNT" ]
+check "...sharing connections: $(stat_of newConnections) new ones" [ "$(stat_of newConnections)" -le $((COUNT / 8)) ]
+check "...which the others went over" [ "$(stat_of reusedConnections)" -ge $((COUNT - COUNT / 8)) ]
+
+finish
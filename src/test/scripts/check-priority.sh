@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+# Priority: SLOTS downloads the server holds back for a while take every
+# slot, freeing one every half second. Queued behind them come low ones
+# (priority 0), one raised with setPriority after it was queued, and a high
+# one queued last. The server has to be asked for the high one first, then
+# the raised one, then the low ones in the order they came, and all of
+# them have to complete. Expects MaxConcurrent = SLOTS and
+# PreemptLowerPriority=false.
+#
+# usage: check-priority.sh [SLOTS] [LOW] (PORT and TARGET_DIR from the environment)
+
+SLOTS=${1:-10}
+LOW=${2:-4}
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+TICKETS=()
+for (( i = 0; i < SLOTS; i++ ))
+do
+    TICKETS+=($(start_download "{\"target\":\"$SERVER/file/blocker-$i.bin?size=16384&delay=$((2 + i / 2)).$((i % 2 * 5))\"}"))
+done
+sleep 0.5
+for (( i = 0; i < LOW; i++ ))
+do
+    TICKETS+=($(start_download "{\"target\":\"$SERVER/file/queued-low-$i.bin?size=16384\"}"))
+done
+RAISED=$(start_download "{\"target\":\"$SERVER/file/queued-raised.bin?size=16384\"}")
+TICKETS+=($RAISED)
+TICKETS+=($(start_download "{\"target\":\"$SERVER/file/queued-high.bin?size=16384\",\"priority\":10}"))
+check "a queued download was raised" [ "$(field returnValue "$(call setPriority "{\"ticket\":$RAISED,\"priority\":5}")")" = "true" ]
+
+DONE=0
+for TICKET in "${TICKETS[@]}"
+do
+    completes "$TICKET" && DONE=$((DONE + 1))
+done
+check "all ${#TICKETS[@]} downloads completed" [ $DONE -eq ${#TICKETS[@]} ]
+
+EXPECTED="queued-high.bin queued-raised.bin"
+for (( i = 0; i < LOW; i++ ))
+do
+    EXPECTED="$EXPECTED queued-low-$i.bin"
+done
+ORDER=$(logged "/file/queued-" | sed 's,^[A-Z]* /file/\([^?]*\)?.*,\1,' | awk '!seen[$0]++' | tr '\n' ' ')
+check "the queued ones started highest priority first: $ORDER" [ "$ORDER" = "$EXPECTED " ]
+
+finish
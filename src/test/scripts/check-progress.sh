@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Progress: a subscribed download while FLOODERS loops keep the service
+# busy with downloadStatusQuery / getAllHistory calls. Its subscriber has
+# to get progress, in order (amountReceived never going back), and then
+# the completion, and the file has to be what the server sent. Run it with
+# TransferThread on and off: progress is posted from the transfer thread
+# when it is on.
+#
+# usage: check-progress.sh [FLOODERS] (PORT and TARGET_DIR from the environment)
+
+FLOODERS=${1:-4}
+SIZE=$((8 * 1024 * 1024))
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+REPLIES=$(mktemp)
+PIDS=""
+for (( i = 0; i < FLOODERS; i++ ))
+do
+    ( while true; do call downloadStatusQuery '{"ticket":1}'; call getAllHistory '{}'; done ) >/dev/null 2>&1 &
+    PIDS="$PIDS $!"
+done
+trap 'kill $SERVER_PID $PIDS $SUBSCRIBER_PID 2>/dev/null; rm -rf "$TARGET_DIR" "$SERVER_LOG" "$REPLIES"' EXIT
+
+URL="$SERVER/file/progress.bin?size=$SIZE&rate=2097152"
+luna-send -i $SERVICE/download "{\"target\":\"$URL\",\"targetDir\":\"$TARGET_DIR\",\"subscribe\":true}" > "$REPLIES" 2>&1 &
+SUBSCRIBER_PID=$!
+
+for (( i = 0; i < 600; i++ ))
+do
+    grep -q '"completed"' "$REPLIES" && break
+    sleep 0.1
+done
+kill $SUBSCRIBER_PID $PIDS 2>/dev/null
+
+check "the subscriber got the completion" grep -q '"completed": *true' "$REPLIES"
+RECEIVED=$(grep -o '"amountReceived": *[0-9]*' "$REPLIES" | grep -o '[0-9]*$')
+check "...after some progress" [ $(echo "$RECEIVED" | wc -l) -ge 2 ]
+check "...that never went back" [ "$(echo "$RECEIVED" | sort -n)" = "$RECEIVED" ]
+check "...and got to all of it" [ "$(echo "$RECEIVED" | tail -n 1)" = "$SIZE" ]
+TARGET=$(field target "$(grep '"completed"' "$REPLIES" | tail -n 1)")
+check "the file is what the server sent" [ "$(sha256_of_file "$TARGET")" = "$(sha256_of_url "$URL")" ]
+
+finish
@@ -0,0 +1,94 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+# Receive speed limits: COUNT downloads of a SIZE_MB file at once, held by
+# setMaxRecvSpeed to LIMIT_KB KB/s together; one download alone with a
+# "maxRecvSpeed" of a quarter of that; and COUNT at once from an app
+# (OWNER_APP) whose downloads setMaxRecvSpeed holds to half of it. Each time
+# they have to have come in at no more than 10% over the limit, and at no
+# less than half of it. Transfers have to have been paused for the limit
+# on all of them (the others are curl's own, CURLOPT_MAX_RECV_SPEED_LARGE),
+# and getStats has to report the limits; setRecvSpeed, for one download's,
+# has to refuse to set them. They are set back to 0 (none) afterwards.
+#
+# usage: check-recv-speed.sh [COUNT] [SIZE_MB] [LIMIT_KB] (PORT and TARGET_DIR from the environment)
+
+COUNT=${1:-4}
+SIZE_MB=${2:-4}
+LIMIT_KB=${3:-2048}
+SIZE=$((SIZE_MB * 1024 * 1024))
+LIMIT=$((LIMIT_KB * 1024))
+OWNER_APP=com.example.limited
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+trap 'kill $SERVER_PID 2>/dev/null; rm -rf "$TARGET_DIR" "$SERVER_LOG"
+      call setMaxRecvSpeed "{\"maxRecvSpeed\":0}" >/dev/null
+      call setMaxRecvSpeed "{\"maxRecvSpeed\":0,\"owner\":\"$OWNER_APP\"}" >/dev/null' EXIT
+
+# runs downloads at once and sets RATE to the bytes per second they came in at together, DONE to how many
+# completed: run NAME COUNT [JSON FIELDS] [APP]
+run() {
+    local tickets=() reply start end ticket
+    start=$(date +%s.%N)
+    for (( i = 0; i < $2; i++ ))
+    do
+        reply=$(luna-send -n 1 ${4:+-a $4} $SERVICE/download \
+                "{\"target\":\"$SERVER/file/$1-$i.bin?size=$SIZE\",\"targetDir\":\"$TARGET_DIR\"${3:+,$3}}")
+        tickets+=($(field ticket "$reply"))
+    done
+    DONE=0
+    for ticket in "${tickets[@]}"
+    do
+        completes "$ticket" 300 && DONE=$((DONE + 1))
+    done
+    end=$(date +%s.%N)
+    RATE=$(awk -v s=$start -v e=$end -v bytes=$(($2 * SIZE)) 'BEGIN { printf("%d", bytes / (e - s)) }')
+}
+
+# RATE within LIMIT: no more than 10% over it, no less than half of it: within LIMIT
+within() {
+    [ $RATE -le $(($1 * 11 / 10)) ] && [ $RATE -ge $(($1 / 2)) ]
+}
+
+check "setRecvSpeed without a ticket is refused" \
+    [ "$(field returnValue "$(call setRecvSpeed "{\"maxRecvSpeed\":$LIMIT}")")" = "false" ]
+call setMaxRecvSpeed "{\"maxRecvSpeed\":$LIMIT}" >/dev/null
+get_stats true
+check "all transfers got a limit of $LIMIT_KB KB/s" \
+    [ "$(echo "$STATS" | python3 -c 'import json, sys; print(json.load(sys.stdin)["transfers"]["maxRecvSpeed"])')" = "$LIMIT" ]
+run together $COUNT
+check "$COUNT downloads under it completed" [ $DONE -eq $COUNT ]
+check "...at $((RATE / 1024)) KB/s together" within $LIMIT
+get_stats
+check "...with transfers paused for it" [ "$(stat_of recvSpeedPauses)" -gt 0 ]
+call setMaxRecvSpeed "{\"maxRecvSpeed\":0}" >/dev/null
+
+run alone 1 "\"maxRecvSpeed\":$((LIMIT / 4))"
+check "a download with a limit of $((LIMIT_KB / 4)) KB/s of its own completed" [ $DONE -eq 1 ]
+check "...at $((RATE / 1024)) KB/s" within $((LIMIT / 4))
+
+call setMaxRecvSpeed "{\"maxRecvSpeed\":$((LIMIT / 2)),\"owner\":\"$OWNER_APP\"}" >/dev/null
+run owned $COUNT "" $OWNER_APP
+check "$COUNT downloads of an app with a limit of $((LIMIT_KB / 2)) KB/s completed" [ $DONE -eq $COUNT ]
+check "...at $((RATE / 1024)) KB/s together" within $((LIMIT / 2))
+get_stats
+check "...the limit the app's queue stats report" [ "$(echo "$STATS" | python3 -c '
+import json, sys
+print([owner["maxRecvSpeed"] for owner in json.load(sys.stdin)["queue"]["owners"] if owner["owner"] == sys.argv[1]][0])' $OWNER_APP)" = "$((LIMIT / 2))" ]
+
+finish
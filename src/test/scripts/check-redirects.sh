@@ -0,0 +1,60 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Redirects: a short link on localhost sends downloads to a file on
+# 127.0.0.1, i.e. to another host as far as the download manager can tell.
+# A download with an authToken / deviceId gets there without them, and
+# neither uses nor fills the redirect cache; one without is cached
+# (expects RedirectCacheSeconds > 0).
+#
+# usage: check-redirects.sh (PORT and TARGET_DIR from the environment)
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+FILE_URL="http://127.0.0.1:$PORT/file/redirected.bin?size=262144"
+SHORT_URL="$SERVER/redirect?to=$FILE_URL"
+CREDENTIALS='"authToken":"check-token","deviceId":"check-device"'
+EXPECTED=$(sha256_of_url "$FILE_URL")
+
+get_stats true
+TICKET=$(start_download "{\"target\":\"$SHORT_URL\",$CREDENTIALS}")
+check "download with credentials started" [ -n "$TICKET" ]
+check "download with credentials completed" wait_done "$TICKET"
+check "...has the file redirected to" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$EXPECTED" ]
+check "...sent its credentials to the url asked for" logged "/redirect?to=" "auth=check-token"
+check "...but not to the other host" [ -z "$(logged "/file/redirected.bin" "auth=check-token")" ]
+
+: > "$SERVER_LOG"
+for i in 1 2
+do
+    TICKET=$(start_download "{\"target\":\"$SHORT_URL\"}")
+    wait_done "$TICKET"
+    check "download $i without credentials completed" [ "$(field completed "$STATUS")" = "true" ]
+done
+get_stats
+check "the second one went straight to where the first was redirected" [ "$(stat_of redirectCacheHits)" = "1" ]
+check "...so the link was asked for once" [ "$(logged "/redirect?to=" | wc -l)" = "1" ]
+
+: > "$SERVER_LOG"
+TICKET=$(start_download "{\"target\":\"$SHORT_URL\",$CREDENTIALS}")
+wait_done "$TICKET"
+check "with credentials, the cached location isn't used" logged "/redirect?to=" "auth=check-token"
+check "...and the other host still gets none" [ -z "$(logged "/file/redirected.bin" "auth=check-token")" ]
+
+finish
@@ -0,0 +1,87 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+# Resumes: a SIZE_MB download is paused half way and resumed three times.
+# Resumed as it was, the end of what it had has to be found to be what the
+# server sends again; with its last TORN_KB zeroed first, the way a crash
+# tearing its last write leaves it, the mismatch has to be found and cut
+# back. Either way it has to come out as what the server sent, and so does
+# a hashed one with its expectedHash, which has to hash again what it kept.
+# Expects ResumeVerifyKB > TORN_KB.
+#
+# usage: check-resume.sh [SIZE_MB] [TORN_KB] (PORT and TARGET_DIR from the environment)
+
+SIZE_MB=${1:-8}
+TORN_KB=${2:-16}
+SIZE=$((SIZE_MB * 1024 * 1024))
+RATE=$((1024 * 1024))
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+# starts a download to NAME and pauses it once half of it is in its temp file: pause_half NAME [JSON FIELDS]
+pause_half() {
+    local temp="$TARGET_DIR/.$1"
+    TICKET=$(start_download "{\"target\":\"$SERVER/file/$1?size=$SIZE&rate=$RATE\",\"targetFilename\":\"$1\",\"canHandlePause\":true${2:+,$2}}")
+    while [ $(stat -c %s "$temp" 2>/dev/null || echo 0) -lt $((SIZE / 2)) ]
+    do
+        sleep 0.05
+    done
+    call pauseDownload "{\"ticket\":$TICKET}" >/dev/null
+    sleep 0.5
+}
+
+# zeroes the last TORN_KB of NAME's temp file: tear NAME
+tear() {
+    local temp="$TARGET_DIR/.$1"
+    dd if=/dev/zero of="$temp" bs=1024 seek=$(( $(stat -c %s "$temp") / 1024 - TORN_KB )) count=$TORN_KB conv=notrunc 2>/dev/null
+}
+
+get_stats true
+pause_half resumed.bin
+call resumeDownload "{\"ticket\":$TICKET}" >/dev/null
+check "download resumed as it was completed" completes "$TICKET" $((SIZE / RATE * 3))
+check "...as what the server sent" \
+    [ "$(sha256_of_file "$(field target "$STATUS")")" = "$(sha256_of_url "$SERVER/file/resumed.bin?size=$SIZE")" ]
+check "...asking for the rest by range" logged "/file/resumed.bin" "range=bytes=[1-9]"
+get_stats true
+check "...its end verified" [ "$(stat_of resumesVerified)" = "1" ]
+check "...with nothing cut back" [ "$(stat_of resumeMismatches)" = "0" ]
+
+pause_half torn.bin
+tear torn.bin
+call resumeDownload "{\"ticket\":$TICKET}" >/dev/null
+check "download resumed torn completed" completes "$TICKET" $((SIZE / RATE * 3))
+check "...as what the server sent" \
+    [ "$(sha256_of_file "$(field target "$STATUS")")" = "$(sha256_of_url "$SERVER/file/torn.bin?size=$SIZE")" ]
+get_stats true
+check "...its end found not to match" [ "$(stat_of resumeMismatches)" = "1" ]
+check "...and at least the torn $TORN_KB KB cut back" [ "$(stat_of resumeBytesDropped)" -ge $((TORN_KB * 1024)) ]
+
+SHA256=$(sha256_of_url "$SERVER/file/torn-hashed.bin?size=$SIZE")
+pause_half torn-hashed.bin "\"expectedHash\":\"$SHA256\""
+tear torn-hashed.bin
+call resumeDownload "{\"ticket\":$TICKET}" >/dev/null
+check "hashed download resumed torn completed" completes "$TICKET" $((SIZE / RATE * 3))
+check "...with no error" [ "$(field completionStatusCode "$STATUS")" = "0" ]
+check "...as what the server sent" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$SHA256" ]
+get_stats
+check "...its end found not to match" [ "$(stat_of resumeMismatches)" = "1" ]
+check "...and what it kept hashed again" [ "$(stat_of hashPrefixesRehashed)" = "1" ]
+check "...coming to its expectedHash" [ "$(stat_of hashesVerified)" = "1" ]
+
+finish
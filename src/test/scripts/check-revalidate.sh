@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+# Revalidation: a SIZE_MB file is downloaded, then again with "revalidate".
+# The server has to answer that one with a 304, and the download has to
+# complete on the file the first one left, untouched. Once the file has
+# changed on the server (/touch), or the one left has been deleted, a
+# "revalidate" download has to fetch it whole again.
+#
+# usage: check-revalidate.sh [SIZE_MB] (PORT and TARGET_DIR from the environment)
+
+SIZE_MB=${1:-4}
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+URL="$SERVER/file/revalidated.bin?size=$((SIZE_MB * 1024 * 1024))"
+REVALIDATE="{\"target\":\"$URL\",\"revalidate\":true}"
+
+get_stats true
+check "first download completed" completes "$(start_download "{\"target\":\"$URL\"}")"
+FIRST=$(field target "$STATUS")
+EXPECTED=$(sha256_of_url "$URL")
+
+: > "$SERVER_LOG"
+check "a revalidating one completed" completes "$(start_download "$REVALIDATE")"
+check "...on a 304" [ "$(logged "/file/revalidated.bin" | wc -l)" = "1" -a -n "$(logged "/file/revalidated.bin" "status=304")" ]
+check "...saying so" [ "$(field revalidated "$STATUS")" = "true" ]
+check "...with the first one's file" [ "$(field target "$STATUS")" = "$FIRST" ]
+check "...which is still what the server has" [ "$(sha256_of_file "$FIRST")" = "$EXPECTED" ]
+get_stats
+check "...counted" [ "$(stat_of revalidated)" = "1" ]
+
+python3 -c 'import sys, ssl, urllib.request; urllib.request.urlopen(sys.argv[1], context=ssl._create_unverified_context())' "$SERVER/touch/revalidated.bin"
+EXPECTED=$(sha256_of_url "$URL")
+: > "$SERVER_LOG"
+check "once the file changed, a revalidating download completed" completes "$(start_download "$REVALIDATE")"
+check "...on a 200" logged "/file/revalidated.bin" "status=200"
+check "...not revalidated" [ "$(field revalidated "$STATUS")" = "false" ]
+check "...with the new file" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$EXPECTED" ]
+
+rm -f "$(field target "$STATUS")"
+: > "$SERVER_LOG"
+check "with the file deleted, a revalidating download completed" completes "$(start_download "$REVALIDATE")"
+check "...on a 200" logged "/file/revalidated.bin" "status=200"
+check "...with the whole file again" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$EXPECTED" ]
+get_stats
+check "only the one revalidation was counted" [ "$(stat_of revalidated)" = "1" ]
+
+finish
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Segmented downloads: a SIZE_MB file from a server that holds every
+# connection to 2 MB/s is split over byte ranges. It has to be fetched over
+# more than one request, come out as what the server sent, and take less
+# than three quarters of the time one connection would. Expects
+# DownloadSegments >= 2 and SegmentMinMB <= SIZE_MB / DownloadSegments.
+#
+# usage: check-segmented.sh [SIZE_MB] (PORT and TARGET_DIR from the environment)
+
+SIZE_MB=${1:-64}
+RATE=$((2 * 1024 * 1024))
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+URL="$SERVER/file/segmented.bin?size=$((SIZE_MB * 1024 * 1024))"
+START=$(date +%s)
+TICKET=$(start_download "{\"target\":\"$URL&rate=$RATE\"}")
+check "download started" [ -n "$TICKET" ]
+check "...and completed" completes "$TICKET" $((SIZE_MB * 1024 * 1024 / RATE * 2))
+ELAPSED=$(( $(date +%s) - START ))
+
+check "...over more than one request" [ $(logged "/file/segmented.bin" | wc -l) -gt 1 ]
+check "...of byte ranges" [ $(logged "/file/segmented.bin" "range=bytes=" | wc -l) -gt 0 ]
+check "...in less than 3/4 of the time one connection takes (${ELAPSED} s)" \
+    [ $ELAPSED -lt $((SIZE_MB * 1024 * 1024 / RATE * 3 / 4)) ]
+check "...and is what the server sent" [ "$(sha256_of_file "$(field target "$STATUS")")" = "$(sha256_of_url "$URL")" ]
+
+finish
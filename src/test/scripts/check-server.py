@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# HTTP server for the check scripts (see check-common.sh).
+#
+#   /file/NAME?size=N[&rate=B][&delay=S][&stall=S][&drop=B][&close=1][&etag=E]
+#       N bytes that depend on NAME, with Range support, an ETag (E, or one
+#       made from NAME and N) and If-None-Match. rate: at most B bytes per
+#       second; delay: S seconds before answering; stall: S seconds before
+#       answering the first request for the url, none for the others; drop:
+#       the connection is closed after B bytes of any answer; close: after
+#       the answer (Connection: close)
+#   /redirect?to=URL[&delay=S]
+#       302 to URL
+#   /touch/NAME
+#       a new version of NAME from then on: other bytes, and another ETag
+#
+# Every request is logged to LOG, one line each:
+#   METHOD PATH host=HOST auth=AUTH-TOKEN|- range=RANGE|- status=CODE tls=new|resumed|-
+# (tls: whether the TLS session of the connection was a new one or taken up again)
+#
+# usage: check-server.py PORT LOG [CERT KEY]   (HTTPS with CERT and KEY)
+
+import hashlib
+import http.server
+import socketserver
+import ssl
+import sys
+import threading
+import time
+import urllib.parse
+
+port, logPath = int(sys.argv[1]), sys.argv[2]
+logFile = open(logPath, "a", buffering=1)
+stalled = set()
+stalledLock = threading.Lock()
+versions = {}
+
+
+# bytes first..last of the content of NAME, a piece at a time: it repeats every
+# 8 KB, so big files don't have to be held
+def content(name, first, last):
+    seed = hashlib.sha256(name.encode()).digest()
+    block = b"".join(hashlib.sha256(seed + bytes([i])).digest() for i in range(256))
+    piece = block * 32
+    pos = first
+    while pos <= last:
+        start = pos % len(block)
+        data = piece[start:start + min(last + 1 - pos, len(piece) - len(block))]
+        yield data
+        pos += len(data)
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        pass
+
+    def note(self, status):
+        tls = "-"
+        if isinstance(self.connection, ssl.SSLSocket):
+            tls = "resumed" if self.connection.session_reused else "new"
+        logFile.write("%s %s host=%s auth=%s range=%s status=%d tls=%s\n" % (
+            self.command, self.path, self.headers.get("Host", "-"),
+            self.headers.get("Auth-Token", "-"), self.headers.get("Range", "-"), status, tls))
+
+    # body: pieces of length bytes in all, of which drop are sent (0: all)
+    def reply(self, status, headers, body=(), length=0, rate=0, drop=0):
+        self.note(status)
+        self.send_response(status)
+        for key, value in headers:
+            self.send_header(key, value)
+        if self.closing:
+            self.send_header("Connection", "close")
+            self.close_connection = True
+        self.send_header("Content-Length", str(length))
+        self.end_headers()
+        if self.command == "HEAD":
+            return
+        chunk = max(rate // 20, 1) if rate > 0 else 1 << 30
+        sent = 0
+        for data in body:
+            for pos in range(0, len(data), chunk):
+                piece = data[pos:pos + chunk]
+                if drop > 0 and sent + len(piece) >= drop:
+                    self.wfile.write(piece[:drop - sent])
+                    self.close_connection = True
+                    return
+                self.wfile.write(piece)
+                sent += len(piece)
+                if rate > 0:
+                    time.sleep(0.05)
+
+    def do_HEAD(self):
+        self.do_GET()
+
+    def do_GET(self):
+        url = urllib.parse.urlparse(self.path)
+        query = dict(urllib.parse.parse_qsl(url.query))
+        self.closing = "close" in query
+        time.sleep(float(query.get("delay", 0)))
+        if "stall" in query:
+            with stalledLock:
+                first = self.path not in stalled
+                stalled.add(self.path)
+            if first:
+                time.sleep(float(query["stall"]))
+
+        if url.path == "/redirect":
+            self.reply(302, [("Location", query["to"])])
+            return
+
+        if url.path.startswith("/touch/"):
+            name = url.path[7:]
+            versions[name] = versions.get(name, 0) + 1
+            self.reply(204, [])
+            return
+
+        if not url.path.startswith("/file/"):
+            self.reply(404, [])
+            return
+
+        name = url.path[6:]
+        if name in versions:
+            name += ";%d" % versions[name]
+        size = int(query.get("size", 65536))
+        etag = '"%s"' % query.get("etag", "%s-%d" % (name, size))
+        if self.headers.get("If-None-Match") == etag:
+            self.reply(304, [("ETag", etag)])
+            return
+
+        headers = [("ETag", etag), ("Accept-Ranges", "bytes"), ("Content-Type", "application/octet-stream")]
+        status, first, last = 200, 0, size - 1
+        ranges = self.headers.get("Range")
+        if ranges and ranges.startswith("bytes="):
+            first, _, last = ranges[6:].partition("-")
+            first = int(first)
+            last = int(last) if last else size - 1
+            if first >= size:
+                self.reply(416, [("Content-Range", "bytes */%d" % size)])
+                return
+            last = min(last, size - 1)
+            headers.append(("Content-Range", "bytes %d-%d/%d" % (first, last, size)))
+            status = 206
+        self.reply(status, headers, content(name, first, last), last + 1 - first, int(query.get("rate", 0)),
+                   int(query.get("drop", 0)))
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+server = Server(("0.0.0.0", port), Handler)
+if len(sys.argv) > 4:
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(sys.argv[3], sys.argv[4])
+    server.socket = context.wrap_socket(server.socket, server_side=True)
+server.serve_forever()
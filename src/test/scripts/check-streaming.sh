@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# Streaming: a SIZE_MB download, above StreamingThresholdMB, is dropped from
+# the page cache as it is written back. Once it completes, no more than a
+# quarter of it may be in the page cache, and it has to be what the server
+# sent (which is checked after, as reading it brings it back in).
+#
+# usage: check-streaming.sh [SIZE_MB] (PORT and TARGET_DIR from the environment)
+
+SIZE_MB=${1:-640}
+
+source "$(dirname "$0")/check-common.sh"
+start_server
+
+# bytes of a file in the page cache: mincore() of a mapping of it, which doesn't read it in
+resident_bytes() {
+    python3 - "$1" <<'PYEOF'
+import ctypes, os, sys
+libc = ctypes.CDLL(None, use_errno=True)
+libc.mmap.restype = ctypes.c_void_p
+libc.mmap.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_long]
+libc.mincore.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
+fd = os.open(sys.argv[1], os.O_RDONLY)
+size = os.fstat(fd).st_size
+page = os.sysconf("SC_PAGE_SIZE")
+addr = libc.mmap(None, size, 1, 1, fd, 0)           # PROT_READ, MAP_SHARED
+pages = (ctypes.c_ubyte * ((size + page - 1) // page))()
+libc.mincore(addr, size, pages)
+print(sum(p & 1 for p in pages) * page)
+PYEOF
+}
+
+URL="$SERVER/file/streaming.bin?size=$((SIZE_MB * 1024 * 1024))"
+TICKET=$(start_download "{\"target\":\"$URL\"}")
+check "download started" [ -n "$TICKET" ]
+check "...and completed" completes "$TICKET" 600
+TARGET=$(field target "$STATUS")
+check "...with no more than a quarter of it left in the page cache" \
+    [ "$(resident_bytes "$TARGET")" -le $((SIZE_MB * 1024 * 1024 / 4)) ]
+check "...and what the server sent" [ "$(sha256_of_file "$TARGET")" = "$(sha256_of_url "$URL")" ]
+
+finish
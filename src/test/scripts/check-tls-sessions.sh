@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# Copyright (c) 2026 LG Electronics, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+# TLS sessions: COUNT downloads one after the other from check-server.py
+# over HTTPS (CERT / KEY, which the device has to trust for localhost), each
+# on a connection of its own. Every connection after the first has to take
+# up the TLS session again, with the CAs held in memory; and after IDLE
+# seconds without downloads (more than IdleRestartSeconds, so that the
+# transfer engines restart), the next download still has to, and to get
+# its handle from the pool. Expects HandlePoolSize > 0.
+#
+# usage: CERT=server.crt KEY=server.key check-tls-sessions.sh [COUNT] [IDLE] (PORT and TARGET_DIR from the environment)
+
+COUNT=${1:-20}
+IDLE=${2:-40}
+
+source "$(dirname "$0")/check-common.sh"
+if [ -z "$CERT" ] || [ -z "$KEY" ]; then
+    echo "needs CERT / KEY for localhost"
+    exit 1
+fi
+start_server "$CERT" "$KEY"
+
+get_stats true
+TARGETS=()
+for (( i = 0; i < COUNT; i++ ))
+do
+    completes "$(start_download "{\"target\":\"$SERVER/file/tls-$i.bin?size=65536&close=1\"}")" \
+        && TARGETS[$i]=$(field target "$STATUS")
+done
+get_stats
+check "$COUNT downloads over HTTPS completed" [ ${#TARGETS[@]} -eq $COUNT ]
+check "...over a connection each, with its handshake" [ "$(stat_of tlsHandshakes)" = "$COUNT" ]
+check "...all but the first taking up the session again" [ $(logged "/file/tls-" "tls=resumed" | wc -l) -eq $((COUNT - 1)) ]
+check "...with the CAs in memory" [ "$(stat_of trustedCerts)" -gt 0 ]
+
+sleep $IDLE
+get_stats true
+check "after $IDLE s idle, a download completed" completes "$(start_download "{\"target\":\"$SERVER/file/tls-idle.bin?size=65536&close=1\"}")"
+get_stats
+check "...taking up the session from before" logged "/file/tls-idle.bin" "tls=resumed"
+check "...with a handle from the pool" [ "$(stat_of handlesReused)" = "1" ]
+
+INTACT=0
+for (( i = 0; i < COUNT; i++ ))
+do
+    [ "$(sha256_of_file "${TARGETS[$i]}")" = "$(sha256_of_url "$SERVER/file/tls-$i.bin?size=65536")" ] && INTACT=$((INTACT + 1))
+done
+check "the files are what the server sent" [ $INTACT -eq $COUNT ]
+
+finish
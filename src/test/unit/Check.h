@@ -0,0 +1,37 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+
+// The unit tests are plain programs: each CHECK that fails is printed and counted, and main() returns
+// CHECK_RESULT(), which ctest takes for failed when it isn't 0. Unlike assert(), this holds with NDEBUG too.
+
+static int s_checkFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            s_checkFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_RESULT() (s_checkFailures == 0 ? 0 : 1)
+
+#endif /* CHECK_H_ */
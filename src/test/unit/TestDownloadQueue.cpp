@@ -0,0 +1,267 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include "DownloadQueue.h"
+#include "Check.h"
+
+// FairShare settings of the owners in these tests: weight and slot cap
+static std::map<std::string,std::pair<unsigned int,unsigned int> > s_fairShare;
+
+static unsigned int weightOf(const std::string& owner)
+{
+    return s_fairShare.count(owner) ? s_fairShare[owner].first : 1;
+}
+
+static unsigned int maxSlotsOf(const std::string& owner)
+{
+    return s_fairShare.count(owner) ? s_fairShare[owner].second : 0;
+}
+
+// a queue, and the downloads running from it
+struct Run {
+    DownloadQueue queue;
+    std::map<unsigned long,std::string> owners;
+    std::deque<unsigned long> running;
+    std::map<std::string,int> starts;
+    unsigned long next;
+
+    Run() : next(1) { queue.configure(1024,weightOf,maxSlotsOf); }
+
+    void push(const std::string& owner, int count, int priority = 0)
+    {
+        for (int i = 0; i < count; ++i) {
+            owners[next] = owner;
+            queue.push(next++,priority,owner);
+        }
+    }
+
+    // fills up to slots downloads, then ends the oldest having fetched what bytesOf says its owner's fetch;
+    // steps times
+    void run(unsigned int slots, int steps, const std::map<std::string,uint64_t>& bytesOf)
+    {
+        for (int step = 0; step < steps; ++step) {
+            while (running.size() < slots) {
+                unsigned long ticket = queue.pop();
+                if (ticket == 0)
+                    break;
+                queue.started(owners[ticket]);
+                starts[owners[ticket]]++;
+                running.push_back(ticket);
+            }
+            if (running.empty())
+                return;
+            unsigned long done = running.front();
+            running.pop_front();
+            std::map<std::string,uint64_t>::const_iterator it = bytesOf.find(owners[done]);
+            queue.ended(owners[done],it != bytesOf.end() ? it->second : 1024 * 1024);
+        }
+    }
+};
+
+// within an owner: highest priority first, then first come first served
+static void testOrder()
+{
+    DownloadQueue queue;
+    queue.push(1,0,"a");
+    queue.push(2,5,"a");
+    queue.push(3,0,"a");
+    queue.push(4,5,"a");
+    queue.push(4,9,"a");                    //already queued: ignored
+    CHECK(queue.size() == 4);
+    CHECK(queue.contains(4));
+    int priority = 0;
+    CHECK(queue.topPriority(priority) && (priority == 5));
+    CHECK(queue.pop() == 2);
+    CHECK(queue.pop() == 4);
+    CHECK(queue.pop() == 1);
+    CHECK(queue.pop() == 3);
+    CHECK(queue.pop() == 0);
+    CHECK(queue.empty());
+    CHECK(!queue.topPriority(priority));
+}
+
+static void testRemoveAndSetPriority()
+{
+    DownloadQueue queue;
+    for (unsigned long ticket = 1; ticket <= 20; ++ticket)
+        queue.push(ticket,(int)(ticket % 3),"a");
+    CHECK(queue.remove(5));
+    CHECK(!queue.remove(5));
+    CHECK(!queue.contains(5));
+    CHECK(queue.size() == 19);
+    CHECK(queue.setPriority(20,10));
+    CHECK(!queue.setPriority(5,10));
+    //12 goes up to 10 too, but came before 20
+    CHECK(queue.setPriority(12,10));
+    CHECK(queue.pop() == 12);
+    CHECK(queue.pop() == 20);
+    //then 2 (2), 8, 11, 14, 17 (all 2, in order), 1, 4, 7, ...
+    CHECK(queue.pop() == 2);
+    CHECK(queue.pop() == 8);
+    CHECK(queue.pop() == 11);
+    CHECK(queue.pop() == 14);
+    CHECK(queue.pop() == 17);
+    CHECK(queue.pop() == 1);
+    CHECK(queue.pop() == 4);
+    CHECK(queue.pop() == 7);
+    while (!queue.empty()) {
+        unsigned long ticket = queue.pop();
+        CHECK(ticket != 0);
+        if (ticket == 0)
+            break;
+    }
+}
+
+// a higher priority of any owner goes before every lower one
+static void testPriorityAcrossOwners()
+{
+    Run run;
+    run.push("a",10,0);
+    run.push("b",2,7);
+    CHECK(run.owners[run.queue.pop()] == "b");
+    CHECK(run.owners[run.queue.pop()] == "b");
+    CHECK(run.owners[run.queue.pop()] == "a");
+}
+
+// the same weight: an owner that queued a few gets as many slots as one that queued a lot, while it has any
+static void testEqualShares()
+{
+    Run run;
+    run.push("flood",300);
+    run.push("few",20);
+    run.run(4,40,std::map<std::string,uint64_t>());
+    CHECK(run.starts["few"] >= 20);
+    CHECK(run.starts["flood"] >= 20);
+    CHECK(run.starts["flood"] <= 24);
+}
+
+// slots in proportion to the weights
+static void testWeights()
+{
+    s_fairShare["heavy"] = std::make_pair(3u,0u);
+    Run run;
+    run.push("heavy",300);
+    run.push("light",300);
+    run.run(4,200,std::map<std::string,uint64_t>());
+    double ratio = (double)run.starts["heavy"] / run.starts["light"];
+    CHECK(ratio > 2.7 && ratio < 3.3);
+    s_fairShare.erase("heavy");
+}
+
+// what is fetched counts: an owner whose downloads are four times as big gets a quarter of the slots
+static void testBytes()
+{
+    Run run;
+    run.push("big",300);
+    run.push("small",300);
+    std::map<std::string,uint64_t> bytesOf;
+    bytesOf["big"] = 4 * 1024 * 1024;
+    bytesOf["small"] = 1024 * 1024;
+    run.run(4,250,bytesOf);
+    double ratio = (double)run.starts["small"] / run.starts["big"];
+    CHECK(ratio > 3.5 && ratio < 4.5);
+}
+
+// an owner at its cap waits, and the others get the slots
+static void testSlotCap()
+{
+    s_fairShare["capped"] = std::make_pair(1u,1u);
+    Run run;
+    run.push("capped",10);
+    CHECK(run.queue.mayStart("capped"));
+    unsigned long first = run.queue.pop();
+    CHECK(run.owners[first] == "capped");
+    run.queue.started("capped");
+    CHECK(!run.queue.mayStart("capped"));
+    CHECK(run.queue.pop() == 0);
+    int priority;
+    CHECK(!run.queue.topPriority(priority));
+
+    run.push("other",2);
+    CHECK(run.owners[run.queue.pop()] == "other");
+    CHECK(run.owners[run.queue.pop()] == "other");
+    CHECK(run.queue.pop() == 0);
+    run.queue.ended("capped",1024);
+    CHECK(run.queue.mayStart("capped"));
+    CHECK(run.owners[run.queue.pop()] == "capped");
+
+    //an owner not seen yet is capped too
+    s_fairShare["unseen"] = std::make_pair(1u,2u);
+    CHECK(run.queue.mayStart("unseen"));
+    run.queue.started("unseen");
+    run.queue.started("unseen");
+    CHECK(!run.queue.mayStart("unseen"));
+    s_fairShare.erase("capped");
+    s_fairShare.erase("unseen");
+}
+
+// without configure(): weight 1 and no caps for everyone
+static void testUnconfigured()
+{
+    s_fairShare["capped"] = std::make_pair(5u,1u);
+    DownloadQueue queue;
+    queue.started("capped");
+    CHECK(queue.mayStart("capped"));
+    std::vector<DownloadQueue::OwnerStats> stats;
+    queue.ownerStats(stats);
+    CHECK((stats.size() == 1) && (stats[0].weight == 1) && (stats[0].maxSlots == 0));
+    s_fairShare.erase("capped");
+}
+
+static void testStats()
+{
+    Run run;
+    run.push("a",3);
+    run.push("b",1);
+    run.run(2,4,std::map<std::string,uint64_t>());
+    std::vector<DownloadQueue::OwnerStats> stats;
+    run.queue.ownerStats(stats);
+    CHECK(stats.size() == 2);
+    uint64_t started = 0, bytes = 0;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        started += stats[i].started;
+        bytes += stats[i].bytes;
+        CHECK(stats[i].waits == stats[i].started);
+    }
+    CHECK(started == 4);
+    CHECK(bytes == 4 * 1024 * 1024);
+
+    //b has nothing queued or running any more: it is forgotten, a's counters start over
+    run.queue.resetStats();
+    stats.clear();
+    run.queue.ownerStats(stats);
+    CHECK(stats.size() <= 1);
+    for (size_t i = 0; i < stats.size(); ++i)
+        CHECK((stats[i].started == 0) && (stats[i].bytes == 0));
+}
+
+int main()
+{
+    testOrder();
+    testRemoveAndSetPriority();
+    testPriorityAcrossOwners();
+    testEqualShares();
+    testWeights();
+    testBytes();
+    testSlotCap();
+    testUnconfigured();
+    testStats();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,187 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "StreamHash.h"
+#include "Check.h"
+
+static std::string digestOf(const std::string& algorithm, const std::string& data)
+{
+    StreamHash * hash = StreamHash::create(algorithm);
+    hash->update((const unsigned char *)data.data(),data.size());
+    std::string rc = hash->digest();
+    delete hash;
+    return rc;
+}
+
+// some bytes that aren't all alike
+static std::vector<unsigned char> sample(size_t size)
+{
+    std::vector<unsigned char> data(size);
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < size; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        data[i] = (unsigned char)x;
+    }
+    return data;
+}
+
+// FIPS 180-2 and RFC 3720 test vectors, through whichever kernel create() picked here
+static void testKnownDigests()
+{
+    CHECK(digestOf("sha256","") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    CHECK(digestOf("sha256","abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    CHECK(digestOf("sha256","abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq")
+          == "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    CHECK(digestOf("sha256",std::string(1000000,'a')) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    CHECK(digestOf("crc32c","123456789") == "e3069283");
+    CHECK(digestOf("crc32c",std::string(32,'\0')) == "8a9136aa");
+    CHECK(digestOf("crc32c",std::string(32,'\xff')) == "62a8ab43");
+}
+
+static void testNames()
+{
+    CHECK(StreamHash::create("md5") == NULL);
+    CHECK(StreamHash::digestLength("sha256") == 64);
+    CHECK(StreamHash::digestLength("crc32c") == 8);
+    CHECK(StreamHash::digestLength("md5") == 0);
+    CHECK(digestOf("sha256","abc").size() == StreamHash::digestLength("sha256"));
+    CHECK(digestOf("crc32c","abc").size() == StreamHash::digestLength("crc32c"));
+}
+
+// however the data is cut into payloads, the digest is that of all of it at once
+static void testChunking(const std::string& algorithm)
+{
+    std::vector<unsigned char> data = sample(10000);
+    StreamHash * whole = StreamHash::create(algorithm);
+    whole->update(&data[0],data.size());
+    std::string expected = whole->digest();
+    delete whole;
+
+    const size_t chunks[] = { 1, 3, 55, 63, 64, 65, 127, 1000, 4096 };
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+        StreamHash * hash = StreamHash::create(algorithm);
+        for (size_t at = 0; at < data.size(); at += chunks[c])
+            hash->update(&data[at],std::min(chunks[c],data.size() - at));
+        CHECK(hash->length() == data.size());
+        CHECK(hash->digest() == expected);
+        delete hash;
+    }
+}
+
+// a hash taken up again from state() goes on as if it never stopped, wherever it stopped
+static void testStateRestore(const std::string& algorithm)
+{
+    std::vector<unsigned char> data = sample(1000);
+    std::string expected;
+    {
+        StreamHash * hash = StreamHash::create(algorithm);
+        hash->update(&data[0],data.size());
+        expected = hash->digest();
+        delete hash;
+    }
+
+    const size_t stops[] = { 0, 1, 63, 64, 65, 500, 999, 1000 };
+    for (size_t s = 0; s < sizeof(stops) / sizeof(stops[0]); ++s) {
+        StreamHash * first = StreamHash::create(algorithm);
+        if (stops[s] > 0)
+            first->update(&data[0],stops[s]);
+        std::string state = first->state();
+        delete first;
+
+        StreamHash * second = StreamHash::restore(state);
+        CHECK(second != NULL);
+        if (second == NULL)
+            continue;
+        CHECK(second->algorithmName() == algorithm);
+        CHECK(second->length() == stops[s]);
+        if (stops[s] < data.size())
+            second->update(&data[stops[s]],data.size() - stops[s]);
+        CHECK(second->digest() == expected);
+        delete second;
+    }
+}
+
+static void testBadStates()
+{
+    CHECK(StreamHash::restore("") == NULL);
+    CHECK(StreamHash::restore("md5:0:00") == NULL);
+    CHECK(StreamHash::restore("crc32c:x:ffffffff") == NULL);
+    CHECK(StreamHash::restore("crc32c:3:ffff") == NULL);
+    CHECK(StreamHash::restore("sha256:0:00") == NULL);
+    //the partial block has to be as long as the length says
+    StreamHash * hash = StreamHash::create("sha256");
+    unsigned char byte = 0;
+    hash->update(&byte,1);
+    std::string state = hash->state();
+    delete hash;
+    StreamHash * restored = StreamHash::restore(state);
+    CHECK(restored != NULL);
+    delete restored;
+    CHECK(StreamHash::restore(state + "00") == NULL);
+    CHECK(StreamHash::restore(state.substr(0,state.size() - 2)) == NULL);
+}
+
+static void testUpdateFromFile()
+{
+    std::vector<unsigned char> data = sample(300000);
+    char path[] = "/tmp/TestStreamHashXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+        return;
+    CHECK(write(fd,&data[0],data.size()) == (ssize_t)data.size());
+    close(fd);
+
+    StreamHash * fromFile = StreamHash::create("sha256");
+    StreamHash * fromMemory = StreamHash::create("sha256");
+    CHECK(fromFile->updateFromFile(path,200000));
+    fromMemory->update(&data[0],200000);
+    CHECK(fromFile->digest() == fromMemory->digest());
+    delete fromFile;
+    delete fromMemory;
+
+    StreamHash * tooFar = StreamHash::create("crc32c");
+    CHECK(!tooFar->updateFromFile(path,data.size() + 1));
+    delete tooFar;
+    StreamHash * missing = StreamHash::create("crc32c");
+    CHECK(!missing->updateFromFile(std::string(path) + ".missing",1));
+    delete missing;
+    unlink(path);
+}
+
+int main()
+{
+    printf("kernels: sha256 %s, crc32c %s\n",StreamHash::kernel(StreamHash::SHA256),StreamHash::kernel(StreamHash::CRC32C));
+    testKnownDigests();
+    testNames();
+    testChunking("sha256");
+    testChunking("crc32c");
+    testStateRestore("sha256");
+    testStateRestore("crc32c");
+    testBadStates();
+    testUpdateFromFile();
+    return CHECK_RESULT();
+}
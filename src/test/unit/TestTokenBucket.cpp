@@ -0,0 +1,118 @@
+// Copyright (c) 2026 LG Electronics, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "TokenBucket.h"
+#include "Check.h"
+
+// the clock is whatever the test says it is: these hold on a loaded build machine too
+static const gint64 START = 1000000000;
+
+static void testUnlimited()
+{
+    TokenBucket bucket;
+    CHECK(bucket.rate() == 0);
+    CHECK(bucket.take(1 << 30,START));
+    CHECK(bucket.take(1 << 30,START));
+    CHECK(bucket.waitUs(START) == 0);
+}
+
+// a full bucket holds burstMs worth; a take goes through whole while anything is left, and the debt is waited out
+static void testBurstAndDebt()
+{
+    TokenBucket bucket;
+    bucket.setRate(100000,100,START);        //100 KB/s, 10 KB of burst
+    CHECK(bucket.rate() == 100000);
+    CHECK(bucket.take(6000,START));
+    CHECK(bucket.take(6000,START));         //4000 were left: goes through, 2000 in debt
+    CHECK(!bucket.take(1,START));
+    //2001 bytes at 100 bytes a ms before the bucket has anything again
+    uint64_t wait = bucket.waitUs(START);
+    CHECK(wait >= 20000 && wait <= 20020);
+    CHECK(!bucket.take(1,START + 20000));
+    CHECK(bucket.take(1,START + (gint64)wait));
+    CHECK(bucket.waitUs(START + (gint64)wait) > 0);
+}
+
+// however long nobody takes, no more than the burst is saved up
+static void testRefillCap()
+{
+    TokenBucket bucket;
+    bucket.setRate(100000,100,START);
+    CHECK(bucket.take(10000,START));
+    CHECK(!bucket.take(1,START));
+    gint64 later = START + 3600 * (gint64)1000000;
+    CHECK(bucket.take(10000,later));
+    CHECK(!bucket.take(1,later));
+}
+
+// taking as fast as it lets us for 10 s gets 10 s at the rate, plus the burst
+static void testRate()
+{
+    TokenBucket bucket;
+    bucket.setRate(1000000,100,START);
+    gint64 now = START;
+    uint64_t taken = 0;
+    while (now < START + 10000000) {
+        if (bucket.take(16384,now))
+            taken += 16384;
+        else
+            now += (gint64)bucket.waitUs(now);
+    }
+    CHECK(taken >= 10000000);
+    CHECK(taken <= 10000000 + 100000 + 2 * 16384);
+}
+
+// time too short for a byte isn't lost: many small steps add up to the same as one big one
+static void testSmallSteps()
+{
+    TokenBucket bucket;
+    bucket.setRate(1000,1000,START);         //a byte a ms
+    CHECK(bucket.take(1000,START));
+    CHECK(!bucket.take(1,START));
+    gint64 now = START;
+    for (int i = 0; i < 100; ++i) {
+        now += 100;                          //a tenth of a byte each
+        bucket.take(0,now);
+    }
+    CHECK(bucket.take(1,now));
+}
+
+// a new rate starts from a full bucket, unless it is in debt
+static void testSetRate()
+{
+    TokenBucket bucket;
+    bucket.setRate(100000,100,START);
+    CHECK(bucket.take(10000,START));
+    bucket.setRate(200000,100,START);
+    CHECK(bucket.take(25000,START));         //5000 in debt
+    CHECK(!bucket.take(1,START));
+    bucket.setRate(100000,100,START);
+    CHECK(!bucket.take(1,START));
+    bucket.setRate(0,100,START);
+    CHECK(bucket.take(1 << 30,START));
+    CHECK(bucket.waitUs(START) == 0);
+}
+
+int main()
+{
+    testUnlimited();
+    testBurstAndDebt();
+    testRefillCap();
+    testRate();
+    testSmallSteps();
+    testSetRate();
+    return CHECK_RESULT();
+}